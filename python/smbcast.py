@@ -0,0 +1,644 @@
+"""Zero-copy reader for smbcast channels.
+
+Subscribes to a channel as a reader through the smb_manager of a vlan,
+maps the board it hands out read-only and walks the datagrams in place.
+Messages come back as memoryviews of the board itself, or as numpy
+arrays over them, many per call, so that a notebook can tap a live
+channel at full rate without a C++ relay process.
+
+A view is only good until the writer laps it. read() checks that the
+writer had not overwritten the batch by the time it returns; copy a
+message (bytes(view), array.copy()) to keep it for longer.
+
+    with Reader('smbcast://md.book', vlan='prod') as reader:
+        while True:
+            for message in reader.read(1024, timeout=1.0):
+                ...
+
+A channel with a last-value area also holds the latest value of each
+key, e.g. of each symbol id. A reader joining late copies them with
+last_values() before it reads on, and skips the datagrams older than the
+value it copied:
+
+    with Reader('smbcast://md.book', vlan='prod') as reader:
+        books = reader.last_values()
+        ...
+
+A channel with a key index lets a reader interested in a few keys read
+only their datagrams. read_keyed() scans the index, 4 bytes a datagram,
+with numpy and skips the others without touching them:
+
+    with Reader('smbcast://md.all', vlan='prod') as reader:
+        for message in reader.read_keyed([3, 77], 1024, timeout=1.0):
+            ...
+
+Run as a script, it taps a channel and prints its rate every second.
+With --dump it prints the channel's last values and its next datagrams
+in hex instead, which smb_bench's python suite compares with what it
+wrote through smb_bridge/BoardRing.h. That checks this module against
+BoardRing, not against libnano's DatagramBoard, whose framing neither
+has been checked against.
+"""
+
+import argparse
+import array
+import getpass
+import mmap
+import os
+import socket
+import struct
+import sys
+import time
+
+# ShMemBCastProtocol, the manager's request and reply messages
+VERSION = 2
+READER_SUBSCRIBE_REQUEST = b'R'
+READER_UNSUBSCRIBE_REQUEST = b'r'
+APPROVAL_MESSAGE = b'A'
+DENIAL_MESSAGE = b'D'
+MAX_MESSAGE_SIZE = 512
+HEADER = struct.Struct('=BcH')
+SUBSCRIBE_REQUEST = struct.Struct('=BcHI')
+MANAGER_SOCKET_FORMAT = '/spare/local/.smb_manager/{}/sock/s'
+
+# The layout of a board, as smb_bridge/BoardRing.h reads it. It starts
+# with the BoardInfo header: the board size, the datagrams written and the
+# bytes written, which the writer publishes once a datagram is complete.
+# The datagrams follow, each a 32 bit length and the payload, padded to
+# ALIGNMENT. A datagram never straddles the end of the board: the writer
+# leaves a WRAP length, or no length if there is no room for one, and
+# carries on at the beginning. This framing has not been checked against
+# libnano's core/link/DatagramBoard.h; keep it in step with BoardRing.h.
+BOARD_INFO = struct.Struct('=QQQ')
+SIZE_OFFSET = 0
+SEQUENCE_OFFSET = 8
+POSITION_OFFSET = 16
+DATA_OFFSET = BOARD_INFO.size
+DATAGRAM_HEADER = struct.Struct('=I')
+ALIGNMENT = 8
+WRAP = 0xFFFFFFFF
+
+POSITION = struct.Struct('=Q')
+
+# LastValueArea, the last-value area some channels have behind the ring,
+# at the first page boundary after it: a header, then one slot per key.
+# A slot is a sequence, odd while the writer updates it and 0 until it
+# set a value, the board position the writer passed with the value, the
+# value size and the value. Keep these in step with
+# smb_manager/LastValueArea.h.
+LAST_VALUE_MAGIC = 0x4C424D53
+LAST_VALUE_VERSION = 1
+LAST_VALUE_PAGE = 4096
+LAST_VALUE_HEADER = struct.Struct('=IIIIQ')
+LAST_VALUE_SLOT = struct.Struct('=QQII')
+LAST_VALUE_SLOT_ALIGNMENT = 64
+
+# KeyIndex, the key index some channels have behind the ring, or behind
+# the last-value area if there is one, at a page boundary: a header, then
+# the key of each datagram and then the board position of its length,
+# datagram n at entry n modulo the capacity. It covers the datagrams from
+# the header's first to its next only. Keep these in step with
+# smb_manager/KeyIndex.h.
+KEY_INDEX_MAGIC = 0x4B424D53
+KEY_INDEX_VERSION = 2
+KEY_INDEX_HEADER = struct.Struct('=IIQQQ')
+KEY_INDEX_FIRST_OFFSET = 16
+KEY_INDEX_HEADER_SIZE = 64
+KEY_INDEX_MIN_CAPACITY = 16
+
+
+class DeniedError(Exception):
+    """The manager denied the subscription."""
+
+
+def _aligned(size):
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1)
+
+
+class Reader:
+    """A reader of one channel.
+
+    channel: the channel name, e.g. 'smbcast://md.book'
+    vlan: the manager's vlan, the user name by default
+    timeout: how long to wait for each reply of the manager, in seconds
+    from_start: read the datagrams still on the board, rather than only
+      those written from now on
+    socket_path: the manager's socket, if not the usual one of the vlan
+
+    overruns counts the times the writer lapped this reader, and
+    lost_bytes the board bytes it skipped because of it. last_value_keys
+    is the number of keys of the channel's last-value area, 0 if it has
+    none, and key_index_capacity the number of entries of its key index.
+    A reader uses either read() or read_keyed().
+    """
+
+    def __init__(self, channel, vlan=None, timeout=10.0, from_start=False,
+                 socket_path=None):
+        self.channel = channel
+        self.overruns = 0
+        self.lost_bytes = 0
+        self.last_value_keys = 0
+        self._map = None
+        self._view = None
+        self._data = None
+        self._area = None
+        self._sequences = None
+        self.key_index_capacity = 0
+        self._index = None
+        self._keys = None
+        self._positions = None
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        try:
+            self._socket.settimeout(timeout)
+            self._socket.connect(socket_path or MANAGER_SOCKET_FORMAT.format(
+                vlan or getpass.getuser()))
+            fd = self._subscribe()
+            try:
+                self._map = mmap.mmap(fd, 0, mmap.MAP_SHARED, mmap.PROT_READ)
+            finally:
+                os.close(fd)
+        except BaseException:
+            self.close()
+            raise
+
+        self._view = memoryview(self._map)
+        self._size = POSITION.unpack_from(self._view, SIZE_OFFSET)[0]
+        self._data = self._view[DATA_OFFSET:DATA_OFFSET + self._size]
+        self._find_last_values()
+        self._find_key_index()
+        sequence = self.sequence()
+        written = self.written()
+        # once the writer wrapped, the datagram boundaries behind it are
+        # unknown, so the start of the board can only be read before that
+        if from_start and written <= self._size:
+            self._position = 0
+            self._sequence = 0
+        else:
+            self._position = written
+            self._sequence = sequence
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+    @property
+    def board_size(self):
+        return self._size
+
+    @property
+    def position(self):
+        """The bytes read, as the writer counts them."""
+        return self._position
+
+    def written(self):
+        """The bytes the writer completed."""
+        return POSITION.unpack_from(self._view, POSITION_OFFSET)[0]
+
+    def sequence(self):
+        """The datagrams the writer completed."""
+        return POSITION.unpack_from(self._view, SEQUENCE_OFFSET)[0]
+
+    def lag(self):
+        """How far behind the writer this reader is, in bytes."""
+        return self.written() - self._position
+
+    def read(self, max_messages=1024, dtype=None, timeout=0.0):
+        """Returns up to max_messages new datagrams, oldest first.
+
+        Each is a read-only memoryview of the board, or with dtype a
+        read-only numpy array over it. Nothing is copied. If the writer
+        lapped this reader, the lost datagrams are skipped and counted in
+        overruns.
+
+        timeout: how long to wait for a datagram, in seconds, if there is
+          none yet. The wait spins, yielding the CPU between looks.
+        """
+        deadline = None
+        written = self.written()
+        while written == self._position and timeout > 0.0:
+            if deadline is None:
+                deadline = time.monotonic() + timeout
+            elif time.monotonic() >= deadline:
+                break
+            os.sched_yield()
+            written = self.written()
+
+        if written - self._position > self._size:
+            self._skip(written)
+            return []
+
+        messages = []
+        position = self._position
+        while position < written and len(messages) < max_messages:
+            offset = position % self._size
+            room = self._size - offset
+            if room < DATAGRAM_HEADER.size:
+                position += room
+                continue
+
+            length = DATAGRAM_HEADER.unpack_from(self._data, offset)[0]
+            if length == WRAP:
+                position += room
+                continue
+            if DATAGRAM_HEADER.size + length > room:
+                # lapped while reading the length
+                break
+
+            start = offset + DATAGRAM_HEADER.size
+            messages.append(self._data[start:start + length])
+            position += _aligned(DATAGRAM_HEADER.size + length)
+
+        # the writer may have lapped the batch while it was sliced
+        written = self.written()
+        if written - self._position > self._size:
+            for message in messages:
+                message.release()
+            self._skip(written)
+            return []
+        self._position = position
+        self._sequence += len(messages)
+
+        if dtype is not None:
+            import numpy
+            return [numpy.frombuffer(message, dtype=dtype)
+                    for message in messages]
+        return messages
+
+    def read_keyed(self, keys, max_messages=1024, dtype=None, timeout=0.0):
+        """Returns up to max_messages new datagrams with one of the keys.
+
+        As read(), but through the channel's key index, so that the
+        datagrams with other keys are skipped without being read. Where
+        the index does not cover the board, e.g. as the writer does not
+        maintain it, the datagrams come back whatever their key, as from
+        read(), so check them.
+
+        keys: the keys of interest
+        """
+        import numpy
+
+        if self._keys is None:
+            raise ValueError(self.channel + ' has no key index')
+
+        deadline = None
+        end = self.sequence()
+        while end == self._sequence and timeout > 0.0:
+            if deadline is None:
+                deadline = time.monotonic() + timeout
+            elif time.monotonic() >= deadline:
+                break
+            os.sched_yield()
+            end = self.sequence()
+        written = self.written()
+
+        first, covered = self._covered()
+        if first > self._sequence or covered < end:
+            return self.read(max_messages, dtype)
+
+        capacity = self.key_index_capacity
+        if end - self._sequence > capacity:
+            self._skip(written)
+            return []
+
+        interest = numpy.asarray(keys, dtype=numpy.uint32)
+        index_keys = numpy.frombuffer(self._keys, dtype=numpy.uint32)
+        matches = []
+        sequence = self._sequence
+        while sequence < end and len(matches) < max_messages:
+            # up to the end of the range or of the index, whichever comes
+            # first
+            begin = sequence % capacity
+            run = min(end - sequence, capacity - begin)
+            hits = numpy.flatnonzero(
+                numpy.isin(index_keys[begin:begin + run], interest))
+            hits = hits[:max_messages - len(matches)]
+            matches.extend(sequence + int(hit) for hit in hits)
+            if len(matches) == max_messages:
+                sequence = matches[-1] + 1
+            else:
+                sequence += run
+        del index_keys
+
+        messages = []
+        position = written
+        lapped = False
+        for match in matches:
+            start = self._positions[match % capacity]
+            offset = start % self._size
+            length = DATAGRAM_HEADER.unpack_from(self._data, offset)[0]
+            if (length == WRAP or
+                    DATAGRAM_HEADER.size + length > self._size - offset):
+                lapped = True
+                break
+
+            messages.append(self._data[offset + DATAGRAM_HEADER.size:
+                                       offset + DATAGRAM_HEADER.size +
+                                       length])
+            position = start + _aligned(DATAGRAM_HEADER.size + length)
+        oldest = matches[0] if matches else None
+        if sequence == end and end != self._sequence and not lapped:
+            # past the last datagram scanned, not past what the writer
+            # published since, should the index stop covering it
+            start = self._positions[(end - 1) % capacity]
+            offset = start % self._size
+            length = DATAGRAM_HEADER.unpack_from(self._data, offset)[0]
+            if (length == WRAP or
+                    DATAGRAM_HEADER.size + length > self._size - offset):
+                lapped = True
+            position = start + _aligned(DATAGRAM_HEADER.size + length)
+            if oldest is None:
+                oldest = end - 1
+        elif sequence == end:
+            position = self._position
+
+        # the writer may have lapped the index entries, or the batch,
+        # while they were read
+        if oldest is not None and not lapped:
+            lapped = (self.sequence() - oldest >= capacity or
+                      self.written() -
+                      self._positions[oldest % capacity] > self._size)
+        if lapped:
+            for message in messages:
+                message.release()
+            self._skip(self.written())
+            return []
+        self._sequence = sequence
+        self._position = position
+
+        if dtype is not None:
+            return [numpy.frombuffer(message, dtype=dtype)
+                    for message in messages]
+        return messages
+
+    def last_value(self, key, attempts=100000):
+        """Copies the latest value of a key.
+
+        Returns the value as bytes and the board position the writer
+        passed with it, or None if the key has no value yet. A datagram
+        read from before that position is older than the value, if the
+        writer publishes its updates as datagrams too.
+
+        attempts: how many times to retry while the writer updates it
+        """
+        if not 0 <= key < self.last_value_keys:
+            raise KeyError(key)
+
+        slot = self._slot_offset(key)
+        # one aligned 64 bit load, as the writer stores it
+        index = (slot - self._area) // 8
+        for _ in range(attempts):
+            before = self._sequences[index]
+            if before == 0:
+                return None
+            if before & 1:
+                continue
+
+            _, position, size, _ = LAST_VALUE_SLOT.unpack_from(
+                self._view, slot)
+            start = slot + LAST_VALUE_SLOT.size
+            value = bytes(self._view[start:start + min(size,
+                                                       self._value_size)])
+            if before == self._sequences[index]:
+                return value, position
+        raise OSError('the writer kept updating key {}'.format(key))
+
+    def last_values(self, attempts=100000):
+        """Copies the latest value of every key that has one.
+
+        Returns a dict of key to value and position, as last_value().
+        Each value is consistent on its own.
+        """
+        values = {}
+        for key in range(self.last_value_keys):
+            if self._sequences[(self._slot_offset(key) - self._area) // 8]:
+                value = self.last_value(key, attempts)
+                if value is not None:
+                    values[key] = value
+        return values
+
+    def close(self):
+        """Unsubscribes and unmaps the board.
+
+        The board stays mapped while views of it are still around.
+        """
+        if self._socket is not None:
+            try:
+                name = self.channel.encode() + b'\0'
+                self._socket.send(HEADER.pack(
+                    VERSION, READER_UNSUBSCRIBE_REQUEST,
+                    HEADER.size + len(name)) + name)
+                self._receive_reply()
+            except (OSError, DeniedError):
+                # the manager cleans up after a closed connection anyway
+                pass
+            self._socket.close()
+            self._socket = None
+
+        for view in (self._keys, self._positions, self._sequences,
+                     self._data, self._view):
+            if view is not None:
+                view.release()
+        self._keys = None
+        self._positions = None
+        self._sequences = None
+        self._data = None
+        self._view = None
+        if self._map is not None:
+            try:
+                self._map.close()
+            except BufferError:
+                # views handed out are still alive, the mapping goes with
+                # them
+                pass
+            self._map = None
+
+    def _subscribe(self):
+        """Sends the subscribe request.
+
+        Returns the board fd.
+        """
+        name = self.channel.encode() + b'\0'
+        self._socket.send(SUBSCRIBE_REQUEST.pack(
+            VERSION, READER_SUBSCRIBE_REQUEST,
+            SUBSCRIBE_REQUEST.size + len(name), 0) + name)
+        self._receive_reply()
+
+        fds = array.array('i')
+        _, ancillary, _, _ = self._socket.recvmsg(
+            fds.itemsize, socket.CMSG_LEN(fds.itemsize))
+        for level, kind, data in ancillary:
+            if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+                # ignoring any truncated integer at the end
+                fds.frombytes(data[:len(data) - (len(data) % fds.itemsize)])
+        if not fds:
+            raise OSError('the manager sent no board for ' + self.channel)
+
+        for fd in fds[1:]:
+            os.close(fd)
+        return fds[0]
+
+    def _receive_reply(self):
+        """Waits for an approval, skipping events."""
+        while True:
+            reply = self._socket.recv(MAX_MESSAGE_SIZE)
+            if len(reply) < HEADER.size:
+                raise OSError('the manager closed the connection')
+
+            _, message_type, _ = HEADER.unpack_from(reply)
+            if message_type == APPROVAL_MESSAGE:
+                return
+            if message_type == DENIAL_MESSAGE:
+                raise DeniedError('the manager denied ' + self.channel)
+
+    def _find_last_values(self):
+        """Finds the last-value area behind the ring, if there is one."""
+        area = ((DATA_OFFSET + self._size + LAST_VALUE_PAGE - 1) &
+                ~(LAST_VALUE_PAGE - 1))
+        if area + LAST_VALUE_SLOT_ALIGNMENT > len(self._map):
+            return
+
+        magic, version, num_keys, value_size, slot_size = \
+            LAST_VALUE_HEADER.unpack_from(self._view, area)
+        expected_slot_size = (
+            (LAST_VALUE_SLOT.size + value_size +
+             LAST_VALUE_SLOT_ALIGNMENT - 1) &
+            ~(LAST_VALUE_SLOT_ALIGNMENT - 1))
+        end = area + LAST_VALUE_SLOT_ALIGNMENT + num_keys * slot_size
+        if (magic != LAST_VALUE_MAGIC or version != LAST_VALUE_VERSION or
+                slot_size != expected_slot_size or end > len(self._map)):
+            return
+
+        self.last_value_keys = num_keys
+        self._area = area
+        self._value_size = value_size
+        self._slot_size = slot_size
+        self._sequences = self._view[area:end].cast('Q')
+
+    def _find_key_index(self):
+        """Finds the key index behind the ring, if there is one."""
+        index = ((DATA_OFFSET + self._size + LAST_VALUE_PAGE - 1) &
+                 ~(LAST_VALUE_PAGE - 1))
+        if self._area is not None:
+            index = ((index + LAST_VALUE_SLOT_ALIGNMENT +
+                      self.last_value_keys * self._slot_size +
+                      LAST_VALUE_PAGE - 1) & ~(LAST_VALUE_PAGE - 1))
+        if index + KEY_INDEX_HEADER_SIZE > len(self._map):
+            return
+
+        magic, version, capacity, _, _ = KEY_INDEX_HEADER.unpack_from(
+            self._view, index)
+        keys = index + KEY_INDEX_HEADER_SIZE
+        positions = keys + capacity * 4
+        end = positions + capacity * 8
+        if (magic != KEY_INDEX_MAGIC or version != KEY_INDEX_VERSION or
+                capacity < KEY_INDEX_MIN_CAPACITY or
+                capacity & (capacity - 1) or end > len(self._map)):
+            return
+
+        self.key_index_capacity = capacity
+        self._index = index
+        self._keys = self._view[keys:positions].cast('I')
+        self._positions = self._view[positions:end].cast('Q')
+
+    def _covered(self):
+        """The first datagram the key index covers, and the one after
+        the last."""
+        # next before first, as a writer that starts sets them the other
+        # way round
+        covered = POSITION.unpack_from(
+            self._view, self._index + KEY_INDEX_FIRST_OFFSET + 8)[0]
+        first = POSITION.unpack_from(self._view,
+                                     self._index + KEY_INDEX_FIRST_OFFSET)[0]
+        return first, covered
+
+    def _slot_offset(self, key):
+        return (self._area + LAST_VALUE_SLOT_ALIGNMENT +
+                key * self._slot_size)
+
+    def _skip(self, written):
+        """Moves past datagrams the writer overwrote."""
+        self.overruns += 1
+        self.lost_bytes += written - self._position
+        # datagram boundaries are only known where the writer is
+        self._position = written
+        self._sequence = self.sequence()
+
+
+def dump(reader, count, timeout=10.0):
+    """Prints the last values and the next count datagrams, in hex.
+
+    Prints 'value <key> <position> <hex>' for each key with a value,
+    then 'ready', and then 'datagram <hex>' for each datagram the writer
+    writes from then on. Returns 0 once count were read, 1 on timeout or
+    overrun.
+    """
+    for key, (value, position) in sorted(reader.last_values().items()):
+        print('value {} {} {}'.format(key, position, value.hex()))
+    print('ready')
+    sys.stdout.flush()
+
+    deadline = time.monotonic() + timeout
+    while count > 0 and time.monotonic() < deadline:
+        batch = reader.read(count, timeout=0.1)
+        for message in batch:
+            print('datagram ' + message.hex())
+            message.release()
+        count -= len(batch)
+        if reader.overruns:
+            print('overrun')
+            return 1
+    sys.stdout.flush()
+    return 0 if count == 0 else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Taps a smbcast channel and prints its rate.')
+    parser.add_argument('channel', help='e.g. smbcast://md.book')
+    parser.add_argument('-v', '--vlan', help='vlan of the manager '
+                        '(default: ${USER})')
+    parser.add_argument('-b', '--batch', type=int, default=4096,
+                        help='datagrams per read (default: 4096)')
+    parser.add_argument('-s', '--socket', help='the manager\'s socket '
+                        '(default: that of the vlan)')
+    parser.add_argument('--dump', type=int, metavar='COUNT',
+                        help='print the last values and the next COUNT '
+                        'datagrams in hex, and exit')
+    arguments = parser.parse_args()
+
+    with Reader(arguments.channel, vlan=arguments.vlan,
+                socket_path=arguments.socket) as reader:
+        if arguments.dump is not None:
+            return dump(reader, arguments.dump)
+
+        print('board of {} bytes, writer at {}'.format(
+            reader.board_size, reader.written()))
+        start = time.monotonic()
+        messages = 0
+        size = 0
+        while True:
+            batch = reader.read(arguments.batch, timeout=0.1)
+            messages += len(batch)
+            size += sum(message.nbytes for message in batch)
+            for message in batch:
+                message.release()
+
+            now = time.monotonic()
+            if now - start >= 1.0:
+                print('{:.0f} datagrams/s, {:.0f} bytes/s, lag {} bytes, '
+                      '{} overruns'.format(messages / (now - start),
+                                           size / (now - start),
+                                           reader.lag(), reader.overruns))
+                sys.stdout.flush()
+                start = now
+                messages = 0
+                size = 0
+
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        pass
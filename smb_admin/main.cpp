@@ -0,0 +1,360 @@
+#include <smb_manager/ManagerProtocol.h>
+
+#include <core/link/IPCAddress.h>
+#include <core/link/ShMemBCastProtocol.h>
+#include <core/utils/StrToInt.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+typedef ShMemBCastProtocol Protocol;
+
+/**
+ * How long to wait for each message of a reply
+ */
+const int REPLY_TIMEOUT_SECONDS = 10;
+
+void usage(const char *programName) {
+  std::cerr << programName << " [option]* <command>" << std::endl
+
+            << "Asks the smb_manager of a vlan what it is doing"
+            << std::endl
+
+            << "Commands:" << std::endl
+
+            << "  list [prefix]            : list the channels starting "
+            << "with prefix, with their board size and subscribers, then "
+            << "the summary" << std::endl
+
+            << "  summary                  : print the number of channels "
+            << "and clients, and the pool and memory use" << std::endl
+
+            << "  resize <channel> <bytes> : move a channel to a larger "
+            << "board while it is in use" << std::endl
+
+            << "Option Descriptions:" << std::endl
+
+            << "  --vlan    | -v <string>  : vlan of the manager (default: "
+            << "${USER})" << std::endl
+
+            << "  --pids    | -p           : list the pid of every reader "
+            << "under its channel" << std::endl
+
+            << "  --help    | -[h?]        : display this help message"
+            << std::endl;
+}
+
+/**
+ * Connects to the manager of a vlan
+ *
+ * @return the connection, negative on error
+ */
+int connectManager(const std::string &vlan) {
+  const IPCAddress &managerAddress = Protocol::getManagerIPCAddress(vlan);
+  struct sockaddr_un address = managerAddress.toSockAddrUn();
+  struct timeval timeout = {REPLY_TIMEOUT_SECONDS, 0};
+  int fd;
+
+  fd = ::socket(AF_UNIX, Protocol::UNIX_DOMAIN_SOCKET_TYPE | SOCK_CLOEXEC,
+                0);
+  if (0 > fd) {
+    std::cerr << "Could not create a socket: " << ::strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  if ((0 != ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                         sizeof(timeout))) ||
+      (0 != ::connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+                      sizeof(address)))) {
+    std::cerr << "Could not connect to the manager of vlan " << vlan
+              << ": " << ::strerror(errno) << std::endl;
+    ::close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int sendRequest(int fd, const char *buffer, ssize_t size) {
+  if ((0 > size) || (size != ::send(fd, buffer, size, MSG_NOSIGNAL))) {
+    std::cerr << "Could not send the request" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Receives the next message
+ *
+ * @return its header, or 0 on error
+ */
+const Protocol::Header *receive(int fd, std::vector<uint64_t> *buffer) {
+  ssize_t size = ::recv(fd, buffer->data(),
+                        buffer->size() * sizeof(uint64_t), 0);
+  const Protocol::Header *header =
+      reinterpret_cast<const Protocol::Header *>(buffer->data());
+
+  if (0 == size) {
+    std::cerr << "The manager closed the connection, is this user "
+              << "permitted?" << std::endl;
+    return 0;
+  }
+  if ((static_cast<ssize_t>(sizeof(Protocol::Header)) > size) ||
+      (static_cast<ssize_t>(header->m_size) != size)) {
+    std::cerr << "No reply from the manager: "
+              << ((0 > size) ? (::strerror(errno)) : ("malformed message"))
+              << std::endl;
+    return 0;
+  }
+
+  return header;
+}
+
+std::string pidList(const int32_t *pids, size_t count) {
+  std::ostringstream list;
+
+  for (size_t i = 0; i < count; i++) {
+    list << ((0 == i) ? ("") : (",")) << pids[i];
+  }
+
+  return list.str();
+}
+
+void printChannels(const ManagerProtocol::QueryChannels *message,
+                   bool pids) {
+  const ManagerProtocol::ChannelEntry *entry =
+      ManagerProtocol::QueryChannels::first(message);
+
+  for (uint16_t i = 0; i < message->m_count; i++) {
+    const std::string writers =
+        pidList(entry->m_pids, entry->m_numWriterPids);
+
+    std::cout << std::left << std::setw(48)
+              << ManagerProtocol::ChannelEntry::name(entry) << std::right
+              << std::setw(12) << entry->m_boardSize << std::setw(16)
+              << (writers.empty() ? ("-") : (writers.c_str()))
+              << std::setw(8) << entry->m_numReaders;
+    if (0 != (ManagerProtocol::RESIZING_FLAG & entry->m_flags)) {
+      std::cout << "  RESIZING";
+    }
+    std::cout << std::endl;
+
+    if (pids && (0 < entry->m_numReaderPids)) {
+      std::cout << "    readers "
+                << pidList(entry->m_pids + entry->m_numWriterPids,
+                           entry->m_numReaderPids);
+      if (0 != (ManagerProtocol::READERS_TRUNCATED_FLAG & entry->m_flags)) {
+        std::cout << " ...";
+      }
+      std::cout << std::endl;
+    }
+
+    entry = ManagerProtocol::ChannelEntry::next(entry);
+  }
+}
+
+void printSummary(const ManagerProtocol::QuerySummary &summary,
+                  bool listed) {
+  if (listed) {
+    std::cout << summary.m_numListed << " channels listed" << std::endl;
+  }
+
+  std::cout << "Manager " << summary.m_managerPid << ": "
+            << summary.m_numChannels << " channels ("
+            << summary.m_numResizing << " resizing), "
+            << summary.m_numClients << " clients" << std::endl
+
+            << "  boards   " << summary.m_boardBytes << " bytes"
+            << std::endl
+
+            << "  pool     " << summary.m_pooledBoards << " spare boards, "
+            << summary.m_pooledBytes << " bytes, " << summary.m_poolHits
+            << " hits, " << summary.m_poolMisses << " misses" << std::endl
+
+            << "  registry " << summary.m_registryBytes << " bytes"
+            << std::endl
+
+            << "  queued   " << summary.m_queuedBytes
+            << " bytes for slow clients" << std::endl;
+}
+
+/**
+ * Sends a query and prints the reply
+ *
+ * @param list Whether to list the channels
+ *
+ * @return 0 on success, non-zero on error
+ */
+int query(int fd, bool list, const std::string &prefix, bool pids) {
+  std::vector<uint64_t> buffer(ManagerProtocol::MAX_MESSAGE_SIZE /
+                               sizeof(uint64_t));
+  char *bytes = reinterpret_cast<char *>(buffer.data());
+
+  if (0 != sendRequest(fd, bytes,
+                       ManagerProtocol::QueryRequest::init(
+                           bytes, buffer.size() * sizeof(uint64_t),
+                           list ? (ManagerProtocol::QUERY_CHANNELS_FLAG)
+                                : (0),
+                           prefix.c_str()))) {
+    return -1;
+  }
+
+  if (list) {
+    std::cout << std::left << std::setw(48) << "CHANNEL" << std::right
+              << std::setw(12) << "BOARD" << std::setw(16) << "WRITER"
+              << std::setw(8) << "READERS" << std::endl;
+  }
+
+  // the channels come in as many messages as they take, the summary
+  // ends the reply
+  for (;;) {
+    const Protocol::Header *header = receive(fd, &buffer);
+    if (0 == header) {
+      return -1;
+    }
+
+    if (ManagerProtocol::isMessage(
+            bytes, header->m_size, ManagerProtocol::QUERY_CHANNELS,
+            offsetof(ManagerProtocol::QueryChannels, m_entries))) {
+      printChannels(
+          reinterpret_cast<const ManagerProtocol::QueryChannels *>(bytes),
+          pids);
+    } else if (ManagerProtocol::isMessage(
+                   bytes, header->m_size, ManagerProtocol::QUERY_SUMMARY,
+                   sizeof(ManagerProtocol::QuerySummary))) {
+      printSummary(
+          *reinterpret_cast<const ManagerProtocol::QuerySummary *>(bytes),
+          list);
+      return 0;
+    } else {
+      std::cerr << "The manager does not support queries" << std::endl;
+      return -1;
+    }
+  }
+}
+
+/**
+ * Asks for a channel to be moved to a larger board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int resize(int fd, const char *channelName, uint64_t requestedSize) {
+  char buffer[offsetof(ManagerProtocol::ResizeRequest, m_channelName) +
+              Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+  std::vector<uint64_t> reply(ManagerProtocol::MAX_MESSAGE_SIZE /
+                              sizeof(uint64_t));
+  const Protocol::Header *header;
+
+  if (0 != sendRequest(fd, buffer,
+                       ManagerProtocol::ResizeRequest::init(
+                           buffer, sizeof(buffer), channelName,
+                           static_cast<uint32_t>(requestedSize)))) {
+    return -1;
+  }
+
+  header = receive(fd, &reply);
+  if (0 == header) {
+    return -1;
+  }
+
+  if (Protocol::APPROVAL_MESSAGE != header->m_messageType) {
+    std::cerr << "The manager denied resizing " << channelName
+              << ", see its log" << std::endl;
+    return -1;
+  }
+
+  std::cout << "Resizing " << channelName << ", it moves once its writer "
+            << "did" << std::endl;
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string vlan;
+  bool pids = false;
+  std::string command;
+  int fd;
+  int retVal;
+
+  // setup getopt_long options
+  const char *optstring = "v:ph?";
+  const struct option longopts[] =
+      // {char* name, int has_arg, int* flag, int val}
+      {{"vlan", required_argument, 0, 'v'},
+       {"pids", no_argument, 0, 'p'},
+       {"help", no_argument, 0, 'h'},
+       {0, 0, 0, 0}};
+
+  int option;
+  while (-1 != (option = ::getopt_long(argc, argv, optstring, longopts, 0))) {
+    switch (option) {
+    case 'v': {
+      vlan = ::optarg;
+    } break;
+
+    case 'p': {
+      pids = true;
+    } break;
+
+    default: {
+      usage(argv[0]);
+      return 1;
+    } break;
+    }
+  }
+
+  if (::optind >= argc) {
+    std::cerr << "Please enter a command" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  command = argv[::optind++];
+
+  if (vlan.empty()) {
+    struct passwd *userDetails = ::getpwuid(::getuid());
+    vlan = userDetails->pw_name;
+  }
+
+  if ("list" == command) {
+    const std::string prefix = (::optind < argc) ? (argv[::optind]) : ("");
+    fd = connectManager(vlan);
+    retVal = (0 > fd) ? (-1) : (query(fd, true, prefix, pids));
+  } else if ("summary" == command) {
+    fd = connectManager(vlan);
+    retVal = (0 > fd) ? (-1) : (query(fd, false, "", false));
+  } else if (("resize" == command) && (::optind + 2 == argc)) {
+    const uint64_t requestedSize = StrToInt::parseUint(argv[::optind + 1]);
+    if ((0 == requestedSize) || (UINT32_MAX < requestedSize)) {
+      std::cerr << "Please enter a board size in bytes, below 4 GiB"
+                << std::endl;
+      return 1;
+    }
+    fd = connectManager(vlan);
+    retVal = (0 > fd) ? (-1)
+                      : (resize(fd, argv[::optind], requestedSize));
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (0 <= fd) {
+    ::close(fd);
+  }
+
+  return (0 == retVal) ? (0) : (1);
+}
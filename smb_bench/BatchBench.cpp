@@ -0,0 +1,216 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "batch";
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint64_t DEFAULT_CHANNELS = 2000;
+
+/***
+ * Subscribes to every channel, one request and round trip at a time,
+ * like a client starting up with the single-channel messages
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribeOneByOne(BenchUtil::Client *client,
+                      const std::vector<const char *> &channelNames) {
+  for (size_t i = 0; i < channelNames.size(); i++) {
+    int boardFd;
+    if ((0 != client->sendSubscribe(channelNames[i], true, 0)) ||
+        (0 != client->receiveApproval()) ||
+        (0 > (boardFd = client->receiveFd()))) {
+      return -1;
+    }
+    ::close(boardFd);
+  }
+
+  return 0;
+}
+
+int unsubscribeOneByOne(BenchUtil::Client *client,
+                        const std::vector<const char *> &channelNames) {
+  for (size_t i = 0; i < channelNames.size(); i++) {
+    if ((0 != client->sendUnsubscribe(channelNames[i], true)) ||
+        (0 != client->receiveApproval())) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Subscribes to every channel with as few batch requests as fit
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribeBatched(BenchUtil::Client *client,
+                     const std::vector<const char *> &channelNames) {
+  std::vector<uint8_t> approved;
+  std::vector<int> boardFds;
+  size_t done = 0;
+
+  while (done < channelNames.size()) {
+    size_t numSent;
+    int numFds;
+
+    if (0 != client->sendBatchSubscribe(&channelNames[done],
+                                        channelNames.size() - done, true, 0,
+                                        &numSent)) {
+      return -1;
+    }
+
+    numFds = client->receiveBatchReply(&approved);
+    if (static_cast<int>(numSent) != numFds) {
+      // something was denied
+      return -1;
+    }
+
+    boardFds.resize(numFds);
+    if (0 != client->receiveFds(&boardFds[0], numFds)) {
+      return -1;
+    }
+    for (int i = 0; i < numFds; i++) {
+      ::close(boardFds[i]);
+    }
+
+    done += numSent;
+  }
+
+  return 0;
+}
+
+int unsubscribeBatched(BenchUtil::Client *client,
+                       const std::vector<const char *> &channelNames) {
+  std::vector<uint8_t> approved;
+  size_t done = 0;
+
+  while (done < channelNames.size()) {
+    size_t numSent;
+
+    if ((0 != client->sendBatchUnsubscribe(&channelNames[done],
+                                           channelNames.size() - done, true,
+                                           &numSent)) ||
+        (0 != client->receiveBatchReply(&approved))) {
+      return -1;
+    }
+
+    for (size_t i = 0; i < approved.size(); i++) {
+      if (0 == approved[i]) {
+        return -1;
+      }
+    }
+
+    done += numSent;
+  }
+
+  return 0;
+}
+
+/***
+ * Runs the batch suite against one dispatcher
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runDispatcher(const BenchOptions &options, const std::string &dispatcher) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  ManagerProcess manager;
+  Client client;
+  uint64_t numChannels =
+      (0 == options.m_channels) ? (DEFAULT_CHANNELS) : (options.m_channels);
+  const std::string single = dispatcher + " single";
+  const std::string batch = dispatcher + " batch";
+  const char *phase = "connect";
+  uint64_t start;
+
+  vlan << "smb_bench." << ::getpid() << ".batch." << dispatcher;
+  arguments.push_back("--dispatcher");
+  arguments.push_back(dispatcher);
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    return -1;
+  }
+
+  std::vector<std::string> channelNames(numChannels);
+  std::vector<const char *> channelNamePointers(numChannels);
+  for (uint64_t i = 0; i < numChannels; i++) {
+    std::ostringstream channelName;
+    channelName << "smbcast://bench.batch." << i;
+    channelNames[i] = channelName.str();
+    channelNamePointers[i] = channelNames[i].c_str();
+  }
+
+  if (0 != client.connect(manager.vlan(), CLIENT_TIMEOUT_SECONDS)) {
+    goto ERROR;
+  }
+
+  // (1) a writer starting up with one request per channel. The channels
+  // are destroyed again by the unsubscribe, so (2) creates them anew
+  phase = "single subscribe";
+  start = nowNanos();
+  if (0 != subscribeOneByOne(&client, channelNamePointers)) {
+    goto ERROR;
+  }
+  printResult(SUITE_NAME, single, "subscribe", numChannels,
+              nowNanos() - start);
+
+  phase = "single unsubscribe";
+  start = nowNanos();
+  if (0 != unsubscribeOneByOne(&client, channelNamePointers)) {
+    goto ERROR;
+  }
+  printResult(SUITE_NAME, single, "unsubscribe", numChannels,
+              nowNanos() - start);
+
+  // (2) the same writer with batch requests
+  phase = "batch subscribe";
+  start = nowNanos();
+  if (0 != subscribeBatched(&client, channelNamePointers)) {
+    goto ERROR;
+  }
+  printResult(SUITE_NAME, batch, "subscribe", numChannels,
+              nowNanos() - start);
+
+  phase = "batch unsubscribe";
+  start = nowNanos();
+  if (0 != unsubscribeBatched(&client, channelNamePointers)) {
+    goto ERROR;
+  }
+  printResult(SUITE_NAME, batch, "unsubscribe", numChannels,
+              nowNanos() - start);
+
+  return 0;
+
+ERROR:
+  std::cout << SUITE_NAME << ": " << dispatcher << " dispatcher failed at "
+            << phase
+            << (manager.running() ? ("") : (" (manager exited)")) << ", see "
+            << manager.logFilePath() << std::endl;
+  return -1;
+}
+} // namespace
+
+int runBatchBench(const BenchOptions &options) {
+  int retVal = 0;
+
+  // a batch reply passes up to MAX_FDS_PER_MESSAGE fds at once
+  BenchUtil::raiseOpenFileLimit(1024);
+
+  for (size_t i = 0; i < options.m_dispatchers.size(); i++) {
+    if (0 != runDispatcher(options, options.m_dispatchers[i])) {
+      retVal = -1;
+    }
+  }
+
+  return retVal;
+}
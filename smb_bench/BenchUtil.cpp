@@ -0,0 +1,539 @@
+#include "BenchUtil.h"
+
+#include <core/link/IPCAddress.h>
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <smb_manager/KeyIndex.h>
+#include <smb_manager/ManagerProtocol.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace BenchUtil {
+namespace {
+const uint64_t MANAGER_START_TIMEOUT_NANOS = 5000000000ULL;
+const useconds_t MANAGER_START_POLL_MICROS = 10000;
+} // namespace
+
+uint64_t raiseOpenFileLimit(uint64_t required) {
+  struct rlimit limit;
+  if (0 != ::getrlimit(RLIMIT_NOFILE, &limit)) {
+    return 0;
+  }
+
+  if (limit.rlim_cur < required) {
+    limit.rlim_cur =
+        (required < limit.rlim_max) ? (required) : (limit.rlim_max);
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  return limit.rlim_cur;
+}
+
+int createBoard(uint64_t boardSize, uint64_t keyIndexCapacity) {
+  const uint64_t indexOffset = KeyIndex::offset(boardSize, 0, 0);
+  const uint64_t fileSize =
+      (0 != keyIndexCapacity)
+          ? (indexOffset + KeyIndex::size(keyIndexCapacity))
+          : (sizeof(DatagramBoard::BoardInfo) + boardSize);
+  DatagramBoard::BoardInfo info;
+  KeyIndex::Header index;
+  int fd;
+
+  fd = ::memfd_create("BenchBoard", MFD_CLOEXEC);
+  if (0 > fd) {
+    return -1;
+  }
+
+  ::memset(&info, 0, sizeof(info));
+  info.m_size = boardSize;
+  ::memset(&index, 0, sizeof(index));
+  KeyIndex::init(&index, keyIndexCapacity);
+  if ((0 != ::ftruncate(fd, fileSize)) ||
+      (sizeof(info) != ::pwrite(fd, &info, sizeof(info), 0)) ||
+      ((0 != keyIndexCapacity) &&
+       (sizeof(index) != ::pwrite(fd, &index, sizeof(index), indexOffset)))) {
+    ::close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+void printResultHeader(void) {
+  std::cout << std::left << std::setw(12) << "suite" << std::setw(20)
+            << "variant" << std::setw(16) << "phase" << std::right
+            << std::setw(10) << "ops" << std::setw(12) << "seconds"
+            << std::setw(14) << "ops/s" << std::setw(12) << "us/op"
+            << std::endl;
+}
+
+void printResult(const char *suite, const std::string &variant,
+                 const char *phase, uint64_t operations, uint64_t nanos) {
+  double seconds = static_cast<double>(nanos) / 1e9;
+  double rate = (0 == nanos) ? (0.0) : (operations / seconds);
+  double microsPerOp = (0 == operations)
+                           ? (0.0)
+                           : (static_cast<double>(nanos) / 1e3 / operations);
+
+  std::cout << std::left << std::setw(12) << suite << std::setw(20) << variant
+            << std::setw(16) << phase << std::right << std::setw(10)
+            << operations << std::setw(12) << std::fixed
+            << std::setprecision(4) << seconds << std::setw(14)
+            << std::setprecision(0) << rate << std::setw(12)
+            << std::setprecision(2) << microsPerOp << std::endl;
+}
+
+void printLatencies(const char *suite, const std::string &variant,
+                    const char *phase, std::vector<uint64_t> *nanos) {
+  const double PERCENTILES[] = {0.5, 0.99, 0.999};
+  const char *const LABELS[] = {"p50", "p99", "p99.9"};
+
+  std::cout << std::left << std::setw(12) << suite << std::setw(20) << variant
+            << std::setw(16) << phase << std::right << std::setw(10)
+            << nanos->size();
+  if (nanos->empty()) {
+    std::cout << std::endl;
+    return;
+  }
+
+  std::sort(nanos->begin(), nanos->end());
+  for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+    // the smallest sample at or above the percentile
+    size_t rank = static_cast<size_t>(PERCENTILES[i] * nanos->size());
+    if (nanos->size() <= rank) {
+      rank = nanos->size() - 1;
+    }
+    std::cout << "  " << LABELS[i] << " " << std::fixed
+              << std::setprecision(1) << ((*nanos)[rank] / 1e3) << "us";
+  }
+  std::cout << "  max " << std::fixed << std::setprecision(1)
+            << (nanos->back() / 1e3) << "us" << std::endl;
+}
+
+std::string writeChannelConfig(const std::string &vlan,
+                               const char *contents) {
+  const std::string path = "/tmp/smb_bench." + vlan + ".ini";
+  std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+
+  file << contents;
+  file.close();
+  if (!file) {
+    std::cerr << "Could not write " << path << std::endl;
+    return std::string();
+  }
+
+  return path;
+}
+
+int ManagerProcess::start(const std::string &managerPath,
+                          const std::string &vlan,
+                          const std::vector<std::string> &extraArguments) {
+  std::vector<std::string> arguments;
+  std::vector<char *> argv;
+  uint64_t deadline;
+
+  m_vlan = vlan;
+  m_logFilePath = "/tmp/smb_bench." + vlan + ".log";
+
+  arguments.push_back(managerPath);
+  arguments.push_back("--vlan");
+  arguments.push_back(m_vlan);
+  arguments.push_back("--log_file");
+  arguments.push_back(m_logFilePath);
+  arguments.insert(arguments.end(), extraArguments.begin(),
+                   extraArguments.end());
+  for (size_t i = 0; i < arguments.size(); i++) {
+    argv.push_back(const_cast<char *>(arguments[i].c_str()));
+  }
+  argv.push_back(0);
+
+  m_pid = ::fork();
+  if (0 > m_pid) {
+    std::cerr << "Could not fork the manager: " << ::strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  if (0 == m_pid) {
+    // child
+    ::execv(argv[0], &argv[0]);
+    ::fprintf(stderr, "Could not exec \"%s\": %s\n", argv[0],
+              ::strerror(errno));
+    ::_exit(127);
+  }
+
+  // wait until the manager accepts connections
+  deadline = nowNanos() + MANAGER_START_TIMEOUT_NANOS;
+  while (nowNanos() < deadline) {
+    if (!running()) {
+      std::cerr << "Manager exited during start up, see " << m_logFilePath
+                << std::endl;
+      return -1;
+    }
+
+    Client probe;
+    if (0 == probe.connect(m_vlan, 1)) {
+      return 0;
+    }
+    ::usleep(MANAGER_START_POLL_MICROS);
+  }
+
+  std::cerr << "Manager did not start listening in time" << std::endl;
+  stop();
+  return -1;
+}
+
+void ManagerProcess::stop(void) {
+  if (0 >= m_pid) {
+    return;
+  }
+
+  ::kill(m_pid, SIGTERM);
+  ::waitpid(m_pid, 0, 0);
+  m_pid = -1;
+}
+
+void ManagerProcess::crash(void) {
+  if (0 >= m_pid) {
+    return;
+  }
+
+  ::kill(m_pid, SIGKILL);
+  ::waitpid(m_pid, 0, 0);
+  m_pid = -1;
+}
+
+bool ManagerProcess::running(void) {
+  if (0 >= m_pid) {
+    return false;
+  }
+
+  if (m_pid == ::waitpid(m_pid, 0, WNOHANG)) {
+    m_pid = -1;
+    return false;
+  }
+
+  return true;
+}
+
+int Client::connect(const std::string &vlan, int timeoutSeconds) {
+  const IPCAddress &managerAddress = Protocol::getManagerIPCAddress(vlan);
+  struct sockaddr_un address = managerAddress.toSockAddrUn();
+  struct timeval timeout = {timeoutSeconds, 0};
+
+  close();
+
+  m_fd = ::socket(AF_UNIX, Protocol::UNIX_DOMAIN_SOCKET_TYPE | SOCK_CLOEXEC,
+                  0);
+  if (0 > m_fd) {
+    return -1;
+  }
+
+  // the send timeout also bounds a connect() stuck on a full backlog
+  if ((0 != ::setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                         sizeof(timeout))) ||
+      (0 != ::setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                         sizeof(timeout))) ||
+      (0 != ::connect(m_fd, reinterpret_cast<struct sockaddr *>(&address),
+                      sizeof(address)))) {
+    close();
+    return -1;
+  }
+
+  return 0;
+}
+
+int Client::send(const char *buffer, ssize_t size) {
+  if ((0 > size) || (size != ::send(m_fd, buffer, size, MSG_NOSIGNAL))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int Client::sendSubscribe(const char *channelName, bool writer,
+                          uint32_t requestedSize) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+  ssize_t size;
+
+  if (writer) {
+    size = Protocol::WriterSubscribeRequest::init(buffer, sizeof(buffer),
+                                                  requestedSize, channelName);
+  } else {
+    size = Protocol::ReaderSubscribeRequest::init(buffer, sizeof(buffer),
+                                                  requestedSize, channelName);
+  }
+
+  return send(buffer, size);
+}
+
+int Client::sendUnsubscribe(const char *channelName, bool writer) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+  ssize_t size;
+
+  if (writer) {
+    size = Protocol::WriterUnsubscribeRequest::init(buffer, sizeof(buffer),
+                                                    channelName);
+  } else {
+    size = Protocol::ReaderUnsubscribeRequest::init(buffer, sizeof(buffer),
+                                                    channelName);
+  }
+
+  return send(buffer, size);
+}
+
+int Client::sendBatchSubscribe(const char *const *channelNames,
+                               size_t count, bool writer,
+                               uint32_t requestedSize, size_t *numSent) {
+  std::vector<char> buffer(ManagerProtocol::MAX_MESSAGE_SIZE);
+
+  return send(&buffer[0], ManagerProtocol::BatchSubscribe::init(
+                              &buffer[0], buffer.size(), writer,
+                              requestedSize, channelNames, count, numSent));
+}
+
+int Client::sendBatchUnsubscribe(const char *const *channelNames,
+                                 size_t count, bool writer,
+                                 size_t *numSent) {
+  std::vector<char> buffer(ManagerProtocol::MAX_MESSAGE_SIZE);
+
+  return send(&buffer[0],
+              ManagerProtocol::BatchUnsubscribe::init(
+                  &buffer[0], buffer.size(), writer, channelNames, count,
+                  numSent));
+}
+
+int Client::sendEventMode(void) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  return send(buffer, Protocol::EventModeRequest::init(buffer, sizeof(buffer)));
+}
+
+int Client::sendReaderProgress(const char *channelName, uint64_t sequence,
+                               uint64_t position) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  return send(buffer,
+              ManagerProtocol::ReaderProgress::init(
+                  buffer, sizeof(buffer), channelName, sequence, position, 0));
+}
+
+int Client::sendResize(const char *channelName, uint32_t requestedSize) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  return send(buffer, ManagerProtocol::ResizeRequest::init(
+                          buffer, sizeof(buffer), channelName, requestedSize));
+}
+
+int Client::sendBoardSwitched(const char *channelName, uint64_t sequence) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  return send(buffer, ManagerProtocol::BoardSwitched::init(
+                          buffer, sizeof(buffer), channelName, sequence));
+}
+
+ssize_t Client::receive(char *buffer, size_t size) {
+  return ::recv(m_fd, buffer, size, 0);
+}
+
+ssize_t Client::receiveMessage(uint8_t type, char *buffer, size_t size,
+                               int *fd) {
+  char control[CMSG_SPACE(sizeof(int))];
+
+  for (;;) {
+    struct iovec iov = {buffer, size};
+    struct msghdr message;
+    struct cmsghdr *controlHeader;
+    int passedFd = -1;
+    ssize_t received;
+
+    ::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    received = ::recvmsg(m_fd, &message, MSG_CMSG_CLOEXEC);
+    controlHeader = CMSG_FIRSTHDR(&message);
+    if ((0 != controlHeader) && (SOL_SOCKET == controlHeader->cmsg_level) &&
+        (SCM_RIGHTS == controlHeader->cmsg_type)) {
+      ::memcpy(&passedFd, CMSG_DATA(controlHeader), sizeof(passedFd));
+    }
+    if (static_cast<ssize_t>(sizeof(Protocol::Header)) > received) {
+      if (0 <= passedFd) {
+        ::close(passedFd);
+      }
+      return -1;
+    }
+
+    const Protocol::Header *header =
+        reinterpret_cast<const Protocol::Header *>(buffer);
+    if (type == static_cast<uint8_t>(header->m_messageType)) {
+      if (0 != fd) {
+        *fd = passedFd;
+      } else if (0 <= passedFd) {
+        ::close(passedFd);
+      }
+      return received;
+    }
+
+    if (0 <= passedFd) {
+      ::close(passedFd);
+    }
+  }
+}
+
+bool Client::pending(void) {
+  struct pollfd pollFd = {m_fd, POLLIN, 0};
+
+  return 0 < ::poll(&pollFd, 1, 0);
+}
+
+int Client::receiveApproval(void) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  for (;;) {
+    ssize_t size = receive(buffer, sizeof(buffer));
+    if (static_cast<ssize_t>(sizeof(Protocol::Header)) > size) {
+      return -1;
+    }
+
+    const Protocol::Header *header =
+        reinterpret_cast<const Protocol::Header *>(buffer);
+    if (Protocol::APPROVAL_MESSAGE == header->m_messageType) {
+      return 0;
+    } else if (Protocol::DENIAL_MESSAGE == header->m_messageType) {
+      return 1;
+    }
+
+    // an event, keep waiting
+  }
+}
+
+int Client::receiveFd(void) {
+  char data[sizeof(int)];
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = {data, sizeof(data)};
+  struct msghdr message;
+  struct cmsghdr *controlHeader;
+  int fd;
+
+  ::memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (0 > ::recvmsg(m_fd, &message, MSG_CMSG_CLOEXEC)) {
+    return -1;
+  }
+
+  controlHeader = CMSG_FIRSTHDR(&message);
+  if ((0 == controlHeader) || (SOL_SOCKET != controlHeader->cmsg_level) ||
+      (SCM_RIGHTS != controlHeader->cmsg_type)) {
+    return -1;
+  }
+
+  ::memcpy(&fd, CMSG_DATA(controlHeader), sizeof(fd));
+  return fd;
+}
+
+int Client::receiveBatchReply(std::vector<uint8_t> *approved) {
+  std::vector<char> buffer(ManagerProtocol::MAX_MESSAGE_SIZE);
+
+  for (;;) {
+    ssize_t size = receive(&buffer[0], buffer.size());
+    if (static_cast<ssize_t>(sizeof(Protocol::Header)) > size) {
+      return -1;
+    }
+
+    if (ManagerProtocol::isMessage(
+            &buffer[0], size, ManagerProtocol::BATCH_REPLY,
+            offsetof(ManagerProtocol::BatchReply, m_approved))) {
+      const ManagerProtocol::BatchReply *reply =
+          reinterpret_cast<const ManagerProtocol::BatchReply *>(&buffer[0]);
+      if (size < static_cast<ssize_t>(
+                     offsetof(ManagerProtocol::BatchReply, m_approved) +
+                     reply->m_count)) {
+        return -1;
+      }
+
+      approved->assign(reply->m_approved,
+                       reply->m_approved + reply->m_count);
+      return reply->m_numFds;
+    }
+
+    const Protocol::Header *header =
+        reinterpret_cast<const Protocol::Header *>(&buffer[0]);
+    if (Protocol::DENIAL_MESSAGE == header->m_messageType) {
+      return -1;
+    }
+
+    // an event, keep waiting
+  }
+}
+
+int Client::receiveFds(int *fds, size_t count) {
+  char data[sizeof(ManagerProtocol::BatchFds)];
+  char control[CMSG_SPACE(sizeof(int) *
+                          ManagerProtocol::MAX_FDS_PER_MESSAGE)];
+  struct iovec iov = {data, sizeof(data)};
+  struct msghdr message;
+  struct cmsghdr *controlHeader;
+  size_t received = 0;
+
+  while (received < count) {
+    size_t numFds;
+
+    ::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (0 > ::recvmsg(m_fd, &message, MSG_CMSG_CLOEXEC)) {
+      return -1;
+    }
+
+    controlHeader = CMSG_FIRSTHDR(&message);
+    if ((0 == controlHeader) || (SOL_SOCKET != controlHeader->cmsg_level) ||
+        (SCM_RIGHTS != controlHeader->cmsg_type)) {
+      return -1;
+    }
+
+    numFds = (controlHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if ((count - received) < numFds) {
+      return -1;
+    }
+
+    ::memcpy(fds + received, CMSG_DATA(controlHeader), numFds * sizeof(int));
+    received += numFds;
+  }
+
+  return 0;
+}
+
+void Client::close(void) {
+  if (0 <= m_fd) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+} // namespace BenchUtil
@@ -0,0 +1,340 @@
+#ifndef SMB_BENCH_BENCHUTIL_H_
+#define SMB_BENCH_BENCHUTIL_H_
+
+/***
+ * @file BenchUtil.h
+ *
+ * @brief
+ * Helpers shared by the smb_bench suites: a forked smb_manager on a
+ * private vlan, raw protocol clients and timing.
+ *
+ * @description
+ * The suites talk to a real smb_manager binary over its Unix Domain
+ * Socket, exactly like production clients do, so that the numbers
+ * include the accept path, the dispatcher and the SCM_RIGHTS transfer.
+ */
+
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+namespace BenchUtil {
+typedef ShMemBCastProtocol Protocol;
+
+/***
+ * @return the CLOCK_MONOTONIC time in nanoseconds
+ */
+inline uint64_t nowNanos(void) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+/***
+ * Raises the soft open file limit as close to 'required' as the hard
+ * limit allows
+ *
+ * @param required The number of descriptors needed
+ *
+ * @return the resulting soft limit
+ */
+uint64_t raiseOpenFileLimit(uint64_t required);
+
+/***
+ * Prints one result row
+ *
+ * @param suite Name of the suite
+ * @param variant The variant measured, e.g. the dispatcher
+ * @param phase The phase measured
+ * @param operations Number of operations completed
+ * @param nanos Elapsed time of the phase
+ */
+void printResult(const char *suite, const std::string &variant,
+                 const char *phase, uint64_t operations, uint64_t nanos);
+
+/***
+ * Prints the header matching printResult()
+ */
+void printResultHeader(void);
+
+/***
+ * Prints the latency percentiles of one phase, in the columns of
+ * printResult()
+ *
+ * @param nanos The latency of each operation. Sorted in place
+ */
+void printLatencies(const char *suite, const std::string &variant,
+                    const char *phase, std::vector<uint64_t> *nanos);
+
+/***
+ * Creates a board file of boardSize bytes in memory, laid out as the
+ * manager does, for the suites that measure boards in-process
+ *
+ * @param keyIndexCapacity The entries of its key index, 0 for none
+ *
+ * @return the board fd, negative on error
+ */
+int createBoard(uint64_t boardSize, uint64_t keyIndexCapacity);
+
+/***
+ * Writes a channel config file for a forked manager (see
+ * ChannelConfig.h)
+ *
+ * @param vlan The manager's vlan, which names the file
+ * @param contents The sections and options
+ *
+ * @return the path of the file, empty on error
+ */
+std::string writeChannelConfig(const std::string &vlan, const char *contents);
+
+/***
+ * A smb_manager child process serving a private vlan
+ */
+class ManagerProcess {
+private:
+  // not copyable, as the child is stopped on destruction
+  ManagerProcess(const ManagerProcess &);
+  ManagerProcess &operator=(const ManagerProcess &);
+
+  pid_t m_pid;
+  std::string m_vlan;
+  std::string m_logFilePath;
+
+public:
+  ManagerProcess(void);
+
+  /***
+   * Stops the manager if still running
+   */
+  ~ManagerProcess(void);
+
+  /***
+   * Forks and execs the manager, then waits until it accepts
+   * connections
+   *
+   * @param managerPath Path to the smb_manager binary
+   * @param vlan The vlan to serve
+   * @param extraArguments Additional command line arguments
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int start(const std::string &managerPath, const std::string &vlan,
+            const std::vector<std::string> &extraArguments);
+
+  /***
+   * Stops the manager and reaps it
+   */
+  void stop(void);
+
+  /***
+   * Kills the manager with SIGKILL, as a crash would, and reaps it
+   */
+  void crash(void);
+
+  /***
+   * @return true if the manager has not exited
+   */
+  bool running(void);
+
+  const std::string &vlan(void) const;
+
+  const std::string &logFilePath(void) const;
+};
+
+/***
+ * A raw protocol client connection to the manager
+ */
+class Client {
+private:
+  // not copyable, as the connection is closed on destruction
+  Client(const Client &);
+  Client &operator=(const Client &);
+
+  int m_fd;
+
+public:
+  Client(void);
+
+  ~Client(void);
+
+  /***
+   * Connects to the manager of a vlan
+   *
+   * @param vlan The vlan
+   * @param timeoutSeconds Receive timeout, so that a wedged manager
+   * fails the run instead of hanging it
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int connect(const std::string &vlan, int timeoutSeconds);
+
+  /***
+   * Sends an already encoded request
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int send(const char *buffer, ssize_t size);
+
+  /***
+   * Sends a reader or writer subscribe request
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendSubscribe(const char *channelName, bool writer,
+                    uint32_t requestedSize);
+
+  /***
+   * Sends a reader or writer unsubscribe request
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendUnsubscribe(const char *channelName, bool writer);
+
+  /***
+   * Sends a batch subscribe request with as many of the channel names
+   * as fit in one message
+   *
+   * @param numSent Set to the number of channel names sent
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendBatchSubscribe(const char *const *channelNames, size_t count,
+                         bool writer, uint32_t requestedSize,
+                         size_t *numSent);
+
+  /***
+   * Sends a batch unsubscribe request with as many of the channel names
+   * as fit in one message
+   *
+   * @param numSent Set to the number of channel names sent
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendBatchUnsubscribe(const char *const *channelNames, size_t count,
+                           bool writer, size_t *numSent);
+
+  /***
+   * Sends a reader progress report
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendReaderProgress(const char *channelName, uint64_t sequence,
+                         uint64_t position);
+
+  /***
+   * Sends a resize request
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendResize(const char *channelName, uint32_t requestedSize);
+
+  /***
+   * Tells the manager the writer moved to the resized board
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendBoardSwitched(const char *channelName, uint64_t sequence);
+
+  /***
+   * Sends an event mode request
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendEventMode(void);
+
+  /***
+   * Receives one message
+   *
+   * @param buffer Where to place the message
+   * @param size Size of buffer
+   *
+   * @return the message size, negative on error
+   */
+  ssize_t receive(char *buffer, size_t size);
+
+  /***
+   * Receives messages until one of a type arrives, skipping the others
+   *
+   * @param type The ManagerProtocol::MessageType or Protocol message type
+   * @param buffer Where to place the message
+   * @param size Size of buffer
+   * @param fd If not 0, set to the descriptor passed with the message,
+   * negative if there is none. Those passed with skipped messages are
+   * closed
+   *
+   * @return the message size, negative on error or timeout
+   */
+  ssize_t receiveMessage(uint8_t type, char *buffer, size_t size,
+                         int *fd = 0);
+
+  /***
+   * @return whether a message is waiting to be received
+   */
+  bool pending(void);
+
+  /***
+   * Receives messages until an approval or denial arrives, skipping
+   * events
+   *
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int receiveApproval(void);
+
+  /***
+   * Receives messages until a batch reply or a denial arrives, skipping
+   * events
+   *
+   * @param approved Set to the approval flag of each channel
+   *
+   * @return the number of fds to follow, negative on denial or error
+   */
+  int receiveBatchReply(std::vector<uint8_t> *approved);
+
+  /***
+   * Receives the fds following a batch reply
+   *
+   * @param fds Where to place them
+   * @param count The number of fds announced by the reply
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int receiveFds(int *fds, size_t count);
+
+  /***
+   * Receives a descriptor passed with SCM_RIGHTS
+   *
+   * @return the descriptor, negative on error
+   */
+  int receiveFd(void);
+
+  void close(void);
+
+  int fileDescriptor(void) const;
+};
+
+// inline functions
+inline ManagerProcess::ManagerProcess(void)
+    : m_pid(-1), m_vlan(), m_logFilePath() {}
+
+inline ManagerProcess::~ManagerProcess(void) { stop(); }
+
+inline const std::string &ManagerProcess::vlan(void) const { return m_vlan; }
+
+inline const std::string &ManagerProcess::logFilePath(void) const {
+  return m_logFilePath;
+}
+
+inline Client::Client(void) : m_fd(-1) {}
+
+inline Client::~Client(void) { close(); }
+
+inline int Client::fileDescriptor(void) const { return m_fd; }
+} // namespace BenchUtil
+
+#endif // SMB_BENCH_BENCHUTIL_H_
@@ -0,0 +1,271 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "churn";
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint64_t DEFAULT_CHANNELS = 1000;
+const uint64_t NUM_OPERATIONS = 100000;
+// requests in flight at any time, each on a different client, so that
+// the manager serves a steady load rather than one round trip at a time
+const size_t MAX_IN_FLIGHT = 64;
+// one operation in RECONNECT_ONE_IN drops a connection and opens a new
+// one, leaving any subscription to the manager's disconnect cleanup
+const uint64_t RECONNECT_ONE_IN = 10;
+
+/***
+ * What a client is doing
+ *
+ * @var CONNECT Opening a new connection, until event mode is approved
+ * @var SUBSCRIBE Joining a channel as a reader, until its board fd
+ * arrives
+ * @var UNSUBSCRIBE Leaving its channel
+ */
+enum Operation { CONNECT, SUBSCRIBE, UNSUBSCRIBE, NUM_OPERATIONS_KINDS };
+
+const char *const PHASE_NAMES[NUM_OPERATIONS_KINDS] = {
+    "connect", "subscribe", "unsubscribe"};
+
+/***
+ * A synthetic client
+ *
+ * @var ChurnClient::m_client Its connection
+ * @var ChurnClient::m_channel The channel it reads, negative if none
+ * @var ChurnClient::m_operation The operation in flight
+ * @var ChurnClient::m_start When the operation was sent
+ * @var ChurnClient::m_busy Whether an operation is in flight
+ */
+struct ChurnClient {
+  BenchUtil::Client m_client;
+  int64_t m_channel;
+  Operation m_operation;
+  uint64_t m_start;
+  bool m_busy;
+};
+
+/***
+ * Sends an operation's request
+ *
+ * @return 0 on success, non-zero on error
+ */
+int startOperation(ChurnClient *client, Operation operation,
+                   const std::string &vlan,
+                   const std::vector<std::string> &channelNames,
+                   uint64_t channel) {
+  client->m_operation = operation;
+  client->m_start = BenchUtil::nowNanos();
+  client->m_busy = true;
+
+  switch (operation) {
+  case CONNECT:
+    client->m_channel = -1;
+    return ((0 != client->m_client.connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+            (0 != client->m_client.sendEventMode()))
+               ? (-1)
+               : (0);
+
+  case SUBSCRIBE:
+    client->m_channel = channel;
+    return client->m_client.sendSubscribe(channelNames[channel].c_str(),
+                                          false, 0);
+
+  default:
+    return client->m_client.sendUnsubscribe(
+        channelNames[client->m_channel].c_str(), false);
+  }
+}
+
+/***
+ * Receives an operation's reply, once the client's socket is readable
+ *
+ * @return 0 on success, non-zero on error
+ */
+int finishOperation(ChurnClient *client) {
+  client->m_busy = false;
+
+  if (0 != client->m_client.receiveApproval()) {
+    return -1;
+  }
+
+  if (SUBSCRIBE == client->m_operation) {
+    int boardFd = client->m_client.receiveFd();
+    if (0 > boardFd) {
+      return -1;
+    }
+    ::close(boardFd);
+  } else if (UNSUBSCRIBE == client->m_operation) {
+    client->m_channel = -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Runs the churn suite against one dispatcher
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runDispatcher(const BenchOptions &options, const std::string &dispatcher) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  ManagerProcess manager;
+  uint64_t numChannels =
+      (0 == options.m_channels) ? (DEFAULT_CHANNELS) : (options.m_channels);
+  const size_t maxInFlight = (MAX_IN_FLIGHT < options.m_clients)
+                                 ? (MAX_IN_FLIGHT)
+                                 : (options.m_clients);
+  // a fixed seed, so that runs compare
+  std::mt19937_64 random(42);
+  std::vector<uint64_t> latencies[NUM_OPERATIONS_KINDS];
+  std::vector<size_t> inFlight;
+  std::vector<struct pollfd> pollFds;
+  uint64_t numIssued = 0;
+  uint64_t numCompleted = 0;
+  uint64_t start;
+  uint64_t i = 0;
+
+  vlan << "smb_bench." << ::getpid() << ".churn." << dispatcher;
+  arguments.push_back("--dispatcher");
+  arguments.push_back(dispatcher);
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    return -1;
+  }
+
+  std::vector<ChurnClient> clients(options.m_clients);
+  std::vector<std::string> channelNames(numChannels);
+  for (i = 0; i < numChannels; i++) {
+    std::ostringstream channelName;
+    channelName << "smbcast://churn." << i;
+    channelNames[i] = channelName.str();
+  }
+
+  // (1) connect everybody, so that the manager serves the churn with its
+  // full client population
+  for (i = 0; i < options.m_clients; i++) {
+    if ((0 != startOperation(&clients[i], CONNECT, manager.vlan(),
+                             channelNames, 0)) ||
+        (0 != finishOperation(&clients[i]))) {
+      goto CONNECT_ERROR;
+    }
+  }
+
+  // (2) churn: random clients reconnect, or toggle a subscription to a
+  // random channel, with up to maxInFlight requests outstanding. Each
+  // operation is timed from its request to the arrival of its reply
+  for (uint64_t kind = 0; kind < NUM_OPERATIONS_KINDS; kind++) {
+    latencies[kind].reserve(NUM_OPERATIONS);
+  }
+  start = nowNanos();
+  while (numCompleted < NUM_OPERATIONS) {
+    while ((inFlight.size() < maxInFlight) &&
+           (numIssued < NUM_OPERATIONS)) {
+      i = random() % options.m_clients;
+      if (clients[i].m_busy) {
+        continue;
+      }
+
+      Operation operation;
+      if (0 == random() % RECONNECT_ONE_IN) {
+        operation = CONNECT;
+      } else if (0 > clients[i].m_channel) {
+        operation = SUBSCRIBE;
+      } else {
+        operation = UNSUBSCRIBE;
+      }
+      if (0 != startOperation(&clients[i], operation, manager.vlan(),
+                              channelNames, random() % numChannels)) {
+        goto CHURN_ERROR;
+      }
+      inFlight.push_back(i);
+      numIssued++;
+    }
+
+    pollFds.resize(inFlight.size());
+    for (size_t j = 0; j < inFlight.size(); j++) {
+      pollFds[j].fd = clients[inFlight[j]].m_client.fileDescriptor();
+      pollFds[j].events = POLLIN;
+      pollFds[j].revents = 0;
+    }
+    if (0 >= ::poll(&pollFds[0], pollFds.size(),
+                    CLIENT_TIMEOUT_SECONDS * 1000)) {
+      i = inFlight[0];
+      goto CHURN_ERROR;
+    }
+
+    // backwards, so that removing an entry does not move the entries
+    // still to be looked at
+    for (size_t j = pollFds.size(); 0 < j--;) {
+      if (0 == pollFds[j].revents) {
+        continue;
+      }
+
+      i = inFlight[j];
+      if (0 != finishOperation(&clients[i])) {
+        goto CHURN_ERROR;
+      }
+      latencies[clients[i].m_operation].push_back(nowNanos() -
+                                                  clients[i].m_start);
+      numCompleted++;
+
+      inFlight[j] = inFlight.back();
+      inFlight.pop_back();
+    }
+  }
+  printResult(SUITE_NAME, dispatcher, "churn", NUM_OPERATIONS,
+              nowNanos() - start);
+  for (uint64_t kind = 0; kind < NUM_OPERATIONS_KINDS; kind++) {
+    printLatencies(SUITE_NAME, dispatcher, PHASE_NAMES[kind],
+                   &(latencies[kind]));
+  }
+
+  return 0;
+
+CHURN_ERROR:
+  std::cout << SUITE_NAME << ": " << dispatcher << " dispatcher failed "
+            << PHASE_NAMES[clients[i].m_operation] << " of client " << i
+            << " after " << numCompleted << " operations"
+            << (manager.running() ? ("") : (" (manager exited)")) << ", see "
+            << manager.logFilePath() << std::endl;
+  return -1;
+
+CONNECT_ERROR:
+  std::cout << SUITE_NAME << ": " << dispatcher
+            << " dispatcher failed at client " << i << " of "
+            << options.m_clients
+            << (manager.running() ? ("") : (" (manager exited)")) << ", see "
+            << manager.logFilePath() << std::endl;
+  return -1;
+}
+} // namespace
+
+int runChurnBench(const BenchOptions &options) {
+  int retVal = 0;
+
+  // one socket per client. Board fds are closed as they arrive
+  uint64_t limit = BenchUtil::raiseOpenFileLimit(options.m_clients + 64);
+  if (limit < options.m_clients + 64) {
+    std::cerr << "Warning: open file limit is " << limit
+              << ", too low for " << options.m_clients << " clients"
+              << std::endl;
+  }
+
+  for (size_t i = 0; i < options.m_dispatchers.size(); i++) {
+    if (0 != runDispatcher(options, options.m_dispatchers[i])) {
+      retVal = -1;
+    }
+  }
+
+  return retVal;
+}
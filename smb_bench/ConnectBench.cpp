@@ -0,0 +1,133 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "connect";
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint64_t DEFAULT_CHANNELS = 100;
+
+/***
+ * Runs the connect suite against one dispatcher
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runDispatcher(const BenchOptions &options, const std::string &dispatcher) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  ManagerProcess manager;
+  uint64_t numChannels =
+      (0 == options.m_channels) ? (DEFAULT_CHANNELS) : (options.m_channels);
+  uint64_t start;
+  uint64_t i;
+
+  vlan << "smb_bench." << ::getpid() << "." << dispatcher;
+  arguments.push_back("--dispatcher");
+  arguments.push_back(dispatcher);
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    return -1;
+  }
+
+  std::vector<Client> clients(options.m_clients);
+  std::vector<std::string> channelNames(numChannels);
+  for (i = 0; i < numChannels; i++) {
+    std::ostringstream channelName;
+    channelName << "smbcast://bench." << i;
+    channelNames[i] = channelName.str();
+  }
+
+  // (1) accept: connect everybody, then wait for every client to be
+  // serviced once
+  start = nowNanos();
+  for (i = 0; i < options.m_clients; i++) {
+    if ((0 != clients[i].connect(manager.vlan(), CLIENT_TIMEOUT_SECONDS)) ||
+        (0 != clients[i].sendEventMode())) {
+      goto CONNECT_ERROR;
+    }
+  }
+  for (i = 0; i < options.m_clients; i++) {
+    if (0 != clients[i].receiveApproval()) {
+      goto CONNECT_ERROR;
+    }
+  }
+  printResult(SUITE_NAME, dispatcher, "accept", options.m_clients,
+              nowNanos() - start);
+
+  // (2) subscribe: every client joins one channel as a reader and
+  // receives the board fd
+  start = nowNanos();
+  for (i = 0; i < options.m_clients; i++) {
+    if (0 != clients[i].sendSubscribe(
+                 channelNames[i % numChannels].c_str(), false, 0)) {
+      goto SUBSCRIBE_ERROR;
+    }
+  }
+  for (i = 0; i < options.m_clients; i++) {
+    int boardFd;
+    if ((0 != clients[i].receiveApproval()) ||
+        (0 > (boardFd = clients[i].receiveFd()))) {
+      goto SUBSCRIBE_ERROR;
+    }
+    ::close(boardFd);
+  }
+  printResult(SUITE_NAME, dispatcher, "subscribe", options.m_clients,
+              nowNanos() - start);
+
+  // (3) unsubscribe
+  start = nowNanos();
+  for (i = 0; i < options.m_clients; i++) {
+    if (0 != clients[i].sendUnsubscribe(
+                 channelNames[i % numChannels].c_str(), false)) {
+      goto UNSUBSCRIBE_ERROR;
+    }
+  }
+  for (i = 0; i < options.m_clients; i++) {
+    if (0 != clients[i].receiveApproval()) {
+      goto UNSUBSCRIBE_ERROR;
+    }
+  }
+  printResult(SUITE_NAME, dispatcher, "unsubscribe", options.m_clients,
+              nowNanos() - start);
+
+  return 0;
+
+UNSUBSCRIBE_ERROR:
+SUBSCRIBE_ERROR:
+CONNECT_ERROR:
+  std::cout << SUITE_NAME << ": " << dispatcher
+            << " dispatcher failed at client " << i << " of "
+            << options.m_clients
+            << (manager.running() ? ("") : (" (manager exited)")) << ", see "
+            << manager.logFilePath() << std::endl;
+  return -1;
+}
+} // namespace
+
+int runConnectBench(const BenchOptions &options) {
+  int retVal = 0;
+
+  // one socket per client. Board fds are closed as they arrive
+  uint64_t limit = BenchUtil::raiseOpenFileLimit(options.m_clients + 64);
+  if (limit < options.m_clients + 64) {
+    std::cerr << "Warning: open file limit is " << limit
+              << ", too low for " << options.m_clients << " clients"
+              << std::endl;
+  }
+
+  for (size_t i = 0; i < options.m_dispatchers.size(); i++) {
+    if (0 != runDispatcher(options, options.m_dispatchers[i])) {
+      retVal = -1;
+    }
+  }
+
+  return retVal;
+}
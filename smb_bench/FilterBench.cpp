@@ -0,0 +1,151 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "filter";
+// larger than the caches, so that the readers measure memory traffic
+const uint64_t BOARD_SIZE = 64 << 20;
+const uint64_t NUM_SYMBOLS = 500;
+const uint32_t PAYLOAD_SIZE = 64;
+// the board holds every datagram of a run, so that nothing is lapped
+const uint64_t NUM_DATAGRAMS =
+    (BOARD_SIZE / ((PAYLOAD_SIZE + sizeof(uint32_t) + 7) & ~7ULL)) - 1;
+const size_t INTEREST_SIZES[] = {1, 5, 50};
+const size_t NUM_INTEREST_SIZES =
+    sizeof(INTEREST_SIZES) / sizeof(INTEREST_SIZES[0]);
+
+/***
+ * Reads every datagram and keeps those whose symbol, the payload's first
+ * word, is of interest, as a reader of a channel without an index must
+ *
+ * @return the datagrams kept
+ */
+uint64_t readAll(BoardRing *ring, const std::vector<uint32_t> &interest) {
+  const char *datagram;
+  uint32_t size;
+  uint64_t kept = 0;
+
+  ring->rewind();
+  while (0 == ring->peek(&datagram, &size)) {
+    uint32_t symbol;
+
+    ::memcpy(&symbol, datagram, sizeof(symbol));
+    for (size_t i = 0; i < interest.size(); i++) {
+      if (interest[i] == symbol) {
+        kept++;
+        break;
+      }
+    }
+    ring->consume(size);
+  }
+
+  return kept;
+}
+
+/***
+ * Reads the datagrams of interest through the key index. Their symbol
+ * is checked all the same, so that a datagram the index got wrong shows
+ *
+ * @return the datagrams kept
+ */
+uint64_t readKeyed(BoardRing *ring, const std::vector<uint32_t> &interest) {
+  const char *datagram;
+  uint32_t size;
+  uint64_t kept = 0;
+
+  ring->rewind();
+  while (0 == ring->peekKeyed(&interest[0], interest.size(), &datagram,
+                              &size)) {
+    uint32_t symbol;
+
+    ::memcpy(&symbol, datagram, sizeof(symbol));
+    for (size_t i = 0; i < interest.size(); i++) {
+      if (interest[i] == symbol) {
+        kept++;
+        break;
+      }
+    }
+    ring->consume(size);
+  }
+
+  return kept;
+}
+} // namespace
+
+int runFilterBench(const BenchOptions &) {
+  BoardRing writer;
+  BoardRing reader;
+  char payload[PAYLOAD_SIZE];
+  int boardFd;
+  int retVal = 0;
+
+  boardFd = BenchUtil::createBoard(BOARD_SIZE,
+                                   KeyIndex::capacityFor(NUM_DATAGRAMS));
+  if ((0 > boardFd) || (0 != writer.map(boardFd, true)) ||
+      (0 != reader.map(boardFd, false)) || (!reader.keyed())) {
+    std::cout << SUITE_NAME << ": could not create the board" << std::endl;
+    if (0 <= boardFd) {
+      ::close(boardFd);
+    }
+    return -1;
+  }
+  ::close(boardFd);
+
+  ::memset(payload, 0, sizeof(payload));
+  for (uint64_t i = 0; i < NUM_DATAGRAMS; i++) {
+    const uint32_t symbol = static_cast<uint32_t>(i % NUM_SYMBOLS);
+
+    ::memcpy(payload, &symbol, sizeof(symbol));
+    writer.write(payload, sizeof(payload), symbol);
+  }
+
+  for (size_t i = 0; i < NUM_INTEREST_SIZES; i++) {
+    std::vector<uint32_t> interest;
+    std::ostringstream phase;
+    uint64_t start;
+    uint64_t allNanos;
+    uint64_t keyedNanos;
+    uint64_t allKept;
+    uint64_t keyedKept;
+
+    // spread over the symbols, as a strategy's would be
+    for (size_t j = 0; j < INTEREST_SIZES[i]; j++) {
+      interest.push_back(
+          static_cast<uint32_t>((j * NUM_SYMBOLS) / INTEREST_SIZES[i]));
+    }
+    phase << INTEREST_SIZES[i] << " of " << NUM_SYMBOLS << " keys";
+
+    start = BenchUtil::nowNanos();
+    allKept = readAll(&reader, interest);
+    allNanos = BenchUtil::nowNanos() - start;
+
+    start = BenchUtil::nowNanos();
+    keyedKept = readKeyed(&reader, interest);
+    keyedNanos = BenchUtil::nowNanos() - start;
+
+    BenchUtil::printResult(SUITE_NAME, "full scan", phase.str().c_str(),
+                           NUM_DATAGRAMS, allNanos);
+    BenchUtil::printResult(SUITE_NAME, "key index", phase.str().c_str(),
+                           NUM_DATAGRAMS, keyedNanos);
+    if (allKept != keyedKept) {
+      std::cout << SUITE_NAME << ": with " << phase.str()
+                << ", the full scan kept " << allKept
+                << " datagrams and the key index " << keyedKept
+                << std::endl;
+      retVal = -1;
+    }
+  }
+
+  return retVal;
+}
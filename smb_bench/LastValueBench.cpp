@@ -0,0 +1,347 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+#include <smb_manager/ManagerProtocol.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "lastvalue";
+const char *const CHANNEL_CONFIG = "[smbcast://bench.last.*]\n"
+                                   "last_value_keys = 64\n"
+                                   "last_value_size = 64\n";
+const uint32_t NUM_KEYS = 64;
+const uint32_t VALUE_SIZE = 64;
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint32_t BOARD_SIZE = 64 << 10;
+const uint32_t NEW_BOARD_SIZE = 256 << 10;
+const uint64_t ROUNDS = 100;
+
+/***
+ * Connects an Event Mode client, if it is not connected yet, and
+ * subscribes it to a channel
+ *
+ * @param boardFd Set to the board fd
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(BenchUtil::Client *client, const std::string &vlan,
+              const std::string &channelName, bool writer, int *boardFd) {
+  if ((0 > client->fileDescriptor()) &&
+      ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+       (0 != client->sendEventMode()) ||
+       (0 != client->receiveApproval()))) {
+    return -1;
+  }
+
+  if ((0 != client->sendSubscribe(channelName.c_str(), writer,
+                                  (writer) ? (BOARD_SIZE) : (0))) ||
+      (0 != client->receiveApproval()) ||
+      (0 > (*boardFd = client->receiveFd()))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Subscribes a client to a channel and maps its board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(BenchUtil::Client *client, const std::string &vlan,
+              const std::string &channelName, bool writer, BoardRing *ring) {
+  int boardFd;
+
+  if (0 != subscribe(client, vlan, channelName, writer, &boardFd)) {
+    return -1;
+  }
+  if (0 != ring->map(boardFd, writer)) {
+    ::close(boardFd);
+    return -1;
+  }
+  ::close(boardFd);
+
+  return 0;
+}
+
+/***
+ * @return the value of a key in a round
+ */
+std::string value(uint32_t key, uint64_t round) {
+  std::ostringstream text;
+
+  text << "key " << key << " round " << round;
+  return text.str();
+}
+
+/***
+ * Writes the value of every key for a round
+ *
+ * @return 0 on success, non-zero on error
+ */
+int writeValues(BoardRing *ring, uint64_t round) {
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    const std::string text = value(key, round);
+    if (0 != ring->writeLastValue(text.c_str(), text.size(), key)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Reads the value of every key back, which must be that of the round
+ * given for the key
+ *
+ * @param rounds The round of each key
+ *
+ * @return 0 if all match, non-zero if not
+ */
+int readValues(const BoardRing &ring, const std::vector<uint64_t> &rounds) {
+  char buffer[VALUE_SIZE];
+  uint64_t position;
+  uint32_t size;
+
+  if (NUM_KEYS != ring.lastValueKeys()) {
+    return -1;
+  }
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    const std::string text = value(key, rounds[key]);
+    if ((0 != ring.lastValue(key, buffer, &size, &position)) ||
+        (text.size() != size) || (0 != ::memcmp(buffer, text.c_str(), size))) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Receives the BoardResized event of a client
+ *
+ * @param fd Set to the new board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int receiveResized(BenchUtil::Client *client, int *fd) {
+  char buffer[ManagerProtocol::MAX_MESSAGE_SIZE];
+  ssize_t size;
+
+  size = client->receiveMessage(ManagerProtocol::BOARD_RESIZED, buffer,
+                                sizeof(buffer), fd);
+  if (!ManagerProtocol::isMessage(
+          buffer, size, ManagerProtocol::BOARD_RESIZED,
+          offsetof(ManagerProtocol::BoardResized, m_channelName) + 1)) {
+    if ((0 <= size) && (0 <= *fd)) {
+      ::close(*fd);
+    }
+    return -1;
+  }
+
+  return (0 > *fd) ? (-1) : (0);
+}
+
+/***
+ * Lets a reader join a channel whose writer updated every key each
+ * round, and times how long it takes to copy the values, which must be
+ * those of the last round
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runJoin(const std::string &vlan) {
+  using namespace BenchUtil;
+
+  const std::string channelName = "smbcast://bench.last.join";
+  std::vector<uint64_t> latencies;
+  std::vector<uint64_t> rounds(NUM_KEYS);
+  Client writer;
+  BoardRing writerRing;
+
+  if (0 != subscribe(&writer, vlan, channelName, true, &writerRing)) {
+    std::cout << SUITE_NAME << ": join: writer subscribe" << std::endl;
+    return -1;
+  }
+
+  for (uint64_t round = 0; round < ROUNDS; round++) {
+    Client reader;
+    BoardRing ring;
+    uint64_t start;
+
+    rounds.assign(NUM_KEYS, round);
+    if ((0 != writeValues(&writerRing, round)) ||
+        (0 != subscribe(&reader, vlan, channelName, false, &ring))) {
+      std::cout << SUITE_NAME << ": join: subscribe in round " << round
+                << std::endl;
+      return -1;
+    }
+
+    start = nowNanos();
+    if (0 != readValues(ring, rounds)) {
+      std::cout << SUITE_NAME << ": join: wrong values in round " << round
+                << std::endl;
+      return -1;
+    }
+    latencies.push_back(nowNanos() - start);
+  }
+
+  printLatencies(SUITE_NAME, "64 keys", "join", &latencies);
+  return 0;
+}
+
+/***
+ * Checks that the values of a resized channel are found on its new
+ * board: carried over by a writer that moves, which then updates one of
+ * them, or by the manager for a channel whose writer left
+ *
+ * @param writerMoves Whether the writer moves, or leaves before the
+ * resize
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runResize(BenchUtil::Client *admin, const std::string &vlan,
+              bool writerMoves) {
+  using namespace BenchUtil;
+
+  const std::string channelName = (writerMoves)
+                                      ? ("smbcast://bench.last.moved")
+                                      : ("smbcast://bench.last.left");
+  const char *variant = (writerMoves) ? ("writer moves") : ("writer left");
+  std::vector<uint64_t> rounds(NUM_KEYS, 0);
+  const char *failure;
+  Client writer;
+  Client reader;
+  Client lateReader;
+  BoardRing writerRing;
+  BoardRing readerRing;
+  BoardRing ring;
+  int boardFd;
+
+  failure = "subscribe";
+  if ((0 != subscribe(&writer, vlan, channelName, true, &writerRing)) ||
+      (0 != subscribe(&reader, vlan, channelName, false, &readerRing)) ||
+      (0 != writeValues(&writerRing, 0))) {
+    goto FAILED;
+  }
+
+  if (writerMoves) {
+    const std::string text = value(0, 1);
+
+    failure = "writer move";
+    if ((0 != admin->sendResize(channelName.c_str(), NEW_BOARD_SIZE)) ||
+        (0 != admin->receiveApproval()) ||
+        (0 != receiveResized(&writer, &boardFd))) {
+      goto FAILED;
+    }
+    if (0 != writerRing.moveTo(boardFd)) {
+      ::close(boardFd);
+      goto FAILED;
+    }
+    ::close(boardFd);
+
+    // the first datagram on the new board updates a carried value
+    rounds[0] = 1;
+    if ((0 != writerRing.writeLastValue(text.c_str(), text.size(), 0)) ||
+        (0 != writer.sendBoardSwitched(channelName.c_str(), NUM_KEYS))) {
+      goto FAILED;
+    }
+  } else {
+    // answered, so that the manager resizes a channel without a writer
+    failure = "writer unsubscribe";
+    writerRing.unmap();
+    if ((0 != writer.sendUnsubscribe(channelName.c_str(), true)) ||
+        (0 != writer.receiveApproval())) {
+      goto FAILED;
+    }
+
+    failure = "resize";
+    if ((0 != admin->sendResize(channelName.c_str(), NEW_BOARD_SIZE)) ||
+        (0 != admin->receiveApproval())) {
+      goto FAILED;
+    }
+  }
+
+  failure = "reader move";
+  if (0 != receiveResized(&reader, &boardFd)) {
+    goto FAILED;
+  }
+  if (0 != ring.map(boardFd, false)) {
+    ::close(boardFd);
+    goto FAILED;
+  }
+  ::close(boardFd);
+
+  failure = "values on the new board";
+  if (0 != readValues(ring, rounds)) {
+    goto FAILED;
+  }
+
+  // one that joins later gets the new board straight away
+  failure = "late reader";
+  ring.unmap();
+  if ((0 != subscribe(&lateReader, vlan, channelName, false, &ring)) ||
+      (NEW_BOARD_SIZE > ring.size()) || (0 != readValues(ring, rounds))) {
+    goto FAILED;
+  }
+
+  std::cout << SUITE_NAME << ": resize, " << variant
+            << ": values found on the new board" << std::endl;
+  return 0;
+
+FAILED:
+  std::cout << SUITE_NAME << ": resize, " << variant << ": " << failure
+            << std::endl;
+  return -1;
+}
+} // namespace
+
+int runLastValueBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  std::string configPath;
+  ManagerProcess manager;
+  Client admin;
+  int retVal = 0;
+
+  vlan << "smb_bench." << ::getpid() << ".last";
+  configPath = writeChannelConfig(vlan.str(), CHANNEL_CONFIG);
+  if (configPath.empty()) {
+    return -1;
+  }
+  arguments.push_back("--channel_config");
+  arguments.push_back(configPath);
+  if (!options.m_dispatchers.empty()) {
+    arguments.push_back("--dispatcher");
+    arguments.push_back(options.m_dispatchers[0]);
+  }
+  if ((0 != manager.start(options.m_managerPath, vlan.str(), arguments)) ||
+      (0 != admin.connect(manager.vlan(), CLIENT_TIMEOUT_SECONDS)) ||
+      (0 != admin.sendEventMode()) || (0 != admin.receiveApproval())) {
+    ::unlink(configPath.c_str());
+    return -1;
+  }
+
+  if ((0 != runJoin(manager.vlan())) ||
+      (0 != runResize(&admin, manager.vlan(), true)) ||
+      (0 != runResize(&admin, manager.vlan(), false))) {
+    std::cout << SUITE_NAME << ": see " << manager.logFilePath()
+              << (manager.running() ? ("") : (" (manager exited)"))
+              << std::endl;
+    retVal = -1;
+  }
+
+  ::unlink(configPath.c_str());
+  return retVal;
+}
@@ -0,0 +1,284 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <core/link/IPCAddress.h>
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <smb_bridge/BoardRing.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "python";
+const char *const CHANNEL_NAME = "smbcast://bench.python.dump";
+const char *const CHANNEL_CONFIG = "[smbcast://bench.python.*]\n"
+                                   "last_value_keys = 16\n"
+                                   "last_value_size = 64\n";
+const uint32_t NUM_KEYS = 16;
+const uint32_t VALUE_SIZE = 64;
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint32_t BOARD_SIZE = 64 << 10;
+// written before the reader joins, so that the datagrams it reads wrap
+const uint64_t PREFILL_SIZE = 56 << 10;
+const uint32_t PREFILL_DATAGRAM_SIZE = 1000;
+const uint32_t NUM_DATAGRAMS = 40;
+const uint32_t MAX_DATAGRAM_SIZE = 1500;
+const size_t MAX_LINE_SIZE = 2 * MAX_DATAGRAM_SIZE + 64;
+
+/***
+ * @return data in lower case hex, as python's bytes.hex()
+ */
+std::string hex(const char *data, size_t size) {
+  static const char DIGITS[] = "0123456789abcdef";
+  std::string text;
+
+  for (size_t i = 0; i < size; i++) {
+    text += DIGITS[(static_cast<unsigned char>(data[i]) >> 4) & 0xF];
+    text += DIGITS[static_cast<unsigned char>(data[i]) & 0xF];
+  }
+  return text;
+}
+
+/***
+ * @return the i-th datagram the writer writes once the reader is ready,
+ * of a size and contents of its own
+ */
+std::string datagram(uint32_t i) {
+  std::string text((i * 397) % MAX_DATAGRAM_SIZE, '\0');
+
+  for (size_t j = 0; j < text.size(); j++) {
+    text[j] = static_cast<char>((i * 7 + j) & 0xFF);
+  }
+  return text;
+}
+
+/***
+ * Reads a line the python reader printed, without its newline
+ *
+ * @return 0 on success, non-zero at the end of its output
+ */
+int readLine(FILE *output, std::string *line) {
+  char buffer[MAX_LINE_SIZE];
+  size_t size;
+
+  if (0 == ::fgets(buffer, sizeof(buffer), output)) {
+    return -1;
+  }
+  size = ::strlen(buffer);
+  if ((0 < size) && ('\n' == buffer[size - 1])) {
+    buffer[--size] = '\0';
+  }
+  line->assign(buffer, size);
+  return 0;
+}
+
+/***
+ * Subscribes a client to the channel and maps its board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(BenchUtil::Client *client, const std::string &vlan, bool writer,
+              BoardRing *ring) {
+  int boardFd;
+
+  if ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+      (0 != client->sendEventMode()) || (0 != client->receiveApproval()) ||
+      (0 != client->sendSubscribe(CHANNEL_NAME, writer,
+                                  (writer) ? (BOARD_SIZE) : (0))) ||
+      (0 != client->receiveApproval()) ||
+      (0 > (boardFd = client->receiveFd()))) {
+    return -1;
+  }
+  if (0 != ring->map(boardFd, writer)) {
+    ::close(boardFd);
+    return -1;
+  }
+  ::close(boardFd);
+
+  return 0;
+}
+
+/***
+ * Writes a value for every key, then fills the board up to PREFILL_SIZE
+ *
+ * @return 0 on success, non-zero on error
+ */
+int prefill(BoardRing *ring) {
+  std::vector<char> filler(PREFILL_DATAGRAM_SIZE, 'x');
+  uint64_t written = 0;
+
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    std::ostringstream text;
+    text << "value of key " << key;
+    if (0 != ring->writeLastValue(text.str().c_str(), text.str().size(),
+                                  key)) {
+      return -1;
+    }
+    written += BoardRing::footprint(text.str().size());
+  }
+  while (written < PREFILL_SIZE) {
+    if (0 != ring->write(&filler[0], filler.size())) {
+      return -1;
+    }
+    written += BoardRing::footprint(filler.size());
+  }
+
+  return 0;
+}
+
+/***
+ * Checks the last values the python reader printed against those a
+ * BoardRing reader finds, up to its 'ready'
+ *
+ * @return 0 if they match, non-zero if not
+ */
+int checkValues(FILE *output, const BoardRing &ring) {
+  char value[VALUE_SIZE];
+  std::string line;
+  uint64_t position;
+  uint32_t size;
+
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    std::ostringstream expected;
+
+    if (0 != ring.lastValue(key, value, &size, &position)) {
+      return -1;
+    }
+    expected << "value " << key << " " << position << " " << hex(value, size);
+    if ((0 != readLine(output, &line)) || (expected.str() != line)) {
+      std::cout << SUITE_NAME << ": expected \"" << expected.str()
+                << "\", python printed \"" << line << "\"" << std::endl;
+      return -1;
+    }
+  }
+
+  if ((0 != readLine(output, &line)) || ("ready" != line)) {
+    return -1;
+  }
+  return 0;
+}
+
+/***
+ * Writes NUM_DATAGRAMS datagrams, across the end of the board, and checks
+ * those the python reader printed
+ *
+ * @return 0 if they match, non-zero if not
+ */
+int checkDatagrams(FILE *output, BoardRing *ring) {
+  std::string line;
+
+  for (uint32_t i = 0; i < NUM_DATAGRAMS; i++) {
+    const std::string text = datagram(i);
+    if (0 != ring->write(text.c_str(), text.size())) {
+      return -1;
+    }
+  }
+
+  for (uint32_t i = 0; i < NUM_DATAGRAMS; i++) {
+    const std::string text = datagram(i);
+    const std::string expected = "datagram " + hex(text.c_str(), text.size());
+    if ((0 != readLine(output, &line)) || (expected != line)) {
+      std::cout << SUITE_NAME << ": datagram " << i << " of " << text.size()
+                << " bytes: python printed \"" << line.substr(0, 80) << "\""
+                << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+} // namespace
+
+int runPythonBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::ostringstream command;
+  std::vector<std::string> arguments;
+  std::string configPath;
+  ManagerProcess manager;
+  Client writer;
+  Client reader;
+  BoardRing writerRing;
+  BoardRing readerRing;
+  const char *failure = 0;
+  FILE *output = 0;
+  int status;
+
+  vlan << "smb_bench." << ::getpid() << ".python";
+  configPath = writeChannelConfig(vlan.str(), CHANNEL_CONFIG);
+  if (configPath.empty()) {
+    return -1;
+  }
+  arguments.push_back("--channel_config");
+  arguments.push_back(configPath);
+  if (!options.m_dispatchers.empty()) {
+    arguments.push_back("--dispatcher");
+    arguments.push_back(options.m_dispatchers[0]);
+  }
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    ::unlink(configPath.c_str());
+    return -1;
+  }
+
+  const struct sockaddr_un address =
+      Protocol::getManagerIPCAddress(manager.vlan()).toSockAddrUn();
+
+  failure = "subscribe";
+  if ((0 != subscribe(&writer, manager.vlan(), true, &writerRing)) ||
+      (0 != subscribe(&reader, manager.vlan(), false, &readerRing)) ||
+      (0 != prefill(&writerRing))) {
+    goto CLEANUP;
+  }
+
+  failure = "python reader start";
+  command << "python3 '" << options.m_pythonReaderPath << "' --dump "
+          << NUM_DATAGRAMS << " --vlan '" << manager.vlan() << "' --socket '"
+          << address.sun_path << "' '" << CHANNEL_NAME << "' 2>&1";
+  output = ::popen(command.str().c_str(), "r");
+  if (0 == output) {
+    goto CLEANUP;
+  }
+
+  failure = "last values";
+  if (0 != checkValues(output, readerRing)) {
+    goto CLEANUP;
+  }
+  failure = "datagrams";
+  if (0 != checkDatagrams(output, &writerRing)) {
+    goto CLEANUP;
+  }
+  failure = 0;
+
+CLEANUP:
+  if (0 != output) {
+    status = ::pclose(output);
+    if ((0 == failure) && (!WIFEXITED(status) || (0 != WEXITSTATUS(status)))) {
+      failure = "python reader exit";
+    }
+  }
+  ::unlink(configPath.c_str());
+
+  if (0 != failure) {
+    std::cout << SUITE_NAME << ": " << failure << " failed, see "
+              << manager.logFilePath()
+              << (manager.running() ? ("") : (" (manager exited)"))
+              << std::endl;
+    return -1;
+  }
+
+  std::cout << SUITE_NAME << ": " << NUM_KEYS << " last values and "
+            << NUM_DATAGRAMS << " datagrams across the board end read back"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,330 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+#include <smb_manager/ManagerProtocol.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "recover";
+const char *const CHANNEL_NAME = "smbcast://bench.recover.board";
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint64_t EXIT_TIMEOUT_NANOS = 10000000000ULL;
+const useconds_t EXIT_POLL_MICROS = 1000;
+const uint32_t BOARD_SIZE = 1 << 20;
+const uint64_t NUM_DATAGRAMS = 100;
+
+/***
+ * @return the i-th datagram written to the channel
+ */
+std::string datagram(uint64_t i) {
+  std::ostringstream text;
+
+  text << "datagram " << i;
+  return text.str();
+}
+
+/***
+ * Connects an Event Mode client, if it is not connected yet, subscribes
+ * it to the channel and maps the board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(BenchUtil::Client *client, const std::string &vlan,
+              bool writer, BoardRing *ring) {
+  int boardFd;
+
+  if ((0 > client->fileDescriptor()) &&
+      ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+       (0 != client->sendEventMode()) ||
+       (0 != client->receiveApproval()))) {
+    return -1;
+  }
+
+  if ((0 != client->sendSubscribe(CHANNEL_NAME, writer,
+                                  (writer) ? (BOARD_SIZE) : (0))) ||
+      (0 != client->receiveApproval()) ||
+      (0 > (boardFd = client->receiveFd()))) {
+    return -1;
+  }
+  ring->unmap();
+  if (0 != ring->map(boardFd, writer)) {
+    ::close(boardFd);
+    return -1;
+  }
+  ::close(boardFd);
+
+  return 0;
+}
+
+/***
+ * Asks the manager for the size of its channels' boards, which must be
+ * that of the one channel
+ *
+ * @return 0 if it is BOARD_SIZE, non-zero if not
+ */
+int checkBoardBytes(BenchUtil::Client *client) {
+  // aligned for the summary
+  uint64_t buffer[ManagerProtocol::MAX_MESSAGE_SIZE / sizeof(uint64_t)];
+  char *bytes = reinterpret_cast<char *>(buffer);
+  ssize_t size;
+
+  if (0 != client->send(bytes, ManagerProtocol::QueryRequest::init(
+                                   bytes, sizeof(buffer), 0, ""))) {
+    return -1;
+  }
+  size = client->receiveMessage(ManagerProtocol::QUERY_SUMMARY, bytes,
+                                sizeof(buffer));
+  if (!ManagerProtocol::isMessage(bytes, size, ManagerProtocol::QUERY_SUMMARY,
+                                  sizeof(ManagerProtocol::QuerySummary))) {
+    return -1;
+  }
+
+  const ManagerProtocol::QuerySummary *summary =
+      reinterpret_cast<const ManagerProtocol::QuerySummary *>(bytes);
+  return ((1 == summary->m_numChannels) &&
+          (BOARD_SIZE == summary->m_boardBytes))
+             ? (0)
+             : (-1);
+}
+
+/***
+ * Writes datagrams from 'first' up to 'last', excluded
+ *
+ * @return 0 on success, non-zero on error
+ */
+int writeDatagrams(BoardRing *ring, uint64_t first, uint64_t last) {
+  for (uint64_t i = first; i < last; i++) {
+    const std::string text = datagram(i);
+    if (0 != ring->write(text.c_str(), text.size())) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Checks that a board is of BOARD_SIZE and holds the first count
+ * datagrams written to the channel, and no more
+ *
+ * @return 0 if it does, non-zero if not
+ */
+int checkBoard(BoardRing *ring, uint64_t count) {
+  const char *found;
+  uint32_t size;
+
+  if (BOARD_SIZE != ring->size()) {
+    return -1;
+  }
+
+  ring->rewind();
+  for (uint64_t i = 0; i < count; i++) {
+    const std::string text = datagram(i);
+    if ((0 != ring->peek(&found, &size)) || (text.size() != size) ||
+        (0 != ::memcmp(found, text.c_str(), size))) {
+      return -1;
+    }
+    ring->consume(size);
+  }
+
+  return (1 == ring->peek(&found, &size)) ? (0) : (-1);
+}
+
+/***
+ * Removes the board directory and the boards left in it
+ */
+void removeBoardDir(const std::string &boardDir) {
+  DIR *dir = ::opendir(boardDir.c_str());
+  struct dirent *entry;
+
+  if (0 == dir) {
+    return;
+  }
+  while (0 != (entry = ::readdir(dir))) {
+    if ((0 != ::strcmp(".", entry->d_name)) &&
+        (0 != ::strcmp("..", entry->d_name))) {
+      ::unlink((boardDir + "/" + entry->d_name).c_str());
+    }
+  }
+  ::closedir(dir);
+  ::rmdir(boardDir.c_str());
+}
+
+/***
+ * Crashes a manager whose channel has a writer, and checks that a
+ * manager started with --recover serves the same board: it and the
+ * readers find its size, the readers its datagrams, and the writer
+ * goes on after them
+ *
+ * @param recovered Started with --recover
+ * @param writer Set to the writer, subscribed to the recovered manager
+ * @param reader Set to a reader, subscribed to the recovered manager
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runCrash(const BenchOptions &options, const std::string &vlan,
+             std::vector<std::string> arguments,
+             BenchUtil::ManagerProcess *recovered, BenchUtil::Client *writer,
+             BoardRing *writerRing, BenchUtil::Client *reader,
+             BoardRing *readerRing) {
+  using namespace BenchUtil;
+
+  const char *failure;
+  ManagerProcess crashed;
+
+  failure = "first manager start";
+  if (0 != crashed.start(options.m_managerPath, vlan, arguments)) {
+    goto FAILED;
+  }
+  failure = "write before the crash";
+  if ((0 != subscribe(writer, vlan, true, writerRing)) ||
+      (0 != writeDatagrams(writerRing, 0, NUM_DATAGRAMS))) {
+    goto FAILED;
+  }
+
+  crashed.crash();
+  writerRing->unmap();
+  writer->close();
+
+  failure = "recovering manager start";
+  arguments.push_back("--recover");
+  if (0 != recovered->start(options.m_managerPath, vlan, arguments)) {
+    goto FAILED;
+  }
+
+  failure = "board size or datagrams after the crash";
+  if ((0 != subscribe(reader, vlan, false, readerRing)) ||
+      (0 != checkBoardBytes(reader)) ||
+      (0 != checkBoard(readerRing, NUM_DATAGRAMS))) {
+    goto FAILED;
+  }
+
+  failure = "writer after the crash";
+  if ((0 != subscribe(writer, vlan, true, writerRing)) ||
+      (0 != writeDatagrams(writerRing, NUM_DATAGRAMS, NUM_DATAGRAMS + 1)) ||
+      (0 != checkBoard(readerRing, NUM_DATAGRAMS + 1))) {
+    goto FAILED;
+  }
+
+  std::cout << SUITE_NAME << ": crash: board of " << readerRing->size()
+            << " bytes and its datagrams recovered" << std::endl;
+  return 0;
+
+FAILED:
+  std::cout << SUITE_NAME << ": crash: " << failure << std::endl;
+  return -1;
+}
+
+/***
+ * Starts a manager with --takeover next to a running one, and checks
+ * that the running one exits, and that its writer and reader go on
+ * with the replacement: the reader subscribes again to the same board,
+ * and finds what the writer writes after the takeover
+ *
+ * @param replacement Started with --takeover
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runTakeover(const BenchOptions &options, const std::string &vlan,
+                std::vector<std::string> arguments,
+                BenchUtil::ManagerProcess *running,
+                BenchUtil::ManagerProcess *replacement,
+                BoardRing *writerRing, BenchUtil::Client *reader) {
+  using namespace BenchUtil;
+
+  const char *failure;
+  BoardRing ring;
+  uint64_t deadline;
+
+  failure = "replacement start";
+  arguments.push_back("--takeover");
+  if (0 != replacement->start(options.m_managerPath, vlan, arguments)) {
+    goto FAILED;
+  }
+
+  failure = "running manager did not exit";
+  deadline = nowNanos() + EXIT_TIMEOUT_NANOS;
+  while (running->running()) {
+    if (nowNanos() >= deadline) {
+      goto FAILED;
+    }
+    ::usleep(EXIT_POLL_MICROS);
+  }
+
+  failure = "writer after the takeover";
+  if (0 != writeDatagrams(writerRing, NUM_DATAGRAMS + 1,
+                          NUM_DATAGRAMS + 2)) {
+    goto FAILED;
+  }
+
+  // the reader's connection was handed over with its subscription
+  failure = "reader after the takeover";
+  if ((0 != subscribe(reader, vlan, false, &ring)) ||
+      (0 != checkBoardBytes(reader)) ||
+      (0 != checkBoard(&ring, NUM_DATAGRAMS + 2))) {
+    goto FAILED;
+  }
+
+  std::cout << SUITE_NAME << ": takeover: clients and board handed over"
+            << std::endl;
+  return 0;
+
+FAILED:
+  std::cout << SUITE_NAME << ": takeover: " << failure << std::endl;
+  return -1;
+}
+} // namespace
+
+int runRecoverBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  std::string boardDir;
+  ManagerProcess recovered;
+  ManagerProcess replacement;
+  Client writer;
+  Client reader;
+  BoardRing writerRing;
+  BoardRing readerRing;
+  int retVal = 0;
+
+  vlan << "smb_bench." << ::getpid() << ".recover";
+  // boards must be on a tmpfs to be recovered
+  boardDir = "/dev/shm/" + vlan.str();
+  arguments.push_back("--board_dir");
+  arguments.push_back(boardDir);
+  if (!options.m_dispatchers.empty()) {
+    arguments.push_back("--dispatcher");
+    arguments.push_back(options.m_dispatchers[0]);
+  }
+
+  if ((0 != runCrash(options, vlan.str(), arguments, &recovered, &writer,
+                     &writerRing, &reader, &readerRing)) ||
+      (0 != runTakeover(options, vlan.str(), arguments, &recovered,
+                        &replacement, &writerRing, &reader))) {
+    std::cout << SUITE_NAME << ": see /tmp/smb_bench." << vlan.str()
+              << ".log" << std::endl;
+    retVal = -1;
+  }
+
+  writerRing.unmap();
+  readerRing.unmap();
+  writer.close();
+  reader.close();
+  recovered.stop();
+  replacement.stop();
+  removeBoardDir(boardDir);
+  return retVal;
+}
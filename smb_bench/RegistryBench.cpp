@@ -0,0 +1,277 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_manager/OpenHashMap.h>
+
+#include <iostream>
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+const char *const SUITE_NAME = "registry";
+const uint64_t DEFAULT_CHANNELS = 100000;
+const uint64_t NUM_CLIENTS = 1000;
+const uint64_t HASH_OPERATIONS = 1000000;
+// the list registry is quadratic, so it only gets a sample
+const uint64_t LIST_OPERATIONS = 2000;
+
+struct FakeClient {
+  uint64_t m_id;
+};
+
+/***
+ * The registry as it was: lists searched with strcmp
+ */
+namespace ListRegistry {
+struct Channel {
+  std::list<FakeClient *> m_readers;
+  const char *m_name;
+};
+
+struct Subscription {
+  const char *m_channelName;
+  bool m_writer;
+};
+
+struct Registry {
+  std::list<Channel> m_channels;
+  std::vector<std::list<Subscription>> m_subscriptions;
+};
+
+Channel *find(Registry &registry, const char *name) {
+  for (std::list<Channel>::iterator iter = registry.m_channels.begin();
+       iter != registry.m_channels.end(); iter++) {
+    if (0 == ::strcmp(name, (*iter).m_name)) {
+      return &(*iter);
+    }
+  }
+  return 0;
+}
+
+/***
+ * Toggles the reader subscription of a client, like a subscribe or
+ * unsubscribe request would
+ */
+void toggle(Registry &registry, FakeClient *client, const char *name) {
+  std::list<Subscription> &subscriptions =
+      registry.m_subscriptions[client->m_id];
+  std::list<Subscription>::iterator iter;
+  for (iter = subscriptions.begin(); iter != subscriptions.end(); iter++) {
+    if ((!(*iter).m_writer) && (0 == ::strcmp((*iter).m_channelName, name))) {
+      break;
+    }
+  }
+
+  Channel *channel = find(registry, name);
+  if (subscriptions.end() == iter) {
+    channel->m_readers.push_back(client);
+    Subscription subscription = {channel->m_name, false};
+    subscriptions.push_back(subscription);
+  } else {
+    for (std::list<FakeClient *>::iterator reader =
+             channel->m_readers.begin();
+         reader != channel->m_readers.end(); reader++) {
+      if (client == *reader) {
+        channel->m_readers.erase(reader);
+        break;
+      }
+    }
+    subscriptions.erase(iter);
+  }
+}
+} // namespace ListRegistry
+
+/***
+ * The registry as it is now: open-addressing maps keyed by the interned
+ * channel name and by pointer
+ */
+namespace HashRegistry {
+struct Channel {
+  OpenHashMap<FakeClient *, uint32_t, PointerKeyTraits<FakeClient>> m_readers;
+  uint32_t m_numReaders;
+  const char *m_name;
+};
+
+typedef OpenHashMap<Channel *, uint32_t, PointerKeyTraits<Channel>>
+    SubscriptionMap;
+
+struct Registry {
+  OpenHashMap<const char *, Channel *, StringKeyTraits> m_channels;
+  std::vector<SubscriptionMap *> m_subscriptions;
+};
+
+Channel *find(Registry &registry, const char *name) {
+  Channel **channel = registry.m_channels.find(name);
+  return (0 == channel) ? (0) : (*channel);
+}
+
+void toggle(Registry &registry, FakeClient *client, const char *name) {
+  SubscriptionMap &subscriptions = *(registry.m_subscriptions[client->m_id]);
+  Channel *channel = find(registry, name);
+
+  if (0 == subscriptions.find(channel)) {
+    channel->m_readers.insert(client, 1);
+    channel->m_numReaders++;
+    subscriptions.insert(channel, 1);
+  } else {
+    channel->m_readers.erase(client);
+    channel->m_numReaders--;
+    subscriptions.erase(channel);
+  }
+}
+} // namespace HashRegistry
+
+/***
+ * Random (channel, client) pairs, with the channel names copied so that
+ * lookups compare contents rather than pointers
+ */
+struct Workload {
+  std::vector<std::string> m_names;
+  std::vector<std::string> m_queries;
+  std::vector<uint32_t> m_channelIndexes;
+  std::vector<uint32_t> m_clientIndexes;
+};
+
+void makeWorkload(Workload *workload, uint64_t numChannels,
+                  uint64_t numOperations) {
+  std::mt19937_64 random(42);
+
+  workload->m_names.resize(numChannels);
+  for (uint64_t i = 0; i < numChannels; i++) {
+    std::ostringstream name;
+    name << "smbcast://md.binance." << i;
+    workload->m_names[i] = name.str();
+  }
+
+  workload->m_queries.resize(numOperations);
+  workload->m_channelIndexes.resize(numOperations);
+  workload->m_clientIndexes.resize(numOperations);
+  for (uint64_t i = 0; i < numOperations; i++) {
+    workload->m_channelIndexes[i] = random() % numChannels;
+    workload->m_clientIndexes[i] = random() % NUM_CLIENTS;
+    workload->m_queries[i] = workload->m_names[workload->m_channelIndexes[i]];
+  }
+}
+
+void runList(const Workload &workload, std::vector<FakeClient> &clients) {
+  using namespace BenchUtil;
+  ListRegistry::Registry registry;
+  uint64_t numOperations = LIST_OPERATIONS;
+  uint64_t start;
+  uint64_t found = 0;
+
+  if (numOperations > workload.m_queries.size()) {
+    numOperations = workload.m_queries.size();
+  }
+
+  // creation is a failed search plus an append per channel, so only a
+  // sample of the searches is timed
+  for (uint64_t i = 0; i < workload.m_names.size(); i++) {
+    ListRegistry::Channel channel;
+    channel.m_name = workload.m_names[i].c_str();
+    registry.m_channels.push_back(channel);
+  }
+  registry.m_subscriptions.resize(NUM_CLIENTS);
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < numOperations; i++) {
+    found += (0 == ListRegistry::find(registry, "smbcast://md.missing"));
+  }
+  printResult(SUITE_NAME, "std::list", "create", numOperations,
+              nowNanos() - start);
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < numOperations; i++) {
+    found +=
+        (0 != ListRegistry::find(registry, workload.m_queries[i].c_str()));
+  }
+  printResult(SUITE_NAME, "std::list", "lookup", numOperations,
+              nowNanos() - start);
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < numOperations; i++) {
+    ListRegistry::toggle(registry, &clients[workload.m_clientIndexes[i]],
+                         workload.m_queries[i].c_str());
+  }
+  printResult(SUITE_NAME, "std::list", "churn", numOperations,
+              nowNanos() - start);
+
+  if (found != (2 * numOperations)) {
+    std::cerr << SUITE_NAME << ": std::list lookups missed" << std::endl;
+  }
+}
+
+void runHash(const Workload &workload, std::vector<FakeClient> &clients) {
+  using namespace BenchUtil;
+  HashRegistry::Registry registry;
+  uint64_t numOperations = workload.m_queries.size();
+  uint64_t start;
+  uint64_t found = 0;
+
+  registry.m_subscriptions.resize(NUM_CLIENTS);
+  for (uint64_t i = 0; i < NUM_CLIENTS; i++) {
+    registry.m_subscriptions[i] = new HashRegistry::SubscriptionMap();
+  }
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < workload.m_names.size(); i++) {
+    HashRegistry::Channel *channel = new HashRegistry::Channel();
+    channel->m_name = workload.m_names[i].c_str();
+    channel->m_numReaders = 0;
+    if (0 == HashRegistry::find(registry, channel->m_name)) {
+      registry.m_channels.insert(channel->m_name, channel);
+    }
+  }
+  printResult(SUITE_NAME, "open-hash", "create", workload.m_names.size(),
+              nowNanos() - start);
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < numOperations; i++) {
+    found +=
+        (0 != HashRegistry::find(registry, workload.m_queries[i].c_str()));
+  }
+  printResult(SUITE_NAME, "open-hash", "lookup", numOperations,
+              nowNanos() - start);
+
+  start = nowNanos();
+  for (uint64_t i = 0; i < numOperations; i++) {
+    HashRegistry::toggle(registry, &clients[workload.m_clientIndexes[i]],
+                         workload.m_queries[i].c_str());
+  }
+  printResult(SUITE_NAME, "open-hash", "churn", numOperations,
+              nowNanos() - start);
+
+  if (found != numOperations) {
+    std::cerr << SUITE_NAME << ": open-hash lookups missed" << std::endl;
+  }
+
+  registry.m_channels.forEach(
+      [](const char *name, HashRegistry::Channel *channel) { delete channel; });
+  for (uint64_t i = 0; i < NUM_CLIENTS; i++) {
+    delete registry.m_subscriptions[i];
+  }
+}
+} // namespace
+
+int runRegistryBench(const BenchOptions &options) {
+  uint64_t numChannels =
+      (0 == options.m_channels) ? (DEFAULT_CHANNELS) : (options.m_channels);
+  std::vector<FakeClient> clients(NUM_CLIENTS);
+  Workload workload;
+
+  for (uint64_t i = 0; i < NUM_CLIENTS; i++) {
+    clients[i].m_id = i;
+  }
+  makeWorkload(&workload, numChannels, HASH_OPERATIONS);
+
+  runHash(workload, clients);
+  runList(workload, clients);
+
+  return 0;
+}
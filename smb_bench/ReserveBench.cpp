@@ -0,0 +1,171 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "reserve";
+const uint64_t BOARD_SIZE = 64 << 20;
+const uint32_t SNAPSHOT_SIZES[] = {1 << 10, 8 << 10, 16 << 10, 30 << 10};
+const size_t NUM_SNAPSHOT_SIZES =
+    sizeof(SNAPSHOT_SIZES) / sizeof(SNAPSHOT_SIZES[0]);
+// bytes written per variant, so that every size wraps the board often
+const uint64_t BYTES_PER_VARIANT = 4ULL << 30;
+
+/***
+ * A level of the depth snapshots the writers build
+ */
+struct Level {
+  int64_t m_price;
+  int64_t m_quantity;
+  uint32_t m_orders;
+  uint32_t m_flags;
+};
+
+/***
+ * Builds a depth snapshot level by level, as a writer does from its book
+ */
+void buildSnapshot(char *target, uint32_t size, uint64_t number) {
+  const uint32_t numLevels = size / sizeof(Level);
+
+  for (uint32_t i = 0; i < numLevels; i++) {
+    Level level;
+
+    level.m_price = static_cast<int64_t>(number + i);
+    level.m_quantity = static_cast<int64_t>(number ^ i);
+    level.m_orders = i;
+    level.m_flags = 0;
+    ::memcpy(target + (i * sizeof(Level)), &level, sizeof(level));
+  }
+}
+
+/***
+ * Builds each snapshot in a buffer and copies it in with write()
+ *
+ * @return 0 on success, non-zero if a write failed
+ */
+int writeCopied(BoardRing *ring, uint32_t size, uint64_t first,
+                uint64_t numSnapshots) {
+  std::vector<char> buffer(size);
+
+  for (uint64_t i = first; i < first + numSnapshots; i++) {
+    buildSnapshot(&buffer[0], size, i);
+    if (0 != ring->write(&buffer[0], size)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Builds each snapshot in the ring with reserveSpan() and commit()
+ *
+ * @return 0 on success, non-zero if a reservation failed
+ */
+int writeReserved(BoardRing *ring, uint32_t size, uint64_t first,
+                  uint64_t numSnapshots) {
+  for (uint64_t i = first; i < first + numSnapshots; i++) {
+    const std::span<char> snapshot = ring->reserveSpan(size);
+
+    if (snapshot.empty()) {
+      return -1;
+    }
+    buildSnapshot(snapshot.data(), size, i);
+    if (0 != ring->commit(size)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Reads the next snapshot and checks it against a fresh one
+ *
+ * @return 0 if it matches, non-zero if not
+ */
+int check(BoardRing *reader, uint32_t size, uint64_t number) {
+  std::vector<char> expected(size);
+  const char *datagram;
+  uint32_t datagramSize;
+
+  buildSnapshot(&expected[0], size, number);
+  if ((0 != reader->peek(&datagram, &datagramSize)) ||
+      (size != datagramSize)) {
+    return -1;
+  }
+
+  return ::memcmp(datagram, &expected[0], size);
+}
+} // namespace
+
+int runReserveBench(const BenchOptions &) {
+  int retVal = 0;
+
+  for (size_t i = 0; i < NUM_SNAPSHOT_SIZES; i++) {
+    const uint32_t size = SNAPSHOT_SIZES[i];
+    const uint64_t numSnapshots = BYTES_PER_VARIANT / size;
+    std::ostringstream phase;
+
+    phase << (size >> 10) << " KiB";
+
+    for (int reserved = 0; 1 >= reserved; reserved++) {
+      const char *variantName = (reserved) ? ("reserve/commit") : ("copy");
+      BoardRing writer;
+      BoardRing reader;
+      uint64_t start;
+      uint64_t nanos;
+      int boardFd;
+      int failed;
+
+      // a fresh board each time, so that neither variant finds the
+      // pages warm
+      boardFd = BenchUtil::createBoard(BOARD_SIZE, 0);
+      if ((0 > boardFd) || (0 != writer.map(boardFd, true)) ||
+          (0 != reader.map(boardFd, false))) {
+        std::cout << SUITE_NAME << ": could not create the board"
+                  << std::endl;
+        if (0 <= boardFd) {
+          ::close(boardFd);
+        }
+        return -1;
+      }
+      ::close(boardFd);
+
+      start = BenchUtil::nowNanos();
+      failed = (reserved) ? (writeReserved(&writer, size, 0, numSnapshots))
+                          : (writeCopied(&writer, size, 0, numSnapshots));
+      nanos = BenchUtil::nowNanos() - start;
+
+      // and one more, for the reader to check
+      reader.skip();
+      if (0 == failed) {
+        failed = (reserved)
+                     ? (writeReserved(&writer, size, numSnapshots, 1))
+                     : (writeCopied(&writer, size, numSnapshots, 1));
+      }
+
+      BenchUtil::printResult(SUITE_NAME, variantName, phase.str().c_str(),
+                             numSnapshots, nanos);
+      if ((0 != failed) || (0 != check(&reader, size, numSnapshots))) {
+        std::cout << SUITE_NAME << ": " << variantName << " of "
+                  << phase.str() << " snapshots did not read back"
+                  << std::endl;
+        retVal = -1;
+      }
+    }
+  }
+
+  return retVal;
+}
@@ -0,0 +1,381 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+#include <smb_manager/ManagerProtocol.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "resize";
+const char *const RESIZE_TIMEOUT_MILLIS = "200";
+const useconds_t RESIZE_TIMEOUT_MICROS = 200000;
+const useconds_t SETTLE_MICROS = 50000;
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint32_t BOARD_SIZE = 64 << 10;
+const uint32_t NEW_BOARD_SIZE = 256 << 10;
+const uint64_t DATAGRAMS_BEFORE = 10;
+const uint64_t ROUNDS = 100;
+
+/***
+ * A channel with a writer and a reader, both Event Mode connections
+ */
+struct Subscribers {
+  std::string m_channelName;
+  BenchUtil::Client m_writer;
+  BenchUtil::Client m_reader;
+  BoardRing m_ring;
+};
+
+/***
+ * Connects an Event Mode client
+ *
+ * @return 0 on success, non-zero on error
+ */
+int connect(BenchUtil::Client *client, const std::string &vlan) {
+  if ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+      (0 != client->sendEventMode()) || (0 != client->receiveApproval())) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Subscribes a writer and a reader to a channel, and writes
+ * DATAGRAMS_BEFORE datagrams to it
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(Subscribers *subscribers, const std::string &vlan) {
+  const char *channelName = subscribers->m_channelName.c_str();
+  const char datagram[] = "before";
+  int writerFd;
+  int readerFd;
+
+  if ((0 != connect(&(subscribers->m_writer), vlan)) ||
+      (0 != connect(&(subscribers->m_reader), vlan)) ||
+      (0 != subscribers->m_writer.sendSubscribe(channelName, true,
+                                                BOARD_SIZE)) ||
+      (0 != subscribers->m_writer.receiveApproval()) ||
+      (0 > (writerFd = subscribers->m_writer.receiveFd()))) {
+    return -1;
+  }
+  if (0 != subscribers->m_ring.map(writerFd, true)) {
+    ::close(writerFd);
+    return -1;
+  }
+  ::close(writerFd);
+
+  if ((0 != subscribers->m_reader.sendSubscribe(channelName, false, 0)) ||
+      (0 != subscribers->m_reader.receiveApproval()) ||
+      (0 > (readerFd = subscribers->m_reader.receiveFd()))) {
+    return -1;
+  }
+  ::close(readerFd);
+
+  for (uint64_t i = 0; i < DATAGRAMS_BEFORE; i++) {
+    if (0 != subscribers->m_ring.write(datagram, sizeof(datagram))) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/***
+ * Receives the BoardResized event of a client
+ *
+ * @param sequence Set to the sequence the event names
+ * @param fd Set to the new board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int receiveResized(BenchUtil::Client *client, uint64_t *sequence, int *fd) {
+  char buffer[ManagerProtocol::MAX_MESSAGE_SIZE];
+  ssize_t size;
+
+  size = client->receiveMessage(ManagerProtocol::BOARD_RESIZED, buffer,
+                                sizeof(buffer), fd);
+  if (!ManagerProtocol::isMessage(
+          buffer, size, ManagerProtocol::BOARD_RESIZED,
+          offsetof(ManagerProtocol::BoardResized, m_channelName) + 1)) {
+    if ((0 <= size) && (0 <= *fd)) {
+      ::close(*fd);
+    }
+    return -1;
+  }
+  if (0 > *fd) {
+    return -1;
+  }
+
+  *sequence =
+      reinterpret_cast<const ManagerProtocol::BoardResized *>(buffer)
+          ->m_sequence;
+  return 0;
+}
+
+/***
+ * Moves the writer to the board of its BoardResized event, writes a
+ * datagram there and tells the manager
+ *
+ * @return 0 on success, non-zero on error
+ */
+int moveWriter(Subscribers *subscribers, const char *datagram,
+               uint32_t size) {
+  uint64_t sequence;
+  int boardFd;
+
+  if (0 != receiveResized(&(subscribers->m_writer), &sequence, &boardFd)) {
+    return -1;
+  }
+  subscribers->m_ring.unmap();
+  if (0 != subscribers->m_ring.map(boardFd, true)) {
+    ::close(boardFd);
+    return -1;
+  }
+  ::close(boardFd);
+
+  if ((0 != subscribers->m_ring.write(datagram, size)) ||
+      (0 != subscribers->m_writer.sendBoardSwitched(
+                subscribers->m_channelName.c_str(), DATAGRAMS_BEFORE))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Moves the reader to the board of its BoardResized event, and checks
+ * that it goes on after the old board's datagrams with the one the
+ * writer wrote to the new board
+ *
+ * @return 0 on success, non-zero on error
+ */
+int moveReader(Subscribers *subscribers, const char *datagram,
+               uint32_t size) {
+  BoardRing ring;
+  const char *found;
+  uint32_t foundSize;
+  uint64_t sequence;
+  int boardFd;
+
+  if (0 != receiveResized(&(subscribers->m_reader), &sequence, &boardFd)) {
+    return -1;
+  }
+  if (0 != ring.map(boardFd, false)) {
+    ::close(boardFd);
+    return -1;
+  }
+  ::close(boardFd);
+  ring.rewind();
+
+  if ((DATAGRAMS_BEFORE != sequence) ||
+      (0 != ring.peek(&found, &foundSize)) || (size != foundSize) ||
+      (0 != ::memcmp(found, datagram, size))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Resizes channels whose writer moves, and times the resize from the
+ * request to the readers' event
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runSwitch(BenchUtil::Client *admin, const std::string &vlan) {
+  using namespace BenchUtil;
+
+  std::vector<uint64_t> latencies;
+
+  for (uint64_t round = 0; round < ROUNDS; round++) {
+    std::ostringstream channelName;
+    std::ostringstream datagram;
+    Subscribers subscribers;
+    uint64_t start;
+
+    channelName << "smbcast://bench.resize." << round;
+    datagram << "after " << round;
+    subscribers.m_channelName = channelName.str();
+    if (0 != subscribe(&subscribers, vlan)) {
+      std::cout << SUITE_NAME << ": could not subscribe in round " << round
+                << std::endl;
+      return -1;
+    }
+
+    start = nowNanos();
+    if ((0 != admin->sendResize(channelName.str().c_str(),
+                                NEW_BOARD_SIZE)) ||
+        (0 != admin->receiveApproval()) ||
+        (0 != moveWriter(&subscribers, datagram.str().c_str(),
+                         datagram.str().size())) ||
+        (0 != moveReader(&subscribers, datagram.str().c_str(),
+                         datagram.str().size()))) {
+      std::cout << SUITE_NAME << ": resize failed in round " << round
+                << std::endl;
+      return -1;
+    }
+    latencies.push_back(nowNanos() - start);
+  }
+
+  printLatencies(SUITE_NAME, "writer moves", "resize", &latencies);
+  return 0;
+}
+
+/***
+ * Checks that the resize of a writer that never moves is given up after
+ * the timeout, and that the channel can be resized again then
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runAbandon(BenchUtil::Client *admin, const std::string &vlan) {
+  const char datagram[] = "after";
+  const char *failure;
+  Subscribers subscribers;
+  uint64_t sequence;
+  int boardFd;
+
+  subscribers.m_channelName = "smbcast://bench.resize.abandoned";
+  const char *channelName = subscribers.m_channelName.c_str();
+
+  failure = "subscribe";
+  if (0 != subscribe(&subscribers, vlan)) {
+    goto FAILED;
+  }
+
+  // the writer is told, but does not move
+  failure = "first resize";
+  if ((0 != admin->sendResize(channelName, NEW_BOARD_SIZE)) ||
+      (0 != admin->receiveApproval()) ||
+      (0 != receiveResized(&(subscribers.m_writer), &sequence, &boardFd))) {
+    goto FAILED;
+  }
+  ::close(boardFd);
+
+  failure = "resize while resizing was not denied";
+  if ((0 != admin->sendResize(channelName, 2 * NEW_BOARD_SIZE)) ||
+      (1 != admin->receiveApproval())) {
+    goto FAILED;
+  }
+
+  // once given up, a late switch must not move the readers
+  ::usleep(RESIZE_TIMEOUT_MICROS + SETTLE_MICROS);
+  failure = "late switch";
+  if (0 != subscribers.m_writer.sendBoardSwitched(channelName,
+                                                  DATAGRAMS_BEFORE)) {
+    goto FAILED;
+  }
+  ::usleep(SETTLE_MICROS);
+  failure = "reader followed an abandoned resize";
+  if (subscribers.m_reader.pending()) {
+    goto FAILED;
+  }
+
+  failure = "resize after the timeout";
+  if ((0 != admin->sendResize(channelName, NEW_BOARD_SIZE)) ||
+      (0 != admin->receiveApproval()) ||
+      (0 != moveWriter(&subscribers, datagram, sizeof(datagram))) ||
+      (0 != moveReader(&subscribers, datagram, sizeof(datagram)))) {
+    goto FAILED;
+  }
+
+  std::cout << SUITE_NAME << ": abandoned resize given up and retried"
+            << std::endl;
+  return 0;
+
+FAILED:
+  std::cout << SUITE_NAME << ": abandoned resize: " << failure << std::endl;
+  return -1;
+}
+
+/***
+ * Checks that the readers of a channel whose writer leaves before
+ * moving move on at once, from where the writer stopped
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runWriterLeaves(BenchUtil::Client *admin, const std::string &vlan) {
+  const char *failure;
+  Subscribers subscribers;
+  uint64_t sequence;
+  int boardFd;
+
+  subscribers.m_channelName = "smbcast://bench.resize.left";
+  const char *channelName = subscribers.m_channelName.c_str();
+
+  failure = "subscribe";
+  if (0 != subscribe(&subscribers, vlan)) {
+    goto FAILED;
+  }
+
+  failure = "resize";
+  if ((0 != admin->sendResize(channelName, NEW_BOARD_SIZE)) ||
+      (0 != admin->receiveApproval()) ||
+      (0 != receiveResized(&(subscribers.m_writer), &sequence, &boardFd))) {
+    goto FAILED;
+  }
+  ::close(boardFd);
+
+  subscribers.m_writer.close();
+  failure = "reader was not moved";
+  if (0 != receiveResized(&(subscribers.m_reader), &sequence, &boardFd)) {
+    goto FAILED;
+  }
+  ::close(boardFd);
+  failure = "reader was moved to the wrong sequence";
+  if (DATAGRAMS_BEFORE != sequence) {
+    goto FAILED;
+  }
+
+  std::cout << SUITE_NAME << ": readers moved on when the writer left"
+            << std::endl;
+  return 0;
+
+FAILED:
+  std::cout << SUITE_NAME << ": writer leaving: " << failure << std::endl;
+  return -1;
+}
+} // namespace
+
+int runResizeBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  ManagerProcess manager;
+  Client admin;
+  int retVal = 0;
+
+  vlan << "smb_bench." << ::getpid() << ".resize";
+  arguments.push_back("--resize_timeout");
+  arguments.push_back(RESIZE_TIMEOUT_MILLIS);
+  if (!options.m_dispatchers.empty()) {
+    arguments.push_back("--dispatcher");
+    arguments.push_back(options.m_dispatchers[0]);
+  }
+  if ((0 != manager.start(options.m_managerPath, vlan.str(), arguments)) ||
+      (0 != connect(&admin, manager.vlan()))) {
+    return -1;
+  }
+
+  if ((0 != runSwitch(&admin, manager.vlan())) ||
+      (0 != runAbandon(&admin, manager.vlan())) ||
+      (0 != runWriterLeaves(&admin, manager.vlan()))) {
+    std::cout << SUITE_NAME << ": see " << manager.logFilePath()
+              << (manager.running() ? ("") : (" (manager exited)"))
+              << std::endl;
+    retVal = -1;
+  }
+
+  return retVal;
+}
@@ -0,0 +1,706 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+const char *const SUITE_NAME = "seqlock";
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint32_t BOARD_SIZE = 16 << 20;
+const size_t MAX_READERS = 8;
+const size_t MAX_FAN_OUT = 4;
+const size_t MIN_DATAGRAM_SIZE = 64;
+const size_t MAX_DATAGRAM_SIZE = 64 << 10;
+// the ring starts a page into the board, clear of the board's header
+const size_t RING_OFFSET = 4096;
+// the latency phase sends a datagram every PACING_NANOS, so that
+// readers are never behind and the numbers show the transfer alone
+const uint64_t LATENCY_DATAGRAMS = 20000;
+const uint64_t PACING_NANOS = 10000;
+// the throughput phase sends as fast as the writer can, up to
+// THROUGHPUT_BYTES or THROUGHPUT_DATAGRAMS, whichever comes first
+const uint64_t THROUGHPUT_DATAGRAMS = 200000;
+const uint64_t THROUGHPUT_BYTES = 1ULL << 30;
+const uint64_t PHASE_TIMEOUT_NANOS = 30000000000ULL;
+// spins before giving up the CPU, so that readers and writer sharing a
+// CPU still make progress
+const uint32_t SPINS_BEFORE_YIELD = 1000;
+
+/***
+ * The header of a datagram slot in the ring the suite lays over the
+ * board, in place of DatagramBoard's own framing. The sequence is
+ * 2n + 1 while datagram n is written, 2n + 2 once it is complete, so
+ * that a reader sees both a datagram torn by a lapping writer and a
+ * datagram it missed.
+ *
+ * @var Slot::m_sequence The sequence
+ * @var Slot::m_stamp The writer's TSC when it started the datagram
+ * @var Slot::m_size The payload size
+ */
+struct alignas(64) Slot {
+  std::atomic<uint64_t> m_sequence;
+  uint64_t m_stamp;
+  uint64_t m_size;
+};
+
+/***
+ * What a reader process hands back
+ *
+ * @var ReaderResult::m_state A ReaderState
+ * @var ReaderResult::m_received The datagrams read intact
+ * @var ReaderResult::m_overruns The datagrams the writer overwrote
+ * before they were read
+ * @var ReaderResult::m_numSamples The latencies recorded
+ * @var ReaderResult::m_samples The latency of each datagram, in TSC
+ * ticks
+ */
+struct ReaderResult {
+  std::atomic<uint32_t> m_state;
+  uint64_t m_received;
+  uint64_t m_overruns;
+  uint64_t m_numSamples;
+  uint64_t m_samples[LATENCY_DATAGRAMS];
+};
+
+/***
+ * Shared between the writer and the reader processes, in an anonymous
+ * shared mapping
+ *
+ * @var Results::m_go Set once every reader is ready
+ * @var Results::m_abort Set to make the readers give up
+ * @var Results::m_readers A result per reader
+ */
+struct Results {
+  std::atomic<bool> m_go;
+  std::atomic<bool> m_abort;
+  ReaderResult m_readers[MAX_READERS];
+};
+
+enum ReaderState { STARTING, READY, DONE, FAILED };
+
+/***
+ * Where the writer and its readers run
+ *
+ * @var Placement::m_name The variant name
+ * @var Placement::m_writerCpu The writer's CPU, negative if not pinned
+ * @var Placement::m_readerCpus A CPU per reader, negative if not pinned
+ */
+struct Placement {
+  std::string m_name;
+  int m_writerCpu;
+  std::vector<int> m_readerCpus;
+};
+
+/***
+ * One measured phase
+ *
+ * @var Phase::m_size The datagram size
+ * @var Phase::m_count The datagrams to send
+ * @var Phase::m_pacingTicks The TSC ticks between datagrams, 0 to send
+ * as fast as possible
+ */
+struct Phase {
+  size_t m_size;
+  uint64_t m_count;
+  uint64_t m_pacingTicks;
+};
+
+/***
+ * @return the TSC where there is one, CLOCK_MONOTONIC nanoseconds
+ * otherwise
+ */
+inline uint64_t ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return BenchUtil::nowNanos();
+#endif
+}
+
+/***
+ * @return the TSC ticks per nanosecond, measured against
+ * CLOCK_MONOTONIC
+ */
+double calibrateTicks(void) {
+  const uint64_t startNanos = BenchUtil::nowNanos();
+  const uint64_t startTicks = ticks();
+
+  ::usleep(100000);
+
+  return static_cast<double>(ticks() - startTicks) /
+         (BenchUtil::nowNanos() - startNanos);
+}
+
+void backOff(uint32_t *spins) {
+  if (SPINS_BEFORE_YIELD < ++(*spins)) {
+    ::sched_yield();
+    *spins = 0;
+  }
+}
+
+/***
+ * Pins the calling process to a CPU
+ *
+ * @return 0 on success, non-zero on error
+ */
+int pin(int cpu) {
+  cpu_set_t cpus;
+
+  if (0 > cpu) {
+    return 0;
+  }
+
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return ::sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+/***
+ * @return a topology attribute of a CPU, negative if unknown
+ */
+int cpuTopology(int cpu, const char *attribute) {
+  std::ostringstream path;
+  int value = -1;
+
+  path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/" << attribute;
+  std::ifstream file(path.str().c_str());
+  if (!(file >> value)) {
+    return -1;
+  }
+
+  return value;
+}
+
+/***
+ * Picks the placements to compare: a reader on another core of the
+ * writer's socket, a reader on another socket, and readers on as many
+ * other CPUs as MAX_FAN_OUT. Placements the machine does not allow are
+ * left out.
+ */
+std::vector<Placement> choosePlacements(const BenchOptions &options) {
+  std::vector<Placement> placements;
+  std::vector<int> cpus;
+  cpu_set_t allowed;
+  int writerCpu;
+  int writerPackage;
+  int writerCore;
+
+  if (!options.m_cpus.empty()) {
+    Placement chosen;
+    chosen.m_name = "chosen cpus";
+    chosen.m_writerCpu = options.m_cpus[0];
+    chosen.m_readerCpus.assign(options.m_cpus.begin() + 1,
+                               options.m_cpus.end());
+    if (chosen.m_readerCpus.empty()) {
+      chosen.m_readerCpus.push_back(-1);
+    }
+    placements.push_back(chosen);
+    return placements;
+  }
+
+  if (0 == ::sched_getaffinity(0, sizeof(allowed), &allowed)) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  if (2 > cpus.size()) {
+    Placement unpinned;
+    unpinned.m_name = "unpinned";
+    unpinned.m_writerCpu = -1;
+    unpinned.m_readerCpus.push_back(-1);
+    placements.push_back(unpinned);
+    return placements;
+  }
+
+  writerCpu = cpus[0];
+  writerPackage = cpuTopology(writerCpu, "physical_package_id");
+  writerCore = cpuTopology(writerCpu, "core_id");
+
+  Placement sameSocket;
+  sameSocket.m_name = "same socket";
+  sameSocket.m_writerCpu = writerCpu;
+  Placement crossSocket;
+  crossSocket.m_name = "cross socket";
+  crossSocket.m_writerCpu = writerCpu;
+  Placement fanOut;
+  fanOut.m_writerCpu = writerCpu;
+
+  for (size_t i = 1; i < cpus.size(); i++) {
+    const int package = cpuTopology(cpus[i], "physical_package_id");
+
+    if (package != writerPackage) {
+      if (crossSocket.m_readerCpus.empty()) {
+        crossSocket.m_readerCpus.push_back(cpus[i]);
+      }
+    } else if (sameSocket.m_readerCpus.empty() &&
+               (cpuTopology(cpus[i], "core_id") != writerCore)) {
+      // not a hyperthread of the writer's core
+      sameSocket.m_readerCpus.push_back(cpus[i]);
+    }
+
+    if (MAX_FAN_OUT > fanOut.m_readerCpus.size()) {
+      fanOut.m_readerCpus.push_back(cpus[i]);
+    }
+  }
+
+  if (!sameSocket.m_readerCpus.empty()) {
+    placements.push_back(sameSocket);
+  } else {
+    std::cout << SUITE_NAME << ": no other core on the socket of cpu "
+              << writerCpu << ", skipping same socket" << std::endl;
+  }
+  if (!crossSocket.m_readerCpus.empty()) {
+    placements.push_back(crossSocket);
+  } else {
+    std::cout << SUITE_NAME << ": a single socket, skipping cross socket"
+              << std::endl;
+  }
+  if (1 < fanOut.m_readerCpus.size()) {
+    std::ostringstream name;
+    name << fanOut.m_readerCpus.size() << " readers";
+    fanOut.m_name = name.str();
+    placements.push_back(fanOut);
+  }
+
+  return placements;
+}
+
+/***
+ * Subscribes to the channel and maps its board
+ *
+ * @param size Set to the size of the mapping
+ *
+ * @return the mapping, 0 on error
+ */
+char *mapBoard(BenchUtil::Client *client, const std::string &vlan,
+               const char *channelName, bool writer, size_t *size) {
+  struct stat status;
+  void *mapping;
+  int boardFd;
+
+  if ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+      (0 != client->sendSubscribe(channelName, writer,
+                                  writer ? (BOARD_SIZE) : (0))) ||
+      (0 != client->receiveApproval()) ||
+      (0 > (boardFd = client->receiveFd()))) {
+    return 0;
+  }
+
+  if (0 != ::fstat(boardFd, &status)) {
+    ::close(boardFd);
+    return 0;
+  }
+  *size = status.st_size;
+
+  mapping = ::mmap(0, *size, PROT_READ | PROT_WRITE, MAP_SHARED, boardFd, 0);
+  ::close(boardFd);
+
+  return (MAP_FAILED == mapping) ? (0) : (static_cast<char *>(mapping));
+}
+
+size_t slotStride(size_t datagramSize) {
+  return (sizeof(Slot) + datagramSize + alignof(Slot) - 1) &
+         ~(alignof(Slot) - 1);
+}
+
+Slot *slotOf(char *board, size_t stride, uint64_t numSlots,
+             uint64_t index) {
+  return reinterpret_cast<Slot *>(board + RING_OFFSET +
+                                  (index % numSlots) * stride);
+}
+
+/***
+ * Reads every datagram of a phase, in a reader process
+ *
+ * @return the exit status
+ */
+int readerMain(const std::string &vlan, const char *channelName,
+               const Phase &phase, int cpu, Results *results,
+               ReaderResult *result) {
+  BenchUtil::Client client;
+  std::vector<char> payload(phase.m_size);
+  size_t mapSize = 0;
+  char *board;
+
+  if ((0 != pin(cpu)) ||
+      (0 == (board = mapBoard(&client, vlan, channelName, false,
+                              &mapSize)))) {
+    result->m_state.store(FAILED, std::memory_order_release);
+    return 1;
+  }
+
+  const size_t stride = slotStride(phase.m_size);
+  const uint64_t numSlots = (mapSize - RING_OFFSET) / stride;
+  uint64_t index = 0;
+  uint32_t spins = 0;
+
+  result->m_state.store(READY, std::memory_order_release);
+  while (!results->m_go.load(std::memory_order_acquire)) {
+    backOff(&spins);
+  }
+
+  while (index < phase.m_count) {
+    Slot *slot = slotOf(board, stride, numSlots, index);
+    const uint64_t complete = 2 * index + 2;
+    uint64_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+
+    if (complete > sequence) {
+      // not written yet
+      if (results->m_abort.load(std::memory_order_relaxed)) {
+        break;
+      }
+      backOff(&spins);
+      continue;
+    }
+    spins = 0;
+
+    if (complete == sequence) {
+      uint64_t first;
+      const uint64_t stamp = slot->m_stamp;
+      ::memcpy(&payload[0], slot + 1, phase.m_size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      sequence = slot->m_sequence.load(std::memory_order_relaxed);
+      ::memcpy(&first, &payload[0], sizeof(first));
+
+      if ((complete == sequence) && (index == first)) {
+        const uint64_t now = ticks();
+        if (LATENCY_DATAGRAMS > result->m_numSamples) {
+          result->m_samples[result->m_numSamples++] = now - stamp;
+        }
+        result->m_received++;
+        index++;
+        continue;
+      }
+    }
+
+    // lapped: skip to the datagram the writer is on
+    const uint64_t latest = (sequence - 1) / 2;
+    if (latest <= index) {
+      // torn without a lap, which the writer never does
+      result->m_overruns++;
+      index++;
+    } else {
+      result->m_overruns += latest - index;
+      index = latest;
+    }
+  }
+
+  ::munmap(board, mapSize);
+  result->m_state.store(DONE, std::memory_order_release);
+  return 0;
+}
+
+/***
+ * Writes the datagrams of a phase
+ */
+void writeDatagrams(char *board, size_t mapSize, const Phase &phase) {
+  const size_t stride = slotStride(phase.m_size);
+  const uint64_t numSlots = (mapSize - RING_OFFSET) / stride;
+  uint64_t next = ticks();
+
+  for (uint64_t index = 0; index < phase.m_count; index++) {
+    Slot *slot = slotOf(board, stride, numSlots, index);
+    char *payload = reinterpret_cast<char *>(slot + 1);
+
+    if (0 != phase.m_pacingTicks) {
+      while (ticks() < next) {
+      }
+      next += phase.m_pacingTicks;
+    }
+
+    slot->m_sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->m_stamp = ticks();
+    slot->m_size = phase.m_size;
+    ::memset(payload + sizeof(index), static_cast<int>(index),
+             phase.m_size - sizeof(index));
+    ::memcpy(payload, &index, sizeof(index));
+    slot->m_sequence.store(2 * index + 2, std::memory_order_release);
+  }
+}
+
+/***
+ * Prints the latency histogram of one phase: the samples in each power
+ * of two bucket of nanoseconds
+ */
+void printHistogram(const std::vector<uint64_t> &nanos) {
+  uint64_t buckets[64] = {0};
+
+  for (size_t i = 0; i < nanos.size(); i++) {
+    size_t bucket = 0;
+    while ((63 > bucket) && ((2ULL << bucket) <= nanos[i])) {
+      bucket++;
+    }
+    buckets[bucket]++;
+  }
+
+  std::cout << std::setw(12) << "" << "histogram";
+  for (size_t bucket = 0; bucket < 64; bucket++) {
+    if (0 != buckets[bucket]) {
+      std::cout << "  <" << (2ULL << bucket) << "ns " << buckets[bucket];
+    }
+  }
+  std::cout << std::endl;
+}
+
+/***
+ * Runs one phase: forks the readers, waits until they hold the board,
+ * then writes
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runPhase(const std::string &vlan, const char *channelName,
+             char *board, size_t mapSize, const Placement &placement,
+             const Phase &phase, double ticksPerNano, Results *results) {
+  const size_t numReaders = placement.m_readerCpus.size();
+  std::vector<pid_t> readers;
+  std::ostringstream phaseName;
+  uint64_t start;
+  uint64_t nanos;
+  uint64_t deadline;
+  int retVal = 0;
+
+  ::memset(board + RING_OFFSET, 0, mapSize - RING_OFFSET);
+  results->m_go.store(false);
+  results->m_abort.store(false);
+  for (size_t r = 0; r < numReaders; r++) {
+    ReaderResult &result = results->m_readers[r];
+    result.m_state.store(STARTING);
+    result.m_received = 0;
+    result.m_overruns = 0;
+    result.m_numSamples = 0;
+  }
+
+  for (size_t r = 0; r < numReaders; r++) {
+    pid_t pid = ::fork();
+    if (0 > pid) {
+      std::cout << SUITE_NAME << ": could not fork a reader: "
+                << ::strerror(errno) << std::endl;
+      retVal = -1;
+      goto WAIT;
+    }
+    if (0 == pid) {
+      // child
+      ::_exit(readerMain(vlan, channelName, phase,
+                         placement.m_readerCpus[r], results,
+                         &(results->m_readers[r])));
+    }
+    readers.push_back(pid);
+  }
+
+  deadline = BenchUtil::nowNanos() + PHASE_TIMEOUT_NANOS;
+  for (size_t r = 0; r < numReaders; r++) {
+    while (STARTING == results->m_readers[r].m_state.load()) {
+      if (BenchUtil::nowNanos() > deadline) {
+        break;
+      }
+      ::usleep(1000);
+    }
+    if (READY != results->m_readers[r].m_state.load()) {
+      std::cout << SUITE_NAME << ": reader " << r
+                << " could not map the board" << std::endl;
+      retVal = -1;
+      goto WAIT;
+    }
+  }
+
+  results->m_go.store(true, std::memory_order_release);
+  start = BenchUtil::nowNanos();
+  writeDatagrams(board, mapSize, phase);
+  nanos = BenchUtil::nowNanos() - start;
+
+  // a reader still waiting once the writer is long done lost the end of
+  // the phase
+  deadline = BenchUtil::nowNanos() + PHASE_TIMEOUT_NANOS;
+  for (size_t r = 0; r < numReaders; r++) {
+    while ((DONE != results->m_readers[r].m_state.load()) &&
+           (BenchUtil::nowNanos() < deadline)) {
+      ::usleep(1000);
+    }
+  }
+
+  phaseName << phase.m_size << "B "
+            << ((0 == phase.m_pacingTicks) ? ("tput") : ("latency"));
+  if (0 == phase.m_pacingTicks) {
+    BenchUtil::printResult(SUITE_NAME, placement.m_name,
+                           phaseName.str().c_str(), phase.m_count, nanos);
+  }
+
+  for (size_t r = 0; r < numReaders; r++) {
+    const ReaderResult &result = results->m_readers[r];
+
+    if (DONE != result.m_state.load()) {
+      std::cout << SUITE_NAME << ": reader " << r << " did not finish"
+                << std::endl;
+      retVal = -1;
+      continue;
+    }
+
+    if (0 != phase.m_pacingTicks) {
+      std::vector<uint64_t> latencies(result.m_numSamples);
+      for (size_t i = 0; i < result.m_numSamples; i++) {
+        latencies[i] =
+            static_cast<uint64_t>(result.m_samples[i] / ticksPerNano);
+      }
+      BenchUtil::printLatencies(SUITE_NAME, placement.m_name,
+                                phaseName.str().c_str(), &latencies);
+      printHistogram(latencies);
+    }
+    std::cout << std::setw(12) << "" << "reader " << r << " on cpu "
+              << placement.m_readerCpus[r] << ": " << result.m_received
+              << " read, " << result.m_overruns << " overrun" << std::endl;
+  }
+
+WAIT:
+  results->m_abort.store(true);
+  for (size_t r = 0; r < readers.size(); r++) {
+    ::waitpid(readers[r], 0, 0);
+  }
+
+  return retVal;
+}
+
+/***
+ * Runs every datagram size with one placement
+ *
+ * @return 0 on success, non-zero on error
+ */
+int runPlacement(const std::string &vlan, const Placement &placement,
+                 double ticksPerNano, Results *results) {
+  BenchUtil::Client writer;
+  std::ostringstream channelName;
+  size_t mapSize = 0;
+  char *board;
+  int retVal = 0;
+
+  if (MAX_READERS < placement.m_readerCpus.size()) {
+    std::cout << SUITE_NAME << ": at most " << MAX_READERS << " readers"
+              << std::endl;
+    return -1;
+  }
+
+  channelName << "smbcast://seqlock." << placement.m_writerCpu;
+  board = mapBoard(&writer, vlan, channelName.str().c_str(), true,
+                   &mapSize);
+  if (0 == board) {
+    std::cout << SUITE_NAME << ": could not map the writer's board"
+              << std::endl;
+    return -1;
+  }
+  if (RING_OFFSET + 2 * slotStride(MAX_DATAGRAM_SIZE) > mapSize) {
+    std::cout << SUITE_NAME << ": the board is too small" << std::endl;
+    ::munmap(board, mapSize);
+    return -1;
+  }
+
+  if (0 != pin(placement.m_writerCpu)) {
+    std::cout << SUITE_NAME << ": could not pin the writer to cpu "
+              << placement.m_writerCpu << std::endl;
+    ::munmap(board, mapSize);
+    return -1;
+  }
+
+  for (size_t size = MIN_DATAGRAM_SIZE; MAX_DATAGRAM_SIZE >= size;
+       size *= 4) {
+    Phase latency;
+    latency.m_size = size;
+    latency.m_count = LATENCY_DATAGRAMS;
+    latency.m_pacingTicks =
+        static_cast<uint64_t>(PACING_NANOS * ticksPerNano);
+
+    Phase throughput;
+    throughput.m_size = size;
+    throughput.m_count = (THROUGHPUT_BYTES / size < THROUGHPUT_DATAGRAMS)
+                             ? (THROUGHPUT_BYTES / size)
+                             : (THROUGHPUT_DATAGRAMS);
+    throughput.m_pacingTicks = 0;
+
+    if ((0 != runPhase(vlan, channelName.str().c_str(), board, mapSize,
+                       placement, latency, ticksPerNano, results)) ||
+        (0 != runPhase(vlan, channelName.str().c_str(), board, mapSize,
+                       placement, throughput, ticksPerNano, results))) {
+      retVal = -1;
+    }
+  }
+
+  ::munmap(board, mapSize);
+
+  return retVal;
+}
+} // namespace
+
+int runSeqlockBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  ManagerProcess manager;
+  std::vector<Placement> placements = choosePlacements(options);
+  cpu_set_t original;
+  Results *results;
+  void *mapping;
+  double ticksPerNano;
+  int retVal = 0;
+
+  mapping = ::mmap(0, sizeof(Results), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == mapping) {
+    std::cout << SUITE_NAME << ": could not map the results" << std::endl;
+    return -1;
+  }
+  results = new (mapping) Results();
+
+  vlan << "smb_bench." << ::getpid() << ".seqlock";
+  arguments.push_back("--dispatcher");
+  arguments.push_back(options.m_dispatchers[0]);
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    ::munmap(mapping, sizeof(Results));
+    return -1;
+  }
+
+  ticksPerNano = calibrateTicks();
+  ::sched_getaffinity(0, sizeof(original), &original);
+
+  // so that nobody quotes the numbers as DatagramBoard's
+  std::cout << SUITE_NAME << ": a seqlock ring of the suite's own over a "
+            << "manager's board, not DatagramBoard's read and write path"
+            << std::endl;
+
+  for (size_t i = 0; i < placements.size(); i++) {
+    if (0 != runPlacement(manager.vlan(), placements[i], ticksPerNano,
+                          results)) {
+      std::cout << SUITE_NAME << ": " << placements[i].m_name
+                << " failed, see " << manager.logFilePath() << std::endl;
+      retVal = -1;
+    }
+  }
+
+  // later suites run where they please
+  ::sched_setaffinity(0, sizeof(original), &original);
+  ::munmap(mapping, sizeof(Results));
+
+  return retVal;
+}
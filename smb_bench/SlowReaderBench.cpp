@@ -0,0 +1,267 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <smb_bridge/BoardRing.h>
+#include <smb_manager/ManagerProtocol.h>
+#include <smb_manager/StatsSegment.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char *const SUITE_NAME = "slowreader";
+const char *const CHANNEL_CONFIG = "[smbcast://bench.slow.*]\n"
+                                   "slow_reader = unsubscribe\n"
+                                   "slow_reader_lag = 50\n";
+const char *const SLOW_READER_INTERVAL_MILLIS = "10";
+const char *const STATS_INTERVAL_MILLIS = "20";
+const useconds_t STATS_WAIT_MICROS = 100000;
+const int SNAPSHOT_ATTEMPTS = 100;
+const useconds_t SNAPSHOT_RETRY_MICROS = 1000;
+const int CLIENT_TIMEOUT_SECONDS = 10;
+const uint32_t BOARD_SIZE = 1 << 20;
+const uint32_t DATAGRAM_SIZE = 1 << 10;
+const uint64_t ROUNDS = 20;
+
+/***
+ * Connects an Event Mode client and subscribes it to a channel
+ *
+ * @param boardFd Set to the board fd
+ *
+ * @return 0 on success, non-zero on error
+ */
+int subscribe(BenchUtil::Client *client, const std::string &vlan,
+              const std::string &channelName, bool writer, int *boardFd) {
+  if ((0 > client->fileDescriptor()) &&
+      ((0 != client->connect(vlan, CLIENT_TIMEOUT_SECONDS)) ||
+       (0 != client->sendEventMode()) ||
+       (0 != client->receiveApproval()))) {
+    return -1;
+  }
+
+  if ((0 != client->sendSubscribe(channelName.c_str(), writer,
+                                  (writer) ? (BOARD_SIZE) : (0))) ||
+      (0 != client->receiveApproval()) ||
+      (0 > (*boardFd = client->receiveFd()))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/***
+ * Checks the stats segment for a channel left with one reader that never
+ * reported its progress, whose lag must be unknown
+ *
+ * @return 0 if it is, non-zero if not
+ */
+int checkStats(const std::string &vlan, const std::string &channelName) {
+  const std::string segmentName = StatsSegment::name(vlan);
+  std::vector<uint64_t> copy;
+  struct stat status;
+  void *mapping;
+  int retVal = -1;
+  int fd;
+
+  fd = ::shm_open(segmentName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (0 > fd) {
+    return -1;
+  }
+  if ((0 != ::fstat(fd, &status)) ||
+      (sizeof(StatsSegment::Header) > static_cast<size_t>(status.st_size))) {
+    ::close(fd);
+    return -1;
+  }
+  mapping = ::mmap(0, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == mapping) {
+    return -1;
+  }
+
+  const StatsSegment::Header *segment =
+      static_cast<const StatsSegment::Header *>(mapping);
+  StatsSegment::Header *sample;
+
+  copy.resize((status.st_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  sample = reinterpret_cast<StatsSegment::Header *>(&copy[0]);
+  if (StatsSegment::VERSION != segment->m_version) {
+    goto CLEANUP;
+  }
+  // the manager may be preempted while it writes
+  for (int i = 0; 0 != StatsSegment::snapshot(segment, sample, 1000); i++) {
+    if (SNAPSHOT_ATTEMPTS <= i) {
+      goto CLEANUP;
+    }
+    ::usleep(SNAPSHOT_RETRY_MICROS);
+  }
+
+  for (uint32_t i = 0; i < sample->m_numChannels; i++) {
+    const StatsSegment::ChannelRow &channel =
+        StatsSegment::channels(sample)[i];
+    if (0 != ::strcmp(channel.m_name, channelName.c_str())) {
+      continue;
+    }
+
+    const StatsSegment::ReaderRow &reader =
+        StatsSegment::readers(sample)[channel.m_firstReader];
+    if ((1 == channel.m_numReaderRows) &&
+        (0 == (StatsSegment::REPORTED_FLAG & reader.m_flags)) &&
+        (StatsSegment::UNKNOWN_LAG == reader.m_lagBytes) &&
+        (StatsSegment::UNKNOWN_LAG == reader.m_lagMessages)) {
+      retVal = 0;
+    }
+    break;
+  }
+
+CLEANUP:
+  ::munmap(mapping, status.st_size);
+  return retVal;
+}
+} // namespace
+
+int runSlowReaderBench(const BenchOptions &options) {
+  using namespace BenchUtil;
+
+  std::ostringstream vlan;
+  std::vector<std::string> arguments;
+  std::vector<uint64_t> latencies;
+  std::vector<char> datagram(DATAGRAM_SIZE, 'x');
+  std::vector<char> buffer(ManagerProtocol::MAX_MESSAGE_SIZE);
+  std::string configPath;
+  ManagerProcess manager;
+  Client writer;
+  Client reporting;
+  Client silent;
+  const char *failure = 0;
+  uint64_t round;
+
+  vlan << "smb_bench." << ::getpid() << ".slow";
+  configPath = writeChannelConfig(vlan.str(), CHANNEL_CONFIG);
+  if (configPath.empty()) {
+    return -1;
+  }
+  arguments.push_back("--channel_config");
+  arguments.push_back(configPath);
+  arguments.push_back("--slow_reader_interval");
+  arguments.push_back(SLOW_READER_INTERVAL_MILLIS);
+  arguments.push_back("--stats_interval");
+  arguments.push_back(STATS_INTERVAL_MILLIS);
+  if (!options.m_dispatchers.empty()) {
+    arguments.push_back("--dispatcher");
+    arguments.push_back(options.m_dispatchers[0]);
+  }
+  if (0 != manager.start(options.m_managerPath, vlan.str(), arguments)) {
+    ::unlink(configPath.c_str());
+    return -1;
+  }
+
+  // each round one reader reports that it read nothing, the other does
+  // not report at all, and the writer fills the board past the lag
+  // threshold. Only the first must be dropped
+  for (round = 0; round < ROUNDS; round++) {
+    std::ostringstream channelName;
+    BoardRing ring;
+    uint64_t written = 0;
+    uint64_t start;
+    int boardFd;
+
+    channelName << "smbcast://bench.slow." << round;
+    if (0 != subscribe(&writer, manager.vlan(), channelName.str(), true,
+                       &boardFd)) {
+      failure = "writer subscribe";
+      break;
+    }
+    if (0 != ring.map(boardFd, true)) {
+      ::close(boardFd);
+      failure = "board map";
+      break;
+    }
+    ::close(boardFd);
+
+    if ((0 != subscribe(&reporting, manager.vlan(), channelName.str(), false,
+                        &boardFd))) {
+      failure = "reader subscribe";
+      break;
+    }
+    ::close(boardFd);
+    if (0 != subscribe(&silent, manager.vlan(), channelName.str(), false,
+                       &boardFd)) {
+      failure = "reader subscribe";
+      break;
+    }
+    ::close(boardFd);
+
+    // progress reports are not answered, so give the manager time to
+    // take it before the writer moves
+    if (0 != reporting.sendReaderProgress(channelName.str().c_str(), 0, 0)) {
+      failure = "progress report";
+      break;
+    }
+    ::usleep(STATS_WAIT_MICROS);
+
+    while (written <= ring.size() / 2) {
+      if (0 != ring.write(&datagram[0], DATAGRAM_SIZE)) {
+        failure = "write";
+        break;
+      }
+      written += BoardRing::footprint(DATAGRAM_SIZE);
+    }
+    if (0 != failure) {
+      break;
+    }
+
+    start = nowNanos();
+    for (;;) {
+      ssize_t size = reporting.receiveMessage(ManagerProtocol::SLOW_READER,
+                                              &buffer[0], buffer.size());
+      if (!ManagerProtocol::isMessage(
+              &buffer[0], size, ManagerProtocol::SLOW_READER,
+              offsetof(ManagerProtocol::SlowReader, m_channelName) + 1)) {
+        failure = "slow reader event";
+        break;
+      }
+      const ManagerProtocol::SlowReader *event =
+          reinterpret_cast<const ManagerProtocol::SlowReader *>(&buffer[0]);
+      if (ManagerProtocol::READER_UNSUBSCRIBED == event->m_state) {
+        break;
+      }
+    }
+    if (0 != failure) {
+      break;
+    }
+    latencies.push_back(nowNanos() - start);
+
+    // the silent reader is never judged, but must show up as unknown
+    ::usleep(STATS_WAIT_MICROS);
+    if (silent.pending()) {
+      failure = "silent reader was told it is slow";
+      break;
+    }
+    if (0 != checkStats(manager.vlan(), channelName.str())) {
+      failure = "silent reader stats";
+      break;
+    }
+  }
+
+  printLatencies(SUITE_NAME, "unsubscribe", "detect", &latencies);
+  ::unlink(configPath.c_str());
+  if (0 != failure) {
+    std::cout << SUITE_NAME << ": failed at " << failure << " in round "
+              << round
+              << (manager.running() ? ("") : (" (manager exited)"))
+              << ", see " << manager.logFilePath() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+#ifndef SMB_BENCH_SUITES_H_
+#define SMB_BENCH_SUITES_H_
+
+/***
+ * @file Suites.h
+ *
+ * @brief
+ * The benchmark suites of smb_bench and the options they share.
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/***
+ * Options shared by every suite
+ *
+ * @var BenchOptions::m_managerPath Path to the smb_manager binary
+ * @var BenchOptions::m_dispatchers Dispatchers to run the manager with
+ * @var BenchOptions::m_clients Number of concurrent clients
+ * @var BenchOptions::m_channels Number of distinct channels, 0 for the
+ * suite's default
+ * @var BenchOptions::m_cpus CPUs to pin the seqlock writer (the first)
+ * and readers to, empty for the suite's choice
+ * @var BenchOptions::m_pythonReaderPath Path to python/smbcast.py
+ */
+struct BenchOptions {
+  std::string m_managerPath;
+  std::vector<std::string> m_dispatchers;
+  uint64_t m_clients;
+  uint64_t m_channels;
+  std::vector<int> m_cpus;
+  std::string m_pythonReaderPath;
+};
+
+/***
+ * Signature of a suite entry point
+ *
+ * @return 0 on success, non-zero if any variant failed
+ */
+typedef int (*SuiteFunction)(const BenchOptions &options);
+
+/***
+ * Connects m_clients clients to a forked manager, then measures accept,
+ * reader subscribe (including the board fd transfer) and unsubscribe
+ * throughput for each dispatcher.
+ */
+int runConnectBench(const BenchOptions &options);
+
+/***
+ * Keeps m_clients clients connected to a forked manager while random
+ * ones reconnect, or join or leave one of m_channels channels as readers
+ * (including the board fd transfer), with a window of requests in
+ * flight. Reports the throughput and the p50, p99 and p99.9 latency of
+ * each operation, for each dispatcher.
+ */
+int runChurnBench(const BenchOptions &options);
+
+/***
+ * Measures how long a writer takes to subscribe to, and unsubscribe
+ * from, m_channels channels on a forked manager: one request per channel
+ * against batch requests, for each dispatcher.
+ */
+int runBatchBench(const BenchOptions &options);
+
+/***
+ * Measures the manager's channel and subscription index in-process:
+ * channel creation, lookup by name and reader subscribe/unsubscribe churn,
+ * open-hash maps against the former strcmp-scanned lists. The list
+ * variant runs on a sample of the operations.
+ */
+int runRegistryBench(const BenchOptions &options);
+
+/***
+ * Gets a board from a forked manager for a writer and its readers, each
+ * reader in its own process, lays a seqlock ring of its own over it and
+ * passes TSC-stamped datagrams of 64 B to 64 KiB through that. This
+ * models the transfer over shared memory per placement. It is not a
+ * DatagramBoard benchmark: libnano's write and read path is not in this
+ * tree, so its numbers are not DatagramBoard latencies, and the suite
+ * says so when it runs. Reports the latency percentiles and histogram of
+ * paced datagrams, the throughput of unpaced ones and the datagrams
+ * each reader lost to overruns. Readers run on another core of the
+ * writer's socket, on another socket, and on several CPUs at once, or
+ * on m_cpus.
+ */
+int runSeqlockBench(const BenchOptions &options);
+
+/***
+ * Measures a reader interested in 1, 5 and 50 of 500 symbols in-process,
+ * over a board larger than the caches: reading every datagram and
+ * checking its symbol, against skipping to the datagrams of interest
+ * through the board's key index.
+ */
+int runFilterBench(const BenchOptions &options);
+
+/***
+ * Measures a BoardRing writer publishing depth snapshots of 1 to 30 KiB
+ * in-process: building each in a buffer and copying it in with write(),
+ * against building it in place with reserve() and commit(). A reader
+ * checks the last snapshot of each. DatagramBoard's own writer, which
+ * has no reserve and commit, is not measured.
+ */
+int runReserveBench(const BenchOptions &options);
+
+/***
+ * Measures how long a forked manager takes to unsubscribe a reader that
+ * reported it fell behind the slow reader lag of its channel. A second
+ * reader of each channel never reports its progress: it must be neither
+ * judged nor dropped, and must show an unknown lag in the stats segment,
+ * as the manager cannot see how far such a reader got.
+ */
+int runSlowReaderBench(const BenchOptions &options);
+
+/***
+ * Times the resize of a channel on a forked manager, from the request
+ * to the reader's event, with a writer that moves to the new board, and
+ * checks that the reader goes on there. Also checks that the resize of
+ * a writer that never moves is given up after the resize timeout, and
+ * that the readers of a writer that leaves before moving move at once.
+ */
+int runResizeBench(const BenchOptions &options);
+
+/***
+ * Times how long a reader joining a channel of a forked manager late
+ * takes to copy the last value of 64 keys, and checks them. Also checks
+ * that the values are found on the new board of a resized channel,
+ * whether its writer moves or left before the resize.
+ */
+int runLastValueBench(const BenchOptions &options);
+
+/***
+ * Kills a forked manager whose channel keeps its board in a named file,
+ * and checks that a manager started with --recover serves the same
+ * board: it and the readers find its size, the readers its datagrams,
+ * and the writer goes on after them. Then starts a manager with
+ * --takeover, and checks that the recovered one exits and its writer
+ * and reader go on with the replacement.
+ */
+int runRecoverBench(const BenchOptions &options);
+
+/***
+ * Checks python/smbcast.py, run with python3 from m_pythonReaderPath,
+ * against a board of a forked manager written through BoardRing: the
+ * last values it prints must be those a BoardRing reader finds, and the
+ * datagrams it reads those written, across the end of the board. It is
+ * not checked against boards DatagramBoard wrote, as libnano is not in
+ * this tree.
+ */
+int runPythonBench(const BenchOptions &options);
+
+#endif // SMB_BENCH_SUITES_H_
@@ -0,0 +1,260 @@
+#include "BenchUtil.h"
+#include "Suites.h"
+
+#include <core/utils/StrToInt.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const uint64_t DEFAULT_CLIENTS = 10000;
+#ifdef SMB_SOURCE_DIR
+const char *const DEFAULT_PYTHON_READER_PATH =
+    SMB_SOURCE_DIR "/python/smbcast.py";
+#else
+const char *const DEFAULT_PYTHON_READER_PATH = "python/smbcast.py";
+#endif
+
+/**
+ * A benchmark suite
+ *
+ * @var Suite::m_name Name used on the command line
+ * @var Suite::m_function Entry point
+ * @var Suite::m_description One line description for usage()
+ */
+struct Suite {
+  const char *m_name;
+  SuiteFunction m_function;
+  const char *m_description;
+};
+
+const Suite SUITES[] = {
+    {"connect", runConnectBench,
+     "accept, subscribe and unsubscribe throughput"},
+    {"churn", runChurnBench,
+     "subscribe, unsubscribe and reconnect latency under random churn"},
+    {"registry", runRegistryBench,
+     "channel and subscription index, open-hash vs std::list"},
+    {"batch", runBatchBench,
+     "startup subscribe time, single vs batch requests"},
+    {"seqlock", runSeqlockBench,
+     "seqlock ring model, not DatagramBoard, per CPU placement"},
+    {"filter", runFilterBench,
+     "reader filtering by key, full scan vs key index"},
+    {"reserve", runReserveBench,
+     "writing snapshots, copied vs built in place with reserve/commit"},
+    {"slowreader", runSlowReaderBench,
+     "slow reader detection, reporting vs silent readers"},
+    {"resize", runResizeBench,
+     "channel resize latency, and resizes whose writer never moves"},
+    {"lastvalue", runLastValueBench,
+     "late joiner last-value copy, and last values across resizes"},
+    {"recover", runRecoverBench,
+     "board recovery after a manager crash, and manager takeover"},
+    {"python", runPythonBench,
+     "python reader against a BoardRing writer, values and datagrams"},
+};
+const size_t NUM_SUITES = sizeof(SUITES) / sizeof(SUITES[0]);
+
+/**
+ * @return the smb_manager binary next to this one
+ */
+std::string defaultManagerPath(const char *programName) {
+  char path[PATH_MAX];
+  ssize_t size = ::readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (0 > size) {
+    ::strncpy(path, programName, sizeof(path) - 1);
+    size = ::strlen(path);
+  }
+  path[size] = '\0';
+
+  return std::string(::dirname(path)) + "/smb_manager";
+}
+
+/**
+ * Parses a comma separated list of cpus
+ *
+ * @return 0 on success, non-zero on error
+ */
+int parseCpus(const char *list, std::vector<int> *cpus) {
+  const char *end = list;
+
+  cpus->clear();
+  for (;;) {
+    const char *start = end;
+    uint64_t cpu = StrToInt::parseUint(start, StrToInt::npos, 10, &end);
+    if ((start == end) || (CPU_SETSIZE <= cpu)) {
+      return -1;
+    }
+    cpus->push_back(static_cast<int>(cpu));
+
+    if ('\0' == *end) {
+      return 0;
+    }
+    if (',' != *end++) {
+      return -1;
+    }
+  }
+}
+
+void usage(const char *programName) {
+  std::cerr << programName << " [option]* <suite>*" << std::endl
+
+            << "Option Descriptions:" << std::endl
+
+            << "  --manager    | -m <string>  : path to the smb_manager binary "
+            << "(default: next to this binary)" << std::endl
+
+            << "  --dispatcher | -D <string>  : \"select\", \"epoll\" or "
+            << "\"both\" (default: both)" << std::endl
+
+            << "  --clients    | -c <integer> : concurrent clients (default: "
+            << DEFAULT_CLIENTS << ")" << std::endl
+
+            << "  --channels   | -n <integer> : distinct channels (default: "
+            << "connect 100, churn 1000, registry 100000, "
+            << "batch 2000)" << std::endl
+
+            << "  --cpus       | -C <list>    : comma separated cpus, the "
+            << "seqlock writer's then its readers' (default: same socket, "
+            << "cross socket and fan out)" << std::endl
+
+            << "  --python     | -p <string>  : path to python/smbcast.py "
+            << "(default: " << DEFAULT_PYTHON_READER_PATH << ")" << std::endl
+
+            << "  --help       | -[h?]        : display this help message"
+            << std::endl
+
+            << "Suites (default: all):" << std::endl;
+
+  for (size_t i = 0; i < NUM_SUITES; i++) {
+    std::cerr << "  " << SUITES[i].m_name << " : " << SUITES[i].m_description
+              << std::endl;
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  std::string dispatcher = "both";
+  std::vector<const Suite *> suites;
+  int retVal = 0;
+
+  options.m_clients = DEFAULT_CLIENTS;
+  // 0 selects each suite's own default
+  options.m_channels = 0;
+  options.m_pythonReaderPath = DEFAULT_PYTHON_READER_PATH;
+
+  // setup getopt_long options
+  const char *optstring = "m:D:c:n:C:p:h?";
+  const struct option longopts[] =
+      // {char* name, int has_arg, int* flag, int val}
+      {{"manager", required_argument, 0, 'm'},
+       {"dispatcher", required_argument, 0, 'D'},
+       {"clients", required_argument, 0, 'c'},
+       {"channels", required_argument, 0, 'n'},
+       {"cpus", required_argument, 0, 'C'},
+       {"python", required_argument, 0, 'p'},
+       {"help", no_argument, 0, 'h'},
+       {0, 0, 0, 0}};
+
+  int option;
+  while (-1 != (option = ::getopt_long(argc, argv, optstring, longopts, 0))) {
+    switch (option) {
+    case 'm': {
+      options.m_managerPath = ::optarg;
+    } break;
+
+    case 'D': {
+      dispatcher = ::optarg;
+    } break;
+
+    case 'c': {
+      options.m_clients = StrToInt::parseUint(::optarg);
+    } break;
+
+    case 'n': {
+      options.m_channels = StrToInt::parseUint(::optarg);
+    } break;
+
+    case 'C': {
+      if (0 != parseCpus(::optarg, &(options.m_cpus))) {
+        std::cerr << "Invalid cpu list \"" << ::optarg << "\"" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'p': {
+      options.m_pythonReaderPath = ::optarg;
+    } break;
+
+    default: {
+      usage(argv[0]);
+      return 1;
+    } break;
+    }
+  }
+
+  // verify arguments
+  if (0 == options.m_clients) {
+    std::cerr << "Please specify at least one client" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  if ("both" == dispatcher) {
+    options.m_dispatchers.push_back("select");
+    options.m_dispatchers.push_back("epoll");
+  } else if (("select" == dispatcher) || ("epoll" == dispatcher)) {
+    options.m_dispatchers.push_back(dispatcher);
+  } else {
+    std::cerr << "Unknown dispatcher \"" << dispatcher << "\"" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (options.m_managerPath.empty()) {
+    options.m_managerPath = defaultManagerPath(argv[0]);
+  }
+
+  // select suites
+  for (int i = ::optind; i < argc; i++) {
+    size_t j;
+    for (j = 0; j < NUM_SUITES; j++) {
+      if (0 == ::strcmp(argv[i], SUITES[j].m_name)) {
+        suites.push_back(&SUITES[j]);
+        break;
+      }
+    }
+
+    if (NUM_SUITES == j) {
+      std::cerr << "Unknown suite \"" << argv[i] << "\"" << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (suites.empty()) {
+    for (size_t i = 0; i < NUM_SUITES; i++) {
+      suites.push_back(&SUITES[i]);
+    }
+  }
+
+  // run
+  BenchUtil::printResultHeader();
+  for (size_t i = 0; i < suites.size(); i++) {
+    if (0 != suites[i]->m_function(options)) {
+      retVal = 1;
+    }
+  }
+
+  return retVal;
+}
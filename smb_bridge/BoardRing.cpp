@@ -0,0 +1,404 @@
+#include "BoardRing.h"
+
+#include <atomic>
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+uint64_t nowNanos(void) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+} // namespace
+
+uint64_t BoardRing::written(void) const {
+  const uint64_t position = m_info->m_position;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return position;
+}
+
+uint64_t BoardRing::writtenSequence(void) const {
+  const uint64_t sequence = m_info->m_sequence;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sequence;
+}
+
+int BoardRing::map(int boardFd, bool writable) {
+  struct stat status;
+  void *mapping;
+
+  unmap();
+
+  if ((writable && !WRITABLE) || (0 != ::fstat(boardFd, &status)) ||
+      (sizeof(DatagramBoard::BoardInfo) >=
+       static_cast<size_t>(status.st_size))) {
+    return -1;
+  }
+
+  mapping = ::mmap(0, status.st_size,
+                   writable ? (PROT_READ | PROT_WRITE) : (PROT_READ),
+                   MAP_SHARED, boardFd, 0);
+  if (MAP_FAILED == mapping) {
+    return -1;
+  }
+
+  m_info = static_cast<DatagramBoard::BoardInfo *>(mapping);
+  m_data = static_cast<char *>(mapping) + sizeof(DatagramBoard::BoardInfo);
+  m_mapSize = status.st_size;
+  m_size = m_info->m_size;
+  if (m_mapSize - sizeof(DatagramBoard::BoardInfo) < m_size) {
+    // a header from another layout
+    unmap();
+    return -1;
+  }
+  m_index = KeyIndex::find(mapping, m_mapSize);
+  m_lastValues = LastValueArea::find(mapping, m_mapSize);
+  m_wait = WaitArea::find(mapping, m_mapSize);
+  if ((0 != m_wait) && (!writable)) {
+    mapWaitArea(boardFd, status.st_blksize);
+  } else if (0 != m_wait) {
+    // readers may block from now on
+    m_wait->m_wakers.fetch_add(1, std::memory_order_seq_cst);
+    m_waking = true;
+  }
+  m_position = written();
+  m_sequence = writtenSequence();
+  if ((0 != m_index) && writable) {
+    KeyIndex::start(m_index, m_sequence);
+  }
+
+  return 0;
+}
+
+void BoardRing::unmap(void) {
+  if (m_waking) {
+    m_wait->m_wakers.fetch_sub(1, std::memory_order_seq_cst);
+    m_waking = false;
+  }
+  if (0 != m_info) {
+    ::munmap(m_info, m_mapSize);
+    m_info = 0;
+    m_data = 0;
+    m_index = 0;
+    m_lastValues = 0;
+    m_wait = 0;
+  }
+  if (0 != m_waitMapping) {
+    ::munmap(m_waitMapping, m_waitMapSize);
+    m_waitMapping = 0;
+  }
+}
+
+void BoardRing::mapWaitArea(int boardFd, uint64_t blockSize) {
+  const uint64_t waitOffset =
+      reinterpret_cast<char *>(m_wait) - reinterpret_cast<char *>(m_info);
+  const uint64_t pageSize = ::sysconf(_SC_PAGESIZE);
+  // hugetlb files are only mapped in whole huge pages, their block size
+  const uint64_t granule =
+      ((pageSize < blockSize) && (0 == (blockSize & (blockSize - 1))))
+          ? (blockSize)
+          : (pageSize);
+  const uint64_t mapOffset = waitOffset & ~(granule - 1);
+  void *mapping;
+
+  m_wait = 0;
+  mapping = ::mmap(0, waitOffset - mapOffset + WaitArea::SIZE,
+                   PROT_READ | PROT_WRITE, MAP_SHARED, boardFd, mapOffset);
+  if (MAP_FAILED == mapping) {
+    // e.g. a read-only fd, the reader polls
+    return;
+  }
+
+  m_waitMapping = mapping;
+  m_waitMapSize = waitOffset - mapOffset + WaitArea::SIZE;
+  m_wait = reinterpret_cast<WaitArea::Header *>(
+      static_cast<char *>(mapping) + (waitOffset - mapOffset));
+}
+
+int BoardRing::peek(const char **datagram, uint32_t *size) {
+  for (;;) {
+    const uint64_t end = written();
+    uint64_t offset;
+    uint64_t room;
+    uint32_t length;
+
+    if (end - m_position > m_size) {
+      return -1;
+    }
+    if (end == m_position) {
+      return 1;
+    }
+
+    offset = m_position % m_size;
+    room = m_size - offset;
+    if (sizeof(length) > room) {
+      m_position += room;
+      continue;
+    }
+
+    ::memcpy(&length, m_data + offset, sizeof(length));
+    if (WRAP == length) {
+      m_position += room;
+      continue;
+    }
+    if (sizeof(length) + length > room) {
+      // lapped while reading the length
+      return -1;
+    }
+
+    *datagram = m_data + offset + sizeof(length);
+    *size = length;
+    return 0;
+  }
+}
+
+int BoardRing::indexed(uint64_t sequence, uint64_t *position,
+                       uint32_t *length) const {
+  uint64_t offset;
+
+  *position =
+      KeyIndex::positions(m_index)[sequence & (m_index->m_capacity - 1)];
+  offset = *position % m_size;
+  ::memcpy(length, m_data + offset, sizeof(*length));
+
+  // the entry, or the datagram's length, may have been overwritten
+  // while they were read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if ((writtenSequence() - sequence > m_index->m_capacity) ||
+      (written() - *position > m_size) || (WRAP == *length) ||
+      (sizeof(*length) + *length > m_size - offset)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int BoardRing::peekKeyed(const uint32_t *keys, size_t numKeys,
+                         const char **datagram, uint32_t *size) {
+  const uint64_t end = writtenSequence();
+  uint64_t match;
+  uint64_t position;
+  uint32_t length;
+
+  if (!KeyIndex::covers(m_index, m_sequence, end)) {
+    // a writer that does not index, or one that started after the
+    // reader, which then reads everything up to where the index starts
+    return peek(datagram, size);
+  }
+  if (end - m_sequence > m_index->m_capacity) {
+    return -1;
+  }
+
+  if (0 != KeyIndex::scan(m_index, m_sequence, end, keys, numKeys, &match)) {
+    // past the last datagram scanned, not past what the writer published
+    // since, should the index stop covering it
+    if (m_sequence != end) {
+      if (0 != indexed(end - 1, &position, &length)) {
+        return -1;
+      }
+      m_position = position + footprint(length);
+      m_sequence = end;
+    }
+    return 1;
+  }
+
+  if (0 != indexed(match, &position, &length)) {
+    return -1;
+  }
+
+  m_position = position;
+  m_sequence = match;
+  *datagram = m_data + (position % m_size) + sizeof(length);
+  *size = length;
+  return 0;
+}
+
+int BoardRing::lastValue(uint32_t key, char *value, uint32_t *size,
+                         uint64_t *position) const {
+  if (0 == m_lastValues) {
+    return -1;
+  }
+
+  return LastValueArea::read(m_lastValues, key, value, size, position,
+                             LAST_VALUE_ATTEMPTS);
+}
+
+int BoardRing::wait(uint64_t spinNanos, uint64_t timeoutNanos) {
+  const uint64_t start = nowNanos();
+  uint64_t now = start;
+
+  while (now - start < spinNanos) {
+    if (written() != m_position) {
+      return 0;
+    }
+    now = nowNanos();
+  }
+
+  for (;;) {
+    const uint64_t left =
+        (WAIT_FOREVER == timeoutNanos)
+            ? (WAIT_FOREVER)
+            : ((now - start < timeoutNanos) ? (timeoutNanos - (now - start))
+                                            : (0));
+    bool ready;
+
+    if (0 == left) {
+      return (written() != m_position) ? (0) : (1);
+    }
+
+    if ((0 == m_wait) ||
+        (0 == m_wait->m_wakers.load(std::memory_order_relaxed))) {
+      const uint64_t sleep = (POLL_NANOS < left) ? (POLL_NANOS) : (left);
+      const struct timespec duration = {
+          static_cast<time_t>(sleep / 1000000000),
+          static_cast<long>(sleep % 1000000000)};
+
+      if (written() != m_position) {
+        return 0;
+      }
+      ::nanosleep(&duration, 0);
+    } else {
+      uint32_t wakes;
+
+      // registered before the board is checked, as the writer publishes
+      // before it checks for waiters
+      m_wait->m_waiters.fetch_add(1, std::memory_order_seq_cst);
+      wakes = m_wait->m_wakes.load(std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      ready = (written() != m_position);
+      if (!ready) {
+        WaitArea::block(m_wait, wakes, left);
+      }
+      m_wait->m_waiters.fetch_sub(1, std::memory_order_relaxed);
+      if (ready) {
+        return 0;
+      }
+    }
+
+    if (written() != m_position) {
+      return 0;
+    }
+    now = nowNanos();
+  }
+}
+
+void BoardRing::consume(uint32_t size) {
+  m_position += footprint(size);
+  m_sequence++;
+}
+
+uint64_t BoardRing::skip(void) {
+  const uint64_t end = written();
+  const uint64_t skipped = end - m_position;
+
+  m_position = end;
+  m_sequence = writtenSequence();
+  return skipped;
+}
+
+#ifdef SMB_BOARDRING_WRITER
+int BoardRing::write(const char *datagram, uint32_t size, uint32_t key) {
+  char *target = reserve(size);
+
+  if (0 == target) {
+    return -1;
+  }
+
+  ::memcpy(target, datagram, size);
+  return commit(size, key);
+}
+
+int BoardRing::writeLastValue(const char *datagram, uint32_t size,
+                              uint32_t key) {
+  char *target;
+
+  if (0 == m_lastValues) {
+    return -1;
+  }
+  target = reserve(size);
+  if (0 == target) {
+    return -1;
+  }
+
+  ::memcpy(target, datagram, size);
+  // before the datagram is published, so that a reader that maps the
+  // board after it finds the value
+  if (0 != LastValueArea::update(m_lastValues, key, datagram, size,
+                                 m_reserved)) {
+    abort();
+    return -1;
+  }
+
+  return commit(size, key);
+}
+
+int BoardRing::moveTo(int boardFd) {
+  BoardRing next;
+
+  if (0 != next.map(boardFd, true)) {
+    unmap();
+    return -1;
+  }
+  if ((0 != m_lastValues) && (0 != next.m_lastValues)) {
+    // the new board's readers find them before its first datagram
+    LastValueArea::copy(m_lastValues, next.m_lastValues);
+  }
+  next.unmap();
+
+  return map(boardFd, true);
+}
+
+char *BoardRing::reserve(uint32_t maxSize) {
+  const uint64_t bytes = footprint(maxSize);
+  const uint64_t offset = m_position % m_size;
+  const uint64_t room = m_size - offset;
+  const uint32_t wrap = WRAP;
+
+  m_reserving = false;
+  if (m_size < bytes) {
+    return 0;
+  }
+
+  m_reserved = m_position;
+  if (bytes > room) {
+    // readers only look this far once the datagram is committed
+    if (sizeof(wrap) <= room) {
+      ::memcpy(m_data + offset, &wrap, sizeof(wrap));
+    }
+    m_reserved += room;
+  }
+  m_reserving = true;
+  m_reservedSize = maxSize;
+
+  return m_data + (m_reserved % m_size) + sizeof(uint32_t);
+}
+
+int BoardRing::commit(uint32_t size, uint32_t key) {
+  if ((!m_reserving) || (m_reservedSize < size)) {
+    return -1;
+  }
+
+  ::memcpy(m_data + (m_reserved % m_size), &size, sizeof(size));
+  if (0 != m_index) {
+    KeyIndex::append(m_index, m_sequence, key, m_reserved);
+  }
+  m_position = m_reserved + footprint(size);
+  m_sequence++;
+  m_reserving = false;
+
+  // readers must see the datagram before the position that covers it
+  std::atomic_thread_fence(std::memory_order_release);
+  m_info->m_sequence = m_sequence;
+  m_info->m_position = m_position;
+  if (0 != m_wait) {
+    WaitArea::wake(m_wait);
+  }
+
+  return 0;
+}
+#endif
@@ -0,0 +1,385 @@
+#ifndef SMB_BRIDGE_BOARDRING_H_
+#define SMB_BRIDGE_BOARDRING_H_
+
+/***
+ * @file BoardRing.h
+ *
+ * @brief
+ * Reads or writes the datagrams of a mapped board.
+ *
+ * @description
+ * The board starts with its DatagramBoard::BoardInfo header, whose
+ * m_sequence and m_position count the datagrams and bytes written, and
+ * are published once a datagram is complete. The datagrams follow, each
+ * a uint32_t length and the datagram, padded to ALIGNMENT. A datagram
+ * never straddles the end of the board: the writer leaves a WRAP length,
+ * or no length if there is no room for one, and goes on at the
+ * beginning. Positions grow forever; a datagram's offset is its position
+ * modulo the board size. This is the layout python/smbcast.py reads.
+ *
+ * The layout is this tree's reading of DatagramBoard's, which lives in
+ * libnano and has not been checked against it. Until it is, only builds
+ * with SMB_BOARDRING_WRITER defined map boards writable, so that no
+ * writer puts datagrams in another framing into channels shared with
+ * DatagramBoard readers. smb_bench defines it for the boards it measures
+ * on, its own or those of the manager it forks. smb_bridge and
+ * smb_journal only read boards.
+ *
+ * A reader is lapped once the writer is a board ahead of it. It then
+ * skips to where the writer is, since datagram boundaries are only known
+ * from there on.
+ *
+ * A board may have a key index (see KeyIndex.h). The writer then keys
+ * each datagram, and a reader interested in a few keys finds their
+ * datagrams with peekKeyed(), which skips the others without touching
+ * them. Only datagrams the index covers are skipped: those of a writer
+ * that does not index, e.g. one writing through DatagramBoard, come back
+ * whatever their key, so readers check it all the same. A reader uses
+ * either peek() or peekKeyed().
+ *
+ * A reader with nothing to read may wait() for the writer: it spins for
+ * a while, for the latency of a busy channel, and then blocks on the
+ * board's wait area (see WaitArea.h), so that a quiet channel costs no
+ * CPU. Boards without one, or whose writer does not wake readers, are
+ * polled instead.
+ *
+ * A writer either copies a datagram in with write(), or builds it in
+ * place: reserve() hands out room for it straight in the ring, and
+ * commit() publishes it, or abort() drops it. A reservation that does
+ * not fit before the end of the board starts at the beginning, behind a
+ * WRAP, as write() does. Nothing is published until commit(), so that
+ * readers never see a datagram half built.
+ *
+ * The writer calls, from write() on, only exist in builds with
+ * SMB_BOARDRING_WRITER, i.e. in smb_bench, whose reserve suite measures
+ * reserve() and commit() against write(). Writers on DatagramBoard
+ * itself, which lives in libnano, have no reserve and commit.
+ *
+ * A board may have a last-value area (see LastValueArea.h). A writer
+ * that publishes the latest value of a key, e.g. a symbol's book, does
+ * so with writeLastValue(), which stores it in the key's slot before the
+ * datagram is published, so that a reader joining late finds the value
+ * of every datagram written before it mapped the board with lastValue().
+ * A writer moved to the board a channel was resized to with moveTo()
+ * carries the values over before it writes there.
+ */
+
+#include <smb_manager/KeyIndex.h>
+#include <smb_manager/LastValueArea.h>
+#include <smb_manager/WaitArea.h>
+
+#include <core/link/DatagramBoard.h>
+
+#include <span>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class BoardRing {
+public:
+  static const size_t ALIGNMENT = 8;
+  static const uint32_t WRAP = 0xFFFFFFFF;
+
+  /***
+   * @var WRITABLE Whether boards may be mapped writable, see above
+   */
+#ifdef SMB_BOARDRING_WRITER
+  static const bool WRITABLE = true;
+#else
+  static const bool WRITABLE = false;
+#endif
+
+private:
+  // not copyable, as the board is unmapped on destruction
+  BoardRing(const BoardRing &);
+  BoardRing &operator=(const BoardRing &);
+
+  DatagramBoard::BoardInfo *m_info;
+  char *m_data;
+  KeyIndex::Header *m_index;
+  LastValueArea::Header *m_lastValues;
+  WaitArea::Header *m_wait;
+  // a reader's writable mapping of the wait area
+  void *m_waitMapping;
+  size_t m_waitMapSize;
+  // whether the writer counts in the wait area's m_wakers
+  bool m_waking;
+  size_t m_mapSize;
+  uint64_t m_size;
+  uint64_t m_position;
+  // the datagrams written, or those a reader moved past
+  uint64_t m_sequence;
+  // the position of the reserved datagram's length, and its largest size
+  bool m_reserving;
+  uint64_t m_reserved;
+  uint32_t m_reservedSize;
+
+  uint64_t written(void) const;
+
+  uint64_t writtenSequence(void) const;
+
+  /***
+   * Reads the key index entry of a datagram and the length it points at
+   *
+   * @return 0 on success, non-zero if the writer lapped them
+   */
+  int indexed(uint64_t sequence, uint64_t *position, uint32_t *length) const;
+
+  /***
+   * Maps the wait area of a board mapped read-only writable, so that the
+   * reader can register in it
+   */
+  void mapWaitArea(int boardFd, uint64_t blockSize);
+
+public:
+  /***
+   * @var POLL_NANOS How long wait() sleeps between looks at a board
+   * it cannot block on
+   * @var WAIT_FOREVER A wait() timeout for no limit
+   * @var LAST_VALUE_ATTEMPTS How often lastValue() retries while the
+   * writer updates the value
+   */
+  static const uint64_t POLL_NANOS = 50000;
+  static const uint64_t WAIT_FOREVER = UINT64_MAX;
+  static const size_t LAST_VALUE_ATTEMPTS = 100000;
+
+  BoardRing(void);
+
+  ~BoardRing(void);
+
+  /***
+   * Maps a board. A reader starts where the writer is, a writer goes on
+   * after the last datagram
+   *
+   * @param writable Whether to write to it. Fails unless WRITABLE
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int map(int boardFd, bool writable);
+
+  void unmap(void);
+
+  bool mapped(void) const;
+
+  /***
+   * @return the size of the board, without its header
+   */
+  uint64_t size(void) const;
+
+  /***
+   * Finds the next datagram without moving past it
+   *
+   * @param datagram Set to the datagram, in the board
+   * @param size Set to its size
+   *
+   * @return 0 if there is one, 1 if the writer is not further, negative
+   * if the reader was lapped, in which case it must skip()
+   */
+  int peek(const char **datagram, uint32_t *size);
+
+  /***
+   * @return whether the board has a key index
+   */
+  bool keyed(void) const;
+
+  /***
+   * Finds the next datagram with one of the keys without moving past it,
+   * skipping the others through the board's key index. Where the index
+   * does not cover the board, it finds the next datagram, as peek()
+   *
+   * @param keys The keys of interest
+   * @param datagram Set to the datagram, in the board
+   * @param size Set to its size
+   *
+   * @return 0 if there is one, 1 if the writer has no further datagram
+   * that may have those keys, negative if the reader was lapped, in which
+   * case it must skip()
+   */
+  int peekKeyed(const uint32_t *keys, size_t numKeys, const char **datagram,
+                uint32_t *size);
+
+  /***
+   * @return the keys of the board's last-value area, 0 if it has none
+   */
+  uint32_t lastValueKeys(void) const;
+
+  /***
+   * Copies the last value of a key
+   *
+   * @param value At least the area's value size
+   * @param size Set to the size of the value
+   * @param position Set to the position of the datagram that carried it,
+   * or 0 if it was carried over from the board of a resized channel. A
+   * reader that mapped the board at or before it reads that datagram too
+   *
+   * @return 0 on success, 1 if the key has no value yet, negative if the
+   * board has no last-value area, the key is out of range or the writer
+   * kept updating the value
+   */
+  int lastValue(uint32_t key, char *value, uint32_t *size,
+                uint64_t *position) const;
+
+  /***
+   * Waits until the writer wrote past what peek() or peekKeyed() last
+   * found. Readers of a resized channel should wait with a timeout, as
+   * the writer goes on on the new board
+   *
+   * @param spinNanos How long to spin before blocking
+   * @param timeoutNanos How long to wait in all, or WAIT_FOREVER
+   *
+   * @return 0 once there is more, 1 on timeout
+   */
+  int wait(uint64_t spinNanos, uint64_t timeoutNanos);
+
+  /***
+   * @return whether the writer has not lapped the datagram peek() or
+   * peekKeyed() found yet. Check after copying it
+   */
+  bool intact(void) const;
+
+  /***
+   * Moves past the datagram peek() or peekKeyed() found
+   */
+  void consume(uint32_t size);
+
+  /***
+   * Moves to where the writer is
+   *
+   * @return the bytes skipped
+   */
+  uint64_t skip(void);
+
+  /***
+   * Moves a reader to the first datagram of a board the writer started
+   * afresh, e.g. one a channel was resized to
+   */
+  void rewind(void);
+
+#ifdef SMB_BOARDRING_WRITER
+  /***
+   * Appends a datagram and publishes it, with KeyIndex::NO_KEY if the
+   * board has a key index
+   *
+   * @return 0 on success, non-zero if it does not fit in the board
+   */
+  int write(const char *datagram, uint32_t size);
+
+  /***
+   * Appends a datagram with its key and publishes it
+   *
+   * @return 0 on success, non-zero if it does not fit in the board
+   */
+  int write(const char *datagram, uint32_t size, uint32_t key);
+
+  /***
+   * Appends a datagram with its key, makes it the key's last value and
+   * publishes it
+   *
+   * @return 0 on success, non-zero if the board has no last-value area,
+   * the key is out of range, or the datagram does not fit in the board
+   * or in a slot
+   */
+  int writeLastValue(const char *datagram, uint32_t size, uint32_t key);
+
+  /***
+   * Moves a writer to the board a channel was resized to, carrying the
+   * last values of keys over to it. Call it before writing to the new
+   * board
+   *
+   * @return 0 on success, non-zero on error, in which case the writer
+   * maps no board
+   */
+  int moveTo(int boardFd);
+
+  /***
+   * Reserves room for a datagram of up to maxSize bytes in the ring. It
+   * replaces a reservation not committed yet
+   *
+   * @return where to build the datagram, 0 if its footprint() is larger
+   * than the board
+   */
+  char *reserve(uint32_t maxSize);
+
+  /***
+   * reserve(), as a span of maxSize bytes that ends within the board,
+   * with no data() if it does not fit
+   */
+  std::span<char> reserveSpan(uint32_t maxSize);
+
+  /***
+   * Publishes the reserved datagram, with its key if the board has a key
+   * index
+   *
+   * @param size Its size, at most what was reserved
+   *
+   * @return 0 on success, non-zero if nothing of that size was reserved
+   */
+  int commit(uint32_t size, uint32_t key = KeyIndex::NO_KEY);
+
+  /***
+   * Drops the reserved datagram
+   */
+  void abort(void);
+#endif
+
+  /***
+   * @return the bytes a datagram takes in the board
+   */
+  static uint64_t footprint(uint32_t size);
+};
+
+// inline and template functions
+inline BoardRing::BoardRing(void)
+    : m_info(0), m_data(0), m_index(0), m_lastValues(0), m_wait(0),
+      m_waitMapping(0),
+      m_waitMapSize(0), m_waking(false), m_mapSize(0), m_size(0),
+      m_position(0), m_sequence(0), m_reserving(false), m_reserved(0),
+      m_reservedSize(0) {}
+
+inline BoardRing::~BoardRing(void) { unmap(); }
+
+inline bool BoardRing::mapped(void) const { return 0 != m_info; }
+
+inline uint64_t BoardRing::size(void) const { return m_size; }
+
+inline bool BoardRing::keyed(void) const { return 0 != m_index; }
+
+inline uint32_t BoardRing::lastValueKeys(void) const {
+  return (0 == m_lastValues) ? (0) : (m_lastValues->m_numKeys);
+}
+
+inline void BoardRing::rewind(void) {
+  m_position = 0;
+  m_sequence = 0;
+}
+
+inline bool BoardRing::intact(void) const {
+  return written() - m_position <= m_size;
+}
+
+#ifdef SMB_BOARDRING_WRITER
+inline int BoardRing::write(const char *datagram, uint32_t size) {
+  return write(datagram, size, KeyIndex::NO_KEY);
+}
+
+inline std::span<char> BoardRing::reserveSpan(uint32_t maxSize) {
+  char *datagram = reserve(maxSize);
+  uint64_t room;
+
+  if (0 == datagram) {
+    return std::span<char>();
+  }
+
+  // where the reservation went, behind a WRAP or not
+  room = m_size - (m_reserved % m_size) - sizeof(uint32_t);
+  return std::span<char>(datagram, (room < maxSize) ? (room) : (maxSize));
+}
+
+inline void BoardRing::abort(void) { m_reserving = false; }
+#endif
+
+inline uint64_t BoardRing::footprint(uint32_t size) {
+  return (sizeof(uint32_t) + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+#endif // SMB_BRIDGE_BOARDRING_H_
@@ -0,0 +1,157 @@
+#ifndef SMB_BRIDGE_BRIDGEPROTOCOL_H_
+#define SMB_BRIDGE_BRIDGEPROTOCOL_H_
+
+/***
+ * @file BridgeProtocol.h
+ *
+ * @brief
+ * The UDP packets smb_bridge sends between hosts.
+ *
+ * @description
+ * -# Data carries datagrams of one channel, as many as fit in a packet.
+ *    Packets are numbered per channel from 0.
+ * -# Nak asks for packets again, unicast by a receiver to the sender
+ *    once it sees a packet number jump. The sender sends them again,
+ *    unicast, while they are still in its replay buffer, and a Heartbeat
+ *    otherwise.
+ * -# Heartbeat announces a channel, every so often and whenever a Nak
+ *    asks for packets the sender no longer holds. It names the channel,
+ *    so that a receiver can create it locally, and carries the next
+ *    packet number and the oldest one the sender holds, so that a
+ *    receiver finds out about packets lost at the tail of a burst, and
+ *    gives up on those it can no longer get.
+ *
+ * Each sender picks a random session when it starts; a receiver that
+ * sees the session of a channel change starts the channel over.
+ *
+ * Fields are in host byte order: the bridge runs between hosts of the
+ * same byte order.
+ *
+ * Only the sending side is in this tree. A receiver writes the channels
+ * to the boards of its host's manager, which needs DatagramBoard's own
+ * write API: BoardRing's framing is not checked against it (see
+ * BoardRing.h).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct BridgeProtocol {
+  static const uint32_t MAGIC = 0x534d4242;
+  static const uint8_t VERSION = 1;
+
+  enum PacketType { DATA = 1, NAK = 2, HEARTBEAT = 3 };
+
+  /***
+   * The largest UDP payload
+   */
+  static const size_t MAX_PACKET_SIZE = 65507;
+
+  /***
+   * The longest channel name
+   */
+  static const size_t MAX_CHANNEL_NAME_LENGTH = 256;
+
+  /***
+   * The header of every packet
+   *
+   * @var Header::m_magic MAGIC
+   * @var Header::m_version VERSION
+   * @var Header::m_type A PacketType
+   * @var Header::m_channelId The channel's index in the sender's list
+   * @var Header::m_session The sender's session
+   * @var Header::m_size The packet size
+   * @var Header::m_sequence The packet number for Data, the first
+   * missing one for Nak, the next one to be sent for Heartbeat
+   */
+  struct Header {
+    uint32_t m_magic;
+    uint8_t m_version;
+    uint8_t m_type;
+    uint16_t m_channelId;
+    uint32_t m_session;
+    uint32_t m_size;
+    uint64_t m_sequence;
+  };
+
+  /***
+   * Each datagram is a uint32_t length followed by the datagram,
+   * unaligned
+   *
+   * @var Data::m_count The number of datagrams
+   */
+  struct Data {
+    Header m_header;
+    uint32_t m_count;
+    uint32_t m_reserved;
+    char m_datagrams[1];
+  };
+
+  /***
+   * @var Nak::m_count The number of packets from m_header.m_sequence
+   */
+  struct Nak {
+    Header m_header;
+    uint64_t m_count;
+  };
+
+  /***
+   * @var Heartbeat::m_oldestSequence The oldest packet the sender holds
+   * @var Heartbeat::m_boardSize The size of the channel's board
+   * @var Heartbeat::m_channelName The channel name, 0 terminated
+   */
+  struct Heartbeat {
+    Header m_header;
+    uint64_t m_oldestSequence;
+    uint64_t m_boardSize;
+    char m_channelName[MAX_CHANNEL_NAME_LENGTH + 1];
+
+    /***
+     * @return the size of a heartbeat naming a channel
+     */
+    static size_t size(const char *channelName);
+  };
+
+  /***
+   * Fills in a header, but for m_size
+   */
+  static void initHeader(Header *header, PacketType type,
+                         uint16_t channelId, uint32_t session,
+                         uint64_t sequence);
+
+  /***
+   * @return whether buffer holds a complete, well formed packet of the
+   * given type and at least minimumSize bytes
+   */
+  static bool isPacket(const char *buffer, size_t size, PacketType type,
+                       size_t minimumSize);
+};
+
+// inline and template functions
+inline size_t BridgeProtocol::Heartbeat::size(const char *channelName) {
+  return offsetof(Heartbeat, m_channelName) + ::strlen(channelName) + 1;
+}
+
+inline void BridgeProtocol::initHeader(Header *header, PacketType type,
+                                       uint16_t channelId, uint32_t session,
+                                       uint64_t sequence) {
+  header->m_magic = MAGIC;
+  header->m_version = VERSION;
+  header->m_type = type;
+  header->m_channelId = channelId;
+  header->m_session = session;
+  header->m_size = 0;
+  header->m_sequence = sequence;
+}
+
+inline bool BridgeProtocol::isPacket(const char *buffer, size_t size,
+                                     PacketType type, size_t minimumSize) {
+  const Header *header = reinterpret_cast<const Header *>(buffer);
+
+  return (minimumSize <= size) && (sizeof(Header) <= size) &&
+         (MAGIC == header->m_magic) && (VERSION == header->m_version) &&
+         (type == header->m_type) && (size == header->m_size);
+}
+
+#endif // SMB_BRIDGE_BRIDGEPROTOCOL_H_
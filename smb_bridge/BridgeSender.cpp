@@ -0,0 +1,423 @@
+#include "BridgeSender.h"
+
+#include <iostream>
+#include <new>
+#include <random>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+const int MANAGER_TIMEOUT_SECONDS = 10;
+
+uint64_t nowMicros(void) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+} // namespace
+
+BridgeSender::BridgeSender(void)
+    : m_options(), m_manager(), m_channels(), m_socket(-1), m_session(0),
+      m_lastHeartbeat(0), m_numSent(0) {}
+
+BridgeSender::~BridgeSender(void) {
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    delete m_channels[i];
+  }
+
+  if (0 <= m_socket) {
+    ::close(m_socket);
+  }
+}
+
+int BridgeSender::init(const Options &options) {
+  struct sockaddr_in local;
+  const int loop = 1;
+
+  m_options = options;
+  // packets are built in place, Data needs them aligned
+  m_options.m_packetSize &= ~(alignof(BridgeProtocol::Data) - 1);
+
+  if ((offsetof(BridgeProtocol::Data, m_datagrams) + sizeof(uint32_t) >=
+       m_options.m_packetSize) ||
+      (BridgeProtocol::MAX_PACKET_SIZE < m_options.m_packetSize)) {
+    std::cerr << "The packet size must be between "
+              << offsetof(BridgeProtocol::Data, m_datagrams) +
+                     sizeof(uint32_t)
+              << " and " << BridgeProtocol::MAX_PACKET_SIZE << " bytes"
+              << std::endl;
+    return -1;
+  }
+  if (BATCH_PACKETS > m_options.m_replayPackets) {
+    std::cerr << "Please keep at least " << BATCH_PACKETS
+              << " packets per channel for Naks" << std::endl;
+    return -1;
+  }
+  if (m_options.m_channels.empty() ||
+      (UINT16_MAX < m_options.m_channels.size())) {
+    std::cerr << "Please name between 1 and " << UINT16_MAX << " channels"
+              << std::endl;
+    return -1;
+  }
+
+  m_session = static_cast<uint32_t>(std::random_device()());
+
+  if (0 != m_manager.connect(m_options.m_vlan, MANAGER_TIMEOUT_SECONDS)) {
+    std::cerr << "Could not connect to the manager of vlan "
+              << m_options.m_vlan << std::endl;
+    return -1;
+  }
+
+  for (size_t i = 0; i < m_options.m_channels.size(); i++) {
+    const char *channelName = m_options.m_channels[i].c_str();
+    Channel *channel;
+    int boardFd;
+    int retVal;
+
+    if (BridgeProtocol::MAX_CHANNEL_NAME_LENGTH < ::strlen(channelName)) {
+      std::cerr << "Channel name too long: " << channelName << std::endl;
+      return -1;
+    }
+
+    channel = new (std::nothrow) Channel();
+    if (0 == channel) {
+      std::cerr << "Out of memory for the channels" << std::endl;
+      return -1;
+    }
+    try {
+      m_channels.push_back(channel);
+    } catch (const std::bad_alloc &) {
+      delete channel;
+      std::cerr << "Out of memory for the channels" << std::endl;
+      return -1;
+    }
+
+    try {
+      channel->m_name = channelName;
+      channel->m_replay.resize(m_options.m_replayPackets *
+                               m_options.m_packetSize);
+    } catch (const std::bad_alloc &) {
+      std::cerr << "Out of memory for the replay buffers" << std::endl;
+      return -1;
+    }
+    channel->m_nextSequence = 0;
+    channel->m_datagrams = 0;
+    channel->m_overruns = 0;
+    channel->m_tooLarge = 0;
+    channel->m_resent = 0;
+
+    retVal = m_manager.subscribe(channelName, false, 0, &boardFd);
+    if (0 != retVal) {
+      std::cerr << "The manager "
+                << ((0 < retVal) ? ("denied") : ("did not answer"))
+                << " the subscription to " << channelName << std::endl;
+      return -1;
+    }
+    retVal = channel->m_board.map(boardFd, false);
+    ::close(boardFd);
+    if (0 != retVal) {
+      std::cerr << "Could not map the board of " << channelName << std::endl;
+      return -1;
+    }
+  }
+
+  ::memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr = m_options.m_interface;
+  local.sin_port = 0;
+
+  m_socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if ((0 > m_socket) ||
+      (0 != ::bind(m_socket, reinterpret_cast<struct sockaddr *>(&local),
+                   sizeof(local))) ||
+      (0 != ::setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_IF,
+                         &(m_options.m_interface),
+                         sizeof(m_options.m_interface))) ||
+      (0 != ::setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL,
+                         &(m_options.m_ttl), sizeof(m_options.m_ttl))) ||
+      (0 != ::setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+                         sizeof(loop)))) {
+    std::cerr << "Could not open the socket: " << ::strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+const BridgeProtocol::Data *BridgeSender::buildPacket(uint16_t channelId) {
+  Channel *channel = m_channels[channelId];
+  char *slot = replaySlot(channel, channel->m_nextSequence);
+  BridgeProtocol::Data *packet = reinterpret_cast<BridgeProtocol::Data *>(slot);
+  char *cursor = packet->m_datagrams;
+  const char *end = slot + m_options.m_packetSize;
+  uint32_t count = 0;
+
+  for (;;) {
+    const char *datagram;
+    uint32_t size;
+    int retVal = channel->m_board.peek(&datagram, &size);
+
+    if (0 < retVal) {
+      break;
+    }
+    if (0 > retVal) {
+      channel->m_overruns++;
+      channel->m_board.skip();
+      continue;
+    }
+
+    if (offsetof(BridgeProtocol::Data, m_datagrams) + sizeof(size) + size >
+        m_options.m_packetSize) {
+      channel->m_tooLarge++;
+      channel->m_board.consume(size);
+      continue;
+    }
+    if (sizeof(size) + size > static_cast<size_t>(end - cursor)) {
+      // it starts the next packet
+      break;
+    }
+
+    ::memcpy(cursor, &size, sizeof(size));
+    ::memcpy(cursor + sizeof(size), datagram, size);
+    if (!channel->m_board.intact()) {
+      // overwritten while copied
+      channel->m_overruns++;
+      channel->m_board.skip();
+      continue;
+    }
+
+    cursor += sizeof(size) + size;
+    count++;
+    channel->m_board.consume(size);
+  }
+
+  if (0 == count) {
+    return 0;
+  }
+
+  BridgeProtocol::initHeader(&(packet->m_header), BridgeProtocol::DATA,
+                             channelId, m_session,
+                             channel->m_nextSequence++);
+  packet->m_header.m_size = cursor - slot;
+  packet->m_count = count;
+  packet->m_reserved = 0;
+  channel->m_datagrams += count;
+
+  return packet;
+}
+
+int BridgeSender::sendPackets(const BridgeProtocol::Header *const *packets,
+                              size_t count,
+                              const struct sockaddr_in *address) {
+  struct mmsghdr messages[BATCH_PACKETS];
+  struct iovec vectors[BATCH_PACKETS];
+  size_t sent = 0;
+
+  if (0 == address) {
+    address = &(m_options.m_group);
+  }
+
+  while (sent < count) {
+    const size_t batch =
+        (BATCH_PACKETS < count - sent) ? (BATCH_PACKETS) : (count - sent);
+    int retVal;
+
+    ::memset(messages, 0, sizeof(messages[0]) * batch);
+    for (size_t i = 0; i < batch; i++) {
+      vectors[i].iov_base = const_cast<BridgeProtocol::Header *>(
+          packets[sent + i]);
+      vectors[i].iov_len = packets[sent + i]->m_size;
+      messages[i].msg_hdr.msg_name = const_cast<struct sockaddr_in *>(address);
+      messages[i].msg_hdr.msg_namelen = sizeof(*address);
+      messages[i].msg_hdr.msg_iov = &(vectors[i]);
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    retVal = ::sendmmsg(m_socket, messages, batch, 0);
+    if (0 > retVal) {
+      if (EINTR == errno) {
+        continue;
+      }
+      std::cerr << "Could not send: " << ::strerror(errno) << std::endl;
+      return -1;
+    }
+    sent += retVal;
+  }
+
+  return 0;
+}
+
+int BridgeSender::sendHeartbeat(uint16_t channelId,
+                                const struct sockaddr_in *address) {
+  const Channel *channel = m_channels[channelId];
+  BridgeProtocol::Heartbeat heartbeat;
+
+  BridgeProtocol::initHeader(&(heartbeat.m_header),
+                             BridgeProtocol::HEARTBEAT, channelId, m_session,
+                             channel->m_nextSequence);
+  heartbeat.m_header.m_size =
+      BridgeProtocol::Heartbeat::size(channel->m_name.c_str());
+  heartbeat.m_oldestSequence = oldestSequence(channel);
+  heartbeat.m_boardSize = channel->m_board.size();
+  ::strcpy(heartbeat.m_channelName, channel->m_name.c_str());
+
+  const BridgeProtocol::Header *packet = &(heartbeat.m_header);
+  return sendPackets(&packet, 1, address);
+}
+
+int BridgeSender::handleNaks(void) {
+  BridgeProtocol::Nak naks[BATCH_PACKETS];
+  struct sockaddr_in senders[BATCH_PACKETS];
+  struct mmsghdr messages[BATCH_PACKETS];
+  struct iovec vectors[BATCH_PACKETS];
+  const BridgeProtocol::Header *packets[BATCH_PACKETS];
+  int numReceived;
+
+  ::memset(messages, 0, sizeof(messages));
+  for (size_t i = 0; i < BATCH_PACKETS; i++) {
+    vectors[i].iov_base = &(naks[i]);
+    vectors[i].iov_len = sizeof(naks[i]);
+    messages[i].msg_hdr.msg_name = &(senders[i]);
+    messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    messages[i].msg_hdr.msg_iov = &(vectors[i]);
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  numReceived = ::recvmmsg(m_socket, messages, BATCH_PACKETS, MSG_DONTWAIT,
+                           0);
+  if (0 > numReceived) {
+    return ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno))
+               ? (0)
+               : (-1);
+  }
+
+  for (int i = 0; i < numReceived; i++) {
+    const BridgeProtocol::Nak &nak = naks[i];
+    Channel *channel;
+    uint64_t first;
+    uint64_t last;
+    size_t count = 0;
+
+    if ((!BridgeProtocol::isPacket(reinterpret_cast<const char *>(&nak),
+                                   messages[i].msg_len, BridgeProtocol::NAK,
+                                   sizeof(nak))) ||
+        (m_session != nak.m_header.m_session) ||
+        (m_channels.size() <= nak.m_header.m_channelId)) {
+      continue;
+    }
+    channel = m_channels[nak.m_header.m_channelId];
+
+    first = nak.m_header.m_sequence;
+    if (channel->m_nextSequence <= first) {
+      continue;
+    }
+    last = (nak.m_count < channel->m_nextSequence - first)
+               ? (first + nak.m_count)
+               : (channel->m_nextSequence);
+    if (first < oldestSequence(channel)) {
+      // some are gone, tell the receiver where to go on from
+      if (0 != sendHeartbeat(nak.m_header.m_channelId, &(senders[i]))) {
+        return -1;
+      }
+      first = oldestSequence(channel);
+    }
+
+    for (uint64_t sequence = first; sequence < last; sequence++) {
+      packets[count++] = reinterpret_cast<const BridgeProtocol::Header *>(
+          replaySlot(channel, sequence));
+      if ((BATCH_PACKETS == count) || (sequence + 1 == last)) {
+        if (0 != sendPackets(packets, count, &(senders[i]))) {
+          return -1;
+        }
+        channel->m_resent += count;
+        count = 0;
+      }
+    }
+  }
+
+  return numReceived;
+}
+
+int BridgeSender::run(const volatile sig_atomic_t *stop) {
+  const BridgeProtocol::Header *packets[BATCH_PACKETS];
+
+  while (!(*stop)) {
+    size_t count = 0;
+    bool busy = false;
+    uint64_t now;
+    int numNaks;
+
+    // (1) send what the writers wrote, a batch per channel and pass at
+    // most, so that a busy channel holds up neither the others nor Naks
+    for (size_t i = 0; i < m_channels.size(); i++) {
+      const BridgeProtocol::Data *packet;
+
+      for (size_t j = 0;
+           (BATCH_PACKETS > j) && (0 != (packet = buildPacket(i))); j++) {
+        busy = true;
+        if ((0 != m_options.m_dropOneIn) &&
+            (0 == (++m_numSent % m_options.m_dropOneIn))) {
+          // left for a Nak to recover
+          continue;
+        }
+
+        packets[count++] = &(packet->m_header);
+        if (BATCH_PACKETS == count) {
+          // later packets may reuse the replay slots of these
+          if (0 != sendPackets(packets, count, 0)) {
+            return -1;
+          }
+          count = 0;
+        }
+      }
+    }
+    if ((0 < count) && (0 != sendPackets(packets, count, 0))) {
+      return -1;
+    }
+
+    // (2) announce the channels
+    now = nowMicros();
+    if (m_options.m_heartbeatMicros <= now - m_lastHeartbeat) {
+      m_lastHeartbeat = now;
+      for (size_t i = 0; i < m_channels.size(); i++) {
+        if (0 != sendHeartbeat(i, 0)) {
+          return -1;
+        }
+      }
+    }
+
+    // (3) answer the Naks, waiting for them if there is nothing else
+    numNaks = handleNaks();
+    if (0 > numNaks) {
+      std::cerr << "Could not receive: " << ::strerror(errno) << std::endl;
+      return -1;
+    }
+    if (!busy && (0 == numNaks)) {
+      struct pollfd readable = {m_socket, POLLIN, 0};
+      struct timespec timeout = {
+          static_cast<time_t>(m_options.m_idleMicros / 1000000),
+          static_cast<long>((m_options.m_idleMicros % 1000000) * 1000)};
+      ::ppoll(&readable, 1, &timeout, 0);
+    }
+  }
+
+  return 0;
+}
+
+void BridgeSender::report(void) const {
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    const Channel *channel = m_channels[i];
+
+    std::cout << channel->m_name << ": " << channel->m_datagrams
+              << " datagrams in " << channel->m_nextSequence << " packets, "
+              << channel->m_resent << " packets resent, "
+              << channel->m_overruns << " overruns, " << channel->m_tooLarge
+              << " datagrams too large" << std::endl;
+  }
+}
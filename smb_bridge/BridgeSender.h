@@ -0,0 +1,177 @@
+#ifndef SMB_BRIDGE_BRIDGESENDER_H_
+#define SMB_BRIDGE_BRIDGESENDER_H_
+
+/***
+ * @file BridgeSender.h
+ *
+ * @brief
+ * Reads channels from the local boards and sends their datagrams to a
+ * UDP multicast group.
+ *
+ * @description
+ * The sender subscribes to each channel as a reader and polls the
+ * boards. Datagrams are batched into Data packets as large as the
+ * packet size allows, and the packets of a pass go out with one
+ * sendmmsg(2). A datagram larger than a packet is dropped and counted.
+ *
+ * Every packet is built in place in the channel's replay buffer, which
+ * keeps the last replayPackets packets for Naks. Heartbeats go out for
+ * every channel each heartbeatMicros. The group may also be a unicast
+ * address, e.g. to bridge to a single host.
+ *
+ * The sender is single threaded and never blocks: when neither the
+ * boards nor the socket have anything, it waits up to idleMicros for a
+ * Nak before polling the boards again.
+ */
+
+#include "BoardRing.h"
+#include "BridgeProtocol.h"
+#include "ManagerClient.h"
+
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class BridgeSender {
+public:
+  /***
+   * @var Options::m_vlan The vlan of the local manager
+   * @var Options::m_channels The channels to send
+   * @var Options::m_group The address and port to send to
+   * @var Options::m_interface The interface to send from
+   * @var Options::m_ttl The multicast TTL, 0 to stay on the host
+   * @var Options::m_packetSize The largest packet to send
+   * @var Options::m_replayPackets The packets kept per channel for Naks
+   * @var Options::m_heartbeatMicros How often to announce each channel
+   * @var Options::m_idleMicros How long to wait for a Nak when idle
+   * @var Options::m_dropOneIn Drop one Data packet in so many the first
+   * time it is sent, 0 never. Exercises the Naks, e.g. on loopback
+   */
+  struct Options {
+    std::string m_vlan;
+    std::vector<std::string> m_channels;
+    struct sockaddr_in m_group;
+    struct in_addr m_interface;
+    int m_ttl;
+    size_t m_packetSize;
+    size_t m_replayPackets;
+    uint64_t m_heartbeatMicros;
+    uint64_t m_idleMicros;
+    uint64_t m_dropOneIn;
+  };
+
+private:
+  // not copyable
+  BridgeSender(const BridgeSender &);
+  BridgeSender &operator=(const BridgeSender &);
+
+  /***
+   * The packets sendmmsg(2) sends at most at once
+   */
+  static const size_t BATCH_PACKETS = 64;
+
+  /***
+   * @var Channel::m_name The channel name
+   * @var Channel::m_board Its board
+   * @var Channel::m_nextSequence The next packet number
+   * @var Channel::m_replay m_replayPackets packets of m_packetSize
+   * bytes, packet n in slot n % m_replayPackets
+   * @var Channel::m_datagrams Datagrams sent
+   * @var Channel::m_overruns Times the channel's writer lapped the sender
+   * @var Channel::m_tooLarge Datagrams too large for a packet
+   * @var Channel::m_resent Packets sent again for Naks
+   */
+  struct Channel {
+    std::string m_name;
+    BoardRing m_board;
+    uint64_t m_nextSequence;
+    std::vector<char> m_replay;
+    uint64_t m_datagrams;
+    uint64_t m_overruns;
+    uint64_t m_tooLarge;
+    uint64_t m_resent;
+  };
+
+  Options m_options;
+  ManagerClient m_manager;
+  std::vector<Channel *> m_channels;
+  int m_socket;
+  uint32_t m_session;
+  uint64_t m_lastHeartbeat;
+  uint64_t m_numSent;
+
+  char *replaySlot(Channel *channel, uint64_t sequence);
+
+  /***
+   * @return the oldest packet of a channel still in its replay buffer
+   */
+  uint64_t oldestSequence(const Channel *channel) const;
+
+  /***
+   * Builds the channel's next packet from its board
+   *
+   * @return the packet, 0 if the board has no datagram
+   */
+  const BridgeProtocol::Data *buildPacket(uint16_t channelId);
+
+  /***
+   * Sends packets with as few sendmmsg(2) as it takes
+   *
+   * @param address Where to, 0 for the group
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int sendPackets(const BridgeProtocol::Header *const *packets,
+                  size_t count, const struct sockaddr_in *address);
+
+  int sendHeartbeat(uint16_t channelId, const struct sockaddr_in *address);
+
+  /***
+   * Answers the Naks waiting on the socket
+   *
+   * @return the number of Naks answered, negative on error
+   */
+  int handleNaks(void);
+
+public:
+  BridgeSender(void);
+
+  ~BridgeSender(void);
+
+  /***
+   * Subscribes to the channels and opens the socket
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(const Options &options);
+
+  /***
+   * Sends until stop is set
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int run(const volatile sig_atomic_t *stop);
+
+  /***
+   * Prints the counters of each channel
+   */
+  void report(void) const;
+};
+
+// inline and template functions
+inline char *BridgeSender::replaySlot(Channel *channel, uint64_t sequence) {
+  return &(channel->m_replay[(sequence % m_options.m_replayPackets) *
+                             m_options.m_packetSize]);
+}
+
+inline uint64_t BridgeSender::oldestSequence(const Channel *channel) const {
+  return (channel->m_nextSequence > m_options.m_replayPackets)
+             ? (channel->m_nextSequence - m_options.m_replayPackets)
+             : (0);
+}
+
+#endif // SMB_BRIDGE_BRIDGESENDER_H_
@@ -0,0 +1,245 @@
+#include "ManagerClient.h"
+
+#include <core/link/IPCAddress.h>
+
+#include <new>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int ManagerClient::connect(const std::string &vlan, int timeoutSeconds) {
+  const IPCAddress &managerAddress = Protocol::getManagerIPCAddress(vlan);
+  struct sockaddr_un address = managerAddress.toSockAddrUn();
+  struct timeval timeout = {timeoutSeconds, 0};
+
+  close();
+
+  m_fd = ::socket(AF_UNIX, Protocol::UNIX_DOMAIN_SOCKET_TYPE | SOCK_CLOEXEC,
+                  0);
+  if (0 > m_fd) {
+    return -1;
+  }
+
+  if ((0 != ::setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                         sizeof(timeout))) ||
+      (0 != ::connect(m_fd, reinterpret_cast<struct sockaddr *>(&address),
+                      sizeof(address)))) {
+    close();
+    return -1;
+  }
+
+  return 0;
+}
+
+int ManagerClient::send(const char *buffer, ssize_t size) {
+  if ((0 > size) || (size != ::send(m_fd, buffer, size, MSG_NOSIGNAL))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int ManagerClient::subscribe(const char *channelName, bool writer,
+                             uint32_t requestedSize, int *boardFd) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+  ssize_t size;
+  int retVal;
+
+  if (writer) {
+    size = Protocol::WriterSubscribeRequest::init(buffer, sizeof(buffer),
+                                                  requestedSize, channelName);
+  } else {
+    size = Protocol::ReaderSubscribeRequest::init(buffer, sizeof(buffer),
+                                                  requestedSize, channelName);
+  }
+
+  if (0 != send(buffer, size)) {
+    return -1;
+  }
+
+  retVal = receiveApproval();
+  if (0 != retVal) {
+    return retVal;
+  }
+
+  *boardFd = receiveFd();
+  return (0 > *boardFd) ? (-1) : (0);
+}
+
+int ManagerClient::unsubscribe(const char *channelName, bool writer) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+  ssize_t size;
+
+  if (writer) {
+    size = Protocol::WriterUnsubscribeRequest::init(buffer, sizeof(buffer),
+                                                    channelName);
+  } else {
+    size = Protocol::ReaderUnsubscribeRequest::init(buffer, sizeof(buffer),
+                                                    channelName);
+  }
+
+  if (0 != send(buffer, size)) {
+    return -1;
+  }
+
+  return receiveApproval();
+}
+
+int ManagerClient::receiveApproval(void) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  for (;;) {
+    ssize_t size = ::recv(m_fd, buffer, sizeof(buffer), 0);
+    if (static_cast<ssize_t>(sizeof(Protocol::Header)) > size) {
+      return -1;
+    }
+
+    const Protocol::Header *header =
+        reinterpret_cast<const Protocol::Header *>(buffer);
+    if (Protocol::APPROVAL_MESSAGE == header->m_messageType) {
+      return 0;
+    } else if (Protocol::DENIAL_MESSAGE == header->m_messageType) {
+      return 1;
+    }
+
+    // an event, keep waiting
+  }
+}
+
+int ManagerClient::subscribePattern(const char *pattern,
+                                    std::vector<std::string> *names,
+                                    std::vector<int> *boardFds) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+  const Protocol::Header *header =
+      reinterpret_cast<const Protocol::Header *>(buffer);
+  uint32_t numMatches;
+  ssize_t size;
+  int fd;
+
+  if (0 != send(buffer, ManagerProtocol::PatternRequest::init(
+                            buffer, sizeof(buffer),
+                            ManagerProtocol::PATTERN_SUBSCRIBE_REQUEST,
+                            pattern))) {
+    return -1;
+  }
+
+  size = receiveMessage(buffer, sizeof(buffer), &fd, 0);
+  if (0 <= fd) {
+    ::close(fd);
+    return -1;
+  }
+  if ((static_cast<ssize_t>(sizeof(Protocol::Header)) <= size) &&
+      (Protocol::DENIAL_MESSAGE == header->m_messageType)) {
+    return 1;
+  }
+  if (!ManagerProtocol::isMessage(buffer, size,
+                                  ManagerProtocol::PATTERN_REPLY,
+                                  sizeof(ManagerProtocol::PatternReply))) {
+    return -1;
+  }
+
+  // each match passes its board
+  numMatches =
+      reinterpret_cast<const ManagerProtocol::PatternReply *>(buffer)
+          ->m_numMatches;
+  for (uint32_t i = 0; i < numMatches; i++) {
+    size = receiveMessage(buffer, sizeof(buffer), &fd, 0);
+    if ((0 > fd) ||
+        !ManagerProtocol::isMessage(
+            buffer, size, ManagerProtocol::CHANNEL_MATCH,
+            offsetof(ManagerProtocol::ChannelMatch, m_channelName) + 1) ||
+        ('\0' != buffer[size - 1])) {
+      goto MATCH_ERROR;
+    }
+
+    try {
+      names->push_back(
+          reinterpret_cast<const ManagerProtocol::ChannelMatch *>(buffer)
+              ->m_channelName);
+      boardFds->push_back(fd);
+    } catch (const std::bad_alloc &) {
+      goto MATCH_ERROR;
+    }
+  }
+
+  return 0;
+
+MATCH_ERROR:
+  if (0 <= fd) {
+    ::close(fd);
+  }
+  return -1;
+}
+
+int ManagerClient::eventMode(void) {
+  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
+
+  if (0 != send(buffer,
+                Protocol::EventModeRequest::init(buffer, sizeof(buffer)))) {
+    return -1;
+  }
+
+  return receiveApproval();
+}
+
+ssize_t ManagerClient::receiveEvent(char *buffer, size_t size, int *fd) {
+  ssize_t retVal = receiveMessage(buffer, size, fd, MSG_DONTWAIT);
+
+  if ((0 > retVal) && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+    return 0;
+  }
+
+  // the manager closing the connection is an error too
+  return (0 == retVal) ? (-1) : (retVal);
+}
+
+int ManagerClient::receiveFd(void) {
+  char data[sizeof(int)];
+  int fd;
+
+  if (0 > receiveMessage(data, sizeof(data), &fd, 0)) {
+    return -1;
+  }
+
+  return fd;
+}
+
+ssize_t ManagerClient::receiveMessage(char *buffer, size_t size, int *fd,
+                                      int flags) {
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = {buffer, size};
+  struct msghdr message;
+  struct cmsghdr *controlHeader;
+  ssize_t retVal;
+
+  ::memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  *fd = -1;
+  retVal = ::recvmsg(m_fd, &message, MSG_CMSG_CLOEXEC | flags);
+  if (0 > retVal) {
+    return -1;
+  }
+
+  controlHeader = CMSG_FIRSTHDR(&message);
+  if ((0 != controlHeader) && (SOL_SOCKET == controlHeader->cmsg_level) &&
+      (SCM_RIGHTS == controlHeader->cmsg_type)) {
+    ::memcpy(fd, CMSG_DATA(controlHeader), sizeof(*fd));
+  }
+
+  return retVal;
+}
+
+void ManagerClient::close(void) {
+  if (0 <= m_fd) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
@@ -0,0 +1,139 @@
+#ifndef SMB_BRIDGE_MANAGERCLIENT_H_
+#define SMB_BRIDGE_MANAGERCLIENT_H_
+
+/***
+ * @file ManagerClient.h
+ *
+ * @brief
+ * A tool's connection to the smb_manager of its vlan, shared by
+ * smb_bridge and smb_journal.
+ *
+ * @description
+ * One connection holds every subscription of the tool, so that the
+ * manager unsubscribes them all if the tool goes away. Requests are
+ * answered in order, and the tool waits for each answer.
+ *
+ * A connection in event mode also gets events, e.g. the ChannelMatch of
+ * a pattern. Events may only arrive once the approval of eventMode()
+ * did; a tool must not send requests after it, since waiting for their
+ * answers skips events, and with them the boards they pass.
+ */
+
+#include <smb_manager/ManagerProtocol.h>
+
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+class ManagerClient {
+private:
+  typedef ShMemBCastProtocol Protocol;
+
+  // not copyable, as the connection is closed on destruction
+  ManagerClient(const ManagerClient &);
+  ManagerClient &operator=(const ManagerClient &);
+
+  int m_fd;
+
+  int send(const char *buffer, ssize_t size);
+
+  /***
+   * Receives messages until an approval or denial arrives, skipping
+   * events
+   *
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int receiveApproval(void);
+
+  /***
+   * @return the descriptor passed with SCM_RIGHTS, negative on error
+   */
+  int receiveFd(void);
+
+  /***
+   * Receives a message and the descriptor passed with it, if any
+   *
+   * @param fd Set to the descriptor, negative if there is none
+   * @param flags recv(2) flags, e.g. MSG_DONTWAIT
+   *
+   * @return the message size, negative on error
+   */
+  ssize_t receiveMessage(char *buffer, size_t size, int *fd, int flags);
+
+public:
+  ManagerClient(void);
+
+  ~ManagerClient(void);
+
+  /***
+   * @param timeoutSeconds How long to wait for each answer
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int connect(const std::string &vlan, int timeoutSeconds);
+
+  /***
+   * Subscribes to a channel
+   *
+   * @param requestedSize The board size, if the channel is new
+   * @param boardFd Set to the board, to be closed by the caller
+   *
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int subscribe(const char *channelName, bool writer,
+                uint32_t requestedSize, int *boardFd);
+
+  /***
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int unsubscribe(const char *channelName, bool writer);
+
+  /***
+   * Subscribes as a reader to every channel starting with a prefix, now
+   * and, in event mode, as they are created (see ManagerProtocol.h)
+   *
+   * @param pattern The prefix followed by a '*'
+   * @param names Set to the channels that exist now
+   * @param boardFds Set to their boards, to be closed by the caller
+   *
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int subscribePattern(const char *pattern, std::vector<std::string> *names,
+                       std::vector<int> *boardFds);
+
+  /***
+   * Asks for events. Send no requests after it
+   *
+   * @return 0 on approval, positive on denial, negative on error
+   */
+  int eventMode(void);
+
+  /***
+   * Receives an event without waiting
+   *
+   * @param fd Set to the descriptor passed with it, negative if none
+   *
+   * @return the event size, 0 if there is none, negative on error
+   */
+  ssize_t receiveEvent(char *buffer, size_t size, int *fd);
+
+  /***
+   * @return the connection, e.g. to poll(2) it for events
+   */
+  int fileDescriptor(void) const;
+
+  void close(void);
+};
+
+// inline and template functions
+inline ManagerClient::ManagerClient(void) : m_fd(-1) {}
+
+inline ManagerClient::~ManagerClient(void) { close(); }
+
+inline int ManagerClient::fileDescriptor(void) const { return m_fd; }
+
+#endif // SMB_BRIDGE_MANAGERCLIENT_H_
@@ -0,0 +1,236 @@
+#include "BridgeSender.h"
+
+#include <core/utils/StrToInt.h>
+
+#include <iostream>
+#include <string>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char *const DEFAULT_GROUP = "239.255.77.1:7400";
+const char *const DEFAULT_INTERFACE = "127.0.0.1";
+const int DEFAULT_TTL = 1;
+// the payload of an unfragmented packet on a 1500 byte MTU
+const size_t DEFAULT_PACKET_SIZE = 1472;
+const size_t DEFAULT_REPLAY_PACKETS = 4096;
+const uint64_t DEFAULT_HEARTBEAT_MICROS = 100000;
+const uint64_t DEFAULT_IDLE_MICROS = 100;
+
+volatile sig_atomic_t g_stop = 0;
+
+void handleSignal(int) { g_stop = 1; }
+
+void usage(const char *programName) {
+  std::cerr << programName << " [option]* send <channel>+" << std::endl
+
+            << "Sends channels of the local smb_manager to other hosts "
+            << "over UDP multicast" << std::endl
+
+            << "Commands:" << std::endl
+
+            << "  send <channel>+           : read the channels and send "
+            << "them to the group" << std::endl
+
+            << "Option Descriptions:" << std::endl
+
+            << "  --vlan      | -v <string> : vlan of the local manager "
+            << "(default: ${USER})" << std::endl
+
+            << "  --group     | -g <a:port> : the group, or a unicast "
+            << "address (default: " << DEFAULT_GROUP << ")" << std::endl
+
+            << "  --interface | -i <addr>   : the interface to send from "
+            << "(default: " << DEFAULT_INTERFACE << ")"
+            << std::endl
+
+            << "  --ttl       | -t <int>    : the multicast TTL (default: "
+            << DEFAULT_TTL << ")" << std::endl
+
+            << "  --size      | -s <int>    : the largest packet to send "
+            << "(default: " << DEFAULT_PACKET_SIZE << ")" << std::endl
+
+            << "  --replay    | -r <int>    : the packets kept per channel "
+            << "for Naks (default: " << DEFAULT_REPLAY_PACKETS << ")"
+            << std::endl
+
+            << "  --drop      | -x <int>    : drop one packet in so many "
+            << "once, to exercise the Naks (default: never)" << std::endl
+
+            << "  --help      | -[h?]       : display this help message"
+            << std::endl;
+}
+
+/**
+ * Parses an IPv4 address and port, e.g. 239.255.77.1:7400
+ *
+ * @return 0 on success, non-zero on error
+ */
+int parseAddress(const std::string &text, struct sockaddr_in *address) {
+  const size_t colon = text.rfind(':');
+  uint64_t port;
+
+  if (std::string::npos == colon) {
+    return -1;
+  }
+
+  port = StrToInt::parseUint(text.c_str() + colon + 1);
+  ::memset(address, 0, sizeof(*address));
+  address->sin_family = AF_INET;
+  address->sin_port = htons(static_cast<uint16_t>(port));
+  if ((0 == port) || (UINT16_MAX < port) ||
+      (1 != ::inet_pton(AF_INET, text.substr(0, colon).c_str(),
+                        &(address->sin_addr)))) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int parseCount(const char *text, const char *what, uint64_t *count) {
+  *count = StrToInt::parseUint(text);
+  if (0 == *count) {
+    std::cerr << "Please enter a positive " << what << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string vlan;
+  std::string group = DEFAULT_GROUP;
+  std::string interface = DEFAULT_INTERFACE;
+  uint64_t ttl = DEFAULT_TTL;
+  uint64_t packetSize = DEFAULT_PACKET_SIZE;
+  uint64_t replayPackets = DEFAULT_REPLAY_PACKETS;
+  uint64_t dropOneIn = 0;
+  struct sockaddr_in groupAddress;
+  struct in_addr interfaceAddress;
+  std::string command;
+  struct sigaction action;
+  int retVal;
+
+  // setup getopt_long options
+  const char *optstring = "v:g:i:t:s:r:x:h?";
+  const struct option longopts[] =
+      // {char* name, int has_arg, int* flag, int val}
+      {{"vlan", required_argument, 0, 'v'},
+       {"group", required_argument, 0, 'g'},
+       {"interface", required_argument, 0, 'i'},
+       {"ttl", required_argument, 0, 't'},
+       {"size", required_argument, 0, 's'},
+       {"replay", required_argument, 0, 'r'},
+       {"drop", required_argument, 0, 'x'},
+       {"help", no_argument, 0, 'h'},
+       {0, 0, 0, 0}};
+
+  int option;
+  while (-1 != (option = ::getopt_long(argc, argv, optstring, longopts, 0))) {
+    switch (option) {
+    case 'v': {
+      vlan = ::optarg;
+    } break;
+
+    case 'g': {
+      group = ::optarg;
+    } break;
+
+    case 'i': {
+      interface = ::optarg;
+    } break;
+
+    case 't': {
+      // 0 is valid, it keeps the packets on the host
+      ttl = StrToInt::parseUint(::optarg);
+      if (255 < ttl) {
+        std::cerr << "Please enter a TTL below 256" << std::endl;
+        return 1;
+      }
+    } break;
+
+    case 's': {
+      if (0 != parseCount(::optarg, "packet size", &packetSize)) {
+        return 1;
+      }
+    } break;
+
+    case 'r': {
+      if (0 != parseCount(::optarg, "number of packets", &replayPackets)) {
+        return 1;
+      }
+    } break;
+
+    case 'x': {
+      if (0 != parseCount(::optarg, "drop rate", &dropOneIn)) {
+        return 1;
+      }
+    } break;
+
+    default: {
+      usage(argv[0]);
+      return 1;
+    } break;
+    }
+  }
+
+  if (::optind >= argc) {
+    std::cerr << "Please enter a command" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  command = argv[::optind++];
+
+  if (vlan.empty()) {
+    struct passwd *userDetails = ::getpwuid(::getuid());
+    vlan = userDetails->pw_name;
+  }
+
+  if (0 != parseAddress(group, &groupAddress)) {
+    std::cerr << "Please enter the group as <address>:<port>" << std::endl;
+    return 1;
+  }
+  if (1 != ::inet_pton(AF_INET, interface.c_str(), &interfaceAddress)) {
+    std::cerr << "Please enter the interface as an address" << std::endl;
+    return 1;
+  }
+
+  // stop cleanly, so that the counters are printed
+  ::memset(&action, 0, sizeof(action));
+  action.sa_handler = handleSignal;
+  ::sigaction(SIGINT, &action, 0);
+  ::sigaction(SIGTERM, &action, 0);
+
+  if (("send" == command) && (::optind < argc)) {
+    BridgeSender sender;
+    BridgeSender::Options options;
+
+    options.m_vlan = vlan;
+    options.m_channels.assign(argv + ::optind, argv + argc);
+    options.m_group = groupAddress;
+    options.m_interface = interfaceAddress;
+    options.m_ttl = static_cast<int>(ttl);
+    options.m_packetSize = packetSize;
+    options.m_replayPackets = replayPackets;
+    options.m_heartbeatMicros = DEFAULT_HEARTBEAT_MICROS;
+    options.m_idleMicros = DEFAULT_IDLE_MICROS;
+    options.m_dropOneIn = dropOneIn;
+
+    retVal = sender.init(options);
+    if (0 == retVal) {
+      retVal = sender.run(&g_stop);
+      sender.report();
+    }
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  return (0 == retVal) ? (0) : (1);
+}
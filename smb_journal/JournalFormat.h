@@ -0,0 +1,200 @@
+#ifndef SMB_JOURNAL_JOURNALFORMAT_H_
+#define SMB_JOURNAL_JOURNALFORMAT_H_
+
+/***
+ * @file JournalFormat.h
+ *
+ * @brief
+ * The layout of a journal: what smb_journal record appends and
+ * smb_journal info reads.
+ *
+ * @description
+ * A journal is a directory of segment files, named after their index,
+ * e.g. 0000000042.smj, and read in index order. A recorder that is
+ * started on a journal appends segments after the last one.
+ *
+ * A segment is created at its full size and starts with a
+ * SegmentHeader. Records follow, each padded to ALIGNMENT, up to the
+ * header's m_end, which the recorder publishes after each record. A
+ * segment that was closed is truncated to m_end and flagged complete;
+ * one that was not, e.g. after a crash, is still good up to m_end.
+ *
+ * Every segment starts with a CHANNEL record for each channel recorded
+ * so far, so that it can be read on its own. Later records name their
+ * channel by the id it declares, which holds for that segment only.
+ */
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct JournalFormat {
+  static const uint32_t MAGIC = 0x4a424d53;
+  static const uint16_t VERSION = 1;
+  static const size_t ALIGNMENT = 8;
+  static const size_t MAX_CHANNEL_NAME_LENGTH = 256;
+
+  /***
+   * @var SEGMENT_SUFFIX Ends the name of a segment file
+   */
+  static constexpr const char *SEGMENT_SUFFIX = ".smj";
+
+  /***
+   * @var DATAGRAM A datagram read from a channel
+   * @var CHANNEL Declares a channel id, see ChannelRecord
+   * @var GAP Datagrams lost, as the recorder was lapped, see GapRecord
+   */
+  enum RecordType { DATAGRAM = 1, CHANNEL = 2, GAP = 3 };
+
+  /***
+   * @var SegmentHeader::m_magic MAGIC
+   * @var SegmentHeader::m_version VERSION
+   * @var SegmentHeader::m_complete 1 once the segment was closed
+   * @var SegmentHeader::m_index The segment's index in the journal
+   * @var SegmentHeader::m_size The size the segment was created with
+   * @var SegmentHeader::m_end Where the records end, from the start of
+   * the segment
+   */
+  struct SegmentHeader {
+    uint32_t m_magic;
+    uint16_t m_version;
+    uint16_t m_complete;
+    uint64_t m_index;
+    uint64_t m_size;
+    volatile uint64_t m_end;
+  };
+
+  /***
+   * The payload follows the header
+   *
+   * @var Record::m_size The record size, header included, unpadded
+   * @var Record::m_type A RecordType
+   * @var Record::m_channelId The channel, as declared in the segment
+   * @var Record::m_timestamp When the recorder read it, in nanoseconds
+   * since the epoch
+   */
+  struct Record {
+    uint32_t m_size;
+    uint16_t m_type;
+    uint16_t m_channelId;
+    uint64_t m_timestamp;
+  };
+
+  /***
+   * @var ChannelRecord::m_boardSize The channel's board size
+   * @var ChannelRecord::m_channelName The NUL-terminated channel name
+   */
+  struct ChannelRecord {
+    uint64_t m_boardSize;
+    char m_channelName[1];
+  };
+
+  /***
+   * @var GapRecord::m_bytes The board bytes skipped
+   */
+  struct GapRecord {
+    uint64_t m_bytes;
+  };
+
+  /***
+   * @return the path of a segment file
+   */
+  static std::string segmentPath(const std::string &directory,
+                                 uint64_t index);
+
+  /***
+   * @param indexes Set to the indexes of the segments in a directory, in
+   * order
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int listSegments(const std::string &directory,
+                          std::vector<uint64_t> *indexes);
+
+  /***
+   * @return the bytes a record with a payload of the size takes
+   */
+  static uint64_t footprint(uint32_t payloadSize);
+
+  /***
+   * @return the payload of a record
+   */
+  static const char *payload(const Record *record);
+
+  /***
+   * @return the payload size of a record
+   */
+  static uint32_t payloadSize(const Record *record);
+};
+
+// inline and template functions
+inline std::string JournalFormat::segmentPath(const std::string &directory,
+                                              uint64_t index) {
+  char name[32];
+
+  ::snprintf(name, sizeof(name), "%010" PRIu64 "%s", index, SEGMENT_SUFFIX);
+  return directory + "/" + name;
+}
+
+inline int JournalFormat::listSegments(const std::string &directory,
+                                       std::vector<uint64_t> *indexes) {
+  const size_t suffixLength = ::strlen(SEGMENT_SUFFIX);
+  DIR *entries = ::opendir(directory.c_str());
+  struct dirent *entry;
+
+  if (0 == entries) {
+    return -1;
+  }
+
+  indexes->clear();
+  while (0 != (entry = ::readdir(entries))) {
+    const size_t length = ::strlen(entry->d_name);
+    char *end;
+    uint64_t index;
+
+    if ((suffixLength >= length) ||
+        (0 != ::strcmp(entry->d_name + length - suffixLength,
+                       SEGMENT_SUFFIX))) {
+      continue;
+    }
+
+    index = ::strtoull(entry->d_name, &end, 10);
+    if (entry->d_name + length - suffixLength == end) {
+      try {
+        indexes->push_back(index);
+      } catch (const std::bad_alloc &) {
+        ::closedir(entries);
+        return -1;
+      }
+    }
+  }
+  ::closedir(entries);
+
+  std::sort(indexes->begin(), indexes->end());
+  return 0;
+}
+
+inline uint64_t JournalFormat::footprint(uint32_t payloadSize) {
+  return (sizeof(Record) + static_cast<uint64_t>(payloadSize) + ALIGNMENT -
+          1) &
+         ~static_cast<uint64_t>(ALIGNMENT - 1);
+}
+
+inline const char *JournalFormat::payload(const Record *record) {
+  return reinterpret_cast<const char *>(record) + sizeof(Record);
+}
+
+inline uint32_t JournalFormat::payloadSize(const Record *record) {
+  return record->m_size - sizeof(Record);
+}
+
+#endif // SMB_JOURNAL_JOURNALFORMAT_H_
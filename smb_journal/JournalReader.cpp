@@ -0,0 +1,114 @@
+#include "JournalReader.h"
+
+#include <atomic>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+JournalReader::JournalReader(void)
+    : m_paths(), m_next(0), m_mapping(0), m_mapSize(0), m_offset(0),
+      m_end(0) {}
+
+JournalReader::~JournalReader(void) { unmap(); }
+
+int JournalReader::open(const std::string &directory) {
+  std::vector<uint64_t> indexes;
+
+  unmap();
+  m_paths.clear();
+  m_next = 0;
+
+  if (0 != JournalFormat::listSegments(directory, &indexes)) {
+    return -1;
+  }
+
+  try {
+    for (size_t i = 0; i < indexes.size(); i++) {
+      m_paths.push_back(JournalFormat::segmentPath(directory, indexes[i]));
+    }
+  } catch (const std::bad_alloc &) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int JournalReader::mapNext(void) {
+  const JournalFormat::SegmentHeader *header;
+  struct stat status;
+  void *mapping;
+  int fd;
+
+  unmap();
+  if (m_paths.size() <= m_next) {
+    return 1;
+  }
+
+  fd = ::open(m_paths[m_next++].c_str(), O_RDONLY | O_CLOEXEC);
+  if (0 > fd) {
+    return -1;
+  }
+  if ((0 != ::fstat(fd, &status)) ||
+      (sizeof(JournalFormat::SegmentHeader) >
+       static_cast<size_t>(status.st_size))) {
+    ::close(fd);
+    return -1;
+  }
+
+  mapping = ::mmap(0, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == mapping) {
+    return -1;
+  }
+  // read once, front to back
+  ::madvise(mapping, status.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+  m_mapping = static_cast<char *>(mapping);
+  m_mapSize = status.st_size;
+
+  header = reinterpret_cast<const JournalFormat::SegmentHeader *>(m_mapping);
+  m_end = header->m_end;
+  // the records before the end, if the segment is still recorded
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if ((JournalFormat::MAGIC != header->m_magic) ||
+      (JournalFormat::VERSION != header->m_version) || (m_mapSize < m_end)) {
+    return -1;
+  }
+  m_offset = sizeof(JournalFormat::SegmentHeader);
+
+  return 0;
+}
+
+void JournalReader::unmap(void) {
+  if (0 != m_mapping) {
+    ::munmap(m_mapping, m_mapSize);
+    m_mapping = 0;
+  }
+}
+
+int JournalReader::next(const JournalFormat::Record **record) {
+  const JournalFormat::Record *found;
+
+  while ((0 == m_mapping) || (m_offset >= m_end)) {
+    const int retVal = mapNext();
+    if (0 != retVal) {
+      return retVal;
+    }
+  }
+
+  found = reinterpret_cast<const JournalFormat::Record *>(m_mapping +
+                                                          m_offset);
+  if ((sizeof(JournalFormat::Record) > m_end - m_offset) ||
+      (sizeof(JournalFormat::Record) > found->m_size) ||
+      (m_end - m_offset <
+       JournalFormat::footprint(JournalFormat::payloadSize(found)))) {
+    return -1;
+  }
+
+  m_offset += JournalFormat::footprint(JournalFormat::payloadSize(found));
+  *record = found;
+  return 0;
+}
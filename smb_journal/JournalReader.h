@@ -0,0 +1,83 @@
+#ifndef SMB_JOURNAL_JOURNALREADER_H_
+#define SMB_JOURNAL_JOURNALREADER_H_
+
+/***
+ * @file JournalReader.h
+ *
+ * @brief
+ * Reads the records of a journal in the order they were appended.
+ *
+ * @description
+ * Segments are mapped read-only one at a time, in index order, and the
+ * records are returned in place. A segment still being recorded is
+ * read up to the end its recorder published when it was mapped.
+ */
+
+#include "JournalFormat.h"
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class JournalReader {
+private:
+  // not copyable, as the segment is unmapped on destruction
+  JournalReader(const JournalReader &);
+  JournalReader &operator=(const JournalReader &);
+
+  /***
+   * Maps the next segment
+   *
+   * @return 0 on success, 1 if there is none, negative on error
+   */
+  int mapNext(void);
+
+  void unmap(void);
+
+  std::vector<std::string> m_paths;
+  size_t m_next;
+  char *m_mapping;
+  uint64_t m_mapSize;
+  uint64_t m_offset;
+  uint64_t m_end;
+
+public:
+  JournalReader(void);
+
+  ~JournalReader(void);
+
+  /***
+   * Finds the segments of a journal
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int open(const std::string &directory);
+
+  /***
+   * @param record Set to the next record, valid until the next call
+   *
+   * @return 0 if there is one, 1 at the end of the journal, negative if
+   * a segment is malformed
+   */
+  int next(const JournalFormat::Record **record);
+
+  size_t numSegments(void) const;
+
+  /***
+   * @return the path of the segment being read, e.g. for errors
+   */
+  const std::string &path(void) const;
+};
+
+// inline and template functions
+inline size_t JournalReader::numSegments(void) const {
+  return m_paths.size();
+}
+
+inline const std::string &JournalReader::path(void) const {
+  return m_paths[m_next - 1];
+}
+
+#endif // SMB_JOURNAL_JOURNALREADER_H_
@@ -0,0 +1,395 @@
+#include "JournalWriter.h"
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+uint64_t nowNanos(void) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_REALTIME, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+} // namespace
+
+JournalWriter::JournalWriter(void)
+    : m_directory(), m_segmentSize(0), m_channels(), m_declarationBytes(0),
+      m_current(), m_end(0), m_flushMark(0), m_numSegments(0),
+      m_numStalls(0), m_nextIndex(0), m_spare(), m_spareFailed(false),
+      m_retired(), m_flushFd(-1), m_flushIndex(0), m_flushEnd(0),
+      m_mutex(), m_wakeUp(), m_spareReady(), m_thread(), m_running(false),
+      m_started(false) {
+  m_current.m_fd = -1;
+  m_current.m_header = 0;
+  m_spare = m_current;
+  ::pthread_mutex_init(&m_mutex, 0);
+  ::pthread_cond_init(&m_wakeUp, 0);
+  ::pthread_cond_init(&m_spareReady, 0);
+}
+
+JournalWriter::~JournalWriter(void) {
+  close();
+
+  ::pthread_cond_destroy(&m_spareReady);
+  ::pthread_cond_destroy(&m_wakeUp);
+  ::pthread_mutex_destroy(&m_mutex);
+}
+
+int JournalWriter::open(const std::string &directory, uint64_t segmentSize) {
+  std::vector<uint64_t> indexes;
+
+  if ((0 != m_current.m_header) ||
+      (sizeof(JournalFormat::SegmentHeader) >= segmentSize)) {
+    return -1;
+  }
+
+  if ((0 != ::mkdir(directory.c_str(), 0755)) && (EEXIST != errno)) {
+    return -1;
+  }
+
+  m_directory = directory;
+  m_segmentSize = segmentSize;
+  if (0 != JournalFormat::listSegments(m_directory, &indexes)) {
+    return -1;
+  }
+  // after the segments of earlier recordings
+  m_nextIndex = indexes.empty() ? (0) : (indexes.back() + 1);
+  if (0 != create(m_nextIndex, &m_current)) {
+    return -1;
+  }
+  m_nextIndex++;
+  m_end = m_current.m_header->m_end;
+  m_flushMark = 0;
+  m_numSegments = 1;
+  m_flushFd = m_current.m_fd;
+  m_flushIndex = m_current.m_header->m_index;
+  m_flushEnd = 0;
+
+  m_running.store(true, std::memory_order_release);
+  if (0 != ::pthread_create(&m_thread, 0, workerMain, this)) {
+    m_running.store(false, std::memory_order_release);
+    close();
+    return -1;
+  }
+  m_started = true;
+
+  return 0;
+}
+
+int JournalWriter::declareChannel(const char *channelName,
+                                  uint64_t boardSize, uint16_t *channelId) {
+  const size_t nameLength = ::strlen(channelName);
+  const uint32_t payloadSize =
+      offsetof(JournalFormat::ChannelRecord, m_channelName) + nameLength + 1;
+  const uint64_t bytes = JournalFormat::footprint(payloadSize);
+  JournalFormat::ChannelRecord *record;
+
+  // the declarations must leave room in every segment
+  if ((JournalFormat::MAX_CHANNEL_NAME_LENGTH < nameLength) ||
+      (UINT16_MAX < m_channels.size()) ||
+      ((m_segmentSize - sizeof(JournalFormat::SegmentHeader)) / 2 <
+       m_declarationBytes + bytes)) {
+    return -1;
+  }
+
+  // before the channel is added, as a new segment declares them all
+  record = reinterpret_cast<JournalFormat::ChannelRecord *>(
+      reserve(payloadSize));
+  if (0 == record) {
+    return -1;
+  }
+
+  try {
+    Declaration declaration;
+    declaration.m_name = channelName;
+    declaration.m_boardSize = boardSize;
+    m_channels.push_back(declaration);
+  } catch (const std::bad_alloc &) {
+    return -1;
+  }
+  m_declarationBytes += bytes;
+  *channelId = static_cast<uint16_t>(m_channels.size() - 1);
+
+  record->m_boardSize = boardSize;
+  ::memcpy(record->m_channelName, channelName, nameLength + 1);
+  commit(JournalFormat::CHANNEL, *channelId, nowNanos(), payloadSize);
+
+  return 0;
+}
+
+char *JournalWriter::reserve(uint32_t payloadSize) {
+  const uint64_t bytes = JournalFormat::footprint(payloadSize);
+
+  if (m_segmentSize < m_end + bytes) {
+    if ((m_segmentSize < sizeof(JournalFormat::SegmentHeader) +
+                             m_declarationBytes + bytes) ||
+        (0 != roll())) {
+      return 0;
+    }
+  }
+
+  return reinterpret_cast<char *>(m_current.m_header) + m_end +
+         sizeof(JournalFormat::Record);
+}
+
+void JournalWriter::commit(JournalFormat::RecordType type,
+                           uint16_t channelId, uint64_t timestamp,
+                           uint32_t payloadSize) {
+  JournalFormat::Record *record = reinterpret_cast<JournalFormat::Record *>(
+      reinterpret_cast<char *>(m_current.m_header) + m_end);
+
+  record->m_size = sizeof(JournalFormat::Record) + payloadSize;
+  record->m_type = type;
+  record->m_channelId = channelId;
+  record->m_timestamp = timestamp;
+  m_end += JournalFormat::footprint(payloadSize);
+
+  publish();
+}
+
+void JournalWriter::writeRecord(JournalFormat::RecordType type,
+                                uint16_t channelId, uint64_t timestamp,
+                                const char *payload, uint32_t payloadSize) {
+  ::memcpy(reinterpret_cast<char *>(m_current.m_header) + m_end +
+               sizeof(JournalFormat::Record),
+           payload, payloadSize);
+  commit(type, channelId, timestamp, payloadSize);
+}
+
+void JournalWriter::publish(void) {
+  // readers must see the records before the end that covers them
+  std::atomic_thread_fence(std::memory_order_release);
+  m_current.m_header->m_end = m_end;
+
+  if (m_flushMark != m_end / FLUSH_BYTES) {
+    m_flushMark = m_end / FLUSH_BYTES;
+
+    ::pthread_mutex_lock(&m_mutex);
+    m_flushEnd = m_end;
+    ::pthread_cond_signal(&m_wakeUp);
+    ::pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+int JournalWriter::roll(void) {
+  alignas(JournalFormat::ChannelRecord) char buffer
+      [offsetof(JournalFormat::ChannelRecord, m_channelName) +
+       JournalFormat::MAX_CHANNEL_NAME_LENGTH + 1];
+  JournalFormat::ChannelRecord *record =
+      reinterpret_cast<JournalFormat::ChannelRecord *>(buffer);
+  bool stalled = false;
+  uint64_t timestamp;
+
+  ::pthread_mutex_lock(&m_mutex);
+  while ((0 == m_spare.m_header) && !m_spareFailed) {
+    if (!stalled) {
+      stalled = true;
+      m_numStalls++;
+    }
+    ::pthread_cond_wait(&m_spareReady, &m_mutex);
+  }
+
+  if (0 == m_spare.m_header) {
+    // the next roll waits for another attempt
+    m_spareFailed = false;
+    ::pthread_cond_signal(&m_wakeUp);
+    ::pthread_mutex_unlock(&m_mutex);
+    return -1;
+  }
+
+  try {
+    m_retired.push_back(m_current);
+  } catch (const std::bad_alloc &) {
+    ::pthread_mutex_unlock(&m_mutex);
+    return -1;
+  }
+  m_current = m_spare;
+  m_spare.m_fd = -1;
+  m_spare.m_header = 0;
+  m_flushFd = m_current.m_fd;
+  m_flushIndex = m_current.m_header->m_index;
+  m_flushEnd = 0;
+  ::pthread_cond_signal(&m_wakeUp);
+  ::pthread_mutex_unlock(&m_mutex);
+
+  m_end = m_current.m_header->m_end;
+  m_flushMark = 0;
+  m_numSegments++;
+
+  // so that the segment can be read on its own
+  timestamp = nowNanos();
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    const size_t nameLength = m_channels[i].m_name.size();
+
+    record->m_boardSize = m_channels[i].m_boardSize;
+    ::memcpy(record->m_channelName, m_channels[i].m_name.c_str(),
+             nameLength + 1);
+    writeRecord(JournalFormat::CHANNEL, static_cast<uint16_t>(i), timestamp,
+                buffer,
+                offsetof(JournalFormat::ChannelRecord, m_channelName) +
+                    nameLength + 1);
+  }
+
+  return 0;
+}
+
+int JournalWriter::create(uint64_t index, Segment *segment) {
+  const std::string path = JournalFormat::segmentPath(m_directory, index);
+  JournalFormat::SegmentHeader *header;
+  void *mapping;
+  int fd;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (0 > fd) {
+    return -1;
+  }
+
+  // allocated up front, so that the writer never waits for the file
+  // system, and faulted in, so that it never waits for the pages
+  if (0 != ::fallocate(fd, 0, 0, m_segmentSize)) {
+    goto CREATE_ERROR;
+  }
+  mapping = ::mmap(0, m_segmentSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (MAP_FAILED == mapping) {
+    goto CREATE_ERROR;
+  }
+  ::madvise(mapping, m_segmentSize, MADV_SEQUENTIAL);
+
+  header = static_cast<JournalFormat::SegmentHeader *>(mapping);
+  header->m_magic = JournalFormat::MAGIC;
+  header->m_version = JournalFormat::VERSION;
+  header->m_complete = 0;
+  header->m_index = index;
+  header->m_size = m_segmentSize;
+  header->m_end = sizeof(JournalFormat::SegmentHeader);
+
+  segment->m_fd = fd;
+  segment->m_header = header;
+  return 0;
+
+CREATE_ERROR:
+  ::close(fd);
+  ::unlink(path.c_str());
+  return -1;
+}
+
+void JournalWriter::retire(const Segment &segment) {
+  const uint64_t end = segment.m_header->m_end;
+
+  segment.m_header->m_complete = 1;
+  ::munmap(segment.m_header, segment.m_header->m_size);
+  // the rest was only allocated
+  ::ftruncate(segment.m_fd, end);
+  ::close(segment.m_fd);
+}
+
+void JournalWriter::work(void) {
+  uint64_t flushIndex = m_flushIndex;
+  uint64_t flushed = 0;
+
+  ::pthread_mutex_lock(&m_mutex);
+
+  while (m_running.load(std::memory_order_acquire)) {
+    // (1) the next segment, the writer may be waiting for it
+    if ((0 == m_spare.m_header) && !m_spareFailed) {
+      const uint64_t index = m_nextIndex;
+      Segment spare;
+      int retVal;
+
+      ::pthread_mutex_unlock(&m_mutex);
+      retVal = create(index, &spare);
+      ::pthread_mutex_lock(&m_mutex);
+
+      if (0 == retVal) {
+        m_spare = spare;
+        m_nextIndex = index + 1;
+      } else {
+        m_spareFailed = true;
+      }
+      ::pthread_cond_signal(&m_spareReady);
+      continue;
+    }
+
+    // (2) the writeback of the current segment
+    if (flushIndex != m_flushIndex) {
+      flushIndex = m_flushIndex;
+      flushed = 0;
+    }
+    if (flushed < m_flushEnd) {
+      const int fd = m_flushFd;
+      const uint64_t end = m_flushEnd;
+
+      // only retired segments are closed, and only by this thread
+      ::pthread_mutex_unlock(&m_mutex);
+      ::sync_file_range(fd, flushed, end - flushed, SYNC_FILE_RANGE_WRITE);
+      ::pthread_mutex_lock(&m_mutex);
+
+      flushed = end;
+      continue;
+    }
+
+    // (3) the segments the writer moved on from
+    if (!m_retired.empty()) {
+      const Segment segment = m_retired.back();
+      m_retired.pop_back();
+
+      ::pthread_mutex_unlock(&m_mutex);
+      retire(segment);
+      ::pthread_mutex_lock(&m_mutex);
+      continue;
+    }
+
+    ::pthread_cond_wait(&m_wakeUp, &m_mutex);
+  }
+
+  ::pthread_mutex_unlock(&m_mutex);
+}
+
+void *JournalWriter::workerMain(void *writer) {
+  static_cast<JournalWriter *>(writer)->work();
+
+  return 0;
+}
+
+void JournalWriter::close(void) {
+  if (m_started) {
+    ::pthread_mutex_lock(&m_mutex);
+    m_running.store(false, std::memory_order_release);
+    ::pthread_cond_signal(&m_wakeUp);
+    ::pthread_mutex_unlock(&m_mutex);
+
+    ::pthread_join(m_thread, 0);
+    m_started = false;
+  }
+
+  // the thread is gone, the rest is done here
+  for (size_t i = 0; i < m_retired.size(); i++) {
+    retire(m_retired[i]);
+  }
+  m_retired.clear();
+
+  if (0 != m_current.m_header) {
+    retire(m_current);
+    m_current.m_fd = -1;
+    m_current.m_header = 0;
+  }
+
+  if (0 != m_spare.m_header) {
+    const std::string path =
+        JournalFormat::segmentPath(m_directory, m_spare.m_header->m_index);
+
+    ::munmap(m_spare.m_header, m_segmentSize);
+    ::close(m_spare.m_fd);
+    ::unlink(path.c_str());
+    m_spare.m_fd = -1;
+    m_spare.m_header = 0;
+  }
+  m_spareFailed = false;
+}
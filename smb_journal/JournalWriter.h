@@ -0,0 +1,207 @@
+#ifndef SMB_JOURNAL_JOURNALWRITER_H_
+#define SMB_JOURNAL_JOURNALWRITER_H_
+
+/***
+ * @file JournalWriter.h
+ *
+ * @brief
+ * Appends records to the memory-mapped segments of a journal.
+ *
+ * @description
+ * Appending a record only copies it into the mapped segment and
+ * publishes the segment's new end; the calling thread makes no system
+ * call but to wake the background thread every FLUSH_BYTES. Everything
+ * else is left to that thread:
+ *
+ * -# it creates the next segment ahead of time, allocated at its full
+ *    size and mapped with its pages faulted in, so that moving to it
+ *    is only a pointer swap,
+ * -# it starts the writeback of the current segment every FLUSH_BYTES,
+ *    so that the disk sees large sequential writes rather than the page
+ *    cache filling up and being flushed at once,
+ * -# it unmaps the segments the writer moved on from, truncates them to
+ *    their records and flags them complete.
+ *
+ * If the next segment is not ready when the current one is full, e.g.
+ * as the disk is slow, the writer waits for it, and counts a stall.
+ *
+ * Everything but the constructor and destructor must be called from
+ * one thread.
+ */
+
+#include "JournalFormat.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class JournalWriter {
+private:
+  // not copyable
+  JournalWriter(const JournalWriter &);
+  JournalWriter &operator=(const JournalWriter &);
+
+  /***
+   * How much of the current segment the background thread lets pile up
+   * before it starts writing it back
+   */
+  static const uint64_t FLUSH_BYTES = 8 << 20;
+
+  /***
+   * @var Segment::m_fd The segment file
+   * @var Segment::m_header Its mapping, 0 if there is none
+   */
+  struct Segment {
+    int m_fd;
+    JournalFormat::SegmentHeader *m_header;
+  };
+
+  /***
+   * @var Declaration::m_name The channel name
+   * @var Declaration::m_boardSize Its board size
+   */
+  struct Declaration {
+    std::string m_name;
+    uint64_t m_boardSize;
+  };
+
+  /***
+   * Creates, allocates and maps a segment
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int create(uint64_t index, Segment *segment);
+
+  /***
+   * Truncates a segment to its records, flags it complete and closes it
+   */
+  static void retire(const Segment &segment);
+
+  /***
+   * Moves to the next segment and declares the channels in it
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int roll(void);
+
+  /***
+   * Writes a record to the current segment, which has room for it, and
+   * publishes it
+   */
+  void writeRecord(JournalFormat::RecordType type, uint16_t channelId,
+                   uint64_t timestamp, const char *payload,
+                   uint32_t payloadSize);
+
+  /***
+   * Publishes the records written since the last time, and has them
+   * written back every FLUSH_BYTES
+   */
+  void publish(void);
+
+  /***
+   * Creates spare segments, flushes and retires segments until close()
+   */
+  void work(void);
+
+  /***
+   * Worker thread entry point
+   */
+  static void *workerMain(void *writer);
+
+  std::string m_directory;
+  uint64_t m_segmentSize;
+  std::vector<Declaration> m_channels;
+  uint64_t m_declarationBytes;
+
+  // the writer's
+  Segment m_current;
+  uint64_t m_end;
+  uint64_t m_flushMark;
+  uint64_t m_numSegments;
+  uint64_t m_numStalls;
+
+  // shared with the background thread, under m_mutex
+  uint64_t m_nextIndex;
+  Segment m_spare;
+  bool m_spareFailed;
+  std::vector<Segment> m_retired;
+  int m_flushFd;
+  uint64_t m_flushIndex;
+  uint64_t m_flushEnd;
+
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_wakeUp;
+  pthread_cond_t m_spareReady;
+  pthread_t m_thread;
+  std::atomic<bool> m_running;
+  bool m_started;
+
+public:
+  JournalWriter(void);
+
+  /***
+   * Closes the journal
+   */
+  ~JournalWriter(void);
+
+  /***
+   * Creates the directory if need be, creates the first segment after
+   * those already there and starts the background thread
+   *
+   * @param segmentSize The size of each segment
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int open(const std::string &directory, uint64_t segmentSize);
+
+  /***
+   * Declares a channel in this segment and the next ones
+   *
+   * @param channelId Set to the channel's id
+   *
+   * @return 0 on success, non-zero on error, e.g. too many channels
+   */
+  int declareChannel(const char *channelName, uint64_t boardSize,
+                     uint16_t *channelId);
+
+  /***
+   * Makes room for a record, moving to the next segment if need be
+   *
+   * @return where to copy the payload, 0 if the record is larger than a
+   * segment or the next segment could not be created
+   */
+  char *reserve(uint32_t payloadSize);
+
+  /***
+   * Appends the record reserve() made room for. A record that is not
+   * committed is overwritten by the next one
+   */
+  void commit(JournalFormat::RecordType type, uint16_t channelId,
+              uint64_t timestamp, uint32_t payloadSize);
+
+  /***
+   * Retires the current segment, removes the spare one and stops the
+   * background thread
+   */
+  void close(void);
+
+  uint64_t numSegments(void) const;
+
+  /***
+   * @return the times the writer waited for the next segment
+   */
+  uint64_t numStalls(void) const;
+};
+
+// inline and template functions
+inline uint64_t JournalWriter::numSegments(void) const {
+  return m_numSegments;
+}
+
+inline uint64_t JournalWriter::numStalls(void) const { return m_numStalls; }
+
+#endif // SMB_JOURNAL_JOURNALWRITER_H_
@@ -0,0 +1,325 @@
+#include "Recorder.h"
+
+#include <iostream>
+#include <new>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+const int MANAGER_TIMEOUT_SECONDS = 10;
+
+uint64_t nowNanos(void) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_REALTIME, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+bool isPattern(const std::string &channel) {
+  return !channel.empty() &&
+         (ManagerProtocol::PATTERN_WILDCARD == channel[channel.size() - 1]);
+}
+} // namespace
+
+Recorder::Recorder(void)
+    : m_options(), m_manager(), m_journal(), m_channels() {}
+
+Recorder::~Recorder(void) {
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    if (0 <= m_channels[i]->m_resizedFd) {
+      ::close(m_channels[i]->m_resizedFd);
+    }
+    delete m_channels[i];
+  }
+}
+
+int Recorder::init(const Options &options) {
+  m_options = options;
+
+  if (0 != m_journal.open(m_options.m_directory, m_options.m_segmentSize)) {
+    std::cerr << "Could not open the journal in " << m_options.m_directory
+              << ": " << ::strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (0 != m_manager.connect(m_options.m_vlan, MANAGER_TIMEOUT_SECONDS)) {
+    std::cerr << "Could not connect to the manager of vlan "
+              << m_options.m_vlan << std::endl;
+    return -1;
+  }
+
+  for (size_t i = 0; i < m_options.m_channels.size(); i++) {
+    const char *channelName = m_options.m_channels[i].c_str();
+    std::vector<std::string> names;
+    std::vector<int> boardFds;
+    int retVal;
+
+    if (isPattern(m_options.m_channels[i])) {
+      retVal = m_manager.subscribePattern(channelName, &names, &boardFds);
+    } else {
+      int boardFd;
+      retVal = m_manager.subscribe(channelName, false, 0, &boardFd);
+      if (0 == retVal) {
+        names.push_back(channelName);
+        boardFds.push_back(boardFd);
+      }
+    }
+    if (0 != retVal) {
+      std::cerr << "Could not subscribe to " << channelName
+                << ((0 < retVal) ? (", the manager denied it")
+                                 : (", the manager did not answer"))
+                << std::endl;
+      return -1;
+    }
+
+    for (size_t j = 0; j < names.size(); j++) {
+      if (0 != addChannel(names[j].c_str(), boardFds[j])) {
+        // the boards left are closed on exit
+        return -1;
+      }
+    }
+  }
+
+  // last, as events are skipped while waiting for answers
+  if (0 != m_manager.eventMode()) {
+    std::cerr << "Could not ask the manager for events" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int Recorder::addChannel(const char *channelName, int boardFd) {
+  Channel *channel;
+
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    if (m_channels[i]->m_name == channelName) {
+      // named and matched, or matched by several patterns
+      ::close(boardFd);
+      return 0;
+    }
+  }
+
+  channel = new (std::nothrow) Channel();
+  if (0 == channel) {
+    ::close(boardFd);
+    return -1;
+  }
+  channel->m_resizedFd = -1;
+  channel->m_datagrams = 0;
+  channel->m_bytes = 0;
+  channel->m_overruns = 0;
+  channel->m_lostBytes = 0;
+  channel->m_unrecorded = 0;
+
+  if (0 != channel->m_board.map(boardFd, false)) {
+    std::cerr << "Could not map the board of " << channelName << std::endl;
+    goto CHANNEL_ERROR;
+  }
+  if (0 != m_journal.declareChannel(channelName, channel->m_board.size(),
+                                    &(channel->m_id))) {
+    std::cerr << "Could not add " << channelName << " to the journal"
+              << std::endl;
+    goto CHANNEL_ERROR;
+  }
+
+  try {
+    channel->m_name = channelName;
+    m_channels.push_back(channel);
+  } catch (const std::bad_alloc &) {
+    goto CHANNEL_ERROR;
+  }
+
+  ::close(boardFd);
+  std::cout << "Recording " << channelName << std::endl;
+  return 0;
+
+CHANNEL_ERROR:
+  ::close(boardFd);
+  delete channel;
+  return -1;
+}
+
+void Recorder::recordGap(Channel *channel, uint64_t timestamp) {
+  const uint64_t bytes = channel->m_board.skip();
+  JournalFormat::GapRecord *gap = reinterpret_cast<JournalFormat::GapRecord *>(
+      m_journal.reserve(sizeof(JournalFormat::GapRecord)));
+
+  channel->m_overruns++;
+  channel->m_lostBytes += bytes;
+  if (0 != gap) {
+    gap->m_bytes = bytes;
+    m_journal.commit(JournalFormat::GAP, channel->m_id, timestamp,
+                     sizeof(*gap));
+  }
+}
+
+size_t Recorder::record(Channel *channel) {
+  uint64_t timestamp = 0;
+  size_t count = 0;
+
+  while ((BATCH_DATAGRAMS > count) && channel->m_board.mapped()) {
+    const char *datagram;
+    uint32_t size;
+    char *copy;
+    int retVal = channel->m_board.peek(&datagram, &size);
+
+    if ((0 < retVal) && (0 <= channel->m_resizedFd)) {
+      // the writer moved before the readers were told, so the old board
+      // is read to the end
+      if (0 != channel->m_board.map(channel->m_resizedFd, false)) {
+        std::cerr << "Could not map the new board of " << channel->m_name
+                  << std::endl;
+      }
+      channel->m_board.rewind();
+      ::close(channel->m_resizedFd);
+      channel->m_resizedFd = -1;
+      continue;
+    }
+    if (0 < retVal) {
+      break;
+    }
+
+    // the batch is stamped with the time it was found
+    if (0 == timestamp) {
+      timestamp = nowNanos();
+    }
+    if (0 > retVal) {
+      recordGap(channel, timestamp);
+      continue;
+    }
+
+    copy = m_journal.reserve(size);
+    if (0 == copy) {
+      channel->m_unrecorded++;
+      channel->m_board.consume(size);
+      continue;
+    }
+
+    ::memcpy(copy, datagram, size);
+    if (!channel->m_board.intact()) {
+      // overwritten while copied, the copy is not committed
+      recordGap(channel, timestamp);
+      continue;
+    }
+
+    m_journal.commit(JournalFormat::DATAGRAM, channel->m_id, timestamp,
+                     size);
+    channel->m_board.consume(size);
+    channel->m_datagrams++;
+    channel->m_bytes += size;
+    count++;
+  }
+
+  return count;
+}
+
+int Recorder::handleEvents(void) {
+  char buffer[ShMemBCastProtocol::Constants::MAX_MESSAGE_SIZE];
+  ssize_t size;
+  int fd;
+
+  while (0 < (size = m_manager.receiveEvent(buffer, sizeof(buffer), &fd))) {
+    if ((0 <= fd) && ('\0' == buffer[size - 1]) &&
+        ManagerProtocol::isMessage(
+            buffer, size, ManagerProtocol::CHANNEL_MATCH,
+            offsetof(ManagerProtocol::ChannelMatch, m_channelName) + 1)) {
+      addChannel(reinterpret_cast<const ManagerProtocol::ChannelMatch *>(
+                     buffer)
+                     ->m_channelName,
+                 fd);
+      continue;
+    }
+
+    if ((0 <= fd) && ('\0' == buffer[size - 1]) &&
+        ManagerProtocol::isMessage(
+            buffer, size, ManagerProtocol::BOARD_RESIZED,
+            offsetof(ManagerProtocol::BoardResized, m_channelName) + 1)) {
+      const char *channelName =
+          reinterpret_cast<const ManagerProtocol::BoardResized *>(buffer)
+              ->m_channelName;
+
+      for (size_t i = 0; (0 <= fd) && (i < m_channels.size()); i++) {
+        Channel *channel = m_channels[i];
+        if (channel->m_name == channelName) {
+          if (0 <= channel->m_resizedFd) {
+            // resized again before the recorder moved, what the
+            // writer wrote to the board between is skipped
+            ::close(channel->m_resizedFd);
+          }
+          channel->m_resizedFd = fd;
+          fd = -1;
+        }
+      }
+    }
+
+    // other events are of no interest
+    if (0 <= fd) {
+      ::close(fd);
+    }
+  }
+
+  return (0 > size) ? (-1) : (0);
+}
+
+int Recorder::run(const volatile sig_atomic_t *stop) {
+  const struct timespec timeout = {
+      static_cast<time_t>(m_options.m_idleMicros / 1000000),
+      static_cast<long>((m_options.m_idleMicros % 1000000) * 1000)};
+  const struct timespec noTimeout = {0, 0};
+  uint64_t numPasses = 0;
+  int retVal = 0;
+
+  while (!(*stop)) {
+    struct pollfd events = {m_manager.fileDescriptor(), POLLIN, 0};
+    size_t count = 0;
+
+    for (size_t i = 0; i < m_channels.size(); i++) {
+      count += record(m_channels[i]);
+    }
+
+    if ((0 == count) && (1 == m_channels.size()) &&
+        m_channels[0]->m_board.mapped()) {
+      // idle: wait a little for the writer, then look for an event
+      m_channels[0]->m_board.wait(0, m_options.m_idleMicros * 1000);
+      if (0 >= ::ppoll(&events, 1, &noTimeout, 0)) {
+        continue;
+      }
+    } else if (0 == count) {
+      // idle: wait a little, or for an event
+      if (0 >= ::ppoll(&events, 1, &timeout, 0)) {
+        continue;
+      }
+    } else if (0 != (++numPasses % EVENT_PASSES)) {
+      continue;
+    }
+
+    if (0 != handleEvents()) {
+      std::cerr << "Lost the connection to the manager" << std::endl;
+      retVal = -1;
+      break;
+    }
+  }
+
+  m_journal.close();
+  return retVal;
+}
+
+void Recorder::report(void) const {
+  for (size_t i = 0; i < m_channels.size(); i++) {
+    const Channel *channel = m_channels[i];
+
+    std::cout << channel->m_name << ": " << channel->m_datagrams
+              << " datagrams, " << channel->m_bytes << " bytes, "
+              << channel->m_overruns << " overruns ("
+              << channel->m_lostBytes << " bytes lost), "
+              << channel->m_unrecorded << " unrecorded" << std::endl;
+  }
+
+  std::cout << m_journal.numSegments() << " segments, "
+            << m_journal.numStalls() << " stalls waiting for one"
+            << std::endl;
+}
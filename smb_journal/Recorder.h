@@ -0,0 +1,159 @@
+#ifndef SMB_JOURNAL_RECORDER_H_
+#define SMB_JOURNAL_RECORDER_H_
+
+/***
+ * @file Recorder.h
+ *
+ * @brief
+ * Records channels to a journal.
+ *
+ * @description
+ * The recorder subscribes as a reader to the channels it is given, and
+ * to the channels matching its patterns, e.g. "smbcast://md.*", now and
+ * as they are created. It polls their boards and appends each datagram
+ * to the journal with the time it read it. A datagram is copied once,
+ * straight from the board into the mapped segment, and only committed
+ * if the writer did not overwrite it meanwhile.
+ *
+ * An idle recorder of a single channel waits on its board (see
+ * BoardRing::wait()), so that it wakes as soon as the writer publishes if
+ * the channel has a wait area. Otherwise it sleeps up to idleMicros, or
+ * until the manager sends an event.
+ *
+ * When the recorder is lapped, it records a gap with the bytes it
+ * skipped and goes on from where the writer is. A channel resized
+ * while recorded is followed to its new board once the old one is read
+ * to the end.
+ *
+ * Channels created while the recorder starts, between its pattern
+ * subscriptions and its asking for events, are not matched.
+ */
+
+#include "JournalWriter.h"
+
+#include <smb_bridge/BoardRing.h>
+#include <smb_bridge/ManagerClient.h>
+
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class Recorder {
+public:
+  /***
+   * @var Options::m_vlan The vlan of the manager
+   * @var Options::m_channels Channel names, or patterns ending in '*'
+   * @var Options::m_directory The journal
+   * @var Options::m_segmentSize The size of each segment
+   * @var Options::m_idleMicros How long to wait for a datagram or an
+   * event when no channel has anything
+   */
+  struct Options {
+    std::string m_vlan;
+    std::vector<std::string> m_channels;
+    std::string m_directory;
+    uint64_t m_segmentSize;
+    uint64_t m_idleMicros;
+  };
+
+private:
+  // not copyable
+  Recorder(const Recorder &);
+  Recorder &operator=(const Recorder &);
+
+  /***
+   * The datagrams read from a channel at most before moving on to the
+   * next one
+   */
+  static const size_t BATCH_DATAGRAMS = 1024;
+
+  /***
+   * How often a busy recorder looks for events, in passes over the
+   * channels. An idle one waits for them
+   */
+  static const uint64_t EVENT_PASSES = 1024;
+
+  /***
+   * @var Channel::m_name The channel name
+   * @var Channel::m_board Its board
+   * @var Channel::m_id Its id in the journal
+   * @var Channel::m_resizedFd The board it was resized to, to move to
+   * once m_board is read, negative if none
+   * @var Channel::m_datagrams Datagrams recorded
+   * @var Channel::m_bytes Their bytes
+   * @var Channel::m_overruns Times the writer lapped the recorder
+   * @var Channel::m_lostBytes Board bytes skipped as it did
+   * @var Channel::m_unrecorded Datagrams read that did not fit in a
+   * segment, or came while the next segment could not be created
+   */
+  struct Channel {
+    std::string m_name;
+    BoardRing m_board;
+    uint16_t m_id;
+    int m_resizedFd;
+    uint64_t m_datagrams;
+    uint64_t m_bytes;
+    uint64_t m_overruns;
+    uint64_t m_lostBytes;
+    uint64_t m_unrecorded;
+  };
+
+  /***
+   * Maps a channel's board and declares it in the journal. The board is
+   * closed either way
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int addChannel(const char *channelName, int boardFd);
+
+  /***
+   * Records what a channel's writer wrote since the last time, up to
+   * BATCH_DATAGRAMS
+   *
+   * @return the datagrams recorded
+   */
+  size_t record(Channel *channel);
+
+  void recordGap(Channel *channel, uint64_t timestamp);
+
+  /***
+   * Handles the events waiting on the manager connection
+   *
+   * @return 0 on success, non-zero if the connection is lost
+   */
+  int handleEvents(void);
+
+  Options m_options;
+  ManagerClient m_manager;
+  JournalWriter m_journal;
+  std::vector<Channel *> m_channels;
+
+public:
+  Recorder(void);
+
+  ~Recorder(void);
+
+  /***
+   * Opens the journal and subscribes to the channels
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(const Options &options);
+
+  /***
+   * Records until stop is set, then closes the journal
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int run(const volatile sig_atomic_t *stop);
+
+  /***
+   * Prints the counters of each channel
+   */
+  void report(void) const;
+};
+
+#endif // SMB_JOURNAL_RECORDER_H_
@@ -0,0 +1,263 @@
+#include "JournalReader.h"
+#include "Recorder.h"
+
+#include <core/utils/StrToInt.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+const uint64_t DEFAULT_SEGMENT_SIZE = 256 << 20;
+// room for the channel declarations and some datagrams
+const uint64_t MIN_SEGMENT_SIZE = 1 << 20;
+const uint64_t DEFAULT_IDLE_MICROS = 100;
+
+volatile sig_atomic_t g_stop = 0;
+
+void handleSignal(int) { g_stop = 1; }
+
+void usage(const char *programName) {
+  std::cerr << programName << " [option]* <command>" << std::endl
+
+            << "Records channels to a journal" << std::endl
+
+            << "Commands:" << std::endl
+
+            << "  record <dir> <channel>+  : record the channels, or the "
+            << "channels matching patterns such as smbcast://md.*, to "
+            << "the journal in dir until interrupted" << std::endl
+
+            << "  info <dir>               : list the recorded channels "
+            << "and what the journal holds of each" << std::endl
+
+            << "Option Descriptions:" << std::endl
+
+            << "  --vlan    | -v <string>  : vlan of the manager (default: "
+            << "${USER})" << std::endl
+
+            << "  --segment | -S <bytes>   : record: the size of each "
+            << "segment (default: " << DEFAULT_SEGMENT_SIZE << ")"
+            << std::endl
+
+            << "  --help    | -[h?]        : display this help message"
+            << std::endl;
+}
+
+std::string formatTime(uint64_t nanos) {
+  const time_t seconds = static_cast<time_t>(nanos / 1000000000);
+  char text[64];
+  struct tm utc;
+
+  ::gmtime_r(&seconds, &utc);
+  ::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+  ::snprintf(text + ::strlen(text), sizeof(text) - ::strlen(text),
+             ".%09llu", static_cast<unsigned long long>(nanos % 1000000000));
+  return text;
+}
+
+/**
+ * What the journal holds of a channel
+ */
+struct ChannelInfo {
+  uint64_t m_boardSize;
+  uint64_t m_datagrams;
+  uint64_t m_bytes;
+  uint64_t m_gaps;
+  uint64_t m_lostBytes;
+  uint64_t m_first;
+  uint64_t m_last;
+};
+
+/**
+ * Lists the recorded channels
+ *
+ * @return 0 on success, non-zero on error
+ */
+int info(const std::string &directory) {
+  std::map<std::string, ChannelInfo> channels;
+  std::vector<ChannelInfo *> ids;
+  JournalReader reader;
+  const JournalFormat::Record *record;
+  int retVal;
+
+  if (0 != reader.open(directory)) {
+    std::cerr << "Could not open the journal in " << directory << ": "
+              << ::strerror(errno) << std::endl;
+    return -1;
+  }
+
+  while (0 == (retVal = reader.next(&record))) {
+    const char *payload = JournalFormat::payload(record);
+    const uint32_t payloadSize = JournalFormat::payloadSize(record);
+    ChannelInfo *channel;
+
+    if (JournalFormat::CHANNEL == record->m_type) {
+      const JournalFormat::ChannelRecord *declaration =
+          reinterpret_cast<const JournalFormat::ChannelRecord *>(payload);
+
+      if ((offsetof(JournalFormat::ChannelRecord, m_channelName) >=
+           payloadSize) ||
+          ('\0' != payload[payloadSize - 1])) {
+        retVal = -1;
+        break;
+      }
+
+      if (ids.size() <= record->m_channelId) {
+        ids.resize(record->m_channelId + 1, 0);
+      }
+      if (0 == channels.count(declaration->m_channelName)) {
+        ChannelInfo &added = channels[declaration->m_channelName];
+        ::memset(&added, 0, sizeof(added));
+      }
+      ids[record->m_channelId] = &(channels[declaration->m_channelName]);
+      ids[record->m_channelId]->m_boardSize = declaration->m_boardSize;
+      continue;
+    }
+
+    channel = (ids.size() > record->m_channelId)
+                  ? (ids[record->m_channelId])
+                  : (0);
+    if (0 == channel) {
+      retVal = -1;
+      break;
+    }
+
+    if (JournalFormat::DATAGRAM == record->m_type) {
+      channel->m_datagrams++;
+      channel->m_bytes += payloadSize;
+      if (0 == channel->m_first) {
+        channel->m_first = record->m_timestamp;
+      }
+      channel->m_last = record->m_timestamp;
+    } else if ((JournalFormat::GAP == record->m_type) &&
+               (sizeof(JournalFormat::GapRecord) <= payloadSize)) {
+      channel->m_gaps++;
+      channel->m_lostBytes +=
+          reinterpret_cast<const JournalFormat::GapRecord *>(payload)
+              ->m_bytes;
+    }
+  }
+
+  if (0 > retVal) {
+    std::cerr << "Malformed record in " << reader.path() << std::endl;
+    return -1;
+  }
+
+  std::cout << std::left << std::setw(48) << "CHANNEL" << std::right
+            << std::setw(12) << "BOARD" << std::setw(12) << "DATAGRAMS"
+            << std::setw(14) << "BYTES" << std::setw(8) << "GAPS"
+            << "  FIRST / LAST (UTC)" << std::endl;
+  for (std::map<std::string, ChannelInfo>::const_iterator channel =
+           channels.begin();
+       channel != channels.end(); ++channel) {
+    const ChannelInfo &counts = channel->second;
+
+    std::cout << std::left << std::setw(48) << channel->first << std::right
+              << std::setw(12) << counts.m_boardSize << std::setw(12)
+              << counts.m_datagrams << std::setw(14) << counts.m_bytes
+              << std::setw(8) << counts.m_gaps;
+    if (0 != counts.m_datagrams) {
+      std::cout << "  " << formatTime(counts.m_first) << " / "
+                << formatTime(counts.m_last);
+    }
+    std::cout << std::endl;
+  }
+  std::cout << reader.numSegments() << " segments" << std::endl;
+
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string vlan;
+  uint64_t segmentSize = DEFAULT_SEGMENT_SIZE;
+  std::string command;
+  struct sigaction action;
+  int retVal;
+
+  // setup getopt_long options
+  const char *optstring = "v:S:h?";
+  const struct option longopts[] =
+      // {char* name, int has_arg, int* flag, int val}
+      {{"vlan", required_argument, 0, 'v'},
+       {"segment", required_argument, 0, 'S'},
+       {"help", no_argument, 0, 'h'},
+       {0, 0, 0, 0}};
+
+  int option;
+  while (-1 != (option = ::getopt_long(argc, argv, optstring, longopts, 0))) {
+    switch (option) {
+    case 'v': {
+      vlan = ::optarg;
+    } break;
+
+    case 'S': {
+      segmentSize = StrToInt::parseUint(::optarg);
+      if (MIN_SEGMENT_SIZE > segmentSize) {
+        std::cerr << "Please enter a segment size of at least "
+                  << MIN_SEGMENT_SIZE << " bytes" << std::endl;
+        return 1;
+      }
+    } break;
+
+    default: {
+      usage(argv[0]);
+      return 1;
+    } break;
+    }
+  }
+
+  if (::optind + 2 > argc) {
+    std::cerr << "Please enter a command and a journal" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  command = argv[::optind++];
+
+  if (vlan.empty()) {
+    struct passwd *userDetails = ::getpwuid(::getuid());
+    vlan = userDetails->pw_name;
+  }
+
+  // stop cleanly, so that the journal is closed and the counters printed
+  ::memset(&action, 0, sizeof(action));
+  action.sa_handler = handleSignal;
+  ::sigaction(SIGINT, &action, 0);
+  ::sigaction(SIGTERM, &action, 0);
+
+  if (("record" == command) && (::optind + 1 < argc)) {
+    Recorder recorder;
+    Recorder::Options options;
+
+    options.m_vlan = vlan;
+    options.m_directory = argv[::optind];
+    options.m_channels.assign(argv + ::optind + 1, argv + argc);
+    options.m_segmentSize = segmentSize;
+    options.m_idleMicros = DEFAULT_IDLE_MICROS;
+
+    retVal = recorder.init(options);
+    if (0 == retVal) {
+      retVal = recorder.run(&g_stop);
+      recorder.report();
+    }
+  } else if (("info" == command) && (::optind + 1 == argc)) {
+    retVal = info(argv[::optind]);
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  return (0 == retVal) ? (0) : (1);
+}
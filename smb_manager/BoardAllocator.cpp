@@ -0,0 +1,814 @@
+#include "BoardAllocator.h"
+#include "KeyIndex.h"
+#include "LastValueArea.h"
+#include "NumaUtil.h"
+#include "WaitArea.h"
+
+#include <core/link/DatagramBoard.h>
+#include <core/utils/FileUtil.h>
+
+#include <new>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// glibc only exposes MFD_HUGETLB, the page size flags are in
+// <linux/memfd.h>, which clashes with <sys/mman.h>
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB (21U << 26)
+#endif
+#ifndef MFD_HUGE_1GB
+#define MFD_HUGE_1GB (30U << 26)
+#endif
+
+namespace {
+const char *const TEMPORARY_NAME = "/.board.XXXXXX";
+const uint64_t HUGE_2MB_PAGE_BYTES = 2 * 1024 * 1024;
+const uint64_t HUGE_1GB_PAGE_BYTES = 1024 * 1024 * 1024;
+
+bool isPlainCharacter(unsigned char c) {
+  return (('A' <= c) && ('Z' >= c)) || (('a' <= c) && ('z' >= c)) ||
+         (('0' <= c) && ('9' >= c)) || ('.' == c) || ('_' == c) ||
+         ('-' == c);
+}
+
+int hexValue(char c) {
+  if (('0' <= c) && ('9' >= c)) {
+    return c - '0';
+  } else if (('A' <= c) && ('F' >= c)) {
+    return c - 'A' + 10;
+  } else if (('a' <= c) && ('f' >= c)) {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+} // namespace
+
+int BoardAllocator::init(const std::string &boardDir) {
+  m_boardDir = boardDir;
+  if (m_boardDir.empty()) {
+    return 0;
+  }
+
+  // strip trailing '/', then let mkdirpForFile create the whole path
+  while ((1 < m_boardDir.size()) &&
+         ('/' == m_boardDir[m_boardDir.size() - 1])) {
+    m_boardDir.erase(m_boardDir.size() - 1);
+  }
+  FileUtil::mkdirpForFile((m_boardDir + "/").c_str(), 0700);
+
+  struct stat status;
+  if ((0 != ::stat(m_boardDir.c_str(), &status)) ||
+      !S_ISDIR(status.st_mode) ||
+      (0 != ::access(m_boardDir.c_str(), R_OK | W_OK | X_OK))) {
+    m_boardDir.clear();
+    return -1;
+  }
+
+  return 0;
+}
+
+int BoardAllocator::create(const char *channelName, uint64_t requestedSize,
+                           PageSize pageSize, const Areas &areas,
+                           Board *board) {
+  if (0 != createAnonymous(requestedSize, pageSize, areas, board)) {
+    return -1;
+  }
+
+  if ((NORMAL_PAGES == board->m_pageSize) && named()) {
+    // failure leaves a working, but unrecoverable, board
+    name(channelName, board);
+  }
+
+  return 0;
+}
+
+int BoardAllocator::createSpare(uint64_t requestedSize, PageSize pageSize,
+                                const Areas &areas, Board *board) {
+  if (0 != createAnonymous(requestedSize, pageSize, areas, board)) {
+    return -1;
+  }
+
+  if ((NORMAL_PAGES == board->m_pageSize) && named() &&
+      (0 == moveToBoardDir(0, board))) {
+    board->m_spare = true;
+  }
+
+  return 0;
+}
+
+int BoardAllocator::createAnonymous(uint64_t requestedSize,
+                                    PageSize pageSize, const Areas &areas,
+                                    Board *board) {
+  DatagramBoard datagramBoard;
+  int boardFd;
+
+  if (0 != datagramBoard.create(&boardFd, requestedSize)) {
+    return -1;
+  }
+  // get real board size and unmap board as I do not need it
+  board->m_size = datagramBoard.m_boardInfo->m_size;
+  datagramBoard.unmap();
+
+  if (0 != layOutAreas(boardFd, board->m_size, areas)) {
+    ::close(boardFd);
+    return -1;
+  }
+
+  board->m_fd = boardFd;
+  board->m_pageSize = NORMAL_PAGES;
+  board->m_named = false;
+  board->m_lockedMapping = 0;
+  board->m_lockedSize = 0;
+  board->m_prefaulted = false;
+  board->m_spare = false;
+  board->m_numaNode = NumaUtil::NO_NODE;
+
+  if (NORMAL_PAGES != pageSize) {
+    // failure leaves a board on normal pages
+    moveToHugePages(pageSize, board);
+  }
+
+  return 0;
+}
+
+int BoardAllocator::layOutAreas(int fd, uint64_t boardSize,
+                                const Areas &areas) {
+  const uint64_t indexOffset = KeyIndex::offset(
+      boardSize, areas.m_lastValueKeys, areas.m_lastValueSize);
+  const uint64_t waitOffset =
+      WaitArea::offset(boardSize, areas.m_lastValueKeys,
+                       areas.m_lastValueSize, areas.m_keyIndexCapacity);
+  LastValueArea::Header area;
+  KeyIndex::Header index;
+  WaitArea::Header wait;
+  struct stat status;
+  uint64_t fileSize;
+
+  if (areas.m_waitArea) {
+    fileSize = waitOffset + WaitArea::SIZE;
+  } else if (0 != areas.m_keyIndexCapacity) {
+    fileSize = indexOffset + KeyIndex::size(areas.m_keyIndexCapacity);
+  } else if (0 != areas.m_lastValueKeys) {
+    fileSize = LastValueArea::offset(boardSize) +
+               LastValueArea::size(areas.m_lastValueKeys,
+                                   areas.m_lastValueSize);
+  } else {
+    return 0;
+  }
+
+  // the slots and entries are holes, i.e. zero, until the writer sets
+  // them
+  if ((0 != ::fstat(fd, &status)) ||
+      ((static_cast<uint64_t>(status.st_size) < fileSize) &&
+       (0 != ::ftruncate(fd, fileSize)))) {
+    return -1;
+  }
+
+  if (0 != areas.m_lastValueKeys) {
+    ::memset(&area, 0, sizeof(area));
+    LastValueArea::init(&area, areas.m_lastValueKeys,
+                        areas.m_lastValueSize);
+    if (sizeof(area) != ::pwrite(fd, &area, sizeof(area),
+                                 LastValueArea::offset(boardSize))) {
+      return -1;
+    }
+  }
+
+  if (0 != areas.m_keyIndexCapacity) {
+    ::memset(&index, 0, sizeof(index));
+    KeyIndex::init(&index, areas.m_keyIndexCapacity);
+    if (sizeof(index) != ::pwrite(fd, &index, sizeof(index), indexOffset)) {
+      return -1;
+    }
+  }
+
+  if (areas.m_waitArea) {
+    WaitArea::init(&wait);
+    if (sizeof(wait) != ::pwrite(fd, &wait, sizeof(wait), waitOffset)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void BoardAllocator::findAreas(int fd, uint64_t boardSize, Areas *areas) {
+  LastValueArea::Header area;
+  KeyIndex::Header index;
+  uint32_t magic;
+
+  *areas = Areas();
+
+  // pread() works on hugetlb files too, and comes up short past the end
+  if ((sizeof(area) == ::pread(fd, &area, sizeof(area),
+                               LastValueArea::offset(boardSize))) &&
+      (LastValueArea::MAGIC == area.m_magic)) {
+    areas->m_lastValueKeys = area.m_numKeys;
+    areas->m_lastValueSize = area.m_valueSize;
+  }
+
+  if ((sizeof(index) ==
+       ::pread(fd, &index, sizeof(index),
+               KeyIndex::offset(boardSize, areas->m_lastValueKeys,
+                                areas->m_lastValueSize))) &&
+      (KeyIndex::MAGIC == index.m_magic)) {
+    areas->m_keyIndexCapacity = index.m_capacity;
+  }
+
+  areas->m_waitArea =
+      (sizeof(magic) ==
+       ::pread(fd, &magic, sizeof(magic),
+               WaitArea::offset(boardSize, areas->m_lastValueKeys,
+                                areas->m_lastValueSize,
+                                areas->m_keyIndexCapacity))) &&
+      (WaitArea::MAGIC == magic);
+}
+
+int BoardAllocator::name(const char *channelName, Board *board) {
+  if (0 != moveToBoardDir(channelName, board)) {
+    return -1;
+  }
+
+  board->m_named = true;
+
+  return 0;
+}
+
+int BoardAllocator::moveToBoardDir(const char *channelName, Board *board) {
+  std::string path;
+  std::string temporaryPath = m_boardDir + TEMPORARY_NAME;
+  struct stat status;
+  int fd;
+
+  if ((0 != channelName) && (path = backingPath(channelName)).empty()) {
+    goto NAME_TOO_LONG_ERROR;
+  }
+
+  if (0 != ::fstat(board->m_fd, &status)) {
+    goto FSTAT_ERROR;
+  }
+
+  fd = ::mkostemp(&(temporaryPath[0]), O_CLOEXEC);
+  if (0 > fd) {
+    goto CREATE_ERROR;
+  }
+
+  if ((0 != ::ftruncate(fd, status.st_size)) ||
+      (0 != copy(board->m_fd, fd, status.st_size))) {
+    goto COPY_ERROR;
+  }
+
+  // only complete boards ever carry the channel's name
+  if (0 == channelName) {
+    path = sparePath(fd);
+  }
+  if (path.empty() || (0 != ::rename(temporaryPath.c_str(), path.c_str()))) {
+    goto COPY_ERROR;
+  }
+
+  ::close(board->m_fd);
+  board->m_fd = fd;
+
+  return 0;
+
+COPY_ERROR:
+  ::close(fd);
+  ::unlink(temporaryPath.c_str());
+
+CREATE_ERROR:
+FSTAT_ERROR:
+NAME_TOO_LONG_ERROR:
+  return -1;
+}
+
+void BoardAllocator::adopt(const char *channelName, Board *board) {
+  if (!board->m_spare) {
+    if ((NORMAL_PAGES == board->m_pageSize) && named()) {
+      // failure leaves a working, but unrecoverable, board
+      name(channelName, board);
+    }
+    return;
+  }
+
+  std::string path = backingPath(channelName);
+  if (!path.empty() &&
+      (0 == ::rename(sparePath(board->m_fd).c_str(), path.c_str()))) {
+    board->m_spare = false;
+    board->m_named = true;
+  }
+}
+
+int BoardAllocator::release(const char *channelName, Board *board) {
+  if (!board->m_named) {
+    return 0;
+  }
+
+  std::string path = backingPath(channelName);
+  std::string spare = sparePath(board->m_fd);
+  if (path.empty() || spare.empty() ||
+      (0 != ::rename(path.c_str(), spare.c_str()))) {
+    return -1;
+  }
+
+  board->m_named = false;
+  board->m_spare = true;
+
+  return 0;
+}
+
+int BoardAllocator::scrub(const Board &board, uint64_t requestedSize) {
+  DatagramBoard datagramBoard;
+  Areas areas;
+  struct stat status;
+  int freshFd;
+  int retVal;
+
+  if (0 != ::fstat(board.m_fd, &status)) {
+    return -1;
+  }
+
+  // the areas' headers go with the board's contents, the fresh board
+  // provides them again
+  findAreas(board.m_fd, board.m_size, &areas);
+
+  if (board.m_prefaulted || (0 != board.m_lockedMapping)) {
+    // keep the pages, just zero them
+    void *mapping = ::mmap(0, status.st_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, board.m_fd, 0);
+    if (MAP_FAILED == mapping) {
+      return -1;
+    }
+    ::memset(mapping, 0, status.st_size);
+    ::munmap(mapping, status.st_size);
+  } else if (0 != ::fallocate(board.m_fd,
+                              FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0,
+                              status.st_size)) {
+    return -1;
+  }
+
+  // a fresh board of the same size provides the headers
+  if (0 != datagramBoard.create(&freshFd, requestedSize)) {
+    return -1;
+  }
+  datagramBoard.unmap();
+
+  if (0 != layOutAreas(freshFd, board.m_size, areas)) {
+    retVal = -1;
+  } else {
+    retVal = copy(freshFd, board.m_fd, status.st_size);
+  }
+  ::close(freshFd);
+
+  return retVal;
+}
+
+int BoardAllocator::moveToHugePages(PageSize pageSize, Board *board) {
+  const uint64_t hugePageBytes = pageBytes(pageSize);
+  const unsigned int flags =
+      MFD_CLOEXEC | MFD_HUGETLB |
+      ((HUGE_2MB_PAGES == pageSize) ? (MFD_HUGE_2MB) : (MFD_HUGE_1GB));
+  struct stat status;
+  uint64_t fileSize;
+  int fd;
+
+  if (0 != ::fstat(board->m_fd, &status)) {
+    goto FSTAT_ERROR;
+  }
+  // hugetlb files come in whole huge pages
+  fileSize = ((status.st_size + hugePageBytes - 1) / hugePageBytes) *
+             hugePageBytes;
+
+  fd = ::memfd_create("DatagramBoard", flags);
+  if (0 > fd) {
+    goto CREATE_ERROR;
+  }
+
+  // mapping the whole file reserves its huge pages, or fails right away
+  // if there are not enough of them
+  if ((0 != ::ftruncate(fd, fileSize)) ||
+      (0 != copy(board->m_fd, fd, fileSize))) {
+    goto COPY_ERROR;
+  }
+
+  ::close(board->m_fd);
+  board->m_fd = fd;
+  board->m_pageSize = pageSize;
+
+  return 0;
+
+COPY_ERROR:
+  ::close(fd);
+
+CREATE_ERROR:
+FSTAT_ERROR:
+  return -1;
+}
+
+void BoardAllocator::destroy(const char *channelName, const Board &board) {
+  if (board.m_spare) {
+    std::string path = sparePath(board.m_fd);
+    if (!path.empty()) {
+      ::unlink(path.c_str());
+    }
+  } else if (board.m_named) {
+    std::string path = backingPath(channelName);
+    if (!path.empty()) {
+      ::unlink(path.c_str());
+    }
+  }
+
+  if (0 != board.m_lockedMapping) {
+    ::munmap(board.m_lockedMapping, board.m_lockedSize);
+  }
+  ::close(board.m_fd);
+}
+
+int BoardAllocator::prefault(const Board &board) {
+  struct stat status;
+  if (0 != ::fstat(board.m_fd, &status)) {
+    return -1;
+  }
+
+  // allocates the pages without mapping them, on tmpfs and hugetlbfs
+  // alike. Pages already written to are left alone
+  return (0 == ::fallocate(board.m_fd, 0, 0, status.st_size)) ? (0) : (-1);
+}
+
+int BoardAllocator::lock(Board *board) {
+  struct stat status;
+  void *mapping;
+
+  if (0 != board->m_lockedMapping) {
+    return 0;
+  }
+
+  if (0 != ::fstat(board->m_fd, &status)) {
+    return -1;
+  }
+
+  mapping = ::mmap(0, status.st_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, board->m_fd, 0);
+  if (MAP_FAILED == mapping) {
+    return -1;
+  }
+
+  if (0 != ::mlock(mapping, status.st_size)) {
+    ::munmap(mapping, status.st_size);
+    return -1;
+  }
+
+  board->m_lockedMapping = mapping;
+  board->m_lockedSize = status.st_size;
+
+  return 0;
+}
+
+const DatagramBoard::BoardInfo *
+BoardAllocator::mapHeader(const Board &board) {
+  void *mapping;
+
+  if (0 != board.m_lockedMapping) {
+    return static_cast<const DatagramBoard::BoardInfo *>(
+        board.m_lockedMapping);
+  }
+
+  // hugetlb files are only mapped in whole huge pages
+  mapping = ::mmap(0, pageBytes(board.m_pageSize), PROT_READ, MAP_SHARED,
+                   board.m_fd, 0);
+  if (MAP_FAILED == mapping) {
+    return 0;
+  }
+
+  return static_cast<const DatagramBoard::BoardInfo *>(mapping);
+}
+
+void BoardAllocator::unmapHeader(const Board &board,
+                                 const DatagramBoard::BoardInfo *header) {
+  if ((0 != header) && (header != board.m_lockedMapping)) {
+    ::munmap(const_cast<DatagramBoard::BoardInfo *>(header),
+             pageBytes(board.m_pageSize));
+  }
+}
+
+int BoardAllocator::copyLastValues(const Board &from, const Board &to) {
+  struct stat fromStatus;
+  struct stat toStatus;
+  void *fromMapping;
+  void *toMapping;
+  const LastValueArea::Header *fromArea;
+  LastValueArea::Header *toArea;
+
+  if ((0 != ::fstat(from.m_fd, &fromStatus)) ||
+      (0 != ::fstat(to.m_fd, &toStatus))) {
+    return -1;
+  }
+
+  // the areas lie behind the ring, so whole files are mapped
+  fromMapping = ::mmap(0, fromStatus.st_size, PROT_READ, MAP_SHARED,
+                       from.m_fd, 0);
+  if (MAP_FAILED == fromMapping) {
+    return -1;
+  }
+  toMapping = ::mmap(0, toStatus.st_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, to.m_fd, 0);
+  if (MAP_FAILED == toMapping) {
+    ::munmap(fromMapping, fromStatus.st_size);
+    return -1;
+  }
+
+  fromArea = LastValueArea::find(
+      static_cast<const void *>(fromMapping), fromStatus.st_size);
+  toArea = LastValueArea::find(toMapping, toStatus.st_size);
+  if ((0 != fromArea) && (0 != toArea)) {
+    LastValueArea::copy(fromArea, toArea);
+  }
+
+  ::munmap(toMapping, toStatus.st_size);
+  ::munmap(fromMapping, fromStatus.st_size);
+
+  return 0;
+}
+
+int BoardAllocator::place(Board *board, int node) {
+  struct stat status;
+  void *mapping;
+  int retVal;
+
+  if (0 != ::fstat(board->m_fd, &status)) {
+    return -1;
+  }
+
+  // the policy is set through a mapping, but outlives it
+  mapping = ::mmap(0, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   board->m_fd, 0);
+  if (MAP_FAILED == mapping) {
+    return -1;
+  }
+
+  retVal = NumaUtil::preferNode(mapping, status.st_size, node);
+  ::munmap(mapping, status.st_size);
+  if (0 != retVal) {
+    return -1;
+  }
+
+  board->m_numaNode = node;
+
+  return 0;
+}
+
+
+int BoardAllocator::recover(std::vector<RecoveredBoard> *boards) {
+  DIR *dir;
+  struct dirent *entry;
+
+  if (!named()) {
+    return 0;
+  }
+
+  dir = ::opendir(m_boardDir.c_str());
+  if (0 == dir) {
+    return -1;
+  }
+
+  while (0 != (entry = ::readdir(dir))) {
+    std::string path = m_boardDir + "/" + entry->d_name;
+    RecoveredBoard recovered;
+    DatagramBoard::BoardInfo info;
+    struct stat status;
+
+    if ((0 == ::strcmp(".", entry->d_name)) ||
+        (0 == ::strcmp("..", entry->d_name))) {
+      continue;
+    }
+
+    if ('.' == entry->d_name[0]) {
+      // a board that was still being written
+      ::unlink(path.c_str());
+      continue;
+    }
+
+    if (0 != decodeName(entry->d_name, &(recovered.m_channelName))) {
+      // not ours
+      continue;
+    }
+
+    recovered.m_board.m_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (0 > recovered.m_board.m_fd) {
+      continue;
+    }
+    // the datagram ring is what the header says, the file also holds
+    // the header and any areas behind the ring
+    if ((0 != ::fstat(recovered.m_board.m_fd, &status)) ||
+        !S_ISREG(status.st_mode) ||
+        (sizeof(info) !=
+         ::pread(recovered.m_board.m_fd, &info, sizeof(info), 0)) ||
+        (0 == info.m_size) ||
+        (static_cast<uint64_t>(status.st_size) <= info.m_size)) {
+      ::close(recovered.m_board.m_fd);
+      continue;
+    }
+    recovered.m_board.m_size = info.m_size;
+    recovered.m_board.m_pageSize = NORMAL_PAGES;
+    recovered.m_board.m_named = true;
+    recovered.m_board.m_lockedMapping = 0;
+    recovered.m_board.m_lockedSize = 0;
+    recovered.m_board.m_prefaulted = false;
+    recovered.m_board.m_spare = false;
+    recovered.m_board.m_numaNode = NumaUtil::NO_NODE;
+
+    try {
+      boards->push_back(recovered);
+    } catch (std::bad_alloc &) {
+      ::close(recovered.m_board.m_fd);
+      ::closedir(dir);
+      return -1;
+    }
+  }
+
+  ::closedir(dir);
+  return 0;
+}
+
+void BoardAllocator::clear(void) {
+  DIR *dir;
+  struct dirent *entry;
+
+  if (!named()) {
+    return;
+  }
+
+  dir = ::opendir(m_boardDir.c_str());
+  if (0 == dir) {
+    return;
+  }
+
+  while (0 != (entry = ::readdir(dir))) {
+    std::string channelName;
+    if ((0 == ::strcmp(".", entry->d_name)) ||
+        (0 == ::strcmp("..", entry->d_name))) {
+      continue;
+    }
+
+    // only remove what could have been ours
+    if (('.' == entry->d_name[0]) ||
+        (0 == decodeName(entry->d_name, &channelName))) {
+      ::unlink((m_boardDir + "/" + entry->d_name).c_str());
+    }
+  }
+
+  ::closedir(dir);
+}
+
+std::string BoardAllocator::backingPath(const char *channelName) const {
+  std::string fileName = encodeName(channelName);
+  if (NAME_MAX < fileName.size()) {
+    return std::string();
+  }
+
+  return m_boardDir + "/" + fileName;
+}
+
+std::string BoardAllocator::sparePath(int fd) const {
+  struct stat status;
+  char fileName[32];
+
+  if (0 != ::fstat(fd, &status)) {
+    return std::string();
+  }
+
+  // '.' makes recover() delete spares a crashed manager left behind
+  ::snprintf(fileName, sizeof(fileName), "/.spare.%llu",
+             static_cast<unsigned long long>(status.st_ino));
+  return m_boardDir + fileName;
+}
+
+int BoardAllocator::copy(int sourceFd, int destinationFd, uint64_t size) {
+  char *destination;
+  off_t offset = 0;
+  int retVal = 0;
+
+  destination = static_cast<char *>(::mmap(
+      0, size, PROT_READ | PROT_WRITE, MAP_SHARED, destinationFd, 0));
+  if (MAP_FAILED == destination) {
+    return -1;
+  }
+
+  // a fresh board is mostly holes; copying only the data extents keeps
+  // the destination just as sparse
+  while (static_cast<uint64_t>(offset) < size) {
+    off_t dataStart = ::lseek(sourceFd, offset, SEEK_DATA);
+    if (0 > dataStart) {
+      // ENXIO: no data past offset
+      retVal = (ENXIO == errno) ? (0) : (-1);
+      break;
+    }
+
+    off_t dataEnd = ::lseek(sourceFd, dataStart, SEEK_HOLE);
+    if ((0 > dataEnd) || (size < static_cast<uint64_t>(dataEnd))) {
+      retVal = -1;
+      break;
+    }
+
+    for (offset = dataStart; offset < dataEnd;) {
+      ssize_t bytesRead = ::pread(sourceFd, destination + offset,
+                                  dataEnd - offset, offset);
+      if (0 >= bytesRead) {
+        retVal = -1;
+        break;
+      }
+      offset += bytesRead;
+    }
+    if (0 != retVal) {
+      break;
+    }
+  }
+
+  ::munmap(destination, size);
+  return retVal;
+}
+
+uint64_t BoardAllocator::pageBytes(PageSize pageSize) {
+  switch (pageSize) {
+  case HUGE_2MB_PAGES:
+    return HUGE_2MB_PAGE_BYTES;
+
+  case HUGE_1GB_PAGES:
+    return HUGE_1GB_PAGE_BYTES;
+
+  case NORMAL_PAGES:
+  default:
+    return ::sysconf(_SC_PAGESIZE);
+  }
+}
+
+BoardAllocator::PageSize BoardAllocator::pageSizeOf(int fd) {
+  struct stat status;
+  if (0 != ::fstat(fd, &status)) {
+    return NORMAL_PAGES;
+  }
+
+  // hugetlbfs reports its page size as the block size
+  if (HUGE_1GB_PAGE_BYTES == static_cast<uint64_t>(status.st_blksize)) {
+    return HUGE_1GB_PAGES;
+  } else if (HUGE_2MB_PAGE_BYTES ==
+             static_cast<uint64_t>(status.st_blksize)) {
+    return HUGE_2MB_PAGES;
+  }
+  return NORMAL_PAGES;
+}
+
+std::string BoardAllocator::encodeName(const char *channelName) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  const unsigned char *name =
+      reinterpret_cast<const unsigned char *>(channelName);
+  std::string fileName;
+
+  for (const unsigned char *c = name; '\0' != *c; c++) {
+    // a leading '.' would make it a hidden, temporary file
+    if (isPlainCharacter(*c) && !(('.' == *c) && (name == c))) {
+      fileName += static_cast<char>(*c);
+    } else {
+      fileName += '%';
+      fileName += HEX_DIGITS[*c >> 4];
+      fileName += HEX_DIGITS[*c & 0xF];
+    }
+  }
+
+  return fileName;
+}
+
+int BoardAllocator::decodeName(const char *fileName,
+                               std::string *channelName) {
+  channelName->clear();
+
+  if (('\0' == *fileName) || ('.' == *fileName)) {
+    return -1;
+  }
+
+  for (const char *c = fileName; '\0' != *c; c++) {
+    if ('%' == *c) {
+      int high = hexValue(c[1]);
+      int low = (0 > high) ? (-1) : (hexValue(c[2]));
+      if ((0 > low) || ((0 == high) && (0 == low))) {
+        return -1;
+      }
+      *channelName += static_cast<char>((high << 4) | low);
+      c += 2;
+    } else if (isPlainCharacter(*c)) {
+      *channelName += *c;
+    } else {
+      return -1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,398 @@
+#ifndef DAEMONS_BOARDALLOCATOR_H_
+#define DAEMONS_BOARDALLOCATOR_H_
+
+/***
+ * @file BoardAllocator.h
+ *
+ * @brief
+ * Creates, destroys and recovers the DatagramBoards behind the
+ * manager's channels.
+ *
+ * @description
+ * Boards are always created by DatagramBoard::create(), which lays out
+ * the board header. When a board directory is configured, the new board
+ * is then moved into a named file in that directory (which should be on
+ * a tmpfs such as /dev/shm), so that a manager restarted after a crash
+ * can find the boards again by channel name. Only the pages the fresh
+ * board actually populated are copied.
+ *
+ * File names are the channel names with every byte outside
+ * [A-Za-z0-9._-] (and a leading '.') percent-encoded. Channels whose
+ * encoded name does not fit in a file name keep an anonymous board.
+ * Names starting with '.' are boards still being written; recover()
+ * deletes them.
+ *
+ * Boards may be backed by 2 MiB or 1 GiB huge pages instead, to spare
+ * readers of large boards the TLB misses. The fresh board is then moved
+ * into a hugetlb memfd, which reserves every huge page of the board up
+ * front. If too few huge pages are reserved on the host, the board
+ * keeps normal pages. Huge page boards are never named, as tmpfs cannot
+ * hold them.
+ *
+ * A board can be warmed before its fd is handed out: prefault()
+ * allocates every page of the file, so that neither the writer nor the
+ * readers pay for allocating and zeroing pages on first touch, and
+ * lock() additionally keeps them resident with a locked mapping owned
+ * by the manager.
+ *
+ * Spare boards are created ahead of their channel by createSpare(). In
+ * the board directory they are kept under a hidden name, so that
+ * adopt() can give one its channel's name with a rename. release()
+ * hides a destroyed channel's board again, and scrub() resets its
+ * contents to those of a fresh board, so that it can be reused.
+ *
+ * On NUMA hosts place() sets a board's memory policy to prefer one
+ * node, and moves the pages it already has there. The policy of a tmpfs
+ * or memfd board belongs to the file, so it holds for every process that
+ * maps the board. hugetlb files keep no policy of their own; their pages
+ * only land on the node if they are allocated while the manager prefers
+ * it, i.e. when the board is created and prefaulted.
+ *
+ * A board may be created with areas behind its datagram ring: a
+ * last-value area (see LastValueArea.h) and a key index (see
+ * KeyIndex.h), and behind those a wait area (see WaitArea.h). The file
+ * is extended to hold them before the board is named or moved to huge
+ * pages, so that they go wherever the board goes, and scrub() keeps
+ * them, emptied.
+ *
+ * mapHeader() gives the manager a read-only view of a board's header, to
+ * sample how far the writer got without touching the board's data.
+ * copyLastValues() carries the last values of a resized channel without
+ * a writer over to its new board.
+ */
+
+#include <core/link/DatagramBoard.h>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+class BoardAllocator {
+public:
+  /***
+   * The pages backing a board
+   *
+   * @var NORMAL_PAGES The system page size
+   * @var HUGE_2MB_PAGES 2 MiB huge pages
+   * @var HUGE_1GB_PAGES 1 GiB huge pages
+   */
+  enum PageSize { NORMAL_PAGES, HUGE_2MB_PAGES, HUGE_1GB_PAGES };
+
+  /***
+   * A board file descriptor and what is known about it
+   *
+   * @var Board::m_fd The board's file descriptor
+   * @var Board::m_size The board size in bytes
+   * @var Board::m_pageSize The pages backing the board
+   * @var Board::m_named Whether the board lives in a named file in the
+   * board directory
+   * @var Board::m_lockedMapping The manager's locked mapping of the
+   * board, 0 if it is not locked
+   * @var Board::m_lockedSize The size of m_lockedMapping
+   * @var Board::m_prefaulted Whether every page of the board was
+   * allocated
+   * @var Board::m_spare Whether the board lives under a hidden spare
+   * name in the board directory
+   * @var Board::m_numaNode The node the board was placed on,
+   * NumaUtil::NO_NODE if it was not placed
+   */
+  struct Board {
+    int m_fd;
+    uint64_t m_size;
+    PageSize m_pageSize;
+    bool m_named;
+    void *m_lockedMapping;
+    uint64_t m_lockedSize;
+    bool m_prefaulted;
+    bool m_spare;
+    int m_numaNode;
+  };
+
+  /***
+   * The areas behind a board's datagram ring
+   *
+   * @var Areas::m_lastValueKeys The keys of the last-value area, 0 for
+   * none
+   * @var Areas::m_lastValueSize The largest value of a key
+   * @var Areas::m_keyIndexCapacity The entries of the key index, a
+   * power of two, 0 for none
+   * @var Areas::m_waitArea Whether there is a wait area
+   */
+  struct Areas {
+    uint32_t m_lastValueKeys;
+    uint32_t m_lastValueSize;
+    uint64_t m_keyIndexCapacity;
+    bool m_waitArea;
+
+    Areas(void);
+
+    bool operator==(const Areas &other) const;
+  };
+
+  /***
+   * A board found by recover()
+   *
+   * @var RecoveredBoard::m_channelName The decoded channel name
+   * @var RecoveredBoard::m_board The board. m_size is the size of its
+   * datagram ring, as in DatagramBoard::BoardInfo::m_size
+   */
+  struct RecoveredBoard {
+    std::string m_channelName;
+    Board m_board;
+  };
+
+private:
+  // not copyable
+  BoardAllocator(const BoardAllocator &);
+  BoardAllocator &operator=(const BoardAllocator &);
+
+  /***
+   * Moves a freshly created anonymous board into its named file
+   *
+   * @return 0 on success, non-zero on error, in which case the board is
+   * left as it was
+   */
+  int name(const char *channelName, Board *board);
+
+  /***
+   * Moves a freshly created anonymous board into the board directory,
+   * under its channel's name or, for a channelName of 0, its spare name
+   *
+   * @return 0 on success, non-zero on error, in which case the board is
+   * left as it was
+   */
+  int moveToBoardDir(const char *channelName, Board *board);
+
+  /***
+   * Creates a board in memory, on normal or huge pages
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int createAnonymous(uint64_t requestedSize, PageSize pageSize,
+                             const Areas &areas, Board *board);
+
+  /***
+   * Extends a board of boardSize bytes by empty areas, and writes their
+   * headers
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int layOutAreas(int fd, uint64_t boardSize, const Areas &areas);
+
+  /***
+   * Reads which areas a board of boardSize bytes has
+   */
+  static void findAreas(int fd, uint64_t boardSize, Areas *areas);
+
+  /***
+   * Moves a freshly created board into a hugetlb memfd
+   *
+   * @return 0 on success, non-zero on error, in which case the board is
+   * left as it was
+   */
+  static int moveToHugePages(PageSize pageSize, Board *board);
+
+  /***
+   * @return the path of the named file for channelName, or an empty
+   * string if the encoded name is too long
+   */
+  std::string backingPath(const char *channelName) const;
+
+  /***
+   * @return the hidden path of a spare board, named after its inode
+   */
+  std::string sparePath(int fd) const;
+
+  std::string m_boardDir;
+
+public:
+  BoardAllocator(void);
+
+  /***
+   * @param boardDir Directory for named boards, created if necessary.
+   * Empty for anonymous boards only.
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(const std::string &boardDir);
+
+  /***
+   * Creates a board
+   *
+   * @param channelName The channel the board is for
+   * @param requestedSize The requested board size in bytes
+   * @param pageSize The pages to back the board with
+   * @param areas The areas behind the board's datagram ring
+   * @param board Set to the new board on success. m_named is false if
+   * the board could not be named, m_pageSize is NORMAL_PAGES if there
+   * were not enough huge pages
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int create(const char *channelName, uint64_t requestedSize,
+             PageSize pageSize, const Areas &areas, Board *board);
+
+  /***
+   * Creates a board for a channel yet to come. It is anonymous, or a
+   * spare in the board directory.
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int createSpare(uint64_t requestedSize, PageSize pageSize,
+                  const Areas &areas, Board *board);
+
+  /***
+   * Turns a spare board into the board of a channel, naming it if
+   * boards are named. A board that cannot be named still works.
+   */
+  void adopt(const char *channelName, Board *board);
+
+  /***
+   * Turns the board of a destroyed channel back into a spare board
+   *
+   * @return 0 on success, non-zero on error, in which case the board
+   * should be destroyed
+   */
+  int release(const char *channelName, Board *board);
+
+  /***
+   * Resets a spare board's contents to those of a fresh board, its
+   * areas included. Pages that were prefaulted or locked stay
+   * allocated, all others are freed.
+   *
+   * @param requestedSize The size the board was created with
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int scrub(const Board &board, uint64_t requestedSize);
+
+  /***
+   * Closes a board and removes its named or spare file. channelName
+   * may be 0 for a spare board.
+   */
+  void destroy(const char *channelName, const Board &board);
+
+  /***
+   * Allocates every page of a board
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int prefault(const Board &board);
+
+  /***
+   * Maps and locks every page of a board, until destroy()
+   *
+   * @return 0 on success, non-zero on error, e.g. RLIMIT_MEMLOCK
+   */
+  static int lock(Board *board);
+
+  /***
+   * Places a board on a NUMA node
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int place(Board *board, int node);
+
+  /***
+   * Maps the header of a board read-only, so that the manager can watch
+   * the writer. A locked board's mapping is used instead, if it has one
+   *
+   * @return the header, or 0 on error
+   */
+  static const DatagramBoard::BoardInfo *mapHeader(const Board &board);
+
+  /***
+   * Undoes mapHeader(). Must be called before the board is destroyed or
+   * released
+   */
+  static void unmapHeader(const Board &board,
+                          const DatagramBoard::BoardInfo *header);
+
+  /***
+   * Copies the last values of one board to another, see
+   * LastValueArea::copy(). Neither may have a writer
+   *
+   * @return 0 on success, also if either has no last-value area,
+   * non-zero on error
+   */
+  static int copyLastValues(const Board &from, const Board &to);
+
+  /***
+   * Opens every named board in the board directory
+   *
+   * @param boards The recovered boards are appended here
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int recover(std::vector<RecoveredBoard> *boards);
+
+  /***
+   * Removes every named board left in the board directory. Processes
+   * which still map them are not affected.
+   */
+  void clear(void);
+
+  /***
+   * @return whether boards are named
+   */
+  bool named(void) const;
+
+  const std::string &boardDir(void) const;
+
+  /***
+   * Copies the populated extents of a board into another file of at
+   * least the same size, through a shared mapping of the destination, so
+   * that hugetlb files work too
+   *
+   * @param size The size of the destination file
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int copy(int sourceFd, int destinationFd, uint64_t size);
+
+  /***
+   * @return the size of a page in bytes
+   */
+  static uint64_t pageBytes(PageSize pageSize);
+
+  /***
+   * @return the pages backing an existing board
+   */
+  static PageSize pageSizeOf(int fd);
+
+  /***
+   * Percent-encodes a channel name into a file name
+   */
+  static std::string encodeName(const char *channelName);
+
+  /***
+   * Reverses encodeName()
+   *
+   * @return 0 on success, non-zero if fileName is not an encoded name
+   */
+  static int decodeName(const char *fileName, std::string *channelName);
+};
+
+// inline and template functions
+inline BoardAllocator::Areas::Areas(void)
+    : m_lastValueKeys(0), m_lastValueSize(0), m_keyIndexCapacity(0),
+      m_waitArea(false) {}
+
+inline bool BoardAllocator::Areas::operator==(const Areas &other) const {
+  return (m_lastValueKeys == other.m_lastValueKeys) &&
+         ((0 == m_lastValueKeys) ||
+          (m_lastValueSize == other.m_lastValueSize)) &&
+         (m_keyIndexCapacity == other.m_keyIndexCapacity) &&
+         (m_waitArea == other.m_waitArea);
+}
+
+inline BoardAllocator::BoardAllocator(void) : m_boardDir() {}
+
+inline bool BoardAllocator::named(void) const { return !m_boardDir.empty(); }
+
+inline const std::string &BoardAllocator::boardDir(void) const {
+  return m_boardDir;
+}
+
+#endif // DAEMONS_BOARDALLOCATOR_H_
@@ -0,0 +1,276 @@
+#include "BoardPool.h"
+
+#include <new>
+
+BoardPool::BoardPool(BoardAllocator *allocator)
+    : m_allocator(allocator), m_classes(), m_mutex(), m_wakeUp(),
+      m_thread(), m_running(false), m_started(false), m_hits(0),
+      m_misses(0) {
+  ::pthread_mutex_init(&m_mutex, 0);
+  ::pthread_cond_init(&m_wakeUp, 0);
+}
+
+BoardPool::~BoardPool(void) {
+  stop();
+
+  for (size_t i = 0; i < m_classes.size(); i++) {
+    delete m_classes[i];
+  }
+  ::pthread_cond_destroy(&m_wakeUp);
+  ::pthread_mutex_destroy(&m_mutex);
+}
+
+int BoardPool::start(void) {
+  if (m_started) {
+    return 0;
+  }
+
+  m_running.store(true, std::memory_order_release);
+  if (0 != ::pthread_create(&m_thread, 0, workerMain, this)) {
+    m_running.store(false, std::memory_order_release);
+    return -1;
+  }
+  m_started = true;
+
+  return 0;
+}
+
+void BoardPool::stop(void) {
+  if (m_started) {
+    ::pthread_mutex_lock(&m_mutex);
+    m_running.store(false, std::memory_order_release);
+    ::pthread_cond_signal(&m_wakeUp);
+    ::pthread_mutex_unlock(&m_mutex);
+
+    ::pthread_join(m_thread, 0);
+    m_started = false;
+  }
+
+  destroyAll();
+}
+
+void BoardPool::reserve(const BoardClass &boardClass, size_t target) {
+  Class *newClass;
+
+  if ((0 == target) || (0 == boardClass.m_requestedSize)) {
+    return;
+  }
+
+  ::pthread_mutex_lock(&m_mutex);
+  if ((0 != find(boardClass)) || (MAX_CLASSES <= m_classes.size())) {
+    goto DONE;
+  }
+
+  newClass = new (std::nothrow) Class();
+  if (0 == newClass) {
+    goto DONE;
+  }
+  newClass->m_class = boardClass;
+  newClass->m_target = target;
+
+  try {
+    newClass->m_boards.reserve(target);
+    m_classes.push_back(newClass);
+  } catch (std::bad_alloc &) {
+    delete newClass;
+    goto DONE;
+  }
+  ::pthread_cond_signal(&m_wakeUp);
+
+DONE:
+  ::pthread_mutex_unlock(&m_mutex);
+}
+
+int BoardPool::take(const BoardClass &boardClass, size_t target,
+                    BoardAllocator::Board *board) {
+  Class *pooled;
+
+  ::pthread_mutex_lock(&m_mutex);
+  pooled = find(boardClass);
+  if ((0 == pooled) || pooled->m_boards.empty()) {
+    ::pthread_mutex_unlock(&m_mutex);
+    m_misses++;
+
+    // so that the next channel of this class finds a board
+    reserve(boardClass, target);
+    return -1;
+  }
+
+  *board = pooled->m_boards.back();
+  pooled->m_boards.pop_back();
+  ::pthread_cond_signal(&m_wakeUp);
+  ::pthread_mutex_unlock(&m_mutex);
+  m_hits++;
+
+  return 0;
+}
+
+uint64_t BoardPool::usage(uint64_t *numBytes) {
+  uint64_t numBoards = 0;
+
+  *numBytes = 0;
+  ::pthread_mutex_lock(&m_mutex);
+  for (size_t i = 0; i < m_classes.size(); i++) {
+    const Class *pooled = m_classes[i];
+    for (size_t j = 0; j < pooled->m_boards.size(); j++) {
+      *numBytes += pooled->m_boards[j].m_size;
+    }
+    for (size_t j = 0; j < pooled->m_returned.size(); j++) {
+      *numBytes += pooled->m_returned[j].m_size;
+    }
+    numBoards += pooled->m_boards.size() + pooled->m_returned.size();
+  }
+  ::pthread_mutex_unlock(&m_mutex);
+
+  return numBoards;
+}
+
+int BoardPool::give(const BoardClass &boardClass,
+                    const BoardAllocator::Board &board) {
+  Class *pooled;
+  int retVal = -1;
+
+  ::pthread_mutex_lock(&m_mutex);
+  pooled = find(boardClass);
+  if ((0 != pooled) &&
+      ((pooled->m_boards.size() + pooled->m_returned.size()) <
+       pooled->m_target)) {
+    try {
+      pooled->m_returned.push_back(board);
+      ::pthread_cond_signal(&m_wakeUp);
+      retVal = 0;
+    } catch (std::bad_alloc &) {
+      // the caller destroys it
+    }
+  }
+  ::pthread_mutex_unlock(&m_mutex);
+
+  return retVal;
+}
+
+BoardPool::Class *BoardPool::find(const BoardClass &boardClass) {
+  for (size_t i = 0; i < m_classes.size(); i++) {
+    if (m_classes[i]->m_class == boardClass) {
+      return m_classes[i];
+    }
+  }
+
+  return 0;
+}
+
+int BoardPool::create(const BoardClass &boardClass,
+                      BoardAllocator::Board *board) {
+  const bool placed = (NumaUtil::NO_NODE != boardClass.m_numaNode);
+  int retVal;
+
+  // this thread's own policy, the manager's is not affected
+  if (placed) {
+    NumaUtil::setPreferredNode(boardClass.m_numaNode);
+  }
+
+  retVal = m_allocator->createSpare(boardClass.m_requestedSize,
+                                    boardClass.m_pageSize,
+                                    boardClass.m_areas, board);
+  if (0 == retVal) {
+    if (placed) {
+      BoardAllocator::place(board, boardClass.m_numaNode);
+    }
+    if (boardClass.m_prefault || boardClass.m_lock) {
+      board->m_prefaulted = (0 == BoardAllocator::prefault(*board));
+    }
+    if (boardClass.m_lock) {
+      BoardAllocator::lock(board);
+    }
+  }
+
+  if (placed) {
+    NumaUtil::setPreferredNode(NumaUtil::NO_NODE);
+  }
+
+  return retVal;
+}
+
+void BoardPool::work(void) {
+  ::pthread_mutex_lock(&m_mutex);
+
+  while (m_running.load(std::memory_order_acquire)) {
+    BoardAllocator::Board board;
+    BoardClass boardClass;
+    bool returned = false;
+    bool found = false;
+    bool ready;
+
+    // scrub returned boards first, they are already paid for
+    for (size_t i = 0; !found && (i < m_classes.size()); i++) {
+      Class *pooled = m_classes[i];
+      if (!pooled->m_returned.empty()) {
+        board = pooled->m_returned.back();
+        pooled->m_returned.pop_back();
+        boardClass = pooled->m_class;
+        returned = true;
+        found = true;
+      } else if (pooled->m_boards.size() < pooled->m_target) {
+        boardClass = pooled->m_class;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      ::pthread_cond_wait(&m_wakeUp, &m_mutex);
+      continue;
+    }
+
+    // the manager may take and give boards meanwhile
+    ::pthread_mutex_unlock(&m_mutex);
+    if (returned) {
+      ready = (0 == BoardAllocator::scrub(board, boardClass.m_requestedSize));
+      if (!ready) {
+        m_allocator->destroy(0, board);
+      }
+    } else {
+      ready = (0 == create(boardClass, &board));
+    }
+    ::pthread_mutex_lock(&m_mutex);
+
+    if (!ready) {
+      if (!returned && m_running.load(std::memory_order_acquire)) {
+        // try again when woken up, rather than spin
+        ::pthread_cond_wait(&m_wakeUp, &m_mutex);
+      }
+      continue;
+    }
+
+    try {
+      // classes are never removed, so it is still there
+      find(boardClass)->m_boards.push_back(board);
+    } catch (std::bad_alloc &) {
+      ::pthread_mutex_unlock(&m_mutex);
+      m_allocator->destroy(0, board);
+      ::pthread_mutex_lock(&m_mutex);
+    }
+  }
+
+  ::pthread_mutex_unlock(&m_mutex);
+}
+
+void BoardPool::destroyAll(void) {
+  for (size_t i = 0; i < m_classes.size(); i++) {
+    Class *pooled = m_classes[i];
+
+    for (size_t j = 0; j < pooled->m_boards.size(); j++) {
+      m_allocator->destroy(0, pooled->m_boards[j]);
+    }
+    pooled->m_boards.clear();
+
+    for (size_t j = 0; j < pooled->m_returned.size(); j++) {
+      m_allocator->destroy(0, pooled->m_returned[j]);
+    }
+    pooled->m_returned.clear();
+  }
+}
+
+void *BoardPool::workerMain(void *pool) {
+  static_cast<BoardPool *>(pool)->work();
+
+  return 0;
+}
@@ -0,0 +1,219 @@
+#ifndef DAEMONS_BOARDPOOL_H_
+#define DAEMONS_BOARDPOOL_H_
+
+/***
+ * @file BoardPool.h
+ *
+ * @brief
+ * Spare boards of the ShMemBCast Manager, created ahead of the channels
+ * that will use them.
+ *
+ * @description
+ * Boards are pooled per class, i.e. per requested size, page size, NUMA
+ * node, warming and areas behind the ring. A class is added by reserve(), or
+ * by the first take() that misses it, and is then kept topped up to its
+ * target by a background thread. Creating a channel thus only takes a
+ * board that is already created, named as a spare, placed and warmed.
+ *
+ * The boards of destroyed channels are given back to their class, if it
+ * has room. The background thread scrubs them before they are taken
+ * again. A client must therefore never touch a board after it
+ * unsubscribed from its channel.
+ *
+ * The thread is only started by start(), so that the manager can
+ * daemonize (fork) after init(). Until then take() always misses.
+ *
+ * take(), give() and reserve() must be called from one thread.
+ */
+
+#include "BoardAllocator.h"
+#include "NumaUtil.h"
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class BoardPool {
+public:
+  /***
+   * What makes boards interchangeable
+   *
+   * @var BoardClass::m_requestedSize The size the boards are created
+   * with. 0 for boards that cannot be pooled
+   * @var BoardClass::m_pageSize The pages backing the boards
+   * @var BoardClass::m_numaNode The node the boards are placed on,
+   * NumaUtil::NO_NODE for none
+   * @var BoardClass::m_prefault Whether the boards are prefaulted
+   * @var BoardClass::m_lock Whether the boards are locked
+   * @var BoardClass::m_areas The areas behind the boards' datagram
+   * rings
+   */
+  struct BoardClass {
+    uint64_t m_requestedSize;
+    BoardAllocator::PageSize m_pageSize;
+    int m_numaNode;
+    bool m_prefault;
+    bool m_lock;
+    BoardAllocator::Areas m_areas;
+
+    BoardClass(void);
+
+    bool operator==(const BoardClass &other) const;
+  };
+
+private:
+  // not copyable
+  BoardPool(const BoardPool &);
+  BoardPool &operator=(const BoardPool &);
+
+  static const size_t MAX_CLASSES = 32;
+
+  /***
+   * The spare boards of one class
+   *
+   * @var Class::m_class What the boards are like
+   * @var Class::m_target How many boards to keep ready
+   * @var Class::m_boards The boards ready to be taken
+   * @var Class::m_returned Boards given back, still to be scrubbed
+   */
+  struct Class {
+    BoardClass m_class;
+    size_t m_target;
+    std::vector<BoardAllocator::Board> m_boards;
+    std::vector<BoardAllocator::Board> m_returned;
+  };
+
+  /***
+   * @return the class, or 0 if it is not pooled. Call with m_mutex
+   * held.
+   */
+  Class *find(const BoardClass &boardClass);
+
+  /***
+   * Creates a board of a class, placed and warmed
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int create(const BoardClass &boardClass, BoardAllocator::Board *board);
+
+  /***
+   * Scrubs returned boards and refills classes until there is nothing
+   * left to do or stop() is called
+   */
+  void work(void);
+
+  /***
+   * Destroys every board in the pool. The thread must not run.
+   */
+  void destroyAll(void);
+
+  /***
+   * Worker thread entry point
+   */
+  static void *workerMain(void *pool);
+
+  BoardAllocator *const m_allocator;
+  std::vector<Class *> m_classes;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_wakeUp;
+  pthread_t m_thread;
+  std::atomic<bool> m_running;
+  bool m_started;
+  uint64_t m_hits;
+  uint64_t m_misses;
+
+public:
+  /***
+   * @param allocator Creates and destroys the boards. It must outlive
+   * the pool
+   */
+  explicit BoardPool(BoardAllocator *allocator);
+
+  /***
+   * Stops the thread and destroys every spare board
+   */
+  ~BoardPool(void);
+
+  /***
+   * Starts the thread that fills the pool
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int start(void);
+
+  /***
+   * Stops the thread and destroys every spare board. Spare boards in
+   * the board directory are removed.
+   */
+  void stop(void);
+
+  /***
+   * Starts pooling a class, if it is not pooled yet
+   *
+   * @param target How many boards to keep ready. 0 does nothing
+   */
+  void reserve(const BoardClass &boardClass, size_t target);
+
+  /***
+   * Takes a spare board
+   *
+   * @param target How many boards of the class to keep ready, should it
+   * not be pooled yet
+   *
+   * @return 0 on success, non-zero if there is no spare board
+   */
+  int take(const BoardClass &boardClass, size_t target,
+           BoardAllocator::Board *board);
+
+  /***
+   * Gives back the board of a destroyed channel, already released by
+   * the allocator
+   *
+   * @return 0 if the pool took the board, non-zero if the caller
+   * should destroy it
+   */
+  int give(const BoardClass &boardClass, const BoardAllocator::Board &board);
+
+  /***
+   * Counts the spare boards, those given back included
+   *
+   * @param numBytes Set to their size
+   *
+   * @return the number of boards
+   */
+  uint64_t usage(uint64_t *numBytes);
+
+  /***
+   * @return the number of take() calls that got a board
+   */
+  uint64_t hits(void) const;
+
+  /***
+   * @return the number of take() calls that did not
+   */
+  uint64_t misses(void) const;
+};
+
+// inline and template functions
+inline BoardPool::BoardClass::BoardClass(void)
+    : m_requestedSize(0), m_pageSize(BoardAllocator::NORMAL_PAGES),
+      m_numaNode(NumaUtil::NO_NODE), m_prefault(false), m_lock(false),
+      m_areas() {}
+
+inline bool
+BoardPool::BoardClass::operator==(const BoardClass &other) const {
+  return (m_requestedSize == other.m_requestedSize) &&
+         (m_pageSize == other.m_pageSize) &&
+         (m_numaNode == other.m_numaNode) &&
+         (m_prefault == other.m_prefault) && (m_lock == other.m_lock) &&
+         (m_areas == other.m_areas);
+}
+
+inline uint64_t BoardPool::hits(void) const { return m_hits; }
+
+inline uint64_t BoardPool::misses(void) const { return m_misses; }
+
+#endif // DAEMONS_BOARDPOOL_H_
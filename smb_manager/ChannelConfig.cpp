@@ -0,0 +1,355 @@
+#include "ChannelConfig.h"
+#include "KeyIndex.h"
+
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+const char *const WHITESPACE = " \t\r\n";
+
+std::string trim(const std::string &text) {
+  size_t begin = text.find_first_not_of(WHITESPACE);
+  if (std::string::npos == begin) {
+    return std::string();
+  }
+  size_t end = text.find_last_not_of(WHITESPACE);
+  return text.substr(begin, end - begin + 1);
+}
+
+int parseBool(const std::string &value, bool *result) {
+  if (("yes" == value) || ("true" == value) || ("1" == value)) {
+    *result = true;
+  } else if (("no" == value) || ("false" == value) || ("0" == value)) {
+    *result = false;
+  } else {
+    return -1;
+  }
+
+  return 0;
+}
+} // namespace
+
+int ChannelConfig::parsePageSize(const std::string &value,
+                                 BoardAllocator::PageSize *pageSize) {
+  if ("none" == value) {
+    *pageSize = BoardAllocator::NORMAL_PAGES;
+  } else if (("2M" == value) || ("2m" == value)) {
+    *pageSize = BoardAllocator::HUGE_2MB_PAGES;
+  } else if (("1G" == value) || ("1g" == value)) {
+    *pageSize = BoardAllocator::HUGE_1GB_PAGES;
+  } else {
+    return -1;
+  }
+
+  return 0;
+}
+
+const char *ChannelConfig::pageSizeName(BoardAllocator::PageSize pageSize) {
+  switch (pageSize) {
+  case BoardAllocator::HUGE_2MB_PAGES:
+    return "2M";
+
+  case BoardAllocator::HUGE_1GB_PAGES:
+    return "1G";
+
+  case BoardAllocator::NORMAL_PAGES:
+  default:
+    return "none";
+  }
+}
+
+int ChannelConfig::parseNumaNode(const std::string &value, int *numaNode) {
+  if ("none" == value) {
+    *numaNode = NumaUtil::NO_NODE;
+  } else if ("auto" == value) {
+    *numaNode = AUTO_NODE;
+  } else {
+    char *end;
+    long node = ::strtol(value.c_str(), &end, 10);
+    if (value.empty() || ('\0' != *end) || (0 > node) ||
+        (NumaUtil::numNodes() <= node)) {
+      return -1;
+    }
+    *numaNode = static_cast<int>(node);
+  }
+
+  return 0;
+}
+
+std::string ChannelConfig::numaNodeName(int numaNode) {
+  if (NumaUtil::NO_NODE == numaNode) {
+    return "none";
+  } else if (AUTO_NODE == numaNode) {
+    return "auto";
+  }
+
+  std::ostringstream name;
+  name << numaNode;
+  return name.str();
+}
+
+int ChannelConfig::parsePoolSize(const std::string &value,
+                                 uint32_t *poolSize) {
+  char *end;
+  unsigned long size = ::strtoul(value.c_str(), &end, 10);
+
+  if (value.empty() || ('\0' != *end) || ('-' == value[0]) ||
+      (MAX_POOL_SIZE < size)) {
+    return -1;
+  }
+  *poolSize = static_cast<uint32_t>(size);
+
+  return 0;
+}
+
+int ChannelConfig::parseSlowReaderPolicy(const std::string &value,
+                                         SlowReaderPolicy *policy) {
+  if ("ignore" == value) {
+    *policy = IGNORE_SLOW_READERS;
+  } else if ("warn" == value) {
+    *policy = WARN_SLOW_READERS;
+  } else if ("notify" == value) {
+    *policy = NOTIFY_SLOW_READERS;
+  } else if ("unsubscribe" == value) {
+    *policy = UNSUBSCRIBE_SLOW_READERS;
+  } else {
+    return -1;
+  }
+
+  return 0;
+}
+
+const char *ChannelConfig::slowReaderPolicyName(SlowReaderPolicy policy) {
+  switch (policy) {
+  case WARN_SLOW_READERS:
+    return "warn";
+
+  case NOTIFY_SLOW_READERS:
+    return "notify";
+
+  case UNSUBSCRIBE_SLOW_READERS:
+    return "unsubscribe";
+
+  case IGNORE_SLOW_READERS:
+  default:
+    return "ignore";
+  }
+}
+
+int ChannelConfig::parseSlowReaderLag(const std::string &value,
+                                      uint32_t *lag) {
+  char *end;
+  unsigned long percent = ::strtoul(value.c_str(), &end, 10);
+
+  if (value.empty() || ('\0' != *end) || ('-' == value[0]) ||
+      (0 == percent) || (100 < percent)) {
+    return -1;
+  }
+  *lag = static_cast<uint32_t>(percent);
+
+  return 0;
+}
+
+int ChannelConfig::parseLastValueKeys(const std::string &value,
+                                      uint32_t *lastValueKeys) {
+  char *end;
+  unsigned long count = ::strtoul(value.c_str(), &end, 10);
+
+  if (value.empty() || ('\0' != *end) || ('-' == value[0]) ||
+      (MAX_LAST_VALUE_KEYS < count)) {
+    return -1;
+  }
+  *lastValueKeys = static_cast<uint32_t>(count);
+
+  return 0;
+}
+
+int ChannelConfig::parseLastValueSize(const std::string &value,
+                                      uint32_t *lastValueSize) {
+  char *end;
+  unsigned long size = ::strtoul(value.c_str(), &end, 10);
+
+  if (value.empty() || ('\0' != *end) || ('-' == value[0]) ||
+      (0 == size) || (MAX_LAST_VALUE_SIZE < size)) {
+    return -1;
+  }
+  *lastValueSize = static_cast<uint32_t>(size);
+
+  return 0;
+}
+
+int ChannelConfig::parseKeyIndex(const std::string &value,
+                                 uint64_t *capacity) {
+  char *end;
+  unsigned long long count = ::strtoull(value.c_str(), &end, 10);
+
+  if (value.empty() || ('\0' != *end) || ('-' == value[0]) ||
+      (MAX_KEY_INDEX_ENTRIES < count)) {
+    return -1;
+  }
+  *capacity = (0 == count) ? (0) : (KeyIndex::capacityFor(count));
+
+  return 0;
+}
+
+int ChannelConfig::parseOption(const std::string &key,
+                               const std::string &value, Options *options) {
+  if ("huge_pages" == key) {
+    return parsePageSize(value, &(options->m_pageSize));
+  } else if ("prefault" == key) {
+    return parseBool(value, &(options->m_prefault));
+  } else if ("lock" == key) {
+    return parseBool(value, &(options->m_lock));
+  } else if ("numa_node" == key) {
+    return parseNumaNode(value, &(options->m_numaNode));
+  } else if ("pool_size" == key) {
+    return parsePoolSize(value, &(options->m_poolSize));
+  } else if ("slow_reader" == key) {
+    return parseSlowReaderPolicy(value, &(options->m_slowReaderPolicy));
+  } else if ("slow_reader_lag" == key) {
+    return parseSlowReaderLag(value, &(options->m_slowReaderLag));
+  } else if ("last_value_keys" == key) {
+    return parseLastValueKeys(value, &(options->m_lastValueKeys));
+  } else if ("last_value_size" == key) {
+    return parseLastValueSize(value, &(options->m_lastValueSize));
+  } else if ("key_index" == key) {
+    return parseKeyIndex(value, &(options->m_keyIndexCapacity));
+  } else if ("wait_area" == key) {
+    return parseBool(value, &(options->m_waitArea));
+  }
+
+  // unknown key
+  return -1;
+}
+
+int ChannelConfig::load(const std::string &path) {
+  std::ifstream file(path.c_str());
+  std::string line;
+  size_t lineNumber = 0;
+  Rule *rule = 0;
+
+  if (!file.is_open()) {
+    std::cerr << "Could not open the channel config \"" << path << "\""
+              << std::endl;
+    return -1;
+  }
+
+  try {
+    while (std::getline(file, line)) {
+      lineNumber++;
+      line = trim(line);
+      if (line.empty() || ('#' == line[0]) || (';' == line[0])) {
+        continue;
+      }
+
+      if ('[' == line[0]) {
+        // a new section
+        if ((']' != line[line.size() - 1]) || (2 >= line.size())) {
+          goto SYNTAX_ERROR;
+        }
+
+        Rule newRule;
+        newRule.m_pattern = line.substr(1, line.size() - 2);
+        newRule.m_prefix = ('*' == newRule.m_pattern[newRule.m_pattern.size() -
+                                                     1]);
+        if (newRule.m_prefix) {
+          newRule.m_pattern.erase(newRule.m_pattern.size() - 1);
+        }
+        newRule.m_options = m_defaults;
+        m_rules.push_back(newRule);
+        rule = &(m_rules.back());
+        continue;
+      }
+
+      size_t equalsIndex = line.find('=');
+      if ((0 == rule) || (std::string::npos == equalsIndex)) {
+        goto SYNTAX_ERROR;
+      }
+
+      const std::string key = trim(line.substr(0, equalsIndex));
+      if (!WRITER_AREAS && (("key_index" == key) || ("wait_area" == key))) {
+        std::cerr << "The channel config \"" << path << "\" sets " << key
+                  << " at line " << lineNumber << ", which only writers "
+                  << "built on smb_bridge/BoardRing.h maintain. It needs a "
+                  << "manager built with SMB_BOARDRING_WRITER" << std::endl;
+        return -1;
+      }
+
+      if (0 != parseOption(key, trim(line.substr(equalsIndex + 1)),
+                           &(rule->m_options))) {
+        std::cerr << "Invalid option in the channel config \"" << path
+                  << "\" at line " << lineNumber << ": " << line
+                  << std::endl;
+        return -1;
+      }
+    }
+
+    m_path = path;
+  } catch (std::bad_alloc &) {
+    std::cerr << "Out of memory when loading the channel config" << std::endl;
+    return -1;
+  }
+
+  return 0;
+
+SYNTAX_ERROR:
+  std::cerr << "Syntax error in the channel config \"" << path
+            << "\" at line " << lineNumber << ": " << line << std::endl;
+  return -1;
+}
+
+const ChannelConfig::Options &
+ChannelConfig::lookup(const char *channelName) const {
+  const Rule *best = 0;
+
+  for (size_t i = 0; i < m_rules.size(); i++) {
+    const Rule &rule = m_rules[i];
+
+    if (!rule.m_prefix) {
+      if (rule.m_pattern == channelName) {
+        // an exact match always wins
+        return rule.m_options;
+      }
+    } else if ((0 == ::strncmp(rule.m_pattern.c_str(), channelName,
+                               rule.m_pattern.size())) &&
+               ((0 == best) ||
+                (best->m_pattern.size() < rule.m_pattern.size()))) {
+      best = &rule;
+    }
+  }
+
+  return (0 == best) ? (m_defaults) : (best->m_options);
+}
+
+bool ChannelConfig::usesLock(void) const {
+  if (m_defaults.m_lock) {
+    return true;
+  }
+
+  for (size_t i = 0; i < m_rules.size(); i++) {
+    if (m_rules[i].m_options.m_lock) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ChannelConfig::checksSlowReaders(void) const {
+  if (IGNORE_SLOW_READERS != m_defaults.m_slowReaderPolicy) {
+    return true;
+  }
+
+  for (size_t i = 0; i < m_rules.size(); i++) {
+    if (IGNORE_SLOW_READERS != m_rules[i].m_options.m_slowReaderPolicy) {
+      return true;
+    }
+  }
+
+  return false;
+}
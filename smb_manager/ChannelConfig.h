@@ -0,0 +1,343 @@
+#ifndef DAEMONS_CHANNELCONFIG_H_
+#define DAEMONS_CHANNELCONFIG_H_
+
+/***
+ * @file ChannelConfig.h
+ *
+ * @brief
+ * Per-channel board options of the ShMemBCast Manager.
+ *
+ * @description
+ * The daemon-wide options come from the command line. A channel config
+ * file overrides them for single channels or channel name prefixes, in
+ * the usual ini layout:
+ *
+ * @code
+ * # every market data channel
+ * [smbcast://md.*]
+ * huge_pages = 2M
+ * pool_size = 4
+ *
+ * [smbcast://md.depth]
+ * huge_pages = 1G
+ * lock = yes
+ * numa_node = 1
+ * slow_reader = unsubscribe
+ * slow_reader_lag = 75
+ *
+ * # positions, with the latest of each account for late joiners
+ * [smbcast://positions]
+ * last_value_keys = 4096
+ * last_value_size = 192
+ *
+ * # every symbol, for strategies that trade a few of them
+ * [smbcast://md.all]
+ * key_index = 262144
+ *
+ * # quiet, with a writer that wakes its readers
+ * [smbcast://admin.*]
+ * wait_area = yes
+ * @endcode
+ *
+ * A section names a channel, or a prefix if it ends in '*'. The exact
+ * name wins over any prefix, and a longer prefix over a shorter one.
+ * Options not set in a section keep their daemon-wide value.
+ *
+ * A channel given last_value_keys has a last-value area behind its
+ * datagram ring, with a slot of last_value_size bytes per key (see
+ * LastValueArea.h). Readers joining late copy the latest value of each
+ * key from there before they tail the ring.
+ *
+ * A channel given key_index has a key index of that many entries,
+ * rounded up to a power of two, behind its datagram ring (see
+ * KeyIndex.h). Its writer keys each datagram, and readers interested in
+ * a few keys skip the datagrams of the others.
+ *
+ * A channel given wait_area has a wait area behind its datagram ring
+ * (see WaitArea.h), so that its readers may block on a futex until the
+ * writer wakes them, rather than spin or poll.
+ *
+ * Only writers built on smb_bridge/BoardRing.h fill the key index and
+ * wake readers; DatagramBoard's own writers do neither. key_index and
+ * wait_area are therefore only accepted by managers built with
+ * SMB_BOARDRING_WRITER, the flag such writers are built with (see
+ * WRITER_AREAS). Readers of the areas fall back to a full scan and to
+ * polling where no such writer is found, so a channel whose writer
+ * ignores them still works, only without the gain.
+ */
+
+#include "BoardAllocator.h"
+#include "NumaUtil.h"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+class ChannelConfig {
+public:
+  /***
+   * @var AUTO_NODE Options::m_numaNode value for the node of the client
+   * that creates the channel
+   */
+  static const int AUTO_NODE = -2;
+
+  /***
+   * @var MAX_POOL_SIZE The most spare boards kept per class
+   */
+  static const uint32_t MAX_POOL_SIZE = 1024;
+
+  /***
+   * What the manager does about a reader lagging more than
+   * Options::m_slowReaderLag behind the writer. Each policy does what
+   * the one before it does as well. Only readers that report their
+   * progress (see ManagerProtocol::ReaderProgress) are checked: the
+   * manager cannot see how far other readers got, e.g. those reading
+   * through DatagramBoard alone, so they are never slow.
+   *
+   * @var IGNORE_SLOW_READERS Nothing, the reader's lag is not checked
+   * @var WARN_SLOW_READERS Log it, and log when it caught up again
+   * @var NOTIFY_SLOW_READERS Also send a SlowReader event to the
+   * writer, if it is an Event Mode connection
+   * @var UNSUBSCRIBE_SLOW_READERS Also unsubscribe the reader, telling
+   * it with a SlowReader event if it is an Event Mode connection
+   */
+  enum SlowReaderPolicy {
+    IGNORE_SLOW_READERS,
+    WARN_SLOW_READERS,
+    NOTIFY_SLOW_READERS,
+    UNSUBSCRIBE_SLOW_READERS
+  };
+
+  /***
+   * @var DEFAULT_SLOW_READER_LAG Options::m_slowReaderLag unless set
+   */
+  static const uint32_t DEFAULT_SLOW_READER_LAG = 50;
+
+  /***
+   * @var MAX_LAST_VALUE_KEYS The most keys a last-value area may hold
+   * @var MAX_LAST_VALUE_SIZE The largest value it may hold per key
+   * @var DEFAULT_LAST_VALUE_SIZE Options::m_lastValueSize unless set
+   */
+  static const uint32_t MAX_LAST_VALUE_KEYS = 1 << 20;
+  static const uint32_t MAX_LAST_VALUE_SIZE = 1 << 16;
+  static const uint32_t DEFAULT_LAST_VALUE_SIZE = 232;
+
+  /***
+   * @var MAX_KEY_INDEX_ENTRIES The most entries a key index may have
+   */
+  static const uint64_t MAX_KEY_INDEX_ENTRIES = 1 << 26;
+
+  /***
+   * @var WRITER_AREAS Whether key_index and wait_area are accepted, see
+   * above
+   */
+#ifdef SMB_BOARDRING_WRITER
+  static const bool WRITER_AREAS = true;
+#else
+  static const bool WRITER_AREAS = false;
+#endif
+
+  /***
+   * The options of one channel
+   *
+   * @var Options::m_pageSize The page size backing the board
+   * @var Options::m_prefault Allocate every page of the board before
+   * its fd is handed out
+   * @var Options::m_lock Also lock the board's pages in memory
+   * @var Options::m_numaNode The NUMA node to place the board on,
+   * AUTO_NODE for the node the creating client runs on, or
+   * NumaUtil::NO_NODE to leave it to the kernel
+   * @var Options::m_poolSize How many spare boards of the channel's
+   * class to keep ready. 0 creates every board on demand
+   * @var Options::m_slowReaderPolicy What to do about slow readers
+   * @var Options::m_slowReaderLag How far behind the writer a reader is
+   * slow, in percent of the board size
+   * @var Options::m_lastValueKeys The keys of the board's last-value
+   * area. 0 for no area
+   * @var Options::m_lastValueSize The largest value of a key
+   * @var Options::m_keyIndexCapacity The entries of the board's key
+   * index. 0 for no index
+   * @var Options::m_waitArea Whether the board has a wait area
+   */
+  struct Options {
+    BoardAllocator::PageSize m_pageSize;
+    bool m_prefault;
+    bool m_lock;
+    int m_numaNode;
+    uint32_t m_poolSize;
+    SlowReaderPolicy m_slowReaderPolicy;
+    uint32_t m_slowReaderLag;
+    uint32_t m_lastValueKeys;
+    uint32_t m_lastValueSize;
+    uint64_t m_keyIndexCapacity;
+    bool m_waitArea;
+
+    Options(void);
+  };
+
+private:
+  /***
+   * One section of the config file
+   *
+   * @var Rule::m_pattern The channel name, or the prefix without '*'
+   * @var Rule::m_prefix Whether m_pattern is a prefix
+   * @var Rule::m_options The section's options
+   */
+  struct Rule {
+    std::string m_pattern;
+    bool m_prefix;
+    Options m_options;
+  };
+
+  /***
+   * Applies one "key = value" line to options
+   *
+   * @return 0 on success, non-zero if the key or value is invalid
+   */
+  static int parseOption(const std::string &key, const std::string &value,
+                         Options *options);
+
+  std::vector<Rule> m_rules;
+  Options m_defaults;
+  std::string m_path;
+
+public:
+  ChannelConfig(void);
+
+  /***
+   * The daemon-wide options. Set them before calling load(), as
+   * sections start out as a copy.
+   */
+  Options &defaults(void);
+
+  const Options &defaults(void) const;
+
+  /***
+   * Loads a channel config file
+   *
+   * @return 0 on success, non-zero on error. Errors are printed to
+   * stderr
+   */
+  int load(const std::string &path);
+
+  /***
+   * @return the options of a channel
+   */
+  const Options &lookup(const char *channelName) const;
+
+  /***
+   * @return whether any channel may have its board locked
+   */
+  bool usesLock(void) const;
+
+  /***
+   * @return whether any channel's readers have their lag checked
+   */
+  bool checksSlowReaders(void) const;
+
+  /***
+   * @return the loaded file, empty if none
+   */
+  const std::string &path(void) const;
+
+  /***
+   * Parses "none", "2M" or "1G"
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parsePageSize(const std::string &value,
+                           BoardAllocator::PageSize *pageSize);
+
+  /***
+   * @return "none", "2M" or "1G"
+   */
+  static const char *pageSizeName(BoardAllocator::PageSize pageSize);
+
+  /***
+   * Parses "none", "auto" or the number of a node of this host
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseNumaNode(const std::string &value, int *numaNode);
+
+  /***
+   * @return "none", "auto" or the node number
+   */
+  static std::string numaNodeName(int numaNode);
+
+  /***
+   * Parses a spare board count
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parsePoolSize(const std::string &value, uint32_t *poolSize);
+
+  /***
+   * Parses "ignore", "warn", "notify" or "unsubscribe"
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseSlowReaderPolicy(const std::string &value,
+                                   SlowReaderPolicy *policy);
+
+  /***
+   * @return "ignore", "warn", "notify" or "unsubscribe"
+   */
+  static const char *slowReaderPolicyName(SlowReaderPolicy policy);
+
+  /***
+   * Parses a lag in percent of the board size, 1 to 100
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseSlowReaderLag(const std::string &value, uint32_t *lag);
+
+  /***
+   * Parses a key count, 0 to MAX_LAST_VALUE_KEYS
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseLastValueKeys(const std::string &value,
+                                uint32_t *lastValueKeys);
+
+  /***
+   * Parses a value size, 1 to MAX_LAST_VALUE_SIZE
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseLastValueSize(const std::string &value,
+                                uint32_t *lastValueSize);
+
+  /***
+   * Parses an entry count, 0 to MAX_KEY_INDEX_ENTRIES, and rounds it up
+   * to a power of two
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int parseKeyIndex(const std::string &value, uint64_t *capacity);
+};
+
+// inline and template functions
+inline ChannelConfig::Options::Options(void)
+    : m_pageSize(BoardAllocator::NORMAL_PAGES), m_prefault(false),
+      m_lock(false), m_numaNode(NumaUtil::NO_NODE), m_poolSize(0),
+      m_slowReaderPolicy(IGNORE_SLOW_READERS),
+      m_slowReaderLag(DEFAULT_SLOW_READER_LAG),
+      m_lastValueKeys(0), m_lastValueSize(DEFAULT_LAST_VALUE_SIZE),
+      m_keyIndexCapacity(0), m_waitArea(false) {}
+
+inline ChannelConfig::ChannelConfig(void)
+    : m_rules(), m_defaults(), m_path() {}
+
+inline ChannelConfig::Options &ChannelConfig::defaults(void) {
+  return m_defaults;
+}
+
+inline const ChannelConfig::Options &ChannelConfig::defaults(void) const {
+  return m_defaults;
+}
+
+inline const std::string &ChannelConfig::path(void) const { return m_path; }
+
+#endif // DAEMONS_CHANNELCONFIG_H_
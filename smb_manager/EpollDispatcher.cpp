@@ -0,0 +1,244 @@
+#include "EpollDispatcher.h"
+
+#include <new>
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace {
+// tag set on epoll data for the write descriptor of a channel whose read
+// and write descriptors differ. Registrations are at least 4 byte aligned.
+const uintptr_t WRITE_FD_TAG = 1;
+} // namespace
+
+EpollDispatcher::EpollDispatcher(void)
+    : m_epollFd(-1), m_registrations(), m_removed() {}
+
+EpollDispatcher::~EpollDispatcher(void) {
+  for (std::unordered_map<ChannelBase *, Registration *>::iterator iter =
+           m_registrations.begin();
+       iter != m_registrations.end(); iter++) {
+    delete iter->second;
+  }
+  for (size_t i = 0; i < m_removed.size(); i++) {
+    delete m_removed[i];
+  }
+
+  if (0 <= m_epollFd) {
+    ::close(m_epollFd);
+  }
+}
+
+int EpollDispatcher::init(void) {
+  m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (0 > m_epollFd) {
+    return -1;
+  }
+
+  return 0;
+}
+
+uint32_t EpollDispatcher::epollEvents(int events) {
+  uint32_t epollEvents = 0;
+
+  if (0 != (events & DispatcherBase::ON_READ)) {
+    epollEvents |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (0 != (events & DispatcherBase::ON_WRITE)) {
+    epollEvents |= EPOLLOUT;
+  }
+
+  return epollEvents;
+}
+
+int EpollDispatcher::control(Registration *registration, int op) {
+  struct epoll_event event;
+  int readEvents = registration->m_events & DispatcherBase::ON_READ;
+  int writeEvents = registration->m_events & DispatcherBase::ON_WRITE;
+
+  if ((0 == registration->m_writer) ||
+      (registration->m_readFd == registration->m_writeFd)) {
+    // a single descriptor carries every event
+    event.events = epollEvents(registration->m_events);
+    event.data.ptr = registration;
+    int fd = (0 != registration->m_reader) ? (registration->m_readFd)
+                                           : (registration->m_writeFd);
+    return ::epoll_ctl(m_epollFd, op, fd, &event);
+  }
+
+  // distinct read and write descriptors each get their own entry
+  if (0 != registration->m_reader) {
+    event.events = epollEvents(readEvents);
+    event.data.ptr = registration;
+    if (0 != ::epoll_ctl(m_epollFd, op, registration->m_readFd, &event)) {
+      return -1;
+    }
+  }
+
+  event.events = epollEvents(writeEvents);
+  event.data.u64 = reinterpret_cast<uintptr_t>(registration) | WRITE_FD_TAG;
+  return ::epoll_ctl(m_epollFd, op, registration->m_writeFd, &event);
+}
+
+int EpollDispatcher::addChannel(ChannelBase *channel, int events) {
+  if (m_registrations.end() != m_registrations.find(channel)) {
+    // already registered, just update the interest set
+    return modifyChannel(channel, events);
+  }
+
+  Registration *registration = new (std::nothrow) Registration();
+  if (0 == registration) {
+    return -ENOMEM;
+  }
+
+  registration->m_channel = channel;
+  registration->m_reader = dynamic_cast<ReadCB *>(channel);
+  registration->m_writer = dynamic_cast<WriteCB *>(channel);
+  registration->m_readFd = (0 != registration->m_reader)
+                               ? (registration->m_reader->readFileDescriptor())
+                               : (-1);
+  registration->m_writeFd =
+      (0 != registration->m_writer)
+          ? (registration->m_writer->writeFileDescriptor())
+          : (-1);
+  registration->m_events = events;
+  registration->m_removed = false;
+
+  if (((0 != (events & DispatcherBase::ON_READ)) &&
+       (0 == registration->m_reader)) ||
+      ((0 != (events & DispatcherBase::ON_WRITE)) &&
+       (0 == registration->m_writer))) {
+    // the channel cannot handle the requested events
+    delete registration;
+    return -EINVAL;
+  }
+
+  try {
+    m_registrations[channel] = registration;
+  } catch (const std::bad_alloc &exception) {
+    delete registration;
+    return -ENOMEM;
+  }
+
+  if (0 != control(registration, EPOLL_CTL_ADD)) {
+    int error = errno;
+    m_registrations.erase(channel);
+    delete registration;
+    return -error;
+  }
+
+  return events;
+}
+
+int EpollDispatcher::modifyChannel(ChannelBase *channel, int events) {
+  std::unordered_map<ChannelBase *, Registration *>::iterator iter =
+      m_registrations.find(channel);
+  if (m_registrations.end() == iter) {
+    return -ENOENT;
+  }
+
+  Registration *registration = iter->second;
+  if ((0 != (events & DispatcherBase::ON_WRITE)) &&
+      (0 == registration->m_writer)) {
+    return -EINVAL;
+  }
+
+  registration->m_events = events;
+
+  // a descriptor that is already writable is reported on the next pass
+  if (0 != control(registration, EPOLL_CTL_MOD)) {
+    return -errno;
+  }
+
+  return events;
+}
+
+int EpollDispatcher::removeChannel(ChannelBase *channel) {
+  std::unordered_map<ChannelBase *, Registration *>::iterator iter =
+      m_registrations.find(channel);
+  if (m_registrations.end() == iter) {
+    return -ENOENT;
+  }
+
+  Registration *registration = iter->second;
+  m_registrations.erase(iter);
+
+  // the channel may already have closed its descriptors, in which case
+  // the kernel dropped them from the interest list on its own
+  if (0 <= registration->m_readFd) {
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, registration->m_readFd, 0);
+  }
+  if ((0 <= registration->m_writeFd) &&
+      (registration->m_writeFd != registration->m_readFd)) {
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, registration->m_writeFd, 0);
+  }
+
+  // pending events of this pass may still reference the registration,
+  // so defer freeing it to the end of the pass
+  registration->m_removed = true;
+  m_removed.push_back(registration);
+
+  return 0;
+}
+
+void EpollDispatcher::closeChannel(Registration *registration) {
+  ChannelBase *channel = registration->m_channel;
+
+  removeChannel(channel);
+  if (TTECH_DELETE_CHAN == channel->onClose()) {
+    delete channel;
+  }
+}
+
+void EpollDispatcher::run(void) {
+  for (;;) {
+    int numEvents = ::epoll_wait(m_epollFd, m_events, MAX_EVENTS, -1);
+    if (0 > numEvents) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return;
+    }
+
+    // (1) give every signalled channel one turn. Level-triggered
+    // descriptors that are still ready are reported again on the next
+    // pass, after the other channels had theirs
+    for (int i = 0; i < numEvents; i++) {
+      uintptr_t data = static_cast<uintptr_t>(m_events[i].data.u64);
+      uint32_t events = m_events[i].events;
+      bool writeFd = (0 != (data & WRITE_FD_TAG));
+      Registration *registration =
+          reinterpret_cast<Registration *>(data & ~WRITE_FD_TAG);
+
+      if (registration->m_removed) {
+        continue;
+      }
+
+      if ((!writeFd) && (0 != registration->m_reader) &&
+          (0 != (registration->m_events & DispatcherBase::ON_READ)) &&
+          (0 != (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) &&
+          (TTECH_DELETE_CHAN == registration->m_reader->onRead())) {
+        closeChannel(registration);
+        continue;
+      }
+
+      if ((!registration->m_removed) &&
+          (writeFd || (0 == registration->m_reader) ||
+           (registration->m_readFd == registration->m_writeFd)) &&
+          (0 != registration->m_writer) &&
+          (0 != (registration->m_events & DispatcherBase::ON_WRITE)) &&
+          (0 != (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) &&
+          (TTECH_DELETE_CHAN == registration->m_writer->onWrite())) {
+        closeChannel(registration);
+      }
+    }
+
+    // (2) free registrations removed during this pass
+    for (size_t i = 0; i < m_removed.size(); i++) {
+      delete m_removed[i];
+    }
+    m_removed.clear();
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef DAEMONS_EPOLLDISPATCHER_H_
+#define DAEMONS_EPOLLDISPATCHER_H_
+
+/***
+ * @file EpollDispatcher.h
+ *
+ * @brief
+ * Level-triggered epoll(7) implementation of DispatcherBase.
+ *
+ * @description
+ * The SelectDispatcher rebuilds and scans an fd_set on every pass, so
+ * its cost grows with the highest file descriptor in use, and it cannot
+ * watch descriptors at or above FD_SETSIZE at all. This dispatcher
+ * registers every channel once with the kernel and only touches the
+ * channels that actually became ready.
+ *
+ * Channels are registered level-triggered, as a ReadCB consumes one
+ * message per onRead() call and cannot report EAGAIN. Every ready
+ * channel gets one onRead() per pass and the kernel reports it again on
+ * the next pass until it has been drained, so channels are serviced
+ * round-robin without any extra system call per message. This keeps a
+ * single chatty client from starving the others during a reconnect
+ * storm.
+ *
+ * Channels returning TTECH_DELETE_CHAN are removed and their onClose()
+ * is invoked; if that also returns TTECH_DELETE_CHAN the channel is
+ * delete'd, exactly as with the other dispatchers.
+ */
+
+#include <core/dispatcher/ChannelBase.h>
+#include <core/dispatcher/DispatcherBase.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+class EpollDispatcher : public DispatcherBase {
+private:
+  /***
+   * Book-keeping for a registered channel
+   *
+   * @var Registration::m_channel The registered channel. Not owned
+   * @var Registration::m_reader m_channel as a ReadCB, or 0
+   * @var Registration::m_writer m_channel as a WriteCB, or 0
+   * @var Registration::m_readFd The read descriptor captured at
+   * registration time, as the channel may close it before removal
+   * @var Registration::m_writeFd The write descriptor captured at
+   * registration time
+   * @var Registration::m_events The DispatcherBase::ON_* events
+   * requested
+   * @var Registration::m_removed Set once removed. The registration is
+   * freed at the end of the current pass, as pending epoll events may
+   * still point at it.
+   */
+  struct Registration {
+    ChannelBase *m_channel;
+    ReadCB *m_reader;
+    WriteCB *m_writer;
+    int m_readFd;
+    int m_writeFd;
+    int m_events;
+    bool m_removed;
+  };
+
+  /***
+   * Translates DispatcherBase::ON_* events into epoll events
+   *
+   * @param events The DispatcherBase::ON_* events
+   *
+   * @return the epoll event mask, level-triggered
+   */
+  static uint32_t epollEvents(int events);
+
+  /***
+   * Registers the descriptors of a registration with the epoll
+   * instance
+   *
+   * @param registration The registration to add or modify
+   * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int control(Registration *registration, int op);
+
+  /***
+   * Removes a channel after it returned TTECH_DELETE_CHAN, calling its
+   * onClose() and deleting it if requested
+   *
+   * @param registration The registration of the channel
+   */
+  void closeChannel(Registration *registration);
+
+  static const int MAX_EVENTS = 1024;
+
+  int m_epollFd;
+  std::unordered_map<ChannelBase *, Registration *> m_registrations;
+  std::vector<Registration *> m_removed;
+  struct epoll_event m_events[MAX_EVENTS];
+
+public:
+  /***
+   * Creates the dispatcher. Please be sure to call init() to complete
+   * initialization.
+   */
+  EpollDispatcher(void);
+
+  /***
+   * Destructor. Does not delete any registered channel.
+   */
+  ~EpollDispatcher(void);
+
+  /***
+   * Creates the epoll instance
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(void);
+
+  // DispatcherBase Functions
+  int addChannel(ChannelBase *channel, int events);
+
+  int modifyChannel(ChannelBase *channel, int events);
+
+  int removeChannel(ChannelBase *channel);
+
+  void run(void);
+};
+
+#endif // DAEMONS_EPOLLDISPATCHER_H_
@@ -0,0 +1,322 @@
+#ifndef DAEMONS_HANDOVERPROTOCOL_H_
+#define DAEMONS_HANDOVERPROTOCOL_H_
+
+/***
+ * @file HandoverProtocol.h
+ *
+ * @brief
+ * Messages used by a replacement manager to take over the channels and
+ * clients of the running manager of the same vlan.
+ *
+ * @description
+ * The replacement connects to the manager socket like any client and
+ * sends a Request. A manager running under the same user answers on
+ * that connection with:
+ *
+ * -# Begin, followed by the listening socket (SCM_RIGHTS)
+ * -# one Channel per channel, each followed by the board fd
+ * -# one Client per client, each followed by the client's socket,
+ *    zero or more Subscriptions messages and one Pattern per pattern
+ *    subscription
+ * -# End
+ *
+ * The replacement answers Complete once it has everything, and the
+ * outgoing manager exits without touching any channel. If anything goes
+ * wrong, the outgoing manager sends Abort (or just closes the
+ * connection) and keeps serving; the replacement then exits.
+ *
+ * Every message starts with a ShMemBCastProtocol::Header. The message
+ * types are outside the range used by ShMemBCastProtocol.
+ */
+
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct HandoverProtocol {
+  typedef ShMemBCastProtocol Protocol;
+
+  enum MessageType {
+    HANDOVER_REQUEST = 0xF0,
+    HANDOVER_BEGIN = 0xF1,
+    HANDOVER_CHANNEL = 0xF2,
+    HANDOVER_CLIENT = 0xF3,
+    HANDOVER_SUBSCRIPTIONS = 0xF4,
+    HANDOVER_END = 0xF5,
+    HANDOVER_COMPLETE = 0xF6,
+    HANDOVER_ABORT = 0xF7,
+    HANDOVER_PATTERN = 0xF8
+  };
+
+  /***
+   * @var NAMED_BOARD_FLAG The board lives in the board directory
+   */
+  static const uint32_t NAMED_BOARD_FLAG = 0x1;
+
+  /***
+   * @var EVENT_MODE_FLAG The client is an Event Mode connection
+   */
+  static const uint32_t EVENT_MODE_FLAG = 0x1;
+
+  static const size_t MAX_SUBSCRIPTIONS = 32;
+
+  /***
+   * Large enough for any handover message
+   */
+  static const size_t BUFFER_SIZE =
+      Protocol::Constants::MAX_MESSAGE_SIZE + 64;
+
+  struct Request {
+    Protocol::Header m_header;
+
+    static ssize_t init(char *buffer, size_t size);
+  };
+
+  /***
+   * @var Begin::m_numChannels Number of Channel messages to follow
+   * @var Begin::m_numClients Number of Client messages to follow
+   */
+  struct Begin {
+    Protocol::Header m_header;
+    uint32_t m_numChannels;
+    uint32_t m_numClients;
+
+    static ssize_t init(char *buffer, size_t size, uint32_t numChannels,
+                        uint32_t numClients);
+  };
+
+  /***
+   * @var Channel::m_size The board size
+   * @var Channel::m_index Index Subscriptions refer to the channel by
+   * @var Channel::m_flags NAMED_BOARD_FLAG
+   * @var Channel::m_channelName The NUL-terminated channel name
+   */
+  struct Channel {
+    Protocol::Header m_header;
+    uint64_t m_size;
+    uint32_t m_index;
+    uint32_t m_flags;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, uint32_t index,
+                        uint64_t boardSize, uint32_t flags,
+                        const char *channelName);
+  };
+
+  /***
+   * @var Client::m_pid The client process
+   * @var Client::m_uid The client user
+   * @var Client::m_flags EVENT_MODE_FLAG
+   */
+  struct Client {
+    Protocol::Header m_header;
+    pid_t m_pid;
+    uid_t m_uid;
+    uint32_t m_flags;
+
+    static ssize_t init(char *buffer, size_t size, pid_t pid, uid_t uid,
+                        uint32_t flags);
+  };
+
+  /***
+   * @var Subscription::m_channelIndex Channel::m_index of the channel
+   * @var Subscription::m_readerCount Number of reader subscriptions
+   * @var Subscription::m_writer Non-zero for the writer
+   */
+  struct Subscription {
+    uint32_t m_channelIndex;
+    uint32_t m_readerCount;
+    uint32_t m_writer;
+  };
+
+  /***
+   * Subscriptions of the client sent last
+   */
+  struct Subscriptions {
+    Protocol::Header m_header;
+    uint32_t m_count;
+    Subscription m_subscriptions[MAX_SUBSCRIPTIONS];
+
+    static ssize_t init(char *buffer, size_t size,
+                        const Subscription *subscriptions, uint32_t count);
+  };
+
+  /***
+   * A pattern subscription of the client sent last
+   *
+   * @var Pattern::m_prefix The NUL-terminated prefix the pattern matches
+   */
+  struct Pattern {
+    Protocol::Header m_header;
+    char m_prefix[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *prefix);
+  };
+
+  struct End {
+    Protocol::Header m_header;
+
+    static ssize_t init(char *buffer, size_t size);
+  };
+
+  struct Complete {
+    Protocol::Header m_header;
+
+    static ssize_t init(char *buffer, size_t size);
+  };
+
+  struct Abort {
+    Protocol::Header m_header;
+
+    static ssize_t init(char *buffer, size_t size);
+  };
+
+  /***
+   * Fills in a header
+   *
+   * @return messageSize, or -1 if the buffer is too small
+   */
+  static ssize_t initHeader(char *buffer, size_t size, MessageType type,
+                            size_t messageSize);
+
+  /***
+   * @return whether buffer holds a complete, well formed message of the
+   * given type and at least minimumSize bytes
+   */
+  static bool isMessage(const char *buffer, ssize_t size, MessageType type,
+                        size_t minimumSize);
+};
+
+// inline and template functions
+inline ssize_t HandoverProtocol::initHeader(char *buffer, size_t size,
+                                            MessageType type,
+                                            size_t messageSize) {
+  if (size < messageSize) {
+    return -1;
+  }
+
+  Protocol::Header *header = reinterpret_cast<Protocol::Header *>(buffer);
+  header->m_version = Protocol::VERSION;
+  header->m_messageType =
+      static_cast<decltype(header->m_messageType)>(type);
+  header->m_size = static_cast<decltype(header->m_size)>(messageSize);
+
+  return messageSize;
+}
+
+inline bool HandoverProtocol::isMessage(const char *buffer, ssize_t size,
+                                        MessageType type,
+                                        size_t minimumSize) {
+  const Protocol::Header *header =
+      reinterpret_cast<const Protocol::Header *>(buffer);
+
+  return (static_cast<ssize_t>(minimumSize) <= size) &&
+         (Protocol::VERSION == header->m_version) &&
+         (static_cast<uint8_t>(type) ==
+          static_cast<uint8_t>(header->m_messageType)) &&
+         (static_cast<ssize_t>(header->m_size) == size);
+}
+
+inline ssize_t HandoverProtocol::Request::init(char *buffer, size_t size) {
+  return initHeader(buffer, size, HANDOVER_REQUEST, sizeof(Request));
+}
+
+inline ssize_t HandoverProtocol::Begin::init(char *buffer, size_t size,
+                                             uint32_t numChannels,
+                                             uint32_t numClients) {
+  if (0 > initHeader(buffer, size, HANDOVER_BEGIN, sizeof(Begin))) {
+    return -1;
+  }
+
+  Begin *message = reinterpret_cast<Begin *>(buffer);
+  message->m_numChannels = numChannels;
+  message->m_numClients = numClients;
+
+  return sizeof(Begin);
+}
+
+inline ssize_t HandoverProtocol::Channel::init(char *buffer, size_t size,
+                                               uint32_t index,
+                                               uint64_t boardSize,
+                                               uint32_t flags,
+                                               const char *channelName) {
+  size_t channelNameLength = ::strlen(channelName);
+  size_t messageSize =
+      offsetof(Channel, m_channelName) + channelNameLength + 1;
+  if (0 > initHeader(buffer, size, HANDOVER_CHANNEL, messageSize)) {
+    return -1;
+  }
+
+  Channel *message = reinterpret_cast<Channel *>(buffer);
+  message->m_size = boardSize;
+  message->m_index = index;
+  message->m_flags = flags;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t HandoverProtocol::Client::init(char *buffer, size_t size,
+                                              pid_t pid, uid_t uid,
+                                              uint32_t flags) {
+  if (0 > initHeader(buffer, size, HANDOVER_CLIENT, sizeof(Client))) {
+    return -1;
+  }
+
+  Client *message = reinterpret_cast<Client *>(buffer);
+  message->m_pid = pid;
+  message->m_uid = uid;
+  message->m_flags = flags;
+
+  return sizeof(Client);
+}
+
+inline ssize_t
+HandoverProtocol::Subscriptions::init(char *buffer, size_t size,
+                                      const Subscription *subscriptions,
+                                      uint32_t count) {
+  size_t messageSize =
+      offsetof(Subscriptions, m_subscriptions) + count * sizeof(Subscription);
+  if ((MAX_SUBSCRIPTIONS < count) ||
+      (0 > initHeader(buffer, size, HANDOVER_SUBSCRIPTIONS, messageSize))) {
+    return -1;
+  }
+
+  Subscriptions *message = reinterpret_cast<Subscriptions *>(buffer);
+  message->m_count = count;
+  ::memcpy(message->m_subscriptions, subscriptions,
+           count * sizeof(Subscription));
+
+  return messageSize;
+}
+
+inline ssize_t HandoverProtocol::Pattern::init(char *buffer, size_t size,
+                                               const char *prefix) {
+  size_t prefixLength = ::strlen(prefix);
+  size_t messageSize = offsetof(Pattern, m_prefix) + prefixLength + 1;
+  if (0 > initHeader(buffer, size, HANDOVER_PATTERN, messageSize)) {
+    return -1;
+  }
+
+  ::memcpy(reinterpret_cast<Pattern *>(buffer)->m_prefix, prefix,
+           prefixLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t HandoverProtocol::End::init(char *buffer, size_t size) {
+  return initHeader(buffer, size, HANDOVER_END, sizeof(End));
+}
+
+inline ssize_t HandoverProtocol::Complete::init(char *buffer, size_t size) {
+  return initHeader(buffer, size, HANDOVER_COMPLETE, sizeof(Complete));
+}
+
+inline ssize_t HandoverProtocol::Abort::init(char *buffer, size_t size) {
+  return initHeader(buffer, size, HANDOVER_ABORT, sizeof(Abort));
+}
+
+#endif // DAEMONS_HANDOVERPROTOCOL_H_
@@ -0,0 +1,346 @@
+#ifndef DAEMONS_KEYINDEX_H_
+#define DAEMONS_KEYINDEX_H_
+
+/***
+ * @file KeyIndex.h
+ *
+ * @brief
+ * Layout of the key index of a channel's board, which lets a reader
+ * interested in a few keys, e.g. symbol ids, skip the datagrams of all
+ * others without touching them.
+ *
+ * @description
+ * Channels given key_index in the channel config (see ChannelConfig.h)
+ * have the index laid out behind the datagram ring, and behind the
+ * last-value area if there is one, at a page boundary: a Header, then
+ * m_capacity keys, then m_capacity board positions. The writer of
+ * datagram n, counting from 0 as the board's m_sequence does, stores its
+ * key and the position of its length at entry n modulo m_capacity, and
+ * then n + 1 in m_next, before it publishes the datagram. Datagrams
+ * written without a key get NO_KEY.
+ *
+ * Only writers built on smb_bridge/BoardRing.h maintain the index; one
+ * writing through DatagramBoard alone leaves it as it is, which is why
+ * only managers built with SMB_BOARDRING_WRITER lay it out (see
+ * ChannelConfig.h). As such a writer may still come along, the index
+ * only covers the datagrams from m_first, where the current writer
+ * started, to m_next. Readers read the datagrams outside that range in
+ * full, as if there were no index.
+ *
+ * A reader scans the keys with scan(), four at a time with SSE2 compares
+ * where available, and only reads the positions and the datagrams of the
+ * entries that match. The keys take 4 bytes per datagram, so a reader
+ * interested in a few keys out of hundreds reads a small fraction of
+ * the ring's cache lines.
+ *
+ * The index is lapped once the writer is m_capacity datagrams ahead of
+ * the reader, or the ring once it is a board ahead, whichever comes
+ * first. A capacity of the board size over the typical datagram
+ * footprint keeps the two in step.
+ */
+
+#include "LastValueArea.h"
+
+#include <core/link/DatagramBoard.h>
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct KeyIndex {
+  static const uint32_t MAGIC = 0x4B424D53; // "SMBK"
+  static const uint32_t VERSION = 2;
+
+  /***
+   * @var NO_KEY The key of datagrams written without one. It never
+   * matches
+   * @var MIN_CAPACITY The smallest index, so that the keys fill whole
+   * cache lines
+   * @var HEADER_SIZE The keys start a cache line into the index
+   */
+  static const uint32_t NO_KEY = 0xFFFFFFFF;
+  static const uint64_t MIN_CAPACITY = 16;
+  static const uint64_t HEADER_SIZE = 64;
+
+  /***
+   * @var Header::m_magic MAGIC
+   * @var Header::m_version VERSION
+   * @var Header::m_capacity Number of entries, a power of two
+   * @var Header::m_first The first datagram the current writer indexed
+   * @var Header::m_next The datagram after the last one it indexed
+   */
+  struct Header {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint64_t m_capacity;
+    volatile uint64_t m_first;
+    volatile uint64_t m_next;
+  };
+
+  /***
+   * @return the offset of the index in a board of boardSize bytes, as in
+   * DatagramBoard::BoardInfo::m_size, with the given last-value area
+   */
+  static uint64_t offset(uint64_t boardSize, uint32_t lastValueKeys,
+                         uint32_t lastValueSize);
+
+  /***
+   * @return the size of an index
+   */
+  static uint64_t size(uint64_t capacity);
+
+  /***
+   * @return the capacity of an index of at least numEntries entries
+   */
+  static uint64_t capacityFor(uint64_t numEntries);
+
+  /***
+   * Writes the header of a fresh index
+   */
+  static void init(Header *header, uint64_t capacity);
+
+  /***
+   * @param board The mapped board, starting with its BoardInfo
+   * @param mapSize The size of the mapping
+   *
+   * @return the board's index, or 0 if it has none
+   */
+  static Header *find(void *board, uint64_t mapSize);
+
+  static uint32_t *keys(Header *header);
+
+  static const uint32_t *keys(const Header *header);
+
+  static uint64_t *positions(Header *header);
+
+  static const uint64_t *positions(const Header *header);
+
+  /***
+   * Claims the index for a writer whose first datagram is sequence. Call
+   * it before its first append()
+   */
+  static void start(Header *header, uint64_t sequence);
+
+  /***
+   * @return whether the index covers datagrams [from, to). Read to from
+   * the board first
+   */
+  static bool covers(const Header *header, uint64_t from, uint64_t to);
+
+  /***
+   * Stores the entry of a datagram. Call it before publishing the
+   * datagram
+   *
+   * @param sequence The datagram's number, from 0
+   * @param key Its key
+   * @param position The board position of its length
+   */
+  static void append(Header *header, uint64_t sequence, uint32_t key,
+                     uint64_t position);
+
+  /***
+   * Finds the first datagram in [from, to) with one of the keys
+   *
+   * @param interest The keys of interest, none of them NO_KEY
+   * @param match Set to the datagram's number if there is one
+   *
+   * @return 0 if there is one, 1 if not
+   */
+  static int scan(const Header *header, uint64_t from, uint64_t to,
+                  const uint32_t *interest, size_t numInterest,
+                  uint64_t *match);
+
+private:
+  /***
+   * Scans keys [begin, end) of the array, which does not wrap
+   *
+   * @return the index of the first match, or end
+   */
+  static uint64_t scanRun(const uint32_t *keys, uint64_t begin,
+                          uint64_t end, const uint32_t *interest,
+                          size_t numInterest);
+};
+
+// inline and template functions
+inline uint64_t KeyIndex::offset(uint64_t boardSize, uint32_t lastValueKeys,
+                                 uint32_t lastValueSize) {
+  const uint64_t areaOffset = LastValueArea::offset(boardSize);
+
+  if (0 == lastValueKeys) {
+    return areaOffset;
+  }
+
+  return (areaOffset + LastValueArea::size(lastValueKeys, lastValueSize) +
+          LastValueArea::PAGE_ALIGNMENT - 1) &
+         ~(LastValueArea::PAGE_ALIGNMENT - 1);
+}
+
+inline uint64_t KeyIndex::size(uint64_t capacity) {
+  return HEADER_SIZE + (capacity * (sizeof(uint32_t) + sizeof(uint64_t)));
+}
+
+inline uint64_t KeyIndex::capacityFor(uint64_t numEntries) {
+  uint64_t capacity = MIN_CAPACITY;
+
+  while (capacity < numEntries) {
+    capacity <<= 1;
+  }
+
+  return capacity;
+}
+
+inline void KeyIndex::init(Header *header, uint64_t capacity) {
+  header->m_magic = MAGIC;
+  header->m_version = VERSION;
+  header->m_capacity = capacity;
+  header->m_first = 0;
+  header->m_next = 0;
+}
+
+inline KeyIndex::Header *KeyIndex::find(void *board, uint64_t mapSize) {
+  const DatagramBoard::BoardInfo *info =
+      static_cast<const DatagramBoard::BoardInfo *>(board);
+  const LastValueArea::Header *area;
+  Header *header;
+  uint64_t indexOffset;
+
+  area = LastValueArea::find(board, mapSize);
+  if (0 == area) {
+    if (sizeof(DatagramBoard::BoardInfo) > mapSize) {
+      return 0;
+    }
+    indexOffset = offset(info->m_size, 0, 0);
+  } else {
+    indexOffset = offset(info->m_size, area->m_numKeys, area->m_valueSize);
+  }
+  if ((indexOffset < info->m_size) || (mapSize < indexOffset) ||
+      (mapSize - indexOffset < HEADER_SIZE)) {
+    return 0;
+  }
+
+  header = reinterpret_cast<Header *>(static_cast<char *>(board) +
+                                      indexOffset);
+  if ((MAGIC != header->m_magic) || (VERSION != header->m_version) ||
+      (MIN_CAPACITY > header->m_capacity) ||
+      (0 != (header->m_capacity & (header->m_capacity - 1))) ||
+      (mapSize - indexOffset < size(header->m_capacity))) {
+    return 0;
+  }
+
+  return header;
+}
+
+inline uint32_t *KeyIndex::keys(Header *header) {
+  return reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(header) +
+                                      HEADER_SIZE);
+}
+
+inline const uint32_t *KeyIndex::keys(const Header *header) {
+  return reinterpret_cast<const uint32_t *>(
+      reinterpret_cast<const char *>(header) + HEADER_SIZE);
+}
+
+inline uint64_t *KeyIndex::positions(Header *header) {
+  return reinterpret_cast<uint64_t *>(keys(header) + header->m_capacity);
+}
+
+inline const uint64_t *KeyIndex::positions(const Header *header) {
+  return reinterpret_cast<const uint64_t *>(keys(header) +
+                                            header->m_capacity);
+}
+
+inline void KeyIndex::start(Header *header, uint64_t sequence) {
+  header->m_first = sequence;
+  // readers must see m_first before the m_next that relies on it
+  std::atomic_thread_fence(std::memory_order_release);
+  header->m_next = sequence;
+}
+
+inline bool KeyIndex::covers(const Header *header, uint64_t from,
+                             uint64_t to) {
+  uint64_t next;
+
+  // to was read from the board, which the writer publishes after m_next
+  std::atomic_thread_fence(std::memory_order_acquire);
+  next = header->m_next;
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  return (header->m_first <= from) && (to <= next);
+}
+
+inline void KeyIndex::append(Header *header, uint64_t sequence,
+                             uint32_t key, uint64_t position) {
+  const uint64_t entry = sequence & (header->m_capacity - 1);
+
+  keys(header)[entry] = key;
+  positions(header)[entry] = position;
+  header->m_next = sequence + 1;
+}
+
+inline int KeyIndex::scan(const Header *header, uint64_t from, uint64_t to,
+                          const uint32_t *interest, size_t numInterest,
+                          uint64_t *match) {
+  const uint64_t mask = header->m_capacity - 1;
+  const uint32_t *indexKeys = keys(header);
+
+  while (from < to) {
+    // up to the end of the range or of the array, whichever comes first
+    const uint64_t begin = from & mask;
+    const uint64_t run =
+        (to - from < header->m_capacity - begin) ? (to - from)
+                                                 : (header->m_capacity - begin);
+    const uint64_t found =
+        scanRun(indexKeys, begin, begin + run, interest, numInterest);
+
+    if (begin + run != found) {
+      *match = from + (found - begin);
+      return 0;
+    }
+    from += run;
+  }
+
+  return 1;
+}
+
+inline uint64_t KeyIndex::scanRun(const uint32_t *keys, uint64_t begin,
+                                  uint64_t end, const uint32_t *interest,
+                                  size_t numInterest) {
+  uint64_t i = begin;
+
+#if defined(__SSE2__)
+  // four keys per compare, with every key of interest
+  for (; i + 4 <= end; i += 4) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+    __m128i hits = _mm_setzero_si128();
+    int mask;
+
+    for (size_t j = 0; j < numInterest; j++) {
+      hits = _mm_or_si128(
+          hits, _mm_cmpeq_epi32(block, _mm_set1_epi32(
+                                           static_cast<int>(interest[j]))));
+    }
+    mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+    if (0 != mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; i < end; i++) {
+    for (size_t j = 0; j < numInterest; j++) {
+      if (interest[j] == keys[i]) {
+        return i;
+      }
+    }
+  }
+
+  return end;
+}
+
+#endif // DAEMONS_KEYINDEX_H_
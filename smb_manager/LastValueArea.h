@@ -0,0 +1,324 @@
+#ifndef DAEMONS_LASTVALUEAREA_H_
+#define DAEMONS_LASTVALUEAREA_H_
+
+/***
+ * @file LastValueArea.h
+ *
+ * @brief
+ * Layout of the last-value area of a channel's board, which holds the
+ * latest value of each key, e.g. the book of each symbol id, for
+ * readers joining late.
+ *
+ * @description
+ * Channels given last_value_keys in the channel config (see
+ * ChannelConfig.h) have the area laid out behind the datagram ring, at
+ * the first page boundary after it: a Header, then m_numKeys slots of
+ * m_slotSize bytes each. A slot is a Slot header followed by up to
+ * m_valueSize bytes of value. Boards without the area end with the
+ * ring, or have their key index there (see KeyIndex.h), so find() tells
+ * them apart by the size of the mapping and the magic.
+ *
+ * Every slot is guarded by a sequence lock of its own. The writer
+ * updates a value in place with update(), which neither allocates nor
+ * takes a system call, and a reader copies it with read(), retrying if
+ * the writer was updating it meanwhile. A key is updated by one writer
+ * at a time.
+ *
+ * A late joiner notes the writer's position on the ring, copies the
+ * values it needs, and then tails the ring from that position. A writer
+ * that also publishes each update as a datagram passes the position of
+ * that datagram to update(), so that the reader can tell whether a
+ * datagram it tails is already reflected in the value it copied.
+ *
+ * A resized channel's new board starts with an empty area. The writer
+ * carries its values over with copy() before it writes to the new
+ * board. When the channel has no writer, the manager copies them as it
+ * moves the readers.
+ */
+
+#include <core/link/DatagramBoard.h>
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct LastValueArea {
+  static const uint32_t MAGIC = 0x4C424D53; // "SMBL"
+  static const uint32_t VERSION = 1;
+
+  /***
+   * @var PAGE_ALIGNMENT The area starts on a page of its own
+   * @var SLOT_ALIGNMENT Slots, and the header, take whole cache lines,
+   * so that updating one key never invalidates another
+   */
+  static const uint64_t PAGE_ALIGNMENT = 4096;
+  static const uint64_t SLOT_ALIGNMENT = 64;
+
+  /***
+   * @var Header::m_magic MAGIC
+   * @var Header::m_version VERSION
+   * @var Header::m_numKeys Number of slots, keys run from 0 to
+   * m_numKeys - 1
+   * @var Header::m_valueSize The largest value a slot holds
+   * @var Header::m_slotSize Bytes per slot
+   */
+  struct Header {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_numKeys;
+    uint32_t m_valueSize;
+    uint64_t m_slotSize;
+  };
+
+  /***
+   * @var Slot::m_sequence Odd while the writer updates the value, 0 if
+   * it never set one
+   * @var Slot::m_position The board position the writer passed with the
+   * value
+   * @var Slot::m_size The size of the value, which follows
+   */
+  struct Slot {
+    std::atomic<uint64_t> m_sequence;
+    uint64_t m_position;
+    uint32_t m_size;
+    uint32_t m_padding;
+  };
+
+  /***
+   * @return the offset of the area in a board of boardSize bytes, as in
+   * DatagramBoard::BoardInfo::m_size
+   */
+  static uint64_t offset(uint64_t boardSize);
+
+  static uint64_t slotSize(uint32_t valueSize);
+
+  /***
+   * @return the size of an area
+   */
+  static uint64_t size(uint32_t numKeys, uint32_t valueSize);
+
+  /***
+   * Writes the header of a fresh area. The slots must be zeroed
+   */
+  static void init(Header *header, uint32_t numKeys, uint32_t valueSize);
+
+  /***
+   * @param board The mapped board, starting with its BoardInfo
+   * @param mapSize The size of the mapping
+   *
+   * @return the board's area, or 0 if it has none
+   */
+  static Header *find(void *board, uint64_t mapSize);
+
+  static const Header *find(const void *board, uint64_t mapSize);
+
+  static Slot *slot(Header *header, uint32_t key);
+
+  static const Slot *slot(const Header *header, uint32_t key);
+
+  /***
+   * Sets the value of a key
+   *
+   * @param position The board position of the datagram carrying the
+   * update, if the writer publishes one, else 0
+   *
+   * @return 0 on success, non-zero if the key or size is out of range
+   */
+  static int update(Header *header, uint32_t key, const void *value,
+                    uint32_t size, uint64_t position);
+
+  /***
+   * Copies the value of a key
+   *
+   * @param value At least m_valueSize bytes
+   * @param size Set to the size of the value
+   * @param position Set to the position the writer passed with it, may
+   * be 0
+   * @param maxAttempts How many times to retry while the writer updates
+   * it
+   *
+   * @return 0 on success, 1 if the key has no value yet, negative if the
+   * key is out of range or no consistent copy was made
+   */
+  static int read(const Header *header, uint32_t key, void *value,
+                  uint32_t *size, uint64_t *position, size_t maxAttempts);
+
+  /***
+   * Sets every value of an area that fits in another one, e.g. that of
+   * a resized board. Keys with no value, and keys that already have one
+   * in the other area, are left alone. Call it from the writer of both
+   * areas once it no longer updates the first, or while neither has a
+   * writer
+   *
+   * @return the values copied
+   */
+  static uint32_t copy(const Header *from, Header *to);
+};
+
+// inline and template functions
+inline uint64_t LastValueArea::offset(uint64_t boardSize) {
+  return (sizeof(DatagramBoard::BoardInfo) + boardSize + PAGE_ALIGNMENT -
+          1) &
+         ~(PAGE_ALIGNMENT - 1);
+}
+
+inline uint64_t LastValueArea::slotSize(uint32_t valueSize) {
+  return (sizeof(Slot) + valueSize + SLOT_ALIGNMENT - 1) &
+         ~(SLOT_ALIGNMENT - 1);
+}
+
+inline uint64_t LastValueArea::size(uint32_t numKeys, uint32_t valueSize) {
+  return SLOT_ALIGNMENT + (numKeys * slotSize(valueSize));
+}
+
+inline void LastValueArea::init(Header *header, uint32_t numKeys,
+                                uint32_t valueSize) {
+  header->m_magic = MAGIC;
+  header->m_version = VERSION;
+  header->m_numKeys = numKeys;
+  header->m_valueSize = valueSize;
+  header->m_slotSize = slotSize(valueSize);
+}
+
+inline LastValueArea::Header *LastValueArea::find(void *board,
+                                                  uint64_t mapSize) {
+  return const_cast<Header *>(
+      find(static_cast<const void *>(board), mapSize));
+}
+
+inline const LastValueArea::Header *LastValueArea::find(const void *board,
+                                                        uint64_t mapSize) {
+  const DatagramBoard::BoardInfo *info =
+      static_cast<const DatagramBoard::BoardInfo *>(board);
+  const Header *header;
+  uint64_t areaOffset;
+
+  if (sizeof(DatagramBoard::BoardInfo) > mapSize) {
+    return 0;
+  }
+  areaOffset = offset(info->m_size);
+  if ((areaOffset < info->m_size) || (mapSize < areaOffset) ||
+      (mapSize - areaOffset < SLOT_ALIGNMENT)) {
+    return 0;
+  }
+
+  header = reinterpret_cast<const Header *>(
+      static_cast<const char *>(board) + areaOffset);
+  if ((MAGIC != header->m_magic) || (VERSION != header->m_version) ||
+      (slotSize(header->m_valueSize) != header->m_slotSize) ||
+      (mapSize - areaOffset < size(header->m_numKeys, header->m_valueSize))) {
+    return 0;
+  }
+
+  return header;
+}
+
+inline LastValueArea::Slot *LastValueArea::slot(Header *header,
+                                                uint32_t key) {
+  return reinterpret_cast<Slot *>(reinterpret_cast<char *>(header) +
+                                  SLOT_ALIGNMENT +
+                                  (key * header->m_slotSize));
+}
+
+inline const LastValueArea::Slot *LastValueArea::slot(const Header *header,
+                                                      uint32_t key) {
+  return reinterpret_cast<const Slot *>(
+      reinterpret_cast<const char *>(header) + SLOT_ALIGNMENT +
+      (key * header->m_slotSize));
+}
+
+inline int LastValueArea::update(Header *header, uint32_t key,
+                                 const void *value, uint32_t size,
+                                 uint64_t position) {
+  Slot *target;
+  uint64_t sequence;
+
+  if ((header->m_numKeys <= key) || (header->m_valueSize < size)) {
+    return -1;
+  }
+
+  target = slot(header, key);
+  sequence = target->m_sequence.load(std::memory_order_relaxed);
+  target->m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  target->m_position = position;
+  target->m_size = size;
+  ::memcpy(static_cast<void *>(target + 1), value, size);
+
+  target->m_sequence.store(sequence + 2, std::memory_order_release);
+
+  return 0;
+}
+
+inline int LastValueArea::read(const Header *header, uint32_t key,
+                               void *value, uint32_t *size,
+                               uint64_t *position, size_t maxAttempts) {
+  const Slot *source;
+
+  if (header->m_numKeys <= key) {
+    return -1;
+  }
+
+  source = slot(header, key);
+  for (size_t i = 0; i < maxAttempts; i++) {
+    uint64_t before = source->m_sequence.load(std::memory_order_acquire);
+    uint64_t valuePosition;
+    uint32_t valueSize;
+
+    if (0 == before) {
+      return 1;
+    }
+    if (0 != (before & 1)) {
+      continue;
+    }
+
+    valuePosition = source->m_position;
+    valueSize = source->m_size;
+    if (header->m_valueSize < valueSize) {
+      // torn, the sequence tells
+      valueSize = header->m_valueSize;
+    }
+    ::memcpy(value, static_cast<const void *>(source + 1), valueSize);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (before == source->m_sequence.load(std::memory_order_relaxed)) {
+      *size = valueSize;
+      if (0 != position) {
+        *position = valuePosition;
+      }
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+inline uint32_t LastValueArea::copy(const Header *from, Header *to) {
+  const uint32_t numKeys =
+      (from->m_numKeys < to->m_numKeys) ? (from->m_numKeys) : (to->m_numKeys);
+  uint32_t numCopied = 0;
+
+  for (uint32_t key = 0; key < numKeys; key++) {
+    const Slot *source = slot(from, key);
+    const uint64_t sequence =
+        source->m_sequence.load(std::memory_order_acquire);
+
+    // a value left half updated, e.g. by a writer that died, is skipped,
+    // and one set since is newer. Positions are those of the old board,
+    // so they are not kept
+    if ((0 == sequence) || (0 != (sequence & 1)) ||
+        (0 != slot(to, key)->m_sequence.load(std::memory_order_relaxed)) ||
+        (0 != update(to, key, static_cast<const void *>(source + 1),
+                     source->m_size, 0))) {
+      continue;
+    }
+    numCopied++;
+  }
+
+  return numCopied;
+}
+
+#endif // DAEMONS_LASTVALUEAREA_H_
@@ -0,0 +1,561 @@
+#include "ManagerLog.h"
+
+#include <core/utils/FileUtil.h>
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+// Documented, but not implemented in glibc yet
+mode_t _getumask(void) {
+  mode_t mask = umask(0);
+  umask(mask);
+  return mask;
+}
+
+const size_t NAME_BUFFER_SIZE = 4096;
+const char *const TRUNCATION_MARKER = "...";
+} // namespace
+
+const char *const ManagerLog::TIME_FORMAT = "%F %T";
+const char *const ManagerLog::TIME_ERROR = "UNKNOWN TIME";
+
+ManagerLog::ManagerLog(void)
+    : m_head(0), m_cachedTail(0), m_dropped(0), m_tail(0),
+      m_reportedDropped(0), m_timeStringSeconds(-1), m_ring(0), m_logFile(),
+      m_stream(0), m_thread(), m_running(false), m_started(false),
+      m_mode(SYNC_MODE) {
+  static_assert(sizeof(Record) == RECORD_SIZE, "Record must fill a slot");
+  static_assert(0 == (RING_SIZE & (RING_SIZE - 1)),
+                "RING_SIZE must be a power of two");
+  m_timeString[0] = '\0';
+}
+
+ManagerLog::~ManagerLog(void) {
+  stop();
+  delete[] m_ring;
+}
+
+int ManagerLog::open(const std::string &logFilePath, Mode mode) {
+  if ("-" == logFilePath) {
+    // use stdout
+    m_stream = &std::cout;
+  } else {
+    if (SYNC_MODE == mode) {
+      // set logfile unbuffered
+      m_logFile.rdbuf()->pubsetbuf(0, 0);
+    }
+
+    if (0 != _getumask()) {
+      umask(0); // zero out the umask so that directories are created correctly
+    }
+
+    // create log file directory
+    if (0 != FileUtil::mkdirpForFile(logFilePath.c_str(), 0777)) {
+      std::cerr << "Could not create directory for default log file \""
+                << logFilePath << "\"" << std::endl;
+      return -1;
+    }
+
+    if (FileUtil::exists(logFilePath.c_str())) {
+      // Backup the previous file to ".last"
+      std::string backup = logFilePath;
+      backup += ".last";
+      FileUtil::rename(logFilePath.c_str(), backup.c_str());
+      FileUtil::remove(logFilePath.c_str());
+    }
+
+    // Create the file with the right permissions
+    int fd = FileUtil::open(logFilePath.c_str(),
+                            OpeningMode::CREATE_OR_TRUNCATE, 0666);
+    if (fd < 0) {
+      std::cerr << "Could not create the log file at \"" << logFilePath << "\""
+                << std::endl;
+      return -1;
+    } else {
+      close(fd);
+    }
+
+    // open the file
+    m_logFile.open(logFilePath.c_str(), std::ios_base::out);
+    if (!m_logFile.is_open()) {
+      std::cerr << "Could not open the log file at \"" << logFilePath << "\""
+                << std::endl;
+      return -1;
+    }
+
+    m_stream = &m_logFile;
+  }
+
+  if (ASYNC_MODE == mode) {
+    m_ring = new (std::nothrow) Record[RING_SIZE];
+    if (0 == m_ring) {
+      std::cerr << "Out of memory when creating the log ring" << std::endl;
+      return -1;
+    }
+  }
+
+  m_mode = mode;
+  return 0;
+}
+
+int ManagerLog::start(void) {
+  if ((SYNC_MODE == m_mode) || m_started) {
+    return 0;
+  }
+
+  m_running.store(true, std::memory_order_release);
+  if (0 != ::pthread_create(&m_thread, 0, formatterMain, this)) {
+    m_running.store(false, std::memory_order_release);
+    return -1;
+  }
+  m_started = true;
+
+  return 0;
+}
+
+void ManagerLog::stop(void) {
+  if (m_started) {
+    m_running.store(false, std::memory_order_release);
+    ::pthread_join(m_thread, 0);
+    m_started = false;
+  }
+
+  if (ASYNC_MODE == m_mode) {
+    // the thread may never have run, e.g. if init() failed
+    drain();
+    m_mode = SYNC_MODE;
+  }
+}
+
+void ManagerLog::write(const std::string &text) {
+  struct timespec now;
+  ::clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+  writePrefix(now.tv_sec);
+  (*m_stream) << text;
+  m_stream->flush();
+}
+
+void ManagerLog::post(Event event, pid_t pid, uid_t uid, gid_t gid,
+                      const char *channelName, uint16_t flags, uint64_t value,
+                      uint64_t count, uint64_t duration, int16_t node) {
+  Record syncRecord;
+  Record *record = &syncRecord;
+
+  if ((ASYNC_MODE == m_mode) && (0 == (record = acquire()))) {
+    // ring full, counted by acquire()
+    return;
+  }
+
+  // the coarse clock is a vDSO read, and the log only shows seconds
+  ::clock_gettime(CLOCK_REALTIME_COARSE, &(record->m_time));
+  record->m_value = value;
+  record->m_count = count;
+  record->m_duration = duration;
+  record->m_pid = pid;
+  record->m_uid = uid;
+  record->m_gid = gid;
+  record->m_node = node;
+  record->m_event = event;
+  record->m_flags = flags;
+  record->m_text[0] = '\0';
+  if (0 != channelName) {
+    size_t length = ::strlen(channelName);
+    if (length < sizeof(record->m_text)) {
+      ::memcpy(record->m_text, channelName, length + 1);
+    } else {
+      size_t keep = sizeof(record->m_text) - ::strlen(TRUNCATION_MARKER) - 1;
+      ::memcpy(record->m_text, channelName, keep);
+      ::strcpy(record->m_text + keep, TRUNCATION_MARKER);
+    }
+  }
+
+  if (ASYNC_MODE == m_mode) {
+    m_head.store(m_head.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+  } else {
+    format(*record);
+    m_stream->flush();
+  }
+}
+
+void ManagerLog::writePrefix(time_t seconds) {
+  if (seconds != m_timeStringSeconds) {
+    struct tm localTime;
+    if ((0 == ::localtime_r(&seconds, &localTime)) ||
+        (0 == ::strftime(m_timeString, sizeof(m_timeString), TIME_FORMAT,
+                         &localTime))) {
+      ::strncpy(m_timeString, TIME_ERROR, TIME_STRING_LENGTH - 1);
+      m_timeString[TIME_STRING_LENGTH - 1] = '\0';
+    }
+    m_timeStringSeconds = seconds;
+  }
+
+  (*m_stream) << m_timeString << ": ";
+}
+
+void ManagerLog::writePageSize(uint64_t pageBytes) {
+  static const char *const UNITS[] = {"B", "KiB", "MiB", "GiB"};
+  size_t unit = 0;
+
+  while ((0 == (pageBytes % 1024)) && (0 != pageBytes) &&
+         ((sizeof(UNITS) / sizeof(UNITS[0])) > (unit + 1))) {
+    pageBytes /= 1024;
+    unit++;
+  }
+
+  (*m_stream) << pageBytes << " " << UNITS[unit];
+}
+
+void ManagerLog::format(const Record &record) {
+  std::ostream &out = *m_stream;
+  const char *role = (record.m_flags & WRITER_FLAG) ? ("writer") : ("reader");
+
+  writePrefix(record.m_time.tv_sec);
+
+  switch (record.m_event) {
+  case MANAGER_ENDING: {
+    out << "Manager Ending";
+  } break;
+
+  case CONNECTION_ACCEPTED:
+  case CONNECTION_REJECTED: {
+    char buffer[NAME_BUFFER_SIZE];
+    struct passwd user;
+    struct passwd *userDetails = 0;
+    struct group group;
+    struct group *groupDetails = 0;
+
+    ::getpwuid_r(record.m_uid, &user, buffer, sizeof(buffer) / 2,
+                 &userDetails);
+    ::getgrgid_r(record.m_gid, &group, buffer + (sizeof(buffer) / 2),
+                 sizeof(buffer) / 2, &groupDetails);
+
+    out << ((CONNECTION_ACCEPTED == record.m_event) ? ("Accepted")
+                                                    : ("Rejected"))
+        << " connection from Process " << record.m_pid
+        << ", running under user "
+        << ((0 == userDetails) ? ("<unknown>") : (userDetails->pw_name))
+        << " (" << record.m_uid << ") and group "
+        << ((0 == groupDetails) ? ("<unknown>") : (groupDetails->gr_name))
+        << " (" << record.m_gid << ")";
+  } break;
+
+  case CREDENTIALS_ERROR: {
+    out << "Failed to get client credentials. Dropping connection";
+  } break;
+
+  case DISPATCHER_ADD_ERROR: {
+    out << "Could not add Process " << record.m_pid
+        << " to the dispatcher. Dropping connection";
+  } break;
+
+  case CLIENT_READ_ERROR: {
+    out << "Process " << record.m_pid << " read error";
+  } break;
+
+  case CLIENT_VERSION_ERROR: {
+    out << "Process " << record.m_pid << " version error";
+  } break;
+
+  case CLIENT_MESSAGE_SIZE_ERROR: {
+    out << "Process " << record.m_pid << " msg size error";
+  } break;
+
+  case CLIENT_UNSUPPORTED_MESSAGE: {
+    out << "Process " << record.m_pid << " unsupported msg";
+  } break;
+
+  case CLIENT_WRITE_ERROR: {
+    out << "Process " << record.m_pid << " write error";
+  } break;
+
+  case CLIENT_QUEUE_ERROR: {
+    out << "Process " << record.m_pid
+        << " could not be given an outbound queue";
+  } break;
+
+  case CLIENT_OUTPUT_FULL: {
+    out << "Process " << record.m_pid << " stopped reading, cutting it off "
+        << "with " << record.m_value << " bytes unsent";
+  } break;
+
+  case CLIENT_DISCONNECTED: {
+    out << "Process " << record.m_pid << " disconnected";
+  } break;
+
+  case SUBSCRIBED: {
+    out << "Process " << record.m_pid
+        << " successfully subscribed to channel \"" << record.m_text
+        << "\" as a " << role;
+  } break;
+
+  case SUBSCRIBE_FAILED: {
+    out << "Process " << record.m_pid << " failed to subscribe to channel \""
+        << record.m_text << "\" as a " << role;
+  } break;
+
+  case UNSUBSCRIBED: {
+    out << "Process " << record.m_pid
+        << " successfully unsubscribed from channel \"" << record.m_text
+        << "\" as a " << role;
+  } break;
+
+  case UNSUBSCRIBE_FAILED: {
+    out << "Process " << record.m_pid
+        << " failed to unsubscribe from channel \"" << record.m_text
+        << "\" as a " << role;
+  } break;
+
+  case CONSIDERED_UNSUBSCRIBED: {
+    out << "Process " << record.m_pid
+        << " considered unsubscribed from channel \"" << record.m_text
+        << "\" as a " << role;
+  } break;
+
+  case PATTERN_SUBSCRIBED: {
+    out << "Process " << record.m_pid
+        << " successfully subscribed to channels matching \""
+        << record.m_text << "\", " << record.m_value << " existing";
+  } break;
+
+  case PATTERN_SUBSCRIBE_FAILED: {
+    out << "Process " << record.m_pid
+        << " failed to subscribe to channels matching \"" << record.m_text
+        << "\"";
+  } break;
+
+  case PATTERN_UNSUBSCRIBED: {
+    out << "Process " << record.m_pid
+        << " successfully unsubscribed from channels matching \""
+        << record.m_text << "\"";
+  } break;
+
+  case PATTERN_UNSUBSCRIBE_FAILED: {
+    out << "Process " << record.m_pid
+        << " failed to unsubscribe from channels matching \""
+        << record.m_text << "\"";
+  } break;
+
+  case QUERY_ANSWERED: {
+    out << "Answered the query of Process " << record.m_pid << ", listing "
+        << record.m_value << " channels starting with \"" << record.m_text
+        << "\"";
+  } break;
+
+  case SUBSCRIPTION_LIST_ERROR: {
+    out << "Could not add new subscription to subscription list";
+  } break;
+
+  case READER_INSERT_ERROR: {
+    out << "Could not add reader to channel \"" << record.m_text << "\"";
+  } break;
+
+  case INDEX_INSERT_ERROR: {
+    out << "Could not add new channel \"" << record.m_text
+        << "\" to channel index";
+  } break;
+
+  case CHANNEL_CREATED: {
+    out << "Created channel \"" << record.m_text << "\" with size "
+        << record.m_value << " bytes on ";
+    writePageSize(record.m_count);
+    out << " pages";
+    if (record.m_flags & HUGE_PAGE_FALLBACK_FLAG) {
+      out << ", as there were not enough huge pages";
+    }
+    if (record.m_flags & POOLED_FLAG) {
+      out << ", taken from the pool";
+    }
+    if (record.m_flags & (PREFAULTED_FLAG | LOCKED_FLAG)) {
+      out << ", "
+          << ((record.m_flags & PREFAULTED_FLAG) ? ("prefaulted") : (""))
+          << (((record.m_flags & PREFAULTED_FLAG) &&
+               (record.m_flags & LOCKED_FLAG))
+                  ? (" and ")
+                  : (""))
+          << ((record.m_flags & LOCKED_FLAG) ? ("locked") : (""));
+      if (!(record.m_flags & POOLED_FLAG)) {
+        out << " in " << (record.m_duration / 1000) << " us";
+      }
+    }
+    if (record.m_flags & PREFAULT_FAILED_FLAG) {
+      out << ", could not prefault";
+    }
+    if (record.m_flags & LOCK_FAILED_FLAG) {
+      out << ", could not lock";
+    }
+    if (record.m_flags & PLACED_FLAG) {
+      out << ", on NUMA node " << record.m_node;
+    }
+    if (record.m_flags & PLACEMENT_FAILED_FLAG) {
+      out << ", could not place on NUMA node " << record.m_node;
+    }
+  } break;
+
+  case CHANNEL_DESTROYED: {
+    out << "Destroyed channel \"" << record.m_text << "\"";
+  } break;
+
+  case CHANNEL_RECOVERED: {
+    out << "Recovered channel \"" << record.m_text << "\" with size "
+        << record.m_value << " bytes";
+  } break;
+
+  case CHANNEL_UNCLAIMED: {
+    out << "Destroyed channel \"" << record.m_text
+        << "\" as nobody subscribed to it again";
+  } break;
+
+  case RESIZE_STARTED: {
+    out << "Process " << record.m_pid << " resizes channel \""
+        << record.m_text << "\" from " << record.m_count << " to "
+        << record.m_value << " bytes";
+  } break;
+
+  case RESIZE_DENIED: {
+    out << "Process " << record.m_pid << " could not resize channel \""
+        << record.m_text << "\" to " << record.m_value << " bytes";
+  } break;
+
+  case CHANNEL_RESIZED: {
+    out << "Channel \"" << record.m_text << "\" moved to its board of "
+        << record.m_value << " bytes at message " << record.m_count;
+  } break;
+
+  case RESIZE_ABANDONED: {
+    out << "Abandoned resizing channel \"" << record.m_text << "\" to "
+        << record.m_value << " bytes, as its writer " << record.m_pid
+        << " did not move in time";
+  } break;
+
+  case LAST_VALUES_LOST: {
+    out << "Could not copy the last values of channel \"" << record.m_text
+        << "\" to its board of " << record.m_value << " bytes";
+  } break;
+
+  case SLOW_READER: {
+    out << "Process " << record.m_pid << " lags " << record.m_value
+        << " bytes (" << (100 * record.m_value / std::max<uint64_t>(
+                                                     record.m_count, 1))
+        << "% of the board) behind the writer of channel \""
+        << record.m_text << "\"";
+  } break;
+
+  case SLOW_READER_RECOVERED: {
+    out << "Process " << record.m_pid
+        << " caught up with the writer of channel \"" << record.m_text
+        << "\", " << record.m_value << " bytes behind";
+  } break;
+
+  case SLOW_READER_DROPPED: {
+    out << "Process " << record.m_pid
+        << " was unsubscribed from channel \"" << record.m_text
+        << "\" as a reader, " << record.m_value << " bytes ("
+        << (100 * record.m_value / std::max<uint64_t>(record.m_count, 1))
+        << "% of the board) behind the writer";
+  } break;
+
+  case NAMED_BOARD_ERROR: {
+    out << "Could not name the board of channel \"" << record.m_text
+        << "\", it cannot be recovered";
+  } break;
+
+  case HANDOVER_DENIED: {
+    out << "Denied handover to Process " << record.m_pid
+        << ", its user (" << record.m_uid << ") is not the manager's";
+  } break;
+
+  case HANDOVER_POSTPONED: {
+    out << "Denied handover to Process " << record.m_pid << ", "
+        << record.m_value << " channels are being resized and "
+        << record.m_count << " listings are being sent";
+  } break;
+
+  case HANDOVER_FAILED: {
+    out << "Handover to Process " << record.m_pid
+        << " failed, carrying on";
+  } break;
+
+  case HANDED_OVER: {
+    out << "Handed over " << record.m_value << " channels and "
+        << record.m_count << " clients to Process " << record.m_pid
+        << ", exiting";
+  } break;
+
+  case TOOK_OVER: {
+    out << "Took over " << record.m_value << " channels and "
+        << record.m_count << " clients from Process " << record.m_pid;
+  } break;
+
+  default: {
+    out << "Unknown log event " << record.m_event;
+  } break;
+  }
+
+  out << '\n';
+}
+
+size_t ManagerLog::drain(void) {
+  uint64_t tail = m_tail.load(std::memory_order_relaxed);
+  uint64_t head = m_head.load(std::memory_order_acquire);
+  size_t count = head - tail;
+  bool written = (0 != count);
+
+  for (; head != tail; tail++) {
+    format(m_ring[tail & (RING_SIZE - 1)]);
+    // hand the slot back right away, the producer may be waiting for it
+    m_tail.store(tail + 1, std::memory_order_release);
+  }
+
+  uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+  if (dropped != m_reportedDropped) {
+    struct timespec now;
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+    writePrefix(now.tv_sec);
+    (*m_stream) << "Dropped " << (dropped - m_reportedDropped)
+                << " log records as the log ring was full\n";
+    m_reportedDropped = dropped;
+    written = true;
+  }
+
+  if (written) {
+    m_stream->flush();
+  }
+
+  return count;
+}
+
+void *ManagerLog::formatterMain(void *log) {
+  ManagerLog *self = static_cast<ManagerLog *>(log);
+  long idleNanos = MINIMUM_IDLE_NANOS;
+
+  while (self->m_running.load(std::memory_order_acquire)) {
+    if (0 != self->drain()) {
+      idleNanos = MINIMUM_IDLE_NANOS;
+      continue;
+    }
+
+    // back off while the manager is idle
+    struct timespec idle = {0, idleNanos};
+    ::nanosleep(&idle, 0);
+    if (idleNanos < MAXIMUM_IDLE_NANOS) {
+      idleNanos *= 2;
+    }
+  }
+
+  // write out whatever was posted before stop()
+  self->drain();
+
+  return 0;
+}
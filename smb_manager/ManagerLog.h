@@ -0,0 +1,458 @@
+#ifndef DAEMONS_MANAGERLOG_H_
+#define DAEMONS_MANAGERLOG_H_
+
+/***
+ * @file ManagerLog.h
+ *
+ * @brief
+ * The ShMemBCast Manager's event log.
+ *
+ * @description
+ * Log events are posted as fixed-size binary records. In ASYNC_MODE
+ * the event loop only fills a record in a single-producer,
+ * single-consumer ring; a background thread formats the records,
+ * resolves user and group names and writes them out in batches. The
+ * timestamp string is cached and only rebuilt when the second changes.
+ * If the ring is full the record is dropped and counted, so the event
+ * loop never blocks on the log; the number of dropped records is
+ * reported in the log itself.
+ *
+ * SYNC_MODE formats and flushes every record on the calling thread, as
+ * the manager always used to. It is meant for debugging, where every
+ * line must be on disk before the next request is handled.
+ *
+ * The formatter thread is only started by start(), so that the manager
+ * can daemonize (fork) after init() without losing it. Records posted
+ * before start() wait in the ring.
+ *
+ * All post functions must be called from one thread.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+class ManagerLog {
+public:
+  /***
+   * How records get to the log file
+   *
+   * @var ASYNC_MODE Records are formatted and written by a background
+   * thread
+   * @var SYNC_MODE Records are formatted and flushed as they are posted
+   */
+  enum Mode { ASYNC_MODE, SYNC_MODE };
+
+  /***
+   * What became of a new board, for CHANNEL_CREATED
+   *
+   * @var BoardReport::m_size The board size
+   * @var BoardReport::m_pageBytes The size of the pages backing the board
+   * @var BoardReport::m_hugePageFallback Huge pages were asked for, but
+   * there were not enough of them
+   * @var BoardReport::m_prefaulted Whether the board was prefaulted
+   * @var BoardReport::m_prefaultFailed Prefaulting was asked for, but
+   * failed
+   * @var BoardReport::m_locked Whether the board was locked
+   * @var BoardReport::m_lockFailed Locking was asked for, but failed
+   * @var BoardReport::m_warmNanos How long prefaulting and locking took
+   * @var BoardReport::m_numaNode The NUMA node the board was to be
+   * placed on, NumaUtil::NO_NODE for none
+   * @var BoardReport::m_placementFailed The board could not be placed
+   * on m_numaNode
+   * @var BoardReport::m_pooled The board was a spare from the pool,
+   * warmed before the channel was created
+   */
+  struct BoardReport {
+    uint64_t m_size;
+    uint64_t m_pageBytes;
+    bool m_hugePageFallback;
+    bool m_prefaulted;
+    bool m_prefaultFailed;
+    bool m_locked;
+    bool m_lockFailed;
+    uint64_t m_warmNanos;
+    int m_numaNode;
+    bool m_placementFailed;
+    bool m_pooled;
+  };
+
+  /***
+   * The events the manager logs. Each one maps to one line format.
+   */
+  enum Event {
+    MANAGER_ENDING,
+    CONNECTION_ACCEPTED,
+    CONNECTION_REJECTED,
+    CREDENTIALS_ERROR,
+    DISPATCHER_ADD_ERROR,
+    CLIENT_READ_ERROR,
+    CLIENT_VERSION_ERROR,
+    CLIENT_MESSAGE_SIZE_ERROR,
+    CLIENT_UNSUPPORTED_MESSAGE,
+    CLIENT_WRITE_ERROR,
+    CLIENT_QUEUE_ERROR,
+    CLIENT_OUTPUT_FULL,
+    CLIENT_DISCONNECTED,
+    SUBSCRIBED,
+    SUBSCRIBE_FAILED,
+    UNSUBSCRIBED,
+    UNSUBSCRIBE_FAILED,
+    CONSIDERED_UNSUBSCRIBED,
+    PATTERN_SUBSCRIBED,
+    PATTERN_SUBSCRIBE_FAILED,
+    PATTERN_UNSUBSCRIBED,
+    PATTERN_UNSUBSCRIBE_FAILED,
+    QUERY_ANSWERED,
+    SUBSCRIPTION_LIST_ERROR,
+    READER_INSERT_ERROR,
+    INDEX_INSERT_ERROR,
+    CHANNEL_CREATED,
+    CHANNEL_DESTROYED,
+    CHANNEL_RECOVERED,
+    CHANNEL_UNCLAIMED,
+    RESIZE_STARTED,
+    RESIZE_DENIED,
+    CHANNEL_RESIZED,
+    RESIZE_ABANDONED,
+    LAST_VALUES_LOST,
+    SLOW_READER,
+    SLOW_READER_RECOVERED,
+    SLOW_READER_DROPPED,
+    NAMED_BOARD_ERROR,
+    HANDOVER_DENIED,
+    HANDOVER_POSTPONED,
+    HANDOVER_FAILED,
+    HANDED_OVER,
+    TOOK_OVER
+  };
+
+private:
+  // not copyable
+  ManagerLog(const ManagerLog &);
+  ManagerLog &operator=(const ManagerLog &);
+
+  static const size_t RECORD_SIZE = 256;
+  static const size_t RING_SIZE = 16384;
+  static const size_t CACHE_LINE_SIZE = 64;
+  static const size_t TIME_STRING_LENGTH = 20;
+  static const long MINIMUM_IDLE_NANOS = 1000000;
+  static const long MAXIMUM_IDLE_NANOS = 16000000;
+
+  static const uint16_t WRITER_FLAG = 0x1;
+  static const uint16_t HUGE_PAGE_FALLBACK_FLAG = 0x2;
+  static const uint16_t PREFAULTED_FLAG = 0x4;
+  static const uint16_t PREFAULT_FAILED_FLAG = 0x8;
+  static const uint16_t LOCKED_FLAG = 0x10;
+  static const uint16_t LOCK_FAILED_FLAG = 0x20;
+  static const uint16_t PLACED_FLAG = 0x40;
+  static const uint16_t PLACEMENT_FAILED_FLAG = 0x80;
+  static const uint16_t POOLED_FLAG = 0x100;
+
+  /***
+   * One log record
+   *
+   * @var Record::m_time When the event was posted
+   * @var Record::m_value Event specific value, e.g. a board size
+   * @var Record::m_count Event specific count
+   * @var Record::m_duration Event specific duration in nanoseconds
+   * @var Record::m_pid The client process
+   * @var Record::m_uid The client user
+   * @var Record::m_gid The client group
+   * @var Record::m_node Event specific NUMA node
+   * @var Record::m_event The Event
+   * @var Record::m_flags WRITER_FLAG for writer subscriptions, the
+   * other flags describe a new board
+   * @var Record::m_text The channel name, NUL-terminated. Longer names
+   * are truncated and end in "..."
+   */
+  struct Record {
+    struct timespec m_time;
+    uint64_t m_value;
+    uint64_t m_count;
+    uint64_t m_duration;
+    pid_t m_pid;
+    uid_t m_uid;
+    gid_t m_gid;
+    int16_t m_node;
+    uint16_t m_event;
+    uint16_t m_flags;
+    char m_text[RECORD_SIZE - sizeof(struct timespec) -
+                (3 * sizeof(uint64_t)) - sizeof(pid_t) - sizeof(uid_t) -
+                sizeof(gid_t) - sizeof(int16_t) - (2 * sizeof(uint16_t))];
+  };
+
+  /***
+   * @return a free record to fill in, or 0 if the ring is full
+   */
+  Record *acquire(void);
+
+  /***
+   * Fills in and publishes a record
+   */
+  void post(Event event, pid_t pid, uid_t uid, gid_t gid,
+            const char *channelName, uint16_t flags, uint64_t value,
+            uint64_t count, uint64_t duration = 0, int16_t node = -1);
+
+  /***
+   * Formats one record as a line
+   */
+  void format(const Record &record);
+
+  /***
+   * Writes the "<time>: " line prefix, rebuilding the cached time
+   * string if the second changed
+   */
+  void writePrefix(time_t seconds);
+
+  /***
+   * Writes a page size such as "2 MiB"
+   */
+  void writePageSize(uint64_t pageBytes);
+
+  /***
+   * Formats every published record, then flushes
+   *
+   * @return the number of records formatted
+   */
+  size_t drain(void);
+
+  /***
+   * Formatter thread entry point
+   */
+  static void *formatterMain(void *log);
+
+  static const char *const TIME_FORMAT;
+  static const char *const TIME_ERROR;
+
+  // producer side
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_head;
+  uint64_t m_cachedTail;
+  std::atomic<uint64_t> m_dropped;
+
+  // consumer side
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_tail;
+  uint64_t m_reportedDropped;
+  time_t m_timeStringSeconds;
+  char m_timeString[TIME_STRING_LENGTH];
+
+  alignas(CACHE_LINE_SIZE) Record *m_ring;
+  std::ofstream m_logFile;
+  std::ostream *m_stream;
+  pthread_t m_thread;
+  std::atomic<bool> m_running;
+  bool m_started;
+  Mode m_mode;
+
+public:
+  ManagerLog(void);
+
+  /***
+   * Stops the formatter thread and writes out what is left
+   */
+  ~ManagerLog(void);
+
+  /***
+   * Opens the log. An existing file is moved to "<path>.last"
+   *
+   * @param logFilePath Path to the log file. "-" indicates stdout
+   * @param mode ASYNC_MODE or SYNC_MODE
+   *
+   * @return 0 on success, non-zero on error. Errors are printed to
+   * stderr
+   */
+  int open(const std::string &logFilePath, Mode mode);
+
+  /***
+   * Starts the formatter thread. Does nothing in SYNC_MODE.
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int start(void);
+
+  /***
+   * Stops the formatter thread once it has written out every record
+   * posted so far. The log falls back to SYNC_MODE.
+   */
+  void stop(void);
+
+  /***
+   * Writes preformatted text, such as the start up banner, straight to
+   * the log. Must not be called while the formatter thread runs.
+   */
+  void write(const std::string &text);
+
+  /***
+   * Logs an event about a client process, or about the manager itself
+   */
+  void logEvent(Event event, pid_t pid = 0);
+
+  /***
+   * Logs an accepted or rejected connection. User and group names are
+   * resolved by the formatter.
+   */
+  void logConnection(Event event, pid_t pid, uid_t uid, gid_t gid);
+
+  /***
+   * Logs an event about a handover to or from another manager
+   */
+  void logHandover(Event event, pid_t pid, uid_t uid, uint64_t numChannels,
+                   uint64_t numClients);
+
+  /***
+   * Logs an event about the messages queued for a client
+   *
+   * @param queued The bytes queued
+   */
+  void logOutput(Event event, pid_t pid, uint64_t queued);
+
+  /***
+   * Logs an event about a client's subscription to a channel
+   */
+  void logSubscription(Event event, pid_t pid, const char *channelName,
+                       bool writer);
+
+  /***
+   * Logs an event about a client's pattern subscription
+   *
+   * @param numMatches The channels matched, for PATTERN_SUBSCRIBED
+   */
+  void logPattern(Event event, pid_t pid, const char *pattern,
+                  uint64_t numMatches = 0);
+
+  /***
+   * Logs QUERY_ANSWERED
+   *
+   * @param prefix The prefix of the channels listed
+   * @param numListed The number of channels listed
+   */
+  void logQuery(pid_t pid, const char *prefix, uint64_t numListed);
+
+  /***
+   * Logs an event about a channel
+   *
+   * @param size The board size, for CHANNEL_RECOVERED
+   */
+  void logChannel(Event event, const char *channelName, uint64_t size = 0);
+
+  /***
+   * Logs an event about a reader falling behind the writer of a channel
+   *
+   * @param lag How far behind the reader is, in bytes
+   * @param boardSize The channel's board size
+   */
+  void logSlowReader(Event event, pid_t pid, const char *channelName,
+                     uint64_t lag, uint64_t boardSize);
+
+  /***
+   * Logs an event about moving a channel to a larger board
+   *
+   * @param size The new board size
+   * @param value The old board size for RESIZE_STARTED, the first
+   * message on the new board for CHANNEL_RESIZED, unused for
+   * RESIZE_ABANDONED and LAST_VALUES_LOST
+   */
+  void logResize(Event event, pid_t pid, const char *channelName,
+                 uint64_t size, uint64_t value = 0);
+
+  /***
+   * Logs CHANNEL_CREATED
+   */
+  void logChannelCreated(const char *channelName, const BoardReport &report);
+
+  Mode mode(void) const;
+};
+
+// inline and template functions
+inline ManagerLog::Record *ManagerLog::acquire(void) {
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  if ((head - m_cachedTail) >= RING_SIZE) {
+    m_cachedTail = m_tail.load(std::memory_order_acquire);
+    if ((head - m_cachedTail) >= RING_SIZE) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return 0;
+    }
+  }
+
+  return &(m_ring[head & (RING_SIZE - 1)]);
+}
+
+inline void ManagerLog::logEvent(Event event, pid_t pid) {
+  post(event, pid, 0, 0, 0, 0, 0, 0);
+}
+
+inline void ManagerLog::logConnection(Event event, pid_t pid, uid_t uid,
+                                      gid_t gid) {
+  post(event, pid, uid, gid, 0, 0, 0, 0);
+}
+
+inline void ManagerLog::logHandover(Event event, pid_t pid, uid_t uid,
+                                    uint64_t numChannels,
+                                    uint64_t numClients) {
+  post(event, pid, uid, 0, 0, 0, numChannels, numClients);
+}
+
+inline void ManagerLog::logOutput(Event event, pid_t pid, uint64_t queued) {
+  post(event, pid, 0, 0, 0, 0, queued, 0);
+}
+
+inline void ManagerLog::logSubscription(Event event, pid_t pid,
+                                        const char *channelName, bool writer) {
+  post(event, pid, 0, 0, channelName, writer ? (WRITER_FLAG) : (0), 0, 0);
+}
+
+inline void ManagerLog::logPattern(Event event, pid_t pid,
+                                   const char *pattern, uint64_t numMatches) {
+  post(event, pid, 0, 0, pattern, 0, numMatches, 0);
+}
+
+inline void ManagerLog::logQuery(pid_t pid, const char *prefix,
+                                 uint64_t numListed) {
+  post(QUERY_ANSWERED, pid, 0, 0, prefix, 0, numListed, 0);
+}
+
+inline void ManagerLog::logChannel(Event event, const char *channelName,
+                                   uint64_t size) {
+  post(event, 0, 0, 0, channelName, 0, size, 0);
+}
+
+inline void ManagerLog::logSlowReader(Event event, pid_t pid,
+                                      const char *channelName, uint64_t lag,
+                                      uint64_t boardSize) {
+  post(event, pid, 0, 0, channelName, 0, lag, boardSize);
+}
+
+inline void ManagerLog::logResize(Event event, pid_t pid,
+                                  const char *channelName, uint64_t size,
+                                  uint64_t value) {
+  post(event, pid, 0, 0, channelName, 0, size, value);
+}
+
+inline void ManagerLog::logChannelCreated(const char *channelName,
+                                          const BoardReport &report) {
+  uint16_t flags =
+      (report.m_hugePageFallback ? (HUGE_PAGE_FALLBACK_FLAG) : (0)) |
+      (report.m_prefaulted ? (PREFAULTED_FLAG) : (0)) |
+      (report.m_prefaultFailed ? (PREFAULT_FAILED_FLAG) : (0)) |
+      (report.m_locked ? (LOCKED_FLAG) : (0)) |
+      (report.m_lockFailed ? (LOCK_FAILED_FLAG) : (0)) |
+      (((0 <= report.m_numaNode) && !report.m_placementFailed)
+           ? (PLACED_FLAG)
+           : (0)) |
+      (report.m_placementFailed ? (PLACEMENT_FAILED_FLAG) : (0)) |
+      (report.m_pooled ? (POOLED_FLAG) : (0));
+  post(CHANNEL_CREATED, 0, 0, 0, channelName, flags, report.m_size,
+       report.m_pageBytes, report.m_warmNanos,
+       static_cast<int16_t>(report.m_numaNode));
+}
+
+inline ManagerLog::Mode ManagerLog::mode(void) const { return m_mode; }
+
+#endif // DAEMONS_MANAGERLOG_H_
@@ -0,0 +1,999 @@
+#ifndef DAEMONS_MANAGERPROTOCOL_H_
+#define DAEMONS_MANAGERPROTOCOL_H_
+
+/***
+ * @file ManagerProtocol.h
+ *
+ * @brief
+ * Requests a client may send to the ShMemBCast Manager in addition to
+ * those of ShMemBCastProtocol.
+ *
+ * @description
+ * Clients built against ShMemBCastProtocol alone never send these, and
+ * a manager that does not know them drops the connection, so a client
+ * should only send them to a manager it knows to support them.
+ *
+ * -# PlacementHint asks for the boards of the channels this connection
+ *    goes on to create to be placed on a NUMA node. The manager answers
+ *    with an approval, or a denial if the node does not exist. A channel
+ *    config entry naming a node wins over the hint.
+ * -# BatchSubscribe subscribes to many channels at once, as the writer
+ *    or as a reader. The manager answers with one BatchReply holding an
+ *    approval flag per channel, followed by the board fds of the
+ *    approved channels, in request order, in as many BatchFds messages
+ *    as SCM_RIGHTS needs. A malformed request is answered with a plain
+ *    denial instead.
+ * -# BatchUnsubscribe unsubscribes from many channels at once, and is
+ *    answered with a BatchReply without fds.
+ * -# PatternSubscribe subscribes as a reader to every channel whose name
+ *    starts with a prefix, written as the prefix followed by a single
+ *    trailing '*', e.g. "smbcast://md.binance.*". The manager answers
+ *    with a PatternReply, followed by one ChannelMatch per channel that
+ *    exists now. Each ChannelMatch carries the channel name and passes
+ *    the board fd with it. Channels created later are pushed as
+ *    ChannelMatch events, to Event Mode connections only, once per
+ *    connection however many of its patterns match. Every match is a
+ *    reader subscription of its own, unsubscribed from as usual. A
+ *    malformed or repeated pattern is answered with a denial.
+ * -# PatternUnsubscribe stops the pushes for a pattern, answered with
+ *    an approval, or a denial if there is no such pattern. The channels
+ *    already matched stay subscribed.
+ * -# ReaderProgress tells the manager how far a reader got in a
+ *    channel it subscribed to, so that the manager can publish how far
+ *    the reader lags behind the writer (see StatsSegment.h). It is not
+ *    answered; reports for channels the connection is not a reader of
+ *    are ignored. Readers send it at their own pace, e.g. once a second.
+ * -# SlowReader is an event rather than a request. Under the "notify"
+ *    and "unsubscribe" slow reader policies (see ChannelConfig.h), the
+ *    writer of a channel gets one when a reader falls too far behind,
+ *    when it caught up again, and when it was unsubscribed for falling
+ *    behind. A reader unsubscribed that way gets one too. Only Event
+ *    Mode connections get them. Lags are judged from ReaderProgress
+ *    reports, so a reader that does not report is never slow, and one
+ *    that reports less often than the writer fills the lag threshold
+ *    looks slower than it is.
+ * -# ResizeRequest moves a channel to a new, larger board while it is in
+ *    use. The manager creates the board and sends its fd to the writer
+ *    in a BoardResized event, then answers with an approval. The writer
+ *    moves at its next message boundary: it goes on with the same
+ *    sequence numbers on the new board and tells the manager the first
+ *    one with BoardSwitched, which is not answered. Only then do the
+ *    readers get the new board in a BoardResized event, naming that
+ *    sequence: they read the old board up to the message before it, and
+ *    go on with it on the new board, so that no message is lost. A
+ *    board with a last-value area (see LastValueArea.h) starts with an
+ *    empty one: the writer copies its values over before it writes to
+ *    the new board. A channel without a writer moves at once, and the
+ *    manager copies the values instead. Readers subscribing before
+ *    the writer moved get the old board and the event with the others.
+ *    The request is denied if the size is not larger than the current
+ *    board, the channel is already being resized, or its writer is not
+ *    an Event Mode connection. Readers that are not Event Mode
+ *    connections are not told, and stay on the old board. A writer
+ *    that does not move within the manager's resize timeout must not
+ *    move any more: the manager destroys the new board, ignores a late
+ *    BoardSwitched, and accepts a new ResizeRequest.
+ * -# QueryRequest asks what the manager is doing, e.g. for smb_admin.
+ *    With QUERY_CHANNELS_FLAG set, the manager lists the channels whose
+ *    name starts with the request's prefix, in name order, in as many
+ *    QueryChannels messages as it takes. It always ends the reply with a
+ *    QuerySummary of its registry, board pool and memory use. A long
+ *    listing is sent a few messages per dispatcher pass, and only while
+ *    the connection keeps up, so that it holds up neither the manager
+ *    nor its other clients; channels created or destroyed meanwhile may
+ *    or may not be listed. A malformed request, or one sent before the
+ *    previous reply ended, is answered with a denial.
+ *
+ * Every message starts with a ShMemBCastProtocol::Header. The message
+ * types are outside the range used by ShMemBCastProtocol and
+ * HandoverProtocol.
+ */
+
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct ManagerProtocol {
+  typedef ShMemBCastProtocol Protocol;
+
+  enum MessageType {
+    PLACEMENT_HINT_REQUEST = 0xE0,
+    BATCH_SUBSCRIBE_REQUEST = 0xE1,
+    BATCH_UNSUBSCRIBE_REQUEST = 0xE2,
+    BATCH_REPLY = 0xE3,
+    BATCH_FDS = 0xE4,
+    PATTERN_SUBSCRIBE_REQUEST = 0xE5,
+    PATTERN_UNSUBSCRIBE_REQUEST = 0xE6,
+    PATTERN_REPLY = 0xE7,
+    CHANNEL_MATCH = 0xE8,
+    READER_PROGRESS = 0xE9,
+    SLOW_READER = 0xEA,
+    RESIZE_REQUEST = 0xEB,
+    BOARD_RESIZED = 0xEC,
+    BOARD_SWITCHED = 0xED,
+    QUERY_REQUEST = 0xD0,
+    QUERY_CHANNELS = 0xD1,
+    QUERY_SUMMARY = 0xD2
+  };
+
+  /***
+   * What a SlowReader event tells
+   *
+   * @var READER_LAGGING The reader fell too far behind
+   * @var READER_CAUGHT_UP The reader caught up again
+   * @var READER_UNSUBSCRIBED The reader was unsubscribed for falling
+   * behind
+   */
+  enum SlowReaderState {
+    READER_LAGGING = 0,
+    READER_CAUGHT_UP = 1,
+    READER_UNSUBSCRIBED = 2
+  };
+
+  /***
+   * @var PATTERN_WILDCARD Ends a pattern
+   */
+  static const char PATTERN_WILDCARD = '*';
+
+  /***
+   * @var WRITER_FLAG The batch is about writer subscriptions
+   */
+  static const uint16_t WRITER_FLAG = 0x1;
+
+  /***
+   * @var QUERY_CHANNELS_FLAG List the channels, not just the summary
+   */
+  static const uint32_t QUERY_CHANNELS_FLAG = 0x1;
+
+  /***
+   * @var RESIZING_FLAG The channel is being moved to a larger board
+   * @var READERS_TRUNCATED_FLAG The entry lists only some of the
+   * channel's reader pids
+   */
+  static const uint16_t RESIZING_FLAG = 0x1;
+  static const uint16_t READERS_TRUNCATED_FLAG = 0x2;
+
+  /***
+   * The most reader pids a ChannelEntry holds. The reader count is
+   * exact beyond it. An entry that would not fit in a QueryChannels
+   * message on its own holds fewer
+   */
+  static const size_t MAX_ENTRY_READER_PIDS = 1024;
+
+  /***
+   * Large enough for any message. Header::m_size is 16 bits wide
+   */
+  static const size_t MAX_MESSAGE_SIZE = 65535;
+
+  /***
+   * The most fds the kernel passes in one message (SCM_MAX_FD)
+   */
+  static const size_t MAX_FDS_PER_MESSAGE = 253;
+
+  /***
+   * The most channel names a batch request can carry, as each takes at
+   * least its NUL
+   */
+  static const size_t MAX_BATCH_COUNT =
+      MAX_MESSAGE_SIZE - sizeof(Protocol::Header);
+
+  /***
+   * @var PlacementHint::m_numaNode The node, or -1 to drop the hint
+   */
+  struct PlacementHint {
+    Protocol::Header m_header;
+    int32_t m_numaNode;
+
+    static ssize_t init(char *buffer, size_t size, int32_t numaNode);
+  };
+
+  /***
+   * @var BatchSubscribe::m_requestedSize Board size for new channels
+   * @var BatchSubscribe::m_count Number of channel names
+   * @var BatchSubscribe::m_flags WRITER_FLAG
+   * @var BatchSubscribe::m_channelNames m_count NUL-terminated channel
+   * names, back to back
+   */
+  struct BatchSubscribe {
+    Protocol::Header m_header;
+    uint32_t m_requestedSize;
+    uint16_t m_count;
+    uint16_t m_flags;
+    char m_channelNames[1];
+
+    /***
+     * Packs as many of the channel names as fit in one message
+     *
+     * @param numPacked Set to the number of names packed
+     *
+     * @return the message size, or -1 if not even one name fits
+     */
+    static ssize_t init(char *buffer, size_t size, bool writer,
+                        uint32_t requestedSize,
+                        const char *const *channelNames, size_t count,
+                        size_t *numPacked);
+  };
+
+  /***
+   * @var BatchUnsubscribe::m_count Number of channel names
+   * @var BatchUnsubscribe::m_flags WRITER_FLAG
+   * @var BatchUnsubscribe::m_channelNames m_count NUL-terminated
+   * channel names, back to back
+   */
+  struct BatchUnsubscribe {
+    Protocol::Header m_header;
+    uint16_t m_count;
+    uint16_t m_flags;
+    char m_channelNames[1];
+
+    /***
+     * Packs as many of the channel names as fit in one message
+     *
+     * @param numPacked Set to the number of names packed
+     *
+     * @return the message size, or -1 if not even one name fits
+     */
+    static ssize_t init(char *buffer, size_t size, bool writer,
+                        const char *const *channelNames, size_t count,
+                        size_t *numPacked);
+  };
+
+  /***
+   * @var BatchReply::m_count Number of channels in the request
+   * @var BatchReply::m_numFds Number of fds to follow in BatchFds
+   * messages
+   * @var BatchReply::m_approved Non-zero for each approved channel, in
+   * request order
+   */
+  struct BatchReply {
+    Protocol::Header m_header;
+    uint16_t m_count;
+    uint16_t m_numFds;
+    uint8_t m_approved[1];
+
+    static ssize_t init(char *buffer, size_t size, const uint8_t *approved,
+                        uint16_t count, uint16_t numFds);
+  };
+
+  /***
+   * @var BatchFds::m_count Number of fds passed with this message
+   */
+  struct BatchFds {
+    Protocol::Header m_header;
+    uint16_t m_count;
+
+    static ssize_t init(char *buffer, size_t size, uint16_t count);
+  };
+
+  /***
+   * @var PatternRequest::m_pattern The NUL-terminated pattern
+   */
+  struct PatternRequest {
+    Protocol::Header m_header;
+    char m_pattern[1];
+
+    /***
+     * @param type PATTERN_SUBSCRIBE_REQUEST or
+     * PATTERN_UNSUBSCRIBE_REQUEST
+     */
+    static ssize_t init(char *buffer, size_t size, MessageType type,
+                        const char *pattern);
+  };
+
+  /***
+   * @var PatternReply::m_numMatches Number of ChannelMatch messages to
+   * follow
+   */
+  struct PatternReply {
+    Protocol::Header m_header;
+    uint32_t m_numMatches;
+
+    static ssize_t init(char *buffer, size_t size, uint32_t numMatches);
+  };
+
+  /***
+   * Passes the board fd of the channel with it
+   *
+   * @var ChannelMatch::m_channelName The NUL-terminated channel name
+   */
+  struct ChannelMatch {
+    Protocol::Header m_header;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName);
+  };
+
+  /***
+   * @var ReaderProgress::m_overruns Messages the reader lost, so far
+   * @var ReaderProgress::m_sequence Messages the reader read, so far
+   * @var ReaderProgress::m_position Bytes the reader read, so far
+   * @var ReaderProgress::m_channelName The NUL-terminated channel name
+   */
+  struct ReaderProgress {
+    Protocol::Header m_header;
+    uint32_t m_overruns;
+    uint64_t m_sequence;
+    uint64_t m_position;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName,
+                        uint64_t sequence, uint64_t position,
+                        uint32_t overruns);
+  };
+
+  /***
+   * @var SlowReader::m_pid The reader
+   * @var SlowReader::m_state A SlowReaderState
+   * @var SlowReader::m_lag How far the reader is behind the writer, in
+   * bytes
+   * @var SlowReader::m_channelName The NUL-terminated channel name
+   */
+  struct SlowReader {
+    Protocol::Header m_header;
+    int32_t m_pid;
+    uint32_t m_state;
+    uint64_t m_lag;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName,
+                        pid_t pid, SlowReaderState state, uint64_t lag);
+  };
+
+  /***
+   * @var ResizeRequest::m_requestedSize The new board size
+   * @var ResizeRequest::m_channelName The NUL-terminated channel name
+   */
+  struct ResizeRequest {
+    Protocol::Header m_header;
+    uint32_t m_requestedSize;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName,
+                        uint32_t requestedSize);
+  };
+
+  /***
+   * Passes the new board fd with it
+   *
+   * @var BoardResized::m_sequence For readers, the first message on the
+   * new board. 0 for the writer
+   * @var BoardResized::m_boardSize The new board size
+   * @var BoardResized::m_channelName The NUL-terminated channel name
+   */
+  struct BoardResized {
+    Protocol::Header m_header;
+    uint32_t m_reserved;
+    uint64_t m_sequence;
+    uint64_t m_boardSize;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName,
+                        uint64_t sequence, uint64_t boardSize);
+  };
+
+  /***
+   * @var BoardSwitched::m_sequence The first message the writer wrote
+   * to the new board
+   * @var BoardSwitched::m_channelName The NUL-terminated channel name
+   */
+  struct BoardSwitched {
+    Protocol::Header m_header;
+    uint32_t m_reserved;
+    uint64_t m_sequence;
+    char m_channelName[1];
+
+    static ssize_t init(char *buffer, size_t size, const char *channelName,
+                        uint64_t sequence);
+  };
+
+  /***
+   * @var QueryRequest::m_flags QUERY_CHANNELS_FLAG
+   * @var QueryRequest::m_prefix The NUL-terminated prefix of the
+   * channels to list. Empty for all of them
+   */
+  struct QueryRequest {
+    Protocol::Header m_header;
+    uint32_t m_flags;
+    char m_prefix[1];
+
+    static ssize_t init(char *buffer, size_t size, uint32_t flags,
+                        const char *prefix);
+  };
+
+  /***
+   * A channel listed by a QueryChannels message. It is followed by the
+   * pids of its writers and readers, then by its name, and padded to the
+   * alignment of the next entry.
+   *
+   * @var ChannelEntry::m_boardSize The board size in bytes
+   * @var ChannelEntry::m_numReaders Reader subscriptions, counting each
+   * time a client joined
+   * @var ChannelEntry::m_numWriterPids The writer pids, first in m_pids
+   * @var ChannelEntry::m_numReaderPids The reader pids after them, one
+   * per client, at most MAX_ENTRY_READER_PIDS
+   * @var ChannelEntry::m_flags RESIZING_FLAG and READERS_TRUNCATED_FLAG
+   * @var ChannelEntry::m_nameLength The name length, NUL included
+   */
+  struct ChannelEntry {
+    uint64_t m_boardSize;
+    uint32_t m_numReaders;
+    uint16_t m_numWriterPids;
+    uint16_t m_numReaderPids;
+    uint16_t m_flags;
+    uint16_t m_nameLength;
+    int32_t m_pids[1];
+
+    /***
+     * @return the bytes an entry takes
+     */
+    static size_t size(size_t numPids, size_t nameLength);
+
+    static const char *name(const ChannelEntry *entry);
+
+    /***
+     * @return the entry after this one in its message
+     */
+    static const ChannelEntry *next(const ChannelEntry *entry);
+  };
+
+  /***
+   * Buffers holding it must be aligned for ChannelEntry
+   *
+   * @var QueryChannels::m_count Number of entries
+   * @var QueryChannels::m_entries m_count ChannelEntry back to back
+   */
+  struct QueryChannels {
+    Protocol::Header m_header;
+    uint16_t m_count;
+    uint16_t m_reserved;
+    uint64_t m_entries[1];
+
+    /***
+     * Starts a message without entries
+     */
+    static ssize_t init(char *buffer, size_t size);
+
+    /***
+     * Adds an entry to a message started by init()
+     *
+     * @param pids The writer pids, then the reader pids
+     *
+     * @return the new message size, or -1 if the entry does not fit
+     */
+    static ssize_t append(char *buffer, size_t size,
+                          const char *channelName, uint64_t boardSize,
+                          uint32_t numReaders, uint16_t flags,
+                          const int32_t *pids, uint16_t numWriterPids,
+                          uint16_t numReaderPids);
+
+    static const ChannelEntry *first(const QueryChannels *message);
+  };
+
+  /***
+   * @var QuerySummary::m_managerPid The manager
+   * @var QuerySummary::m_numListed Channels listed by the QueryChannels
+   * messages before it
+   * @var QuerySummary::m_numChannels Channels in the registry
+   * @var QuerySummary::m_numClients Connected clients
+   * @var QuerySummary::m_numResizing Channels being resized
+   * @var QuerySummary::m_boardBytes The size of every channel's board
+   * @var QuerySummary::m_pooledBoards Spare boards in the pool
+   * @var QuerySummary::m_pooledBytes Their size
+   * @var QuerySummary::m_poolHits New channels that got a spare board
+   * @var QuerySummary::m_poolMisses New channels that did not
+   * @var QuerySummary::m_registryBytes Memory held by the manager's
+   * channel and client indexes
+   * @var QuerySummary::m_queuedBytes Bytes waiting in the outbound
+   * queues of slow clients
+   */
+  struct QuerySummary {
+    Protocol::Header m_header;
+    int32_t m_managerPid;
+    uint32_t m_numListed;
+    uint32_t m_numChannels;
+    uint32_t m_numClients;
+    uint32_t m_numResizing;
+    uint64_t m_boardBytes;
+    uint64_t m_pooledBoards;
+    uint64_t m_pooledBytes;
+    uint64_t m_poolHits;
+    uint64_t m_poolMisses;
+    uint64_t m_registryBytes;
+    uint64_t m_queuedBytes;
+
+    /***
+     * Fills in the header. The caller fills in the rest
+     */
+    static ssize_t init(char *buffer, size_t size);
+  };
+
+  /***
+   * @return the length of the prefix a pattern matches, or -1 if it is
+   * not a prefix followed by a single trailing PATTERN_WILDCARD
+   */
+  static ssize_t patternPrefixLength(const char *pattern);
+
+  /***
+   * Walks the channel names of a batch request
+   *
+   * @param channelName A channel name in the request
+   * @param end The end of the request
+   *
+   * @return the channel name after channelName, or 0 if channelName is
+   * not NUL-terminated before end or is too long
+   */
+  static const char *nextChannelName(const char *channelName,
+                                     const char *end);
+
+  /***
+   * Packs channel names back to back
+   *
+   * @return the number of names that fit in size bytes
+   */
+  static size_t packChannelNames(char *buffer, size_t size,
+                                 const char *const *channelNames,
+                                 size_t count, size_t *packedSize);
+
+  /***
+   * Fills in a header
+   *
+   * @return messageSize, or -1 if the buffer is too small
+   */
+  static ssize_t initHeader(char *buffer, size_t size, MessageType type,
+                            size_t messageSize);
+
+  /***
+   * @return whether buffer holds a complete, well formed message of the
+   * given type and at least minimumSize bytes
+   */
+  static bool isMessage(const char *buffer, ssize_t size, MessageType type,
+                        size_t minimumSize);
+};
+
+// inline and template functions
+inline ssize_t ManagerProtocol::initHeader(char *buffer, size_t size,
+                                           MessageType type,
+                                           size_t messageSize) {
+  if (size < messageSize) {
+    return -1;
+  }
+
+  Protocol::Header *header = reinterpret_cast<Protocol::Header *>(buffer);
+  header->m_version = Protocol::VERSION;
+  header->m_messageType =
+      static_cast<decltype(header->m_messageType)>(type);
+  header->m_size = static_cast<decltype(header->m_size)>(messageSize);
+
+  return messageSize;
+}
+
+inline bool ManagerProtocol::isMessage(const char *buffer, ssize_t size,
+                                       MessageType type,
+                                       size_t minimumSize) {
+  const Protocol::Header *header =
+      reinterpret_cast<const Protocol::Header *>(buffer);
+
+  return (static_cast<ssize_t>(minimumSize) <= size) &&
+         (Protocol::VERSION == header->m_version) &&
+         (static_cast<uint8_t>(type) ==
+          static_cast<uint8_t>(header->m_messageType)) &&
+         (static_cast<ssize_t>(header->m_size) == size);
+}
+
+inline ssize_t ManagerProtocol::PlacementHint::init(char *buffer,
+                                                    size_t size,
+                                                    int32_t numaNode) {
+  if (0 > initHeader(buffer, size, PLACEMENT_HINT_REQUEST,
+                     sizeof(PlacementHint))) {
+    return -1;
+  }
+
+  PlacementHint *message = reinterpret_cast<PlacementHint *>(buffer);
+  message->m_numaNode = numaNode;
+
+  return sizeof(PlacementHint);
+}
+
+inline ssize_t ManagerProtocol::BatchSubscribe::init(
+    char *buffer, size_t size, bool writer, uint32_t requestedSize,
+    const char *const *channelNames, size_t count, size_t *numPacked) {
+  const size_t namesOffset = offsetof(BatchSubscribe, m_channelNames);
+  size_t namesSize;
+
+  if (size > MAX_MESSAGE_SIZE) {
+    size = MAX_MESSAGE_SIZE;
+  }
+  if (size <= namesOffset) {
+    return -1;
+  }
+
+  *numPacked = packChannelNames(buffer + namesOffset, size - namesOffset,
+                                channelNames, count, &namesSize);
+  if ((0 == *numPacked) ||
+      (0 > initHeader(buffer, size, BATCH_SUBSCRIBE_REQUEST,
+                      namesOffset + namesSize))) {
+    return -1;
+  }
+
+  BatchSubscribe *message = reinterpret_cast<BatchSubscribe *>(buffer);
+  message->m_requestedSize = requestedSize;
+  message->m_count = static_cast<uint16_t>(*numPacked);
+  message->m_flags = writer ? (WRITER_FLAG) : (0);
+
+  return namesOffset + namesSize;
+}
+
+inline ssize_t ManagerProtocol::BatchUnsubscribe::init(
+    char *buffer, size_t size, bool writer, const char *const *channelNames,
+    size_t count, size_t *numPacked) {
+  const size_t namesOffset = offsetof(BatchUnsubscribe, m_channelNames);
+  size_t namesSize;
+
+  if (size > MAX_MESSAGE_SIZE) {
+    size = MAX_MESSAGE_SIZE;
+  }
+  if (size <= namesOffset) {
+    return -1;
+  }
+
+  *numPacked = packChannelNames(buffer + namesOffset, size - namesOffset,
+                                channelNames, count, &namesSize);
+  if ((0 == *numPacked) ||
+      (0 > initHeader(buffer, size, BATCH_UNSUBSCRIBE_REQUEST,
+                      namesOffset + namesSize))) {
+    return -1;
+  }
+
+  BatchUnsubscribe *message = reinterpret_cast<BatchUnsubscribe *>(buffer);
+  message->m_count = static_cast<uint16_t>(*numPacked);
+  message->m_flags = writer ? (WRITER_FLAG) : (0);
+
+  return namesOffset + namesSize;
+}
+
+inline ssize_t ManagerProtocol::BatchReply::init(char *buffer, size_t size,
+                                                 const uint8_t *approved,
+                                                 uint16_t count,
+                                                 uint16_t numFds) {
+  size_t messageSize = offsetof(BatchReply, m_approved) + count;
+  if ((MAX_MESSAGE_SIZE < messageSize) ||
+      (0 > initHeader(buffer, size, BATCH_REPLY, messageSize))) {
+    return -1;
+  }
+
+  BatchReply *message = reinterpret_cast<BatchReply *>(buffer);
+  message->m_count = count;
+  message->m_numFds = numFds;
+  ::memcpy(message->m_approved, approved, count);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::BatchFds::init(char *buffer, size_t size,
+                                               uint16_t count) {
+  if (0 > initHeader(buffer, size, BATCH_FDS, sizeof(BatchFds))) {
+    return -1;
+  }
+
+  reinterpret_cast<BatchFds *>(buffer)->m_count = count;
+
+  return sizeof(BatchFds);
+}
+
+inline ssize_t ManagerProtocol::PatternRequest::init(char *buffer,
+                                                     size_t size,
+                                                     MessageType type,
+                                                     const char *pattern) {
+  const size_t patternLength = ::strlen(pattern);
+  const size_t messageSize =
+      offsetof(PatternRequest, m_pattern) + patternLength + 1;
+
+  if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < patternLength) ||
+      (0 > initHeader(buffer, size, type, messageSize))) {
+    return -1;
+  }
+
+  ::memcpy(reinterpret_cast<PatternRequest *>(buffer)->m_pattern, pattern,
+           patternLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::PatternReply::init(char *buffer, size_t size,
+                                                   uint32_t numMatches) {
+  if (0 > initHeader(buffer, size, PATTERN_REPLY, sizeof(PatternReply))) {
+    return -1;
+  }
+
+  reinterpret_cast<PatternReply *>(buffer)->m_numMatches = numMatches;
+
+  return sizeof(PatternReply);
+}
+
+inline ssize_t ManagerProtocol::ChannelMatch::init(char *buffer, size_t size,
+                                                   const char *channelName) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(ChannelMatch, m_channelName) + channelNameLength + 1;
+
+  if (0 > initHeader(buffer, size, CHANNEL_MATCH, messageSize)) {
+    return -1;
+  }
+
+  ::memcpy(reinterpret_cast<ChannelMatch *>(buffer)->m_channelName,
+           channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::ReaderProgress::init(
+    char *buffer, size_t size, const char *channelName, uint64_t sequence,
+    uint64_t position, uint32_t overruns) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(ReaderProgress, m_channelName) + channelNameLength + 1;
+
+  if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < channelNameLength) ||
+      (0 > initHeader(buffer, size, READER_PROGRESS, messageSize))) {
+    return -1;
+  }
+
+  ReaderProgress *message = reinterpret_cast<ReaderProgress *>(buffer);
+  message->m_overruns = overruns;
+  message->m_sequence = sequence;
+  message->m_position = position;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::SlowReader::init(char *buffer, size_t size,
+                                                 const char *channelName,
+                                                 pid_t pid,
+                                                 SlowReaderState state,
+                                                 uint64_t lag) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(SlowReader, m_channelName) + channelNameLength + 1;
+
+  if (0 > initHeader(buffer, size, SLOW_READER, messageSize)) {
+    return -1;
+  }
+
+  SlowReader *message = reinterpret_cast<SlowReader *>(buffer);
+  message->m_pid = pid;
+  message->m_state = state;
+  message->m_lag = lag;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::ResizeRequest::init(char *buffer,
+                                                    size_t size,
+                                                    const char *channelName,
+                                                    uint32_t requestedSize) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(ResizeRequest, m_channelName) + channelNameLength + 1;
+
+  if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < channelNameLength) ||
+      (0 > initHeader(buffer, size, RESIZE_REQUEST, messageSize))) {
+    return -1;
+  }
+
+  ResizeRequest *message = reinterpret_cast<ResizeRequest *>(buffer);
+  message->m_requestedSize = requestedSize;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::BoardResized::init(char *buffer,
+                                                   size_t size,
+                                                   const char *channelName,
+                                                   uint64_t sequence,
+                                                   uint64_t boardSize) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(BoardResized, m_channelName) + channelNameLength + 1;
+
+  if (0 > initHeader(buffer, size, BOARD_RESIZED, messageSize)) {
+    return -1;
+  }
+
+  BoardResized *message = reinterpret_cast<BoardResized *>(buffer);
+  message->m_reserved = 0;
+  message->m_sequence = sequence;
+  message->m_boardSize = boardSize;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::BoardSwitched::init(char *buffer,
+                                                    size_t size,
+                                                    const char *channelName,
+                                                    uint64_t sequence) {
+  const size_t channelNameLength = ::strlen(channelName);
+  const size_t messageSize =
+      offsetof(BoardSwitched, m_channelName) + channelNameLength + 1;
+
+  if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < channelNameLength) ||
+      (0 > initHeader(buffer, size, BOARD_SWITCHED, messageSize))) {
+    return -1;
+  }
+
+  BoardSwitched *message = reinterpret_cast<BoardSwitched *>(buffer);
+  message->m_reserved = 0;
+  message->m_sequence = sequence;
+  ::memcpy(message->m_channelName, channelName, channelNameLength + 1);
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::QueryRequest::init(char *buffer,
+                                                   size_t size,
+                                                   uint32_t flags,
+                                                   const char *prefix) {
+  const size_t prefixLength = ::strlen(prefix);
+  const size_t messageSize =
+      offsetof(QueryRequest, m_prefix) + prefixLength + 1;
+
+  if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < prefixLength) ||
+      (0 > initHeader(buffer, size, QUERY_REQUEST, messageSize))) {
+    return -1;
+  }
+
+  QueryRequest *message = reinterpret_cast<QueryRequest *>(buffer);
+  message->m_flags = flags;
+  ::memcpy(message->m_prefix, prefix, prefixLength + 1);
+
+  return messageSize;
+}
+
+inline size_t ManagerProtocol::ChannelEntry::size(size_t numPids,
+                                                  size_t nameLength) {
+  const size_t bytes = offsetof(ChannelEntry, m_pids) +
+                       (numPids * sizeof(int32_t)) + nameLength;
+  return (bytes + alignof(ChannelEntry) - 1) & ~(alignof(ChannelEntry) - 1);
+}
+
+inline const char *
+ManagerProtocol::ChannelEntry::name(const ChannelEntry *entry) {
+  return reinterpret_cast<const char *>(
+      entry->m_pids + entry->m_numWriterPids + entry->m_numReaderPids);
+}
+
+inline const ManagerProtocol::ChannelEntry *
+ManagerProtocol::ChannelEntry::next(const ChannelEntry *entry) {
+  return reinterpret_cast<const ChannelEntry *>(
+      reinterpret_cast<const char *>(entry) +
+      size(entry->m_numWriterPids + entry->m_numReaderPids,
+           entry->m_nameLength));
+}
+
+inline ssize_t ManagerProtocol::QueryChannels::init(char *buffer,
+                                                    size_t size) {
+  const size_t messageSize = offsetof(QueryChannels, m_entries);
+
+  if (0 > initHeader(buffer, size, QUERY_CHANNELS, messageSize)) {
+    return -1;
+  }
+
+  QueryChannels *message = reinterpret_cast<QueryChannels *>(buffer);
+  message->m_count = 0;
+  message->m_reserved = 0;
+
+  return messageSize;
+}
+
+inline ssize_t ManagerProtocol::QueryChannels::append(
+    char *buffer, size_t size, const char *channelName, uint64_t boardSize,
+    uint32_t numReaders, uint16_t flags, const int32_t *pids,
+    uint16_t numWriterPids, uint16_t numReaderPids) {
+  QueryChannels *message = reinterpret_cast<QueryChannels *>(buffer);
+  const size_t nameLength = ::strlen(channelName) + 1;
+  const size_t numPids = numWriterPids + numReaderPids;
+  const size_t offset = message->m_header.m_size;
+  const size_t messageSize = offset + ChannelEntry::size(numPids, nameLength);
+
+  if (size > MAX_MESSAGE_SIZE) {
+    size = MAX_MESSAGE_SIZE;
+  }
+  if ((size < messageSize) ||
+      (Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < nameLength - 1)) {
+    return -1;
+  }
+
+  // zeroes the padding, too
+  ::memset(buffer + offset, 0, messageSize - offset);
+  ChannelEntry *entry = reinterpret_cast<ChannelEntry *>(buffer + offset);
+  entry->m_boardSize = boardSize;
+  entry->m_numReaders = numReaders;
+  entry->m_numWriterPids = numWriterPids;
+  entry->m_numReaderPids = numReaderPids;
+  entry->m_flags = flags;
+  entry->m_nameLength = static_cast<uint16_t>(nameLength);
+  if (0 < numPids) {
+    ::memcpy(entry->m_pids, pids, numPids * sizeof(int32_t));
+  }
+  ::memcpy(entry->m_pids + numPids, channelName, nameLength);
+
+  message->m_count++;
+  message->m_header.m_size =
+      static_cast<decltype(message->m_header.m_size)>(messageSize);
+
+  return messageSize;
+}
+
+inline const ManagerProtocol::ChannelEntry *
+ManagerProtocol::QueryChannels::first(const QueryChannels *message) {
+  return reinterpret_cast<const ChannelEntry *>(message->m_entries);
+}
+
+inline ssize_t ManagerProtocol::QuerySummary::init(char *buffer,
+                                                   size_t size) {
+  if (0 > initHeader(buffer, size, QUERY_SUMMARY, sizeof(QuerySummary))) {
+    return -1;
+  }
+
+  ::memset(buffer + sizeof(Protocol::Header), 0,
+           sizeof(QuerySummary) - sizeof(Protocol::Header));
+
+  return sizeof(QuerySummary);
+}
+
+inline ssize_t ManagerProtocol::patternPrefixLength(const char *pattern) {
+  const char *wildcard = ::strchr(pattern, PATTERN_WILDCARD);
+
+  if ((0 == wildcard) || ('\0' != wildcard[1])) {
+    return -1;
+  }
+
+  return wildcard - pattern;
+}
+
+inline const char *ManagerProtocol::nextChannelName(const char *channelName,
+                                                    const char *end) {
+  const char *nul = static_cast<const char *>(
+      ::memchr(channelName, '\0', end - channelName));
+  if ((0 == nul) ||
+      (Protocol::Constants::MAX_CHANNEL_NAME_LENGTH <
+       static_cast<size_t>(nul - channelName))) {
+    return 0;
+  }
+
+  return nul + 1;
+}
+
+inline size_t
+ManagerProtocol::packChannelNames(char *buffer, size_t size,
+                                  const char *const *channelNames,
+                                  size_t count, size_t *packedSize) {
+  size_t numPacked = 0;
+
+  // m_count is 16 bits wide
+  if (UINT16_MAX < count) {
+    count = UINT16_MAX;
+  }
+
+  *packedSize = 0;
+  for (; numPacked < count; numPacked++) {
+    size_t length = ::strlen(channelNames[numPacked]) + 1;
+    if ((Protocol::Constants::MAX_CHANNEL_NAME_LENGTH < (length - 1)) ||
+        ((size - *packedSize) < length)) {
+      break;
+    }
+
+    ::memcpy(buffer + *packedSize, channelNames[numPacked], length);
+    *packedSize += length;
+  }
+
+  return numPacked;
+}
+
+#endif // DAEMONS_MANAGERPROTOCOL_H_
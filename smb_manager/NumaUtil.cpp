@@ -0,0 +1,156 @@
+#include "NumaUtil.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// from <numaif.h>, which comes with libnuma
+const int MEMORY_POLICY_DEFAULT = 0;
+const int MEMORY_POLICY_PREFERRED = 1;
+const unsigned MEMORY_POLICY_MOVE = (1U << 1);
+
+const size_t NODE_MASK_WORDS = 16;
+const size_t BITS_PER_WORD = sizeof(unsigned long) * CHAR_BIT;
+
+/***
+ * Field 39 of /proc/<pid>/stat, counting from 1
+ */
+const int PROCESSOR_FIELD = 39;
+
+/***
+ * Fills in a node mask with just 'node' set
+ *
+ * @return 0 on success, non-zero if the node does not fit
+ */
+int initNodeMask(int node, unsigned long *mask) {
+  if ((0 > node) || ((NODE_MASK_WORDS * BITS_PER_WORD) <=
+                     static_cast<size_t>(node))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ::memset(mask, 0, NODE_MASK_WORDS * sizeof(unsigned long));
+  mask[node / BITS_PER_WORD] = 1UL << (node % BITS_PER_WORD);
+
+  return 0;
+}
+} // namespace
+
+int NumaUtil::numNodes(void) {
+  std::ifstream file("/sys/devices/system/node/possible");
+  std::string ranges;
+  int lastNode = 0;
+
+  // e.g. "0" or "0-3" or "0,2-3"
+  if (!std::getline(file, ranges)) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (('0' <= ranges[i]) && ('9' >= ranges[i]) &&
+        ((0 == i) || ('0' > ranges[i - 1]) || ('9' < ranges[i - 1]))) {
+      int node = ::atoi(ranges.c_str() + i);
+      if (lastNode < node) {
+        lastNode = node;
+      }
+    }
+  }
+
+  return lastNode + 1;
+}
+
+int NumaUtil::nodeOfCpu(int cpu) {
+  std::ostringstream path;
+  DIR *directory;
+  struct dirent *entry;
+  int node = NO_NODE;
+
+  if (0 > cpu) {
+    return NO_NODE;
+  }
+
+  // the cpu directory links to its node as "node<n>"
+  path << "/sys/devices/system/cpu/cpu" << cpu;
+  directory = ::opendir(path.str().c_str());
+  if (0 == directory) {
+    return NO_NODE;
+  }
+
+  while (0 != (entry = ::readdir(directory))) {
+    if ((0 == ::strncmp(entry->d_name, "node", 4)) &&
+        ('0' <= entry->d_name[4]) && ('9' >= entry->d_name[4])) {
+      node = ::atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  ::closedir(directory);
+
+  return node;
+}
+
+int NumaUtil::nodeOfProcess(pid_t pid) {
+  std::ostringstream path;
+  std::string stat;
+  size_t commandEnd;
+  int cpu = -1;
+
+  path << "/proc/" << pid << "/stat";
+  std::ifstream file(path.str().c_str());
+  if (!std::getline(file, stat)) {
+    return NO_NODE;
+  }
+
+  // the command (field 2) is in parentheses and may contain anything
+  commandEnd = stat.rfind(')');
+  if (std::string::npos == commandEnd) {
+    return NO_NODE;
+  }
+
+  std::istringstream fields(stat.substr(commandEnd + 1));
+  std::string field;
+  for (int i = 3; i <= PROCESSOR_FIELD; i++) {
+    if (!(fields >> field)) {
+      return NO_NODE;
+    }
+  }
+  cpu = ::atoi(field.c_str());
+
+  return nodeOfCpu(cpu);
+}
+
+int NumaUtil::setPreferredNode(int node) {
+  unsigned long mask[NODE_MASK_WORDS];
+
+  if (NO_NODE == node) {
+    return ::syscall(SYS_set_mempolicy, MEMORY_POLICY_DEFAULT, 0, 0);
+  }
+
+  if (0 != initNodeMask(node, mask)) {
+    return -1;
+  }
+
+  // the kernel ignores the last bit of maxnode
+  return ::syscall(SYS_set_mempolicy, MEMORY_POLICY_PREFERRED, mask,
+                   (NODE_MASK_WORDS * BITS_PER_WORD) + 1);
+}
+
+int NumaUtil::preferNode(void *address, size_t length, int node) {
+  unsigned long mask[NODE_MASK_WORDS];
+
+  if (0 != initNodeMask(node, mask)) {
+    return -1;
+  }
+
+  return ::syscall(SYS_mbind, address, length, MEMORY_POLICY_PREFERRED,
+                   mask, (NODE_MASK_WORDS * BITS_PER_WORD) + 1,
+                   MEMORY_POLICY_MOVE);
+}
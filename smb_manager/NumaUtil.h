@@ -0,0 +1,66 @@
+#ifndef DAEMONS_NUMAUTIL_H_
+#define DAEMONS_NUMAUTIL_H_
+
+/***
+ * @file NumaUtil.h
+ *
+ * @brief
+ * The little NUMA support the ShMemBCast Manager needs, straight on top
+ * of the kernel's memory policy system calls, so that the manager does
+ * not depend on libnuma.
+ *
+ * @description
+ * The topology is read from sysfs. On kernels without NUMA support
+ * there is a single node 0, and every policy call fails with ENOSYS,
+ * which callers treat like any other placement failure.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+class NumaUtil {
+public:
+  /***
+   * @var NO_NODE No node, i.e. the kernel's default placement
+   */
+  static const int NO_NODE = -1;
+
+  /***
+   * @return the number of possible nodes, at least 1
+   */
+  static int numNodes(void);
+
+  /***
+   * @return the node of a CPU, or NO_NODE if it is not known
+   */
+  static int nodeOfCpu(int cpu);
+
+  /***
+   * @return the node of the CPU a process last ran on, or NO_NODE if
+   * it is not known
+   */
+  static int nodeOfProcess(pid_t pid);
+
+  /***
+   * Makes the calling thread allocate new memory on a node, falling
+   * back to other nodes when it is full
+   *
+   * @param node The preferred node, NO_NODE to go back to the default
+   * policy
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int setPreferredNode(int node);
+
+  /***
+   * Sets the policy of a mapping to prefer a node, and moves the pages
+   * already allocated to it. For a shared memory file the policy sticks
+   * to the file, so pages allocated later through other mappings follow
+   * it too.
+   *
+   * @return 0 on success, non-zero on error
+   */
+  static int preferNode(void *address, size_t length, int node);
+};
+
+#endif // DAEMONS_NUMAUTIL_H_
@@ -0,0 +1,336 @@
+#ifndef DAEMONS_OPENHASHMAP_H_
+#define DAEMONS_OPENHASHMAP_H_
+
+/***
+ * @file OpenHashMap.h
+ *
+ * @brief
+ * A small open-addressing hash map used for the manager's registries.
+ *
+ * @description
+ * Linear probing over a power-of-two table that is kept at most half
+ * full, with backward-shift deletion so that no tombstones accumulate
+ * under subscribe/unsubscribe churn. Each slot caches 32 bits of the
+ * key's hash, so probing rarely has to call TRAITS::equal() and growing
+ * never rehashes the keys.
+ *
+ * TRAITS must provide:
+ * - static uint32_t hash(const KEY &key)
+ * - static bool equal(const KEY &stored, const KEY &probe)
+ * - static KEY empty(void), a key value that is never inserted
+ * - static bool isEmpty(const KEY &key)
+ *
+ * Errors are reported through return values; the map never throws.
+ * Pointers returned by find() are invalidated by insert() and erase().
+ */
+
+#include <new>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***
+ * Traits for NUL-terminated string keys, compared by content. The map
+ * stores the pointer, so the string must outlive its entry.
+ */
+struct StringKeyTraits {
+  static uint32_t hash(const char *const &key) {
+    // 64 bit FNV-1a, folded
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *c = reinterpret_cast<const unsigned char *>(key);
+         '\0' != *c; c++) {
+      hash ^= *c;
+      hash *= 1099511628211ULL;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+  }
+
+  static bool equal(const char *const &stored, const char *const &probe) {
+    return (stored == probe) || (0 == ::strcmp(stored, probe));
+  }
+
+  static const char *empty(void) { return 0; }
+
+  static bool isEmpty(const char *const &key) { return 0 == key; }
+};
+
+/***
+ * Traits for pointer keys, compared by identity
+ */
+template <typename T> struct PointerKeyTraits {
+  static uint32_t hash(T *const &key) {
+    // fibonacci hashing spreads the aligned low bits
+    uint64_t hash = reinterpret_cast<uintptr_t>(key) * 11400714819323198485ULL;
+    return static_cast<uint32_t>(hash >> 32);
+  }
+
+  static bool equal(T *const &stored, T *const &probe) {
+    return stored == probe;
+  }
+
+  static T *empty(void) { return 0; }
+
+  static bool isEmpty(T *const &key) { return 0 == key; }
+};
+
+template <typename KEY, typename VALUE, typename TRAITS> class OpenHashMap {
+private:
+  // not copyable
+  OpenHashMap(const OpenHashMap &);
+  OpenHashMap &operator=(const OpenHashMap &);
+
+  /***
+   * A table slot
+   *
+   * @var Slot::m_key The key, or TRAITS::empty() for a free slot
+   * @var Slot::m_hash Cached TRAITS::hash() of m_key
+   * @var Slot::m_value The value
+   */
+  struct Slot {
+    KEY m_key;
+    uint32_t m_hash;
+    VALUE m_value;
+  };
+
+  static const size_t MINIMUM_CAPACITY = 8;
+
+  /***
+   * Finds the slot holding key, or the free slot where it would go
+   */
+  size_t probe(const KEY &key, uint32_t hash) const;
+
+  /***
+   * Reallocates the table with 'capacity' slots
+   *
+   * @return 0 on success, non-zero on allocation failure
+   */
+  int rehash(size_t capacity);
+
+  Slot *m_slots;
+  size_t m_mask;
+  size_t m_size;
+
+public:
+  OpenHashMap(void);
+
+  ~OpenHashMap(void);
+
+  /***
+   * Makes room for 'count' entries without further allocation
+   *
+   * @return 0 on success, non-zero on allocation failure
+   */
+  int reserve(size_t count);
+
+  /***
+   * @return the value stored for key, or 0
+   */
+  VALUE *find(const KEY &key) const;
+
+  /***
+   * Inserts a key that is not in the map yet
+   *
+   * @return 0 on success, non-zero on allocation failure
+   */
+  int insert(const KEY &key, const VALUE &value);
+
+  /***
+   * Removes key from the map
+   *
+   * @return true if key was present
+   */
+  bool erase(const KEY &key);
+
+  /***
+   * Removes every entry, keeping the table allocated
+   */
+  void clear(void);
+
+  size_t size(void) const;
+
+  bool empty(void) const;
+
+  /***
+   * @return bytes allocated for the table
+   */
+  size_t memoryUsage(void) const;
+
+  /***
+   * Calls function(key, value) for every entry. The map must not be
+   * modified from within function.
+   */
+  template <typename FUNCTION> void forEach(FUNCTION function) const;
+};
+
+// inline and template functions
+template <typename KEY, typename VALUE, typename TRAITS>
+inline OpenHashMap<KEY, VALUE, TRAITS>::OpenHashMap(void)
+    : m_slots(0), m_mask(0), m_size(0) {}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline OpenHashMap<KEY, VALUE, TRAITS>::~OpenHashMap(void) {
+  delete[] m_slots;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline size_t OpenHashMap<KEY, VALUE, TRAITS>::probe(const KEY &key,
+                                                     uint32_t hash) const {
+  size_t index = hash & m_mask;
+  while (!TRAITS::isEmpty(m_slots[index].m_key) &&
+         ((m_slots[index].m_hash != hash) ||
+          !TRAITS::equal(m_slots[index].m_key, key))) {
+    index = (index + 1) & m_mask;
+  }
+  return index;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+int OpenHashMap<KEY, VALUE, TRAITS>::rehash(size_t capacity) {
+  Slot *slots = new (std::nothrow) Slot[capacity];
+  if (0 == slots) {
+    return -1;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    slots[i].m_key = TRAITS::empty();
+  }
+
+  Slot *oldSlots = m_slots;
+  size_t oldCapacity = (0 == m_slots) ? (0) : (m_mask + 1);
+  m_slots = slots;
+  m_mask = capacity - 1;
+
+  // cached hashes make this a plain move
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (!TRAITS::isEmpty(oldSlots[i].m_key)) {
+      size_t index = oldSlots[i].m_hash & m_mask;
+      while (!TRAITS::isEmpty(m_slots[index].m_key)) {
+        index = (index + 1) & m_mask;
+      }
+      m_slots[index] = oldSlots[i];
+    }
+  }
+
+  delete[] oldSlots;
+  return 0;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+int OpenHashMap<KEY, VALUE, TRAITS>::reserve(size_t count) {
+  size_t capacity = MINIMUM_CAPACITY;
+  while (capacity < (2 * count)) {
+    capacity *= 2;
+  }
+
+  if ((0 != m_slots) && (capacity <= (m_mask + 1))) {
+    return 0;
+  }
+  return rehash(capacity);
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline VALUE *OpenHashMap<KEY, VALUE, TRAITS>::find(const KEY &key) const {
+  if (0 == m_size) {
+    return 0;
+  }
+
+  size_t index = probe(key, TRAITS::hash(key));
+  if (TRAITS::isEmpty(m_slots[index].m_key)) {
+    return 0;
+  }
+  return &(m_slots[index].m_value);
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+int OpenHashMap<KEY, VALUE, TRAITS>::insert(const KEY &key,
+                                            const VALUE &value) {
+  // keep the load factor at or below 1/2
+  if ((0 == m_slots) || ((2 * (m_size + 1)) > (m_mask + 1))) {
+    if (0 != rehash((0 == m_slots) ? (MINIMUM_CAPACITY)
+                                   : (2 * (m_mask + 1)))) {
+      return -1;
+    }
+  }
+
+  uint32_t hash = TRAITS::hash(key);
+  size_t index = probe(key, hash);
+  m_slots[index].m_key = key;
+  m_slots[index].m_hash = hash;
+  m_slots[index].m_value = value;
+  m_size++;
+
+  return 0;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+bool OpenHashMap<KEY, VALUE, TRAITS>::erase(const KEY &key) {
+  if (0 == m_size) {
+    return false;
+  }
+
+  size_t hole = probe(key, TRAITS::hash(key));
+  if (TRAITS::isEmpty(m_slots[hole].m_key)) {
+    return false;
+  }
+
+  // backward-shift the rest of the cluster into the hole, so that no
+  // tombstone is left behind
+  size_t index = (hole + 1) & m_mask;
+  while (!TRAITS::isEmpty(m_slots[index].m_key)) {
+    size_t home = m_slots[index].m_hash & m_mask;
+    // move the entry if its home is not cyclically within (hole, index]
+    if (((index - home) & m_mask) >= ((index - hole) & m_mask)) {
+      m_slots[hole] = m_slots[index];
+      hole = index;
+    }
+    index = (index + 1) & m_mask;
+  }
+
+  m_slots[hole].m_key = TRAITS::empty();
+  m_size--;
+
+  return true;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+void OpenHashMap<KEY, VALUE, TRAITS>::clear(void) {
+  if (0 == m_slots) {
+    return;
+  }
+
+  for (size_t i = 0; i <= m_mask; i++) {
+    m_slots[i].m_key = TRAITS::empty();
+  }
+  m_size = 0;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline size_t OpenHashMap<KEY, VALUE, TRAITS>::size(void) const {
+  return m_size;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline bool OpenHashMap<KEY, VALUE, TRAITS>::empty(void) const {
+  return 0 == m_size;
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+inline size_t OpenHashMap<KEY, VALUE, TRAITS>::memoryUsage(void) const {
+  return (0 == m_slots) ? (0) : ((m_mask + 1) * sizeof(Slot));
+}
+
+template <typename KEY, typename VALUE, typename TRAITS>
+template <typename FUNCTION>
+void OpenHashMap<KEY, VALUE, TRAITS>::forEach(FUNCTION function) const {
+  if (0 == m_slots) {
+    return;
+  }
+
+  for (size_t i = 0; i <= m_mask; i++) {
+    if (!TRAITS::isEmpty(m_slots[i].m_key)) {
+      function(m_slots[i].m_key, m_slots[i].m_value);
+    }
+  }
+}
+
+#endif // DAEMONS_OPENHASHMAP_H_
@@ -0,0 +1,163 @@
+#include "OutboundQueue.h"
+
+#include <core/link/UnixSocketUtil.h>
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const size_t OutboundQueue::MIN_CAPACITY = OutboundQueue::recordSize(
+    ManagerProtocol::MAX_MESSAGE_SIZE, ManagerProtocol::MAX_FDS_PER_MESSAGE);
+
+OutboundQueue::~OutboundQueue(void) {
+  clear();
+  delete[] m_buffer;
+}
+
+int OutboundQueue::init(size_t capacity) {
+  if (MIN_CAPACITY > capacity) {
+    return -1;
+  }
+
+  // suitably aligned for Records, which are a multiple of their alignment
+  m_buffer = new (std::nothrow) char[capacity];
+  if (0 == m_buffer) {
+    return -1;
+  }
+  m_capacity = capacity & ~(alignof(Record) - 1);
+
+  return 0;
+}
+
+int OutboundQueue::send(int socketFd, Kind kind, const char *buffer,
+                        size_t size, const int *fds, size_t numFds) {
+  char control[CMSG_SPACE(sizeof(int) *
+                          ManagerProtocol::MAX_FDS_PER_MESSAGE)];
+  struct msghdr message;
+  struct cmsghdr *controlMessage;
+  struct iovec vector;
+
+  if (FD == kind) {
+    // the socket is non-blocking
+    return (1 == numFds) ? (UnixSocketUtil::sendFd(socketFd, fds[0]))
+                         : (-1);
+  }
+
+  if (ManagerProtocol::MAX_FDS_PER_MESSAGE < numFds) {
+    return -1;
+  }
+
+  vector.iov_base = const_cast<char *>(buffer);
+  vector.iov_len = size;
+
+  ::memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+
+  if (0 < numFds) {
+    ::memset(control, 0, sizeof(control));
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * numFds);
+
+    controlMessage = CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = SOL_SOCKET;
+    controlMessage->cmsg_type = SCM_RIGHTS;
+    controlMessage->cmsg_len = CMSG_LEN(sizeof(int) * numFds);
+    ::memcpy(CMSG_DATA(controlMessage), fds, sizeof(int) * numFds);
+  }
+
+  if (static_cast<ssize_t>(size) !=
+      ::sendmsg(socketFd, &message, MSG_NOSIGNAL | MSG_DONTWAIT)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int OutboundQueue::push(Kind kind, const char *buffer, size_t size,
+                        const int *fds, size_t numFds) {
+  const size_t bytes = recordSize(size, numFds);
+  Record *record;
+  size_t i;
+
+  if (ManagerProtocol::MAX_FDS_PER_MESSAGE < numFds) {
+    return -1;
+  }
+
+  if (m_capacity - m_tail < bytes) {
+    if (m_capacity - (m_tail - m_head) < bytes) {
+      // full
+      return -1;
+    }
+
+    // move what is queued to the front, making room at the back
+    ::memmove(m_buffer, m_buffer + m_head, m_tail - m_head);
+    m_tail -= m_head;
+    m_head = 0;
+  }
+
+  record = reinterpret_cast<Record *>(m_buffer + m_tail);
+  record->m_size = size;
+  record->m_numFds = numFds;
+  record->m_kind = kind;
+
+  for (i = 0; i < numFds; i++) {
+    fdsOf(record)[i] = ::fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+    if (0 > fdsOf(record)[i]) {
+      goto DUP_ERROR;
+    }
+  }
+  if (0 < size) {
+    ::memcpy(messageOf(record), buffer, size);
+  }
+  m_tail += bytes;
+
+  return 0;
+
+DUP_ERROR:
+  while (0 < i) {
+    ::close(fdsOf(record)[--i]);
+  }
+
+  return -1;
+}
+
+int OutboundQueue::flush(int socketFd) {
+  while (!empty()) {
+    Record *record = reinterpret_cast<Record *>(m_buffer + m_head);
+
+    if (0 != send(socketFd, static_cast<Kind>(record->m_kind),
+                  messageOf(record), record->m_size, fdsOf(record),
+                  record->m_numFds)) {
+      return ((EAGAIN == errno) || (EWOULDBLOCK == errno)) ? (1) : (-1);
+    }
+
+    for (uint16_t i = 0; i < record->m_numFds; i++) {
+      ::close(fdsOf(record)[i]);
+    }
+    m_head += recordSize(record->m_size, record->m_numFds);
+  }
+
+  m_head = 0;
+  m_tail = 0;
+
+  return 0;
+}
+
+void OutboundQueue::clear(void) {
+  while (!empty()) {
+    Record *record = reinterpret_cast<Record *>(m_buffer + m_head);
+
+    for (uint16_t i = 0; i < record->m_numFds; i++) {
+      ::close(fdsOf(record)[i]);
+    }
+    m_head += recordSize(record->m_size, record->m_numFds);
+  }
+
+  m_head = 0;
+  m_tail = 0;
+}
@@ -0,0 +1,188 @@
+#ifndef DAEMONS_OUTBOUNDQUEUE_H_
+#define DAEMONS_OUTBOUNDQUEUE_H_
+
+/***
+ * @file OutboundQueue.h
+ *
+ * @brief
+ * The messages the ShMemBCast Manager could not send to a client yet.
+ *
+ * @description
+ * The manager never blocks on a client's socket. A message that does
+ * not fit in the socket buffer is queued, along with the fds passed with
+ * it, and the queue is flushed in order once the socket is writable
+ * again. Later messages go to the back of the queue until it is empty,
+ * so that a client sees its messages in the order they were sent.
+ *
+ * The queue's memory is allocated once by init(), so queuing a message
+ * never allocates. Messages are stored back to back, and moved to the
+ * front when the back runs out of room. A full queue means the client
+ * stopped reading; what to do about it is up to the caller.
+ *
+ * Queued fds are duplicates, so that a board may be destroyed while its
+ * fd waits in the queue. They are closed once sent, or when the queue is
+ * cleared.
+ */
+
+#include "ManagerProtocol.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+class OutboundQueue {
+public:
+  /***
+   * How a message is sent
+   *
+   * @var MESSAGE One sendmsg(2), passing the fds with the message
+   * @var FD UnixSocketUtil::sendFd() of the only fd. The message is
+   * empty
+   */
+  enum Kind { MESSAGE, FD };
+
+  /***
+   * Room for the largest message, passing the most fds
+   */
+  static const size_t MIN_CAPACITY;
+
+private:
+  // not copyable
+  OutboundQueue(const OutboundQueue &);
+  OutboundQueue &operator=(const OutboundQueue &);
+
+  /***
+   * A queued message. It is followed by its fds, then by the message,
+   * padded to the alignment of the next Record.
+   *
+   * @var Record::m_size The message size
+   * @var Record::m_numFds The number of fds
+   * @var Record::m_kind A Kind
+   */
+  struct Record {
+    uint32_t m_size;
+    uint16_t m_numFds;
+    uint16_t m_kind;
+  };
+
+  /***
+   * @return the bytes a record takes in the queue
+   */
+  static size_t recordSize(size_t size, size_t numFds);
+
+  static int *fdsOf(Record *record);
+
+  static char *messageOf(Record *record);
+
+  char *m_buffer;
+  size_t m_capacity;
+  size_t m_head;
+  size_t m_tail;
+
+public:
+  OutboundQueue(void);
+
+  /***
+   * Closes the queued fds
+   */
+  ~OutboundQueue(void);
+
+  /***
+   * Allocates the queue
+   *
+   * @param capacity The bytes it holds, at least MIN_CAPACITY
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(size_t capacity);
+
+  bool empty(void) const;
+
+  /***
+   * @return the bytes in use
+   */
+  size_t size(void) const;
+
+  /***
+   * Sends a message right away, without blocking
+   *
+   * @param fds At most ManagerProtocol::MAX_FDS_PER_MESSAGE fds, exactly
+   * one for FD
+   *
+   * @return 0 on success, non-zero on error. errno is EAGAIN or
+   * EWOULDBLOCK if the socket buffer is full
+   */
+  static int send(int socketFd, Kind kind, const char *buffer, size_t size,
+                  const int *fds, size_t numFds);
+
+  /***
+   * Queues a message, duplicating its fds
+   *
+   * @return 0 on success, non-zero if the queue is full or the fds could
+   * not be duplicated
+   */
+  int push(Kind kind, const char *buffer, size_t size, const int *fds,
+           size_t numFds);
+
+  /***
+   * Finds the first queued MESSAGE a predicate holds for, so that it can
+   * be updated in place
+   *
+   * @param match Called as match(const char *message, size_t size)
+   *
+   * @return the message, or 0 if there is none
+   */
+  template <typename Match> char *find(Match match);
+
+  /***
+   * Sends queued messages until the queue is empty or the socket buffer
+   * is full
+   *
+   * @return 0 if the queue is empty, 1 if messages are left, -1 on error
+   */
+  int flush(int socketFd);
+
+  /***
+   * Drops every queued message
+   */
+  void clear(void);
+};
+
+// inline and template functions
+inline OutboundQueue::OutboundQueue(void)
+    : m_buffer(0), m_capacity(0), m_head(0), m_tail(0) {}
+
+inline size_t OutboundQueue::recordSize(size_t size, size_t numFds) {
+  const size_t bytes = sizeof(Record) + (numFds * sizeof(int)) + size;
+  return (bytes + alignof(Record) - 1) & ~(alignof(Record) - 1);
+}
+
+inline int *OutboundQueue::fdsOf(Record *record) {
+  return reinterpret_cast<int *>(record + 1);
+}
+
+inline char *OutboundQueue::messageOf(Record *record) {
+  return reinterpret_cast<char *>(fdsOf(record) + record->m_numFds);
+}
+
+inline bool OutboundQueue::empty(void) const { return m_head == m_tail; }
+
+inline size_t OutboundQueue::size(void) const { return m_tail - m_head; }
+
+template <typename Match> char *OutboundQueue::find(Match match) {
+  size_t offset = m_head;
+
+  while (offset < m_tail) {
+    Record *record = reinterpret_cast<Record *>(m_buffer + offset);
+    if ((MESSAGE == record->m_kind) &&
+        match(static_cast<const char *>(messageOf(record)),
+              static_cast<size_t>(record->m_size))) {
+      return messageOf(record);
+    }
+
+    offset += recordSize(record->m_size, record->m_numFds);
+  }
+
+  return 0;
+}
+
+#endif // DAEMONS_OUTBOUNDQUEUE_H_
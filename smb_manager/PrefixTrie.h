@@ -0,0 +1,443 @@
+#ifndef DAEMONS_PREFIXTRIE_H_
+#define DAEMONS_PREFIXTRIE_H_
+
+/***
+ * @file PrefixTrie.h
+ *
+ * @brief
+ * A radix trie of NUL-terminated string keys, used by the manager to
+ * match channel names against pattern subscriptions.
+ *
+ * @description
+ * Each node holds the values stored under the key spelled by the path
+ * to it. Edges are labelled with whole strings and chains of nodes
+ * without values are merged, so the trie holds at most two nodes per
+ * key. Children are kept sorted by the first character of their label.
+ *
+ * Both directions of prefix matching cost a walk down one path:
+ * - forEachPrefixOf() visits the values stored under every prefix of a
+ *   key, e.g. the patterns matching a new channel
+ * - forEachWithPrefix() visits the values stored under every key that
+ *   starts with a prefix, e.g. the channels matching a new pattern
+ *
+ * forEachFrom() visits the values in key order from a given key on, and
+ * may stop at any point, so that a long walk can be split up and resumed
+ * from the last key it visited.
+ *
+ * A key may hold several values. Errors are reported through return
+ * values; the trie never throws. The callbacks must not modify the
+ * trie.
+ */
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <string.h>
+
+template <typename VALUE> class PrefixTrie {
+private:
+  // not copyable
+  PrefixTrie(const PrefixTrie &);
+  PrefixTrie &operator=(const PrefixTrie &);
+
+  /***
+   * @var Node::m_label The edge from the parent. Empty for the root only
+   * @var Node::m_children Sorted by the first character of m_label
+   * @var Node::m_values The values stored under this node's key
+   */
+  struct Node {
+    std::string m_label;
+    std::vector<Node *> m_children;
+    std::vector<VALUE> m_values;
+
+    ~Node(void);
+  };
+
+  /***
+   * @return the position of the child whose label starts with c, or
+   * where it would go
+   */
+  static size_t childIndex(const Node *node, char c);
+
+  /***
+   * @return the child whose label starts with c, or 0
+   */
+  static Node *child(const Node *node, char c);
+
+  /***
+   * @return the length of the common prefix of label and key
+   */
+  static size_t commonLength(const std::string &label, const char *key);
+
+  /***
+   * Visits the values of a subtree
+   */
+  template <typename FUNCTION>
+  static void forEachIn(const Node *node, FUNCTION &function);
+
+  /***
+   * Visits the values of a subtree in key order, from a key on
+   *
+   * @param rest What is left of the key below node, 0 if every key of
+   * the subtree comes after it
+   *
+   * @return false once function did
+   */
+  template <typename FUNCTION>
+  static bool forEachFromIn(const Node *node, const char *rest,
+                            bool skipKey, FUNCTION &function);
+
+  /***
+   * Removes a value from the subtree of node. Allocates nothing, so that
+   * it cannot fail half way
+   *
+   * @param rest What is left of the key below node
+   *
+   * @return whether the value was found
+   */
+  static bool eraseIn(Node *node, const char *rest, const VALUE &value);
+
+  /***
+   * Removes a child left without values, or merges it into its only
+   * child
+   *
+   * @param index The position of the child in parent
+   */
+  static void prune(Node *parent, size_t index);
+
+  Node m_root;
+  size_t m_size;
+
+public:
+  PrefixTrie(void);
+
+  /***
+   * Stores a value under a key. The key is copied
+   *
+   * @return 0 on success, non-zero on allocation failure
+   */
+  int insert(const char *key, const VALUE &value);
+
+  /***
+   * Removes one value stored under a key
+   *
+   * @return 0 on success, non-zero if the key does not hold the value
+   */
+  int erase(const char *key, const VALUE &value);
+
+  /***
+   * Calls function(value) for every value stored under a prefix of key,
+   * key itself and the empty prefix included, shortest prefix first
+   */
+  template <typename FUNCTION>
+  void forEachPrefixOf(const char *key, FUNCTION function) const;
+
+  /***
+   * Calls function(value) for every value stored under a key starting
+   * with prefix
+   */
+  template <typename FUNCTION>
+  void forEachWithPrefix(const char *prefix, FUNCTION function) const;
+
+  /***
+   * Calls function(value) for every value stored under key or a key
+   * after it, in key order, for as long as function returns true.
+   * Children are ordered by the char value of their first character, so
+   * the order is that of char comparisons.
+   *
+   * @param skipKey Start after key rather than at it
+   */
+  template <typename FUNCTION>
+  void forEachFrom(const char *key, bool skipKey, FUNCTION function) const;
+
+  /***
+   * @return the number of values stored
+   */
+  size_t size(void) const;
+};
+
+// inline and template functions
+template <typename VALUE> inline PrefixTrie<VALUE>::Node::~Node(void) {
+  for (size_t i = 0; i < m_children.size(); i++) {
+    delete m_children[i];
+  }
+}
+
+template <typename VALUE>
+inline PrefixTrie<VALUE>::PrefixTrie(void) : m_root(), m_size(0) {}
+
+template <typename VALUE>
+inline size_t PrefixTrie<VALUE>::childIndex(const Node *node, char c) {
+  return std::lower_bound(node->m_children.begin(), node->m_children.end(),
+                          c,
+                          [](const Node *child, char first) {
+                            return child->m_label[0] < first;
+                          }) -
+         node->m_children.begin();
+}
+
+template <typename VALUE>
+inline typename PrefixTrie<VALUE>::Node *
+PrefixTrie<VALUE>::child(const Node *node, char c) {
+  size_t index = childIndex(node, c);
+  return ((node->m_children.size() > index) &&
+          (c == node->m_children[index]->m_label[0]))
+             ? (node->m_children[index])
+             : (0);
+}
+
+template <typename VALUE>
+inline size_t PrefixTrie<VALUE>::commonLength(const std::string &label,
+                                              const char *key) {
+  size_t length = 0;
+  while ((label.size() > length) && (label[length] == key[length])) {
+    length++;
+  }
+
+  return length;
+}
+
+template <typename VALUE> int PrefixTrie<VALUE>::insert(const char *key,
+                                                        const VALUE &value) {
+  Node *node = &m_root;
+  const char *rest = key;
+
+  try {
+    while ('\0' != *rest) {
+      Node *next = child(node, *rest);
+
+      if (0 == next) {
+        // (1) nothing shares the first character, add a leaf
+        Node *leaf = new Node();
+        try {
+          leaf->m_label = rest;
+          node->m_children.insert(node->m_children.begin() +
+                                      childIndex(node, *rest),
+                                  leaf);
+        } catch (std::bad_alloc &) {
+          delete leaf;
+          throw;
+        }
+        node = leaf;
+        break;
+      }
+
+      size_t common = commonLength(next->m_label, rest);
+      if (next->m_label.size() > common) {
+        // (2) the key leaves the edge half way, split it
+        Node *middle = new Node();
+        try {
+          middle->m_label = next->m_label.substr(0, common);
+          middle->m_children.push_back(next);
+        } catch (std::bad_alloc &) {
+          middle->m_children.clear();
+          delete middle;
+          throw;
+        }
+        node->m_children[childIndex(node, *rest)] = middle;
+        next->m_label.erase(0, common);
+        next = middle;
+      }
+
+      node = next;
+      rest += common;
+    }
+
+    node->m_values.push_back(value);
+  } catch (std::bad_alloc &) {
+    // any node added is either a split, which is still a valid trie, or
+    // a leaf without values, which no lookup reports
+    return -1;
+  }
+
+  m_size++;
+  return 0;
+}
+
+template <typename VALUE> int PrefixTrie<VALUE>::erase(const char *key,
+                                                       const VALUE &value) {
+  if (!eraseIn(&m_root, key, value)) {
+    return -1;
+  }
+
+  m_size--;
+  return 0;
+}
+
+template <typename VALUE>
+bool PrefixTrie<VALUE>::eraseIn(Node *node, const char *rest,
+                                const VALUE &value) {
+  if ('\0' == *rest) {
+    typename std::vector<VALUE>::iterator found =
+        std::find(node->m_values.begin(), node->m_values.end(), value);
+    if (node->m_values.end() == found) {
+      return false;
+    }
+
+    node->m_values.erase(found);
+    return true;
+  }
+
+  size_t index = childIndex(node, *rest);
+  if ((node->m_children.size() <= index) ||
+      (*rest != node->m_children[index]->m_label[0])) {
+    return false;
+  }
+
+  Node *next = node->m_children[index];
+  if ((0 != ::strncmp(next->m_label.c_str(), rest, next->m_label.size())) ||
+      !eraseIn(next, rest + next->m_label.size(), value)) {
+    return false;
+  }
+
+  prune(node, index);
+  return true;
+}
+
+template <typename VALUE>
+void PrefixTrie<VALUE>::prune(Node *parent, size_t index) {
+  Node *node = parent->m_children[index];
+
+  if (!node->m_values.empty() || (1 < node->m_children.size())) {
+    return;
+  }
+
+  if (node->m_children.empty()) {
+    // a leaf without values
+    parent->m_children.erase(parent->m_children.begin() + index);
+    delete node;
+    return;
+  }
+
+  // a node without values and a single child, merge them
+  Node *only = node->m_children[0];
+  try {
+    only->m_label.insert(0, node->m_label);
+  } catch (std::bad_alloc &) {
+    // leave it unmerged, lookups work all the same
+    return;
+  }
+  parent->m_children[index] = only;
+  node->m_children.clear();
+  delete node;
+}
+
+template <typename VALUE>
+template <typename FUNCTION>
+void PrefixTrie<VALUE>::forEachPrefixOf(const char *key,
+                                        FUNCTION function) const {
+  const Node *node = &m_root;
+  const char *rest = key;
+
+  for (;;) {
+    for (size_t i = 0; i < node->m_values.size(); i++) {
+      function(node->m_values[i]);
+    }
+
+    if ('\0' == *rest) {
+      return;
+    }
+
+    node = child(node, *rest);
+    if ((0 == node) ||
+        (0 != ::strncmp(node->m_label.c_str(), rest, node->m_label.size()))) {
+      return;
+    }
+    rest += node->m_label.size();
+  }
+}
+
+template <typename VALUE>
+template <typename FUNCTION>
+void PrefixTrie<VALUE>::forEachWithPrefix(const char *prefix,
+                                          FUNCTION function) const {
+  const Node *node = &m_root;
+  const char *rest = prefix;
+
+  while ('\0' != *rest) {
+    node = child(node, *rest);
+    if (0 == node) {
+      return;
+    }
+
+    size_t common = commonLength(node->m_label, rest);
+    if ('\0' == rest[common]) {
+      // the prefix ends on this edge, everything below matches
+      break;
+    }
+    if (node->m_label.size() > common) {
+      return;
+    }
+    rest += common;
+  }
+
+  forEachIn(node, function);
+}
+
+template <typename VALUE>
+template <typename FUNCTION>
+void PrefixTrie<VALUE>::forEachIn(const Node *node, FUNCTION &function) {
+  for (size_t i = 0; i < node->m_values.size(); i++) {
+    function(node->m_values[i]);
+  }
+
+  // the depth is bounded by the key length
+  for (size_t i = 0; i < node->m_children.size(); i++) {
+    forEachIn(node->m_children[i], function);
+  }
+}
+
+template <typename VALUE>
+template <typename FUNCTION>
+void PrefixTrie<VALUE>::forEachFrom(const char *key, bool skipKey,
+                                    FUNCTION function) const {
+  forEachFromIn(&m_root, key, skipKey, function);
+}
+
+template <typename VALUE>
+template <typename FUNCTION>
+bool PrefixTrie<VALUE>::forEachFromIn(const Node *node, const char *rest,
+                                      bool skipKey, FUNCTION &function) {
+  // shorter keys come first, so the node's own key is only visited if it
+  // is the key itself, or past it
+  if ((0 == rest) || (('\0' == *rest) && !skipKey)) {
+    for (size_t i = 0; i < node->m_values.size(); i++) {
+      if (!function(node->m_values[i])) {
+        return false;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < node->m_children.size(); i++) {
+    const Node *next = node->m_children[i];
+    const char *nextRest = 0;
+
+    if ((0 != rest) && ('\0' != *rest)) {
+      size_t common = commonLength(next->m_label, rest);
+      if (next->m_label.size() == common) {
+        // the key goes on below this child
+        nextRest = rest + common;
+      } else if (('\0' != rest[common]) &&
+                 (next->m_label[common] < rest[common])) {
+        // the whole subtree comes before the key
+        continue;
+      }
+    }
+
+    // the depth is bounded by the key length
+    if (!forEachFromIn(next, nextRest, skipKey, function)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename VALUE> inline size_t PrefixTrie<VALUE>::size(void) const {
+  return m_size;
+}
+
+#endif // DAEMONS_PREFIXTRIE_H_
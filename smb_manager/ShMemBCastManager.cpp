@@ -1,4 +1,6 @@
 #include "ShMemBCastManager.h"
+#include "EpollDispatcher.h"
+#include "HandoverProtocol.h"
 
 #include <core/dispatcher/DispatcherBase.h>
 #include <core/dispatcher/SelectDispatcher.h>
@@ -7,29 +9,98 @@
 
 #include <core/link/UnixSocketUtil.h>
 
-#include <list>
+#include <algorithm>
+#include <new>
+#include <sstream>
+#include <vector>
 
+#include <fcntl.h>
 #include <pwd.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+const struct timeval ShMemBCastManager::Client::TIMEOUT = {1 * 60, 0};
+
 namespace {
-// Documented, but not implemented in glibc yet
-mode_t _getumask(void) {
-  mode_t mask = umask(0);
-  umask(mask);
-  return mask;
+/***
+ * @return the rate of a counter going from 'before' to 'after' in
+ * 'nanos' nanoseconds, per second. 0 if it went backwards
+ */
+uint64_t perSecond(uint64_t before, uint64_t after, uint64_t nanos) {
+  if ((0 == nanos) || (before > after)) {
+    return 0;
+  }
+
+  return static_cast<uint64_t>((after - before) * 1e9 / nanos);
+}
+
+uint64_t nanosOf(const struct timespec &time) {
+  return (time.tv_sec * 1000000000ULL) + time.tv_nsec;
 }
 } // namespace
 
-const struct timeval ShMemBCastManager::Client::TIMEOUT = {1 * 60, 0};
+ShMemBCastManager::Timer::~Timer(void) {
+  if (0 <= m_fd) {
+    ::close(m_fd);
+  }
+}
+
+int ShMemBCastManager::Timer::init(uint64_t milliseconds, bool periodic) {
+  struct itimerspec expiry;
+
+  m_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (0 > m_fd) {
+    return -1;
+  }
+
+  expiry.it_value.tv_sec = milliseconds / 1000;
+  expiry.it_value.tv_nsec = (milliseconds % 1000) * 1000000;
+  if (periodic) {
+    expiry.it_interval = expiry.it_value;
+  } else {
+    expiry.it_interval.tv_sec = 0;
+    expiry.it_interval.tv_nsec = 0;
+  }
+
+  if (0 != ::timerfd_settime(m_fd, 0, &expiry, 0)) {
+    ::close(m_fd);
+    m_fd = -1;
+    return -1;
+  }
+  m_periodic = periodic;
+
+  return 0;
+}
+
+int ShMemBCastManager::Timer::onRead(void) {
+  uint64_t expirations;
+  if (static_cast<ssize_t>(sizeof(expirations)) !=
+      ::read(m_fd, &expirations, sizeof(expirations))) {
+    // not expired yet
+    return 0;
+  }
+
+  (m_manager->*m_callback)();
+
+  return m_periodic ? (0) : (TTECH_DELETE_CHAN);
+}
+
+int ShMemBCastManager::Client::init(size_t queueSize) {
+  const int flags = ::fcntl(m_link.fileDescriptor(), F_GETFL);
 
-const char *const ShMemBCastManager::LOG_TIME_FORMAT = "%F %T";
-const char *const ShMemBCastManager::LOG_TIME_ERROR = "UNKNOWN TIME";
+  // replies and events wait in the queue rather than block the manager
+  if ((0 > flags) ||
+      (0 != ::fcntl(m_link.fileDescriptor(), F_SETFL, flags | O_NONBLOCK))) {
+    return -1;
+  }
+
+  return m_output.init(queueSize);
+}
 
 int ShMemBCastManager::Client::sendApprovalDenialMessage(bool approval) {
   if (approval) {
@@ -42,7 +113,7 @@ int ShMemBCastManager::Client::sendApprovalDenialMessage(bool approval) {
     }
 
     // send
-    if (size != m_link.write(buffer, size)) {
+    if (0 != sendBuffer(buffer, size)) {
       return -1;
     }
   } else {
@@ -55,7 +126,7 @@ int ShMemBCastManager::Client::sendApprovalDenialMessage(bool approval) {
     }
 
     // send
-    if (size != m_link.write(buffer, size)) {
+    if (0 != sendBuffer(buffer, size)) {
       return -1;
     }
   }
@@ -107,18 +178,10 @@ int ShMemBCastManager::Client::handleMessage(
     goto SUBSCRIBE_ERROR;
   }
 
-  // add subscription to list
-  Subscription subscription;
-  subscription.m_channelName = channel->m_name;
-  subscription.m_writer = true;
-
-  try {
-    m_subscriptions.push_back(subscription);
-  } catch (const std::bad_alloc &exception) {
+  // add subscription to map
+  if (0 != addSubscription(channel, true)) {
     // log this event
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream)) << "Could not add new subscription to "
-                                << "subscription list" << std::endl;
+    m_manager->m_log.logEvent(ManagerLog::SUBSCRIPTION_LIST_ERROR, m_pid);
     goto PUSH_BACK_ERROR;
   }
 
@@ -128,15 +191,13 @@ int ShMemBCastManager::Client::handleMessage(
   }
 
   // send file descriptor
-  if (0 != UnixSocketUtil::sendFd(m_link.fileDescriptor(), channel->m_fd)) {
+  if (0 != sendBoardFd(channel->m_board.m_fd)) {
     goto SEND_FD_ERROR;
   }
 
   // log the subscription
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " successfully subscribed to channel \""
-      << request->m_channelName << "\" as a writer" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBED, m_pid,
+                                   request->m_channelName, true);
 
   return 0;
 
@@ -157,10 +218,8 @@ SUBSCRIBE_ERROR:
   }
 
   // log the subscription attempt
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " failed to subscribe to channel \""
-      << request->m_channelName << "\" as a writer" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBE_FAILED, m_pid,
+                                   request->m_channelName, true);
 
   return retVal;
 }
@@ -184,18 +243,10 @@ int ShMemBCastManager::Client::handleMessage(
     goto SUBSCRIBE_ERROR;
   }
 
-  // add subscription to list
-  Subscription subscription;
-  subscription.m_channelName = channel->m_name;
-  subscription.m_writer = false;
-
-  try {
-    m_subscriptions.push_back(subscription);
-  } catch (const std::bad_alloc &exception) {
+  // add subscription to map
+  if (0 != addSubscription(channel, false)) {
     // log this event
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream)) << "Could not add new subscription to "
-                                << "subscription list" << std::endl;
+    m_manager->m_log.logEvent(ManagerLog::SUBSCRIPTION_LIST_ERROR, m_pid);
     goto PUSH_BACK_ERROR;
   }
 
@@ -205,15 +256,13 @@ int ShMemBCastManager::Client::handleMessage(
   }
 
   // send file descriptor
-  if (0 != UnixSocketUtil::sendFd(m_link.fileDescriptor(), channel->m_fd)) {
+  if (0 != sendBoardFd(channel->m_board.m_fd)) {
     goto SEND_FD_ERROR;
   }
 
   // log the subscription attempt
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " successfully subscribed to channel \""
-      << request->m_channelName << "\" as a reader" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBED, m_pid,
+                                   request->m_channelName, false);
 
   return 0;
 
@@ -234,10 +283,8 @@ SUBSCRIBE_ERROR:
   }
 
   // log the subscription attempt
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " failed to subscribe to channel \""
-      << request->m_channelName << "\" as a reader" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBE_FAILED, m_pid,
+                                   request->m_channelName, false);
 
   return retVal;
 }
@@ -246,7 +293,7 @@ int ShMemBCastManager::Client::handleMessage(
     Protocol::WriterUnsubscribeRequest *request) {
   // variables
   size_t channelNameLength;
-  std::list<Subscription>::iterator iter;
+  Channel *channel;
   int retVal = 0;
 
   // nul-terminate the request
@@ -254,27 +301,20 @@ int ShMemBCastManager::Client::handleMessage(
       Protocol::WriterUnsubscribeRequest::channelNameLength(*request);
   request->m_channelName[channelNameLength] = '\0';
 
-  // find the subscription from list
-  for (iter = m_subscriptions.begin(); iter != m_subscriptions.end(); iter++) {
-    if (((*iter).m_writer) &&
-        (0 == ::strcmp((*iter).m_channelName, request->m_channelName))) {
-      // found!
-      break;
-    }
-  }
-
-  if (iter == m_subscriptions.end()) {
+  // find the subscription
+  channel = findSubscription(request->m_channelName, true);
+  if (0 == channel) {
     // could not find the subscription
     goto NO_SUCH_SUBSCRIPTION_ERROR;
   }
 
   // attempt to remove Subscriber
-  if (0 != m_manager->unsubscribe(this, request->m_channelName, true)) {
+  if (0 != m_manager->unsubscribe(this, channel, true)) {
     goto UNSUBSCRIBE_ERROR;
   }
 
   // remove the subscription
-  m_subscriptions.erase(iter);
+  removeSubscription(channel, true);
 
   // send approval
   if (0 != sendApprovalDenialMessage(true)) {
@@ -282,10 +322,8 @@ int ShMemBCastManager::Client::handleMessage(
   }
 
   // log event
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " successfully unsubscribed from channel \""
-      << request->m_channelName << "\" as a writer" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::UNSUBSCRIBED, m_pid,
+                                   request->m_channelName, true);
 
   return 0;
 
@@ -299,10 +337,8 @@ UNSUBSCRIBE_ERROR:
 
 NO_SUCH_SUBSCRIPTION_ERROR:
   // log unsubscription attempt
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " failed to unsubscribe from channel \""
-      << request->m_channelName << "\" as a writer" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::UNSUBSCRIBE_FAILED, m_pid,
+                                   request->m_channelName, true);
 
   return retVal;
 }
@@ -311,7 +347,7 @@ int ShMemBCastManager::Client::handleMessage(
     Protocol::ReaderUnsubscribeRequest *request) {
   // variables
   size_t channelNameLength;
-  std::list<Subscription>::iterator iter;
+  Channel *channel;
   int retVal = 0;
 
   // nul-terminate the request
@@ -319,27 +355,20 @@ int ShMemBCastManager::Client::handleMessage(
       Protocol::ReaderUnsubscribeRequest::channelNameLength(*request);
   request->m_channelName[channelNameLength] = '\0';
 
-  // find the subscription in the list
-  for (iter = m_subscriptions.begin(); iter != m_subscriptions.end(); iter++) {
-    if ((!(*iter).m_writer) &&
-        (0 == ::strcmp((*iter).m_channelName, request->m_channelName))) {
-      // found!
-      break;
-    }
-  }
-
-  if (iter == m_subscriptions.end()) {
+  // find the subscription
+  channel = findSubscription(request->m_channelName, false);
+  if (0 == channel) {
     // subscription not found
     goto NO_SUCH_SUBSCRIPTION_ERROR;
   }
 
   // attempt to remove Subscriber
-  if (0 != m_manager->unsubscribe(this, request->m_channelName, false)) {
+  if (0 != m_manager->unsubscribe(this, channel, false)) {
     goto UNSUBSCRIBE_ERROR;
   }
 
   // remove subscription
-  m_subscriptions.erase(iter);
+  removeSubscription(channel, false);
 
   // send approval
   if (0 != sendApprovalDenialMessage(true)) {
@@ -347,10 +376,8 @@ int ShMemBCastManager::Client::handleMessage(
   }
 
   // log event
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " successfully unsubscribed from channel \""
-      << request->m_channelName << "\" as a reader" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::UNSUBSCRIBED, m_pid,
+                                   request->m_channelName, false);
 
   return 0;
 
@@ -364,503 +391,2210 @@ UNSUBSCRIBE_ERROR:
 
 NO_SUCH_SUBSCRIPTION_ERROR:
   // log event
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " failed to unsubscribe from channel \""
-      << request->m_channelName << "\" as a reader" << std::endl;
+  m_manager->m_log.logSubscription(ManagerLog::UNSUBSCRIBE_FAILED, m_pid,
+                                   request->m_channelName, false);
 
   return retVal;
 }
 
-void ShMemBCastManager::Client::sendChannelSubscriptionEvent(
-    uint16_t numReaders, const char *channel) {
-  // variables
-  const size_t maxMessageSize = Protocol::Constants::MAX_MESSAGE_SIZE;
-  char *buffer;
-  ssize_t size;
-
-  if (!m_eventMode) {
-    // not an event mode client
-    return;
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::PlacementHint *request) {
+  if ((NumaUtil::NO_NODE != request->m_numaNode) &&
+      ((0 > request->m_numaNode) ||
+       (NumaUtil::numNodes() <= request->m_numaNode))) {
+    // no such node
+    return sendApprovalDenialMessage(false);
   }
 
-  buffer = new (std::nothrow) char[maxMessageSize];
-  if (0 == buffer) {
-    goto BUFFER_ALLOCATE_ERROR;
-  }
+  m_numaHint = request->m_numaNode;
 
-  size = Protocol::ChannelSubscriptionEvent::init(buffer, maxMessageSize,
-                                                  numReaders, channel);
-  if (0 > size) {
-    goto MESSAGE_INIT_ERROR;
-  }
+  return sendApprovalDenialMessage(true);
+}
 
-  if (size != m_link.write(buffer, size)) {
-    goto WRITE_ERROR;
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::BatchSubscribe *request) {
+  // variables
+  const bool writer = (0 != (request->m_flags & ManagerProtocol::WRITER_FLAG));
+  const char *end = reinterpret_cast<const char *>(request) +
+                    request->m_header.m_size;
+  const char *channelName = request->m_channelNames;
+  const uint16_t count = request->m_count;
+  uint16_t numFds = 0;
+
+  if (!validChannelNames(channelName, count, end) ||
+      (0 != allocateBatchScratch())) {
+    return sendApprovalDenialMessage(false);
   }
 
-  delete[] buffer;
-  return;
+  for (uint16_t i = 0; i < count; i++) {
+    Channel *channel = m_manager->subscribe(this, channelName, writer,
+                                            request->m_requestedSize);
 
-WRITE_ERROR:
-  // not a fatal error, as it is just an event
-MESSAGE_INIT_ERROR:
-  delete[] buffer;
+    if ((0 != channel) && (0 != addSubscription(channel, writer))) {
+      m_manager->m_log.logEvent(ManagerLog::SUBSCRIPTION_LIST_ERROR, m_pid);
+      m_manager->unsubscribe(this, channel, writer);
+      channel = 0;
+    }
 
-BUFFER_ALLOCATE_ERROR:
-  return;
-}
+    m_batchApproved[i] = (0 != channel);
+    if (0 != channel) {
+      m_batchFds[numFds++] = channel->m_board.m_fd;
+    }
 
-int ShMemBCastManager::Client::onRead(void) {
-  ssize_t bytesRead;
-  char buffer[Protocol::Constants::MAX_MESSAGE_SIZE];
-  Protocol::Header *header;
-  int retVal;
+    m_manager->m_log.logSubscription((0 != channel)
+                                         ? (ManagerLog::SUBSCRIBED)
+                                         : (ManagerLog::SUBSCRIBE_FAILED),
+                                     m_pid, channelName, writer);
 
-  // read requestn
-  bytesRead = m_link.read(buffer, Protocol::Constants::MAX_MESSAGE_SIZE);
-  if (static_cast<ssize_t>(sizeof(Protocol::Header)) > bytesRead) {
-    // Must have at least a header...
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream))
-      << "Process " << m_pid << " read error" << std::endl;
-    goto READ_ERROR;
+    channelName += ::strlen(channelName) + 1;
   }
 
-  // verify protocol version
-  header = reinterpret_cast<Protocol::Header *>(buffer);
-  if (Protocol::VERSION != header->m_version) {
-    // unsupported version
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream))
-      << "Process " << m_pid << " version error" << std::endl;
-    goto VERSION_ERROR;
-  }
+  // on error the subscriptions are undone as the client is disconnected
+  return sendBatchReply(count, numFds);
+}
 
-  // verify request size matches up
-  if (static_cast<ssize_t>(header->m_size) != bytesRead) {
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream))
-      << "Process " << m_pid << " msg size error" << std::endl;
-    goto MESSAGE_SIZE_ERROR;
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::BatchUnsubscribe *request) {
+  // variables
+  const bool writer = (0 != (request->m_flags & ManagerProtocol::WRITER_FLAG));
+  const char *end = reinterpret_cast<const char *>(request) +
+                    request->m_header.m_size;
+  const char *channelName = request->m_channelNames;
+  const uint16_t count = request->m_count;
+
+  if (!validChannelNames(channelName, count, end) ||
+      (0 != allocateBatchScratch())) {
+    return sendApprovalDenialMessage(false);
   }
 
-  // work based on request type. Result in a channel data
-  switch (header->m_messageType) {
-  case Protocol::EVENT_MODE_REQUEST: {
-    retVal =
-        handleMessage(reinterpret_cast<Protocol::EventModeRequest *>(buffer));
-  } break;
+  for (uint16_t i = 0; i < count; i++) {
+    Channel *channel = findSubscription(channelName, writer);
 
-  case Protocol::NO_EVENT_MODE_REQUEST: {
-    retVal =
-        handleMessage(reinterpret_cast<Protocol::NoEventModeRequest *>(buffer));
-  } break;
+    // the channel may be destroyed, only its address is used afterwards
+    m_batchApproved[i] = (0 != channel) &&
+                         (0 == m_manager->unsubscribe(this, channel, writer));
+    if (m_batchApproved[i]) {
+      removeSubscription(channel, writer);
+    }
 
-  case Protocol::WRITER_SUBSCRIBE_REQUEST: {
-    retVal = handleMessage(
-        reinterpret_cast<Protocol::WriterSubscribeRequest *>(buffer));
-  } break;
+    m_manager->m_log.logSubscription(m_batchApproved[i]
+                                         ? (ManagerLog::UNSUBSCRIBED)
+                                         : (ManagerLog::UNSUBSCRIBE_FAILED),
+                                     m_pid, channelName, writer);
 
-  case Protocol::READER_SUBSCRIBE_REQUEST: {
-    retVal = handleMessage(
-        reinterpret_cast<Protocol::ReaderSubscribeRequest *>(buffer));
-  } break;
+    channelName += ::strlen(channelName) + 1;
+  }
 
-  case Protocol::WRITER_UNSUBSCRIBE_REQUEST: {
-    retVal = handleMessage(
-        reinterpret_cast<Protocol::WriterUnsubscribeRequest *>(buffer));
-  } break;
+  return sendBatchReply(count, 0);
+}
 
-  case Protocol::READER_UNSUBSCRIBE_REQUEST: {
-    retVal = handleMessage(
-        reinterpret_cast<Protocol::ReaderUnsubscribeRequest *>(buffer));
-  } break;
+bool ShMemBCastManager::Client::validChannelNames(const char *channelNames,
+                                                  size_t count,
+                                                  const char *end) {
+  const char *channelName = channelNames;
 
-  default: {
-    (*(m_manager->m_logStream))
-      << "Process " << m_pid << " unsupported msg" << std::endl;
-    goto UNSUPPORTED_MESSAGE_ERROR;
-  }
+  for (size_t i = 0; (i < count) && (0 != channelName); i++) {
+    channelName = ManagerProtocol::nextChannelName(channelName, end);
   }
 
-  if (0 == retVal) {
+  return (0 != channelName);
+}
+
+int ShMemBCastManager::Client::allocateBatchScratch(void) {
+  if (!m_batchApproved.empty()) {
     return 0;
-  } else {
-    disconnect();
-    return TTECH_DELETE_CHAN;
   }
 
-UNSUPPORTED_MESSAGE_ERROR:
-MESSAGE_SIZE_ERROR:
-VERSION_ERROR:
-READ_ERROR:
-  disconnect();
-  return TTECH_DELETE_CHAN;
-}
+  try {
+    m_batchApproved.resize(ManagerProtocol::MAX_BATCH_COUNT);
+    m_batchFds.resize(ManagerProtocol::MAX_BATCH_COUNT);
+    m_batchReply.resize(ManagerProtocol::MAX_MESSAGE_SIZE);
+  } catch (std::bad_alloc &) {
+    m_batchApproved.clear();
+    m_batchFds.clear();
+    m_batchReply.clear();
+    return -1;
+  }
 
-void ShMemBCastManager::Client::disconnect(void) {
-  m_manager->printLogPrefix();
-  (*(m_manager->m_logStream))
-      << "Process " << m_pid << " disconnected" << std::endl;
+  return 0;
+}
 
-  for (std::list<Subscription>::iterator iter = m_subscriptions.begin();
-       iter != m_subscriptions.end(); iter++) {
-    // log and unsubscribe
-    m_manager->printLogPrefix();
-    (*(m_manager->m_logStream))
-        << "Process " << m_pid << " considered unsubscribed from channel \""
-        << (*iter).m_channelName << "\" as a "
-        << (((*iter).m_writer) ? ("writer") : ("reader")) << std::endl;
+int ShMemBCastManager::Client::sendBatchReply(uint16_t count,
+                                              uint16_t numFds) {
+  // variables
+  const int *fds = &m_batchFds[0];
+  char fdsBuffer[sizeof(ManagerProtocol::BatchFds)];
+  ssize_t size;
 
-    m_manager->unsubscribe(this, (*iter).m_channelName, (*iter).m_writer);
+  size = ManagerProtocol::BatchReply::init(&m_batchReply[0],
+                                           m_batchReply.size(),
+                                           &m_batchApproved[0], count, numFds);
+  if ((0 > size) || (0 != sendBuffer(&m_batchReply[0], size))) {
+    return -1;
   }
-  m_subscriptions.clear();
 
-  m_link.close();
-}
-
-ShMemBCastManager::Channel *
-ShMemBCastManager::subscribe(Client *client, const char *channelName,
-                             bool writer, uint32_t requestedSize) {
-  // search for existing channel
-  for (std::list<Channel>::iterator iter = m_channels.begin();
-       iter != m_channels.end(); iter++) {
-    if (0 == ::strcmp(channelName, (*iter).m_name)) {
-      // found an existing channel
-      if (writer) {
-        // add a writer
-        if (0 != (*iter).m_writer) {
-          // writer already subscribed
-          return 0;
-        }
-
-        (*iter).m_writer = client;
-      } else {
-        // add a reader
-        (*iter).m_readers.push_back(client);
-        if (0 != (*iter).m_writer) {
-          // send a channel subscription event
-          (*iter).m_writer->sendChannelSubscriptionEvent(
-              (*iter).m_readers.size(), (*iter).m_name);
-        }
-      }
+  // at most MAX_FDS_PER_MESSAGE fds go with each message
+  while (0 < numFds) {
+    const uint16_t chunk =
+        (ManagerProtocol::MAX_FDS_PER_MESSAGE < numFds)
+            ? (static_cast<uint16_t>(ManagerProtocol::MAX_FDS_PER_MESSAGE))
+            : (numFds);
 
-      return &(*iter);
+    size = ManagerProtocol::BatchFds::init(fdsBuffer, sizeof(fdsBuffer),
+                                           chunk);
+    if (0 != sendBuffer(fdsBuffer, size, fds, chunk)) {
+      return -1;
     }
+
+    fds += chunk;
+    numFds -= chunk;
   }
 
-  // could not find an existing channel. Create a new one.
-  DatagramBoard datagramBoard;
-  int boardFd;
-  uint64_t boardSize;
-  char *channelNameCopy;
-  Channel *channel;
+  return 0;
+}
 
-  // (1) create the board
-  boardSize = (0 == requestedSize) ? (m_defaultBufferSize) : (requestedSize);
-  if (0 != datagramBoard.create(&boardFd, boardSize)) {
-    // board creation failed
-    goto DATAGRAMBOARD_CREATE_ERROR;
-  }
-  // get real board size and unmap board as I do not need it
-  boardSize = datagramBoard.m_boardInfo->m_size;
-  datagramBoard.unmap();
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::ReaderProgress *report) {
+  const char *end =
+      reinterpret_cast<const char *>(report) + report->m_header.m_size;
+  Channel *channel;
+  Reader *reader;
+  struct timespec now;
 
-  // (2) create copy of channel name
-  channelNameCopy = new (std::nothrow) char[::strlen(channelName) + 1];
-  if (0 == channelNameCopy) {
-    goto CHANNEL_NAME_ALLOCATION_ERROR;
+  if (0 == ManagerProtocol::nextChannelName(report->m_channelName, end)) {
+    // not even a string. Reports are not answered, not even by a denial
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    return 0;
   }
-  ::strcpy(channelNameCopy, channelName);
 
-  // add channel to list of channels
-  try {
-    m_channels.push_back(Channel());
-  } catch (const std::bad_alloc &exception) {
-    // log this event
-    printLogPrefix();
-    (*m_logStream) << "Could not add new channel \"" << channelNameCopy
-                   << "\" to channel list" << std::endl;
-    goto PUSH_BACK_ERROR;
+  // a report may cross the reader's unsubscription
+  channel = m_manager->findChannel(report->m_channelName);
+  if (0 == channel) {
+    return 0;
   }
-
-  // populate channel and subscribe client
-  channel = &m_channels.back();
-  channel->m_name = channelNameCopy;
-  channel->m_fd = boardFd;
-  if (writer) {
-    channel->m_writer = client;
-  } else {
-    channel->m_writer = 0;
-    channel->m_readers.push_back(client);
+  reader = channel->m_readers.find(this);
+  if (0 == reader) {
+    return 0;
   }
 
-  // log this event
-  printLogPrefix();
-  (*m_logStream) << "Created channel \"" << channelNameCopy << "\" with size "
-                 << boardSize << " bytes" << std::endl;
-
-  return channel;
-
-PUSH_BACK_ERROR:
-  delete[] channelNameCopy;
-
-CHANNEL_NAME_ALLOCATION_ERROR:
-  ::close(boardFd);
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  reader->m_sequence = report->m_sequence;
+  reader->m_position = report->m_position;
+  reader->m_overruns = report->m_overruns;
+  reader->m_reportTime = nanosOf(now);
+  m_manager->reportProgress(channel, this, reader);
 
-DATAGRAMBOARD_CREATE_ERROR:
   return 0;
 }
 
-int ShMemBCastManager::unsubscribe(Client *client, const char *channelName,
-                                   bool writer) {
-  // search for existing channel
-  for (std::list<Channel>::iterator channelIter = m_channels.begin();
-       channelIter != m_channels.end(); channelIter++) {
-    if (0 == ::strcmp(channelName, (*channelIter).m_name)) {
-      // found. Remove the subscription
-      if (writer) {
-        if ((*channelIter).m_writer == client) {
-          (*channelIter).m_writer = 0;
-        } else {
-          // not the writer
-          return -1;
-        }
-      } else {
-        // remove a reader
-        std::list<Client *>::iterator clientIter;
-        for (clientIter = (*channelIter).m_readers.begin();
-             clientIter != (*channelIter).m_readers.end(); clientIter++) {
-          if ((*clientIter) == client) {
-            // found reader
-            break;
-          }
-        }
-
-        if (clientIter != (*channelIter).m_readers.end()) {
-          (*channelIter).m_readers.erase(clientIter);
-          if (0 != (*channelIter).m_writer) {
-            // send a channel subscription event
-            (*channelIter)
-                .m_writer->sendChannelSubscriptionEvent(
-                    (*channelIter).m_readers.size(), (*channelIter).m_name);
-          }
-        } else {
-          // client does not have a read subscription to this channel
-          return -1;
-        }
-      }
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::ResizeRequest *request) {
+  const char *end =
+      reinterpret_cast<const char *>(request) + request->m_header.m_size;
+  Channel *channel;
 
-      // delete channel if unsubscribed
-      if ((0 == (*channelIter).m_writer) && (*channelIter).m_readers.empty()) {
-        // need to delete the buffer for good
-        // log this event
-        printLogPrefix();
-        (*m_logStream) << "Destroyed channel \"" << (*channelIter).m_name
-                       << "\"" << std::endl;
-
-        delete[]((*channelIter).m_name);
-        ::close((*channelIter).m_fd);
-        m_channels.erase(channelIter);
-      }
+  if (0 == ManagerProtocol::nextChannelName(request->m_channelName, end)) {
+    // not even a string
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    return sendApprovalDenialMessage(false);
+  }
 
-      return 0;
-    }
+  channel = m_manager->findChannel(request->m_channelName);
+  if ((0 == channel) ||
+      (0 != m_manager->resize(this, channel, request->m_requestedSize))) {
+    // log this event
+    m_manager->m_log.logResize(ManagerLog::RESIZE_DENIED, m_pid,
+                               request->m_channelName,
+                               request->m_requestedSize);
+    return sendApprovalDenialMessage(false);
   }
 
-  // channel not found
-  return -1;
+  return sendApprovalDenialMessage(true);
 }
 
-int ShMemBCastManager::init(const std::string &vlan,
-                            const std::set<uid_t> &permittedUIDSet,
-                            const std::set<gid_t> &permittedGIDSet,
-                            uint64_t defaultBufferSize,
-                            const std::string &logFilePath) {
-  std::streambuf *streambuf;
-  const IPCAddress &managerAddress =
-      ShMemBCastProtocol::getManagerIPCAddress(vlan);
-  std::string managerSocketDir = managerAddress.peer();
-  int retVal = 0;
-  struct sigaction sigaction;
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::BoardSwitched *message) {
+  const char *end =
+      reinterpret_cast<const char *>(message) + message->m_header.m_size;
+  Channel *channel;
 
-  // (1) Set allowed uid and gid set
-  try {
-    m_permittedUIDSet = permittedUIDSet;
-    m_permittedGIDSet = permittedGIDSet;
-  } catch (std::bad_alloc &) {
-    std::cerr << "Out of memory when copying permissions" << std::endl;
-    goto COPY_PERMISSIONS_ERROR;
+  if (0 == ManagerProtocol::nextChannelName(message->m_channelName, end)) {
+    // not answered, not even by a denial
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    return 0;
   }
 
-  // (2) set buffer size
-  m_defaultBufferSize = defaultBufferSize;
+  // only the writer moves the channel, and only once
+  channel = findSubscription(message->m_channelName, true);
+  if ((0 != channel) && channel->m_resizing) {
+    m_manager->switchBoard(channel, message->m_sequence);
+  }
 
-  // (3) Open the log file unbuffered
-  if ("-" == logFilePath) {
-    // use stdout
-    streambuf = std::cout.rdbuf();
-  } else {
-    // set logfile unbuffered
-    m_logFile.rdbuf()->pubsetbuf(0, 0);
+  return 0;
+}
+
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::PatternRequest *request, bool subscribe) {
+  // variables
+  const char *end = reinterpret_cast<const char *>(request) +
+                    request->m_header.m_size;
+  std::vector<Channel *> matches;
+  ssize_t prefixLength;
+  char buffer[sizeof(ManagerProtocol::PatternReply)];
+  ssize_t size;
+  size_t numMatches = 0;
 
-    // std::cout << _getumask() << std::endl;
+  if (0 == ManagerProtocol::nextChannelName(request->m_pattern, end)) {
+    // not even a string
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    return sendApprovalDenialMessage(false);
+  }
 
-    if (0 != _getumask()) {
-      umask(0); // zero out the umask so that directories are created correctly
-    }
+  prefixLength = ManagerProtocol::patternPrefixLength(request->m_pattern);
+  if (0 > prefixLength) {
+    goto MALFORMED_PATTERN_ERROR;
+  }
 
-    // create log file directory
-    if (0 != FileUtil::mkdirpForFile(logFilePath.c_str(), 0777)) {
-      std::cerr << "Could not create directory for default log file \""
-                << logFilePath << "\"" << std::endl;
-      goto MKDIRP_ERROR;
-    }
+  // the pattern's prefix
+  request->m_pattern[prefixLength] = '\0';
 
-    if (FileUtil::exists(logFilePath.c_str())) {
-      // Backup the previous file to ".last"
-      std::string backup = logFilePath;
-      backup += ".last";
-      FileUtil::rename(logFilePath.c_str(), backup.c_str());
-      FileUtil::remove(logFilePath.c_str());
+  if (!subscribe) {
+    std::vector<std::string>::iterator pattern =
+        std::find(m_patterns.begin(), m_patterns.end(), request->m_pattern);
+    if (m_patterns.end() == pattern) {
+      goto NO_SUCH_PATTERN_ERROR;
     }
 
-    // Create the file with the right permissions
-    int fd = FileUtil::open(logFilePath.c_str(),
-                            OpeningMode::CREATE_OR_TRUNCATE, 0666);
-    if (fd < 0) {
-      std::cerr << "Could not create the log file at \"" << logFilePath << "\""
-                << std::endl;
-      goto LOG_FILE_OPEN_ERROR;
-    } else {
-      close(fd);
-    }
+    m_manager->m_patterns.erase(request->m_pattern, this);
+    m_patterns.erase(pattern);
 
-    // open the file
-    m_logFile.open(logFilePath.c_str(), std::ios_base::out);
-    if (!m_logFile.is_open()) {
-      std::cerr << "Could not open the log file at \"" << logFilePath << "\""
-                << std::endl;
-      goto LOG_FILE_OPEN_ERROR;
-    }
+    request->m_pattern[prefixLength] = ManagerProtocol::PATTERN_WILDCARD;
+    m_manager->m_log.logPattern(ManagerLog::PATTERN_UNSUBSCRIBED, m_pid,
+                                request->m_pattern);
+    return sendApprovalDenialMessage(true);
+  }
 
-    // get the streambuf
-    streambuf = m_logFile.rdbuf();
+  if (m_patterns.end() !=
+      std::find(m_patterns.begin(), m_patterns.end(), request->m_pattern)) {
+    // already subscribed
+    goto PATTERN_ERROR;
   }
 
-  // create the output stream on the streambuf
+  // (1) the channels that exist now
   try {
-    m_logStream = new std::ostream(streambuf);
+    m_manager->m_channelNames.forEachWithPrefix(
+        request->m_pattern,
+        [&matches](Channel *channel) { matches.push_back(channel); });
   } catch (std::bad_alloc &) {
-    std::cerr << "Out of memory when creating log stream" << std::endl;
-    goto CREATE_LOG_STREAM_ERROR;
+    goto PATTERN_ERROR;
   }
 
-  // (4) open listening UDS
-
-  // try to make the directory
-  if (managerSocketDir[managerSocketDir.size() - 1] != '/') {
-    // Need to make sure there is a trailing '/' or otherwise
-    // tdefu::FileUtil::mkdirpForFile would ignore the last part of the path
-    managerSocketDir += '/';
+  // (2) from now on, new channels are matched too
+  if (0 != addPattern(request->m_pattern)) {
+    goto PATTERN_ERROR;
   }
 
-  FileUtil::mkdirpForFile(managerSocketDir.c_str(), 0777);
-
-  if (0 != m_link.init(managerAddress,
-                       ShMemBCastProtocol::UNIX_DOMAIN_SOCKET_TYPE)) {
-    goto LINK_INIT_ERROR;
+  // (3) subscribe to the existing ones, keeping those that worked
+  for (size_t i = 0; i < matches.size(); i++) {
+    if (0 == subscribeMatch(matches[i])) {
+      matches[numMatches++] = matches[i];
+    }
   }
 
-  // tte::tteso::UnixSocketUtil::bind() changes mode to 0755, so reset again!
-  ::chmod(managerSocketDir.c_str(), 0777);
+  // (4) reply, then pass the fds. On error the subscriptions are undone
+  // as the client is disconnected
+  request->m_pattern[prefixLength] = ManagerProtocol::PATTERN_WILDCARD;
+  m_manager->m_log.logPattern(ManagerLog::PATTERN_SUBSCRIBED, m_pid,
+                              request->m_pattern, numMatches);
 
-  // ::system("/bin/ls -l /spare/local/.smb_manager/spaunov/");
-
-  // (5) ignore SIGPIPE
-  sigaction.sa_handler = SIG_IGN;
-  ::sigemptyset(&(sigaction.sa_mask));
-  sigaction.sa_flags = 0;
-  if (0 != ::sigaction(SIGPIPE, &sigaction, 0)) {
-    retVal = -EINTR;
-    goto SIGACTION_ERROR;
+  size = ManagerProtocol::PatternReply::init(buffer, sizeof(buffer),
+                                             numMatches);
+  if (0 != sendBuffer(buffer, size)) {
+    return -1;
   }
 
-  // (6) Add to dispatcher
-  if (DispatcherBase::ON_READ !=
-      (retVal = m_dispatcher.addChannel(this, DispatcherBase::ON_READ))) {
-    goto DISPATCHER_ERROR;
+  for (size_t i = 0; i < numMatches; i++) {
+    if (0 != sendChannelMatch(matches[i])) {
+      return -1;
+    }
   }
 
-  // log starting stats
-  printLogPrefix();
-  (*m_logStream) << std::endl;
-
-  (*m_logStream)
-      << "---------------------------------------------------------------"
-      << std::endl;
-
-  (*m_logStream) << "Manager Started with Settings:" << std::endl;
-  (*m_logStream) << "  VLAN                : " << vlan << std::endl;
+  return 0;
 
-  (*m_logStream) << "  Permitted UID's     : ";
-  if (!m_permittedUIDSet.empty()) {
-    std::set<uid_t>::const_iterator iter = m_permittedUIDSet.begin();
-    std::set<uid_t>::const_iterator iterEnd = m_permittedUIDSet.end();
+PATTERN_ERROR:
+NO_SUCH_PATTERN_ERROR:
+  request->m_pattern[prefixLength] = ManagerProtocol::PATTERN_WILDCARD;
 
-    (*m_logStream) << *iter;
-    iter++;
+MALFORMED_PATTERN_ERROR:
+  m_manager->m_log.logPattern(subscribe
+                                  ? (ManagerLog::PATTERN_SUBSCRIBE_FAILED)
+                                  : (ManagerLog::PATTERN_UNSUBSCRIBE_FAILED),
+                              m_pid, request->m_pattern);
+  return sendApprovalDenialMessage(false);
+}
 
-    for (; iterEnd != iter; iter++) {
-      (*m_logStream) << "," << *iter;
+int ShMemBCastManager::Client::addPattern(const char *prefix) {
+  try {
+    m_patterns.push_back(prefix);
+  } catch (std::bad_alloc &) {
+    return -1;
+  }
+
+  if (0 != m_manager->m_patterns.insert(prefix, this)) {
+    m_patterns.pop_back();
+    return -1;
+  }
+
+  return 0;
+}
+
+int ShMemBCastManager::Client::subscribeMatch(Channel *channel) {
+  if (channel != m_manager->subscribe(this, channel->m_name, false, 0)) {
+    goto SUBSCRIBE_ERROR;
+  }
+
+  if (0 != addSubscription(channel, false)) {
+    m_manager->m_log.logEvent(ManagerLog::SUBSCRIPTION_LIST_ERROR, m_pid);
+    m_manager->unsubscribe(this, channel, false);
+    goto SUBSCRIBE_ERROR;
+  }
+
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBED, m_pid,
+                                   channel->m_name, false);
+  return 0;
+
+SUBSCRIBE_ERROR:
+  m_manager->m_log.logSubscription(ManagerLog::SUBSCRIBE_FAILED, m_pid,
+                                   channel->m_name, false);
+  return -1;
+}
+
+int ShMemBCastManager::Client::sendChannelMatch(const Channel *channel) {
+  char buffer[offsetof(ManagerProtocol::ChannelMatch, m_channelName) +
+              Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+  ssize_t size;
+
+  size = ManagerProtocol::ChannelMatch::init(buffer, sizeof(buffer),
+                                             channel->m_name);
+
+  return sendBuffer(buffer, size, &(channel->m_board.m_fd), 1);
+}
+
+void ShMemBCastManager::Client::matchChannel(Channel *channel) {
+  if (!m_eventMode || (0 != subscribeMatch(channel))) {
+    return;
+  }
+
+  if (0 != sendChannelMatch(channel)) {
+    // not a fatal error, as it is just an event. Another subscriber
+    // keeps the channel alive
+    m_manager->unsubscribe(this, channel, false);
+    removeSubscription(channel, false);
+  }
+}
+
+void ShMemBCastManager::Client::dropReader(Channel *channel) {
+  const Subscription *subscription = m_subscriptions.find(channel);
+  const uint32_t readerCount =
+      (0 == subscription) ? (0) : (subscription->m_readerCount);
+
+  // the channel may be gone after the last unsubscription, so it is
+  // only used as a key before it
+  for (uint32_t i = 0; i < readerCount; i++) {
+    removeSubscription(channel, false);
+    m_manager->unsubscribe(this, channel, false);
+  }
+}
+
+int ShMemBCastManager::Client::sendBuffer(const char *buffer, ssize_t size,
+                                          const int *fds, size_t numFds) {
+  if (0 > size) {
+    return -1;
+  }
+
+  return deliver(OutboundQueue::MESSAGE, buffer, size, fds, numFds);
+}
+
+int ShMemBCastManager::Client::sendBoardFd(int fd) {
+  return deliver(OutboundQueue::FD, 0, 0, &fd, 1);
+}
+
+int ShMemBCastManager::Client::deliver(OutboundQueue::Kind kind,
+                                       const char *buffer, size_t size,
+                                       const int *fds, size_t numFds) {
+  const bool flushing = !m_output.empty();
+
+  if (m_cutOff) {
+    return -1;
+  }
+
+  // nothing may overtake what is already queued
+  if (!flushing) {
+    if (0 == OutboundQueue::send(m_link.fileDescriptor(), kind, buffer,
+                                 size, fds, numFds)) {
+      return 0;
+    }
+    if ((EAGAIN != errno) && (EWOULDBLOCK != errno)) {
+      return -1;
+    }
+  }
+
+  if (0 != m_output.push(kind, buffer, size, fds, numFds)) {
+    cutOff();
+    return -1;
+  }
+
+  // flushed once the socket is writable again
+  if ((!flushing) &&
+      (0 > m_manager->m_dispatcher->modifyChannel(
+               this, DispatcherBase::ON_READ | DispatcherBase::ON_WRITE))) {
+    cutOff();
+    return -1;
+  }
+
+  return 0;
+}
+
+void ShMemBCastManager::Client::cutOff(void) {
+  m_manager->m_log.logOutput(ManagerLog::CLIENT_OUTPUT_FULL, m_pid,
+                             m_output.size());
+
+  m_cutOff = true;
+  m_output.clear();
+  ::shutdown(m_link.fileDescriptor(), SHUT_RDWR);
+}
+
+int ShMemBCastManager::Client::onWrite(void) {
+  int result = m_output.flush(m_link.fileDescriptor());
+  if (0 > result) {
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_WRITE_ERROR, m_pid);
+    disconnect();
+    return TTECH_DELETE_CHAN;
+  }
+
+  if ((0 == result) && (0 != m_query)) {
+    // the client caught up with the listing
+    if (0 != continueQuery()) {
+      disconnect();
+      return TTECH_DELETE_CHAN;
+    }
+    return 0;
+  }
+
+  if ((0 == result) && (0 > m_manager->m_dispatcher->modifyChannel(
+                                this, DispatcherBase::ON_READ))) {
+    m_manager->m_log.logEvent(ManagerLog::DISPATCHER_ADD_ERROR, m_pid);
+    disconnect();
+    return TTECH_DELETE_CHAN;
+  }
+
+  return 0;
+}
+
+void ShMemBCastManager::Client::sendChannelSubscriptionEvent(
+    uint16_t numReaders, const char *channel) {
+  // variables
+  char buffer[sizeof(Protocol::ChannelSubscriptionEvent)];
+  const Protocol::ChannelSubscriptionEvent *event =
+      reinterpret_cast<const Protocol::ChannelSubscriptionEvent *>(buffer);
+  char *queued;
+  ssize_t size;
+
+  if (!m_eventMode) {
+    // not an event mode client
+    return;
+  }
+
+  size = Protocol::ChannelSubscriptionEvent::init(buffer, sizeof(buffer),
+                                                  numReaders, channel);
+  if (0 > size) {
+    return;
+  }
+
+  // an event still queued for the channel is brought up to date instead,
+  // as only the latest count matters
+  queued = m_output.find([event, size](const char *message,
+                                       size_t messageSize) {
+    const Protocol::ChannelSubscriptionEvent *other =
+        reinterpret_cast<const Protocol::ChannelSubscriptionEvent *>(message);
+    return (static_cast<size_t>(size) == messageSize) &&
+           (event->m_header.m_messageType == other->m_header.m_messageType) &&
+           (0 == ::strcmp(event->m_channelName, other->m_channelName));
+  });
+  if (0 != queued) {
+    ::memcpy(queued, buffer, size);
+    return;
+  }
+
+  // not a fatal error, as it is just an event
+  sendBuffer(buffer, size);
+}
+
+void ShMemBCastManager::Client::sendSlowReaderEvent(
+    const char *channelName, pid_t pid,
+    ManagerProtocol::SlowReaderState state, uint64_t lag) {
+  char buffer[offsetof(ManagerProtocol::SlowReader, m_channelName) +
+              Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+  ssize_t size;
+
+  if (!m_eventMode) {
+    // not an event mode client
+    return;
+  }
+
+  size = ManagerProtocol::SlowReader::init(buffer, sizeof(buffer),
+                                           channelName, pid, state, lag);
+  // not a fatal error, as it is just an event
+  sendBuffer(buffer, size);
+}
+
+int ShMemBCastManager::Client::handleMessage(
+    ManagerProtocol::QueryRequest *request) {
+  const char *end =
+      reinterpret_cast<const char *>(request) + request->m_header.m_size;
+
+  if (0 == ManagerProtocol::nextChannelName(request->m_prefix, end)) {
+    // not even a string
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    return sendApprovalDenialMessage(false);
+  }
+
+  if (0 == (ManagerProtocol::QUERY_CHANNELS_FLAG & request->m_flags)) {
+    return sendQuerySummary(0);
+  }
+
+  if (0 != m_query) {
+    // the previous reply did not end yet
+    return sendApprovalDenialMessage(false);
+  }
+
+  m_query = new (std::nothrow) Query();
+  if (0 == m_query) {
+    return sendApprovalDenialMessage(false);
+  }
+  ::strcpy(m_query->m_prefix, request->m_prefix);
+  m_query->m_cursor[0] = '\0';
+  m_query->m_numListed = 0;
+  m_manager->m_numQueries++;
+
+  return continueQuery();
+}
+
+int ShMemBCastManager::Client::continueQuery(void) {
+  // aligned for the entries
+  uint64_t words[ManagerProtocol::MAX_MESSAGE_SIZE / sizeof(uint64_t)];
+  char *buffer = reinterpret_cast<char *>(words);
+  const size_t prefixLength = ::strlen(m_query->m_prefix);
+
+  // only while the socket takes the messages, so that the listing goes
+  // at the pace the client reads it and never fills its queue
+  for (uint32_t i = 0; (QUERY_MESSAGES_PER_PASS > i) && m_output.empty();
+       i++) {
+    const bool started = ('\0' != m_query->m_cursor[0]);
+    const char *last = 0;
+    bool full = false;
+    ssize_t size = ManagerProtocol::QueryChannels::init(buffer,
+                                                        sizeof(words));
+
+    // resumes after the last channel listed, as channels may have come
+    // and gone since
+    m_manager->m_channelNames.forEachFrom(
+        started ? (m_query->m_cursor) : (m_query->m_prefix), started,
+        [&](Channel *channel) {
+          if (0 != ::strncmp(channel->m_name, m_query->m_prefix,
+                             prefixLength)) {
+            // past the channels starting with the prefix
+            return false;
+          }
+
+          ssize_t newSize = appendChannel(buffer, sizeof(words), channel);
+          if (0 > newSize) {
+            full = true;
+            return false;
+          }
+
+          size = newSize;
+          last = channel->m_name;
+          return true;
+        });
+
+    if (0 != last) {
+      ::strcpy(m_query->m_cursor, last);
+      m_query->m_numListed +=
+          reinterpret_cast<ManagerProtocol::QueryChannels *>(buffer)
+              ->m_count;
+      if (0 != sendBuffer(buffer, size)) {
+        return -1;
+      }
+    }
+
+    if (!full) {
+      // every channel was listed
+      const uint32_t numListed = m_query->m_numListed;
+      m_manager->m_log.logQuery(m_pid, m_query->m_prefix, numListed);
+      endQuery();
+      return sendQuerySummary(numListed);
+    }
+  }
+
+  // carry on once the socket is writable. Modifying the channel re-arms
+  // it, should it be writable already
+  if (m_output.empty() &&
+      (0 > m_manager->m_dispatcher->modifyChannel(
+               this, DispatcherBase::ON_READ | DispatcherBase::ON_WRITE))) {
+    m_manager->m_log.logEvent(ManagerLog::DISPATCHER_ADD_ERROR, m_pid);
+    return -1;
+  }
+
+  return 0;
+}
+
+ssize_t ShMemBCastManager::Client::appendChannel(char *buffer, size_t size,
+                                                 Channel *channel) {
+  const ManagerProtocol::QueryChannels *message =
+      reinterpret_cast<const ManagerProtocol::QueryChannels *>(buffer);
+  const size_t nameLength = ::strlen(channel->m_name) + 1;
+  int32_t pids[1 + ManagerProtocol::MAX_ENTRY_READER_PIDS];
+  uint16_t numWriterPids = 0;
+  uint16_t numReaderPids = 0;
+  uint16_t flags =
+      channel->m_resizing ? (ManagerProtocol::RESIZING_FLAG) : (0);
+
+  if (0 != channel->m_writer) {
+    pids[numWriterPids++] = channel->m_writer->pid();
+  }
+  channel->m_readers.forEach([&](Client *client, const Reader &) {
+    if (ManagerProtocol::MAX_ENTRY_READER_PIDS > numReaderPids) {
+      pids[numWriterPids + numReaderPids++] = client->pid();
+    }
+  });
+
+  // the next message would not have room for it either, so it goes with
+  // fewer readers rather than stalling the listing
+  if (0 == message->m_count) {
+    const size_t room =
+        ((size < ManagerProtocol::MAX_MESSAGE_SIZE)
+             ? (size)
+             : (ManagerProtocol::MAX_MESSAGE_SIZE)) -
+        offsetof(ManagerProtocol::QueryChannels, m_entries);
+    while ((0 < numReaderPids) &&
+           (ManagerProtocol::ChannelEntry::size(
+                numWriterPids + numReaderPids, nameLength) > room)) {
+      numReaderPids--;
+    }
+  }
+  if (channel->m_readers.size() > numReaderPids) {
+    flags |= ManagerProtocol::READERS_TRUNCATED_FLAG;
+  }
+
+  return ManagerProtocol::QueryChannels::append(
+      buffer, size, channel->m_name, channel->m_board.m_size,
+      channel->m_numReaders, flags, pids, numWriterPids, numReaderPids);
+}
+
+int ShMemBCastManager::Client::sendQuerySummary(uint32_t numListed) {
+  char buffer[sizeof(ManagerProtocol::QuerySummary)];
+  ManagerProtocol::QuerySummary *summary =
+      reinterpret_cast<ManagerProtocol::QuerySummary *>(buffer);
+  ssize_t size;
+  uint64_t queuedBytes = 0;
+
+  size = ManagerProtocol::QuerySummary::init(buffer, sizeof(buffer));
+  if (0 > size) {
+    return -1;
+  }
+
+  m_manager->m_clients.forEach([&queuedBytes](Client *client, bool) {
+    queuedBytes += client->m_output.size();
+  });
+
+  summary->m_managerPid = ::getpid();
+  summary->m_numListed = numListed;
+  summary->m_numChannels = m_manager->m_channels.size();
+  summary->m_numClients = m_manager->m_clients.size();
+  summary->m_numResizing = m_manager->m_numResizing;
+  summary->m_boardBytes = m_manager->m_boardBytes;
+  summary->m_pooledBoards =
+      m_manager->m_pool.usage(&(summary->m_pooledBytes));
+  summary->m_poolHits = m_manager->m_pool.hits();
+  summary->m_poolMisses = m_manager->m_pool.misses();
+  summary->m_registryBytes = m_manager->m_channels.memoryUsage() +
+                             m_manager->m_clients.memoryUsage();
+  summary->m_queuedBytes = queuedBytes;
+
+  return sendBuffer(buffer, size);
+}
+
+void ShMemBCastManager::Client::endQuery(void) {
+  if (0 != m_query) {
+    delete m_query;
+    m_query = 0;
+    m_manager->m_numQueries--;
+  }
+}
+
+void ShMemBCastManager::Client::sendBoardResized(
+    const Channel *channel, const BoardAllocator::Board &board,
+    uint64_t sequence) {
+  char buffer[offsetof(ManagerProtocol::BoardResized, m_channelName) +
+              Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+  ssize_t size;
+
+  if (!m_eventMode) {
+    // not an event mode client
+    return;
+  }
+
+  size = ManagerProtocol::BoardResized::init(buffer, sizeof(buffer),
+                                             channel->m_name, sequence,
+                                             board.m_size);
+  // not a fatal error, as it is just an event
+  sendBuffer(buffer, size, &(board.m_fd), 1);
+}
+
+int ShMemBCastManager::Client::onRead(void) {
+  ssize_t bytesRead;
+  // large enough for batch requests
+  char buffer[ManagerProtocol::MAX_MESSAGE_SIZE];
+  Protocol::Header *header;
+  int retVal;
+
+  // read requestn
+  bytesRead = m_link.read(buffer, sizeof(buffer));
+  if ((0 > bytesRead) && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+    // the connection is non-blocking, and nothing came after all
+    return 0;
+  }
+  if (static_cast<ssize_t>(sizeof(Protocol::Header)) > bytesRead) {
+    // Must have at least a header...
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_READ_ERROR, m_pid);
+    goto READ_ERROR;
+  }
+
+  // verify protocol version
+  header = reinterpret_cast<Protocol::Header *>(buffer);
+  if (Protocol::VERSION != header->m_version) {
+    // unsupported version
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_VERSION_ERROR, m_pid);
+    goto VERSION_ERROR;
+  }
+
+  // verify request size matches up
+  if (static_cast<ssize_t>(header->m_size) != bytesRead) {
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_MESSAGE_SIZE_ERROR, m_pid);
+    goto MESSAGE_SIZE_ERROR;
+  }
+
+  // work based on request type. Result in a channel data
+  switch (header->m_messageType) {
+  case Protocol::EVENT_MODE_REQUEST: {
+    retVal =
+        handleMessage(reinterpret_cast<Protocol::EventModeRequest *>(buffer));
+  } break;
+
+  case Protocol::NO_EVENT_MODE_REQUEST: {
+    retVal =
+        handleMessage(reinterpret_cast<Protocol::NoEventModeRequest *>(buffer));
+  } break;
+
+  case Protocol::WRITER_SUBSCRIBE_REQUEST: {
+    retVal = handleMessage(
+        reinterpret_cast<Protocol::WriterSubscribeRequest *>(buffer));
+  } break;
+
+  case Protocol::READER_SUBSCRIBE_REQUEST: {
+    retVal = handleMessage(
+        reinterpret_cast<Protocol::ReaderSubscribeRequest *>(buffer));
+  } break;
+
+  case Protocol::WRITER_UNSUBSCRIBE_REQUEST: {
+    retVal = handleMessage(
+        reinterpret_cast<Protocol::WriterUnsubscribeRequest *>(buffer));
+  } break;
+
+  case Protocol::READER_UNSUBSCRIBE_REQUEST: {
+    retVal = handleMessage(
+        reinterpret_cast<Protocol::ReaderUnsubscribeRequest *>(buffer));
+  } break;
+
+  default: {
+    if (ManagerProtocol::isMessage(buffer, bytesRead,
+                                   ManagerProtocol::PLACEMENT_HINT_REQUEST,
+                                   sizeof(ManagerProtocol::PlacementHint))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::PlacementHint *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::BATCH_SUBSCRIBE_REQUEST,
+            offsetof(ManagerProtocol::BatchSubscribe, m_channelNames))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::BatchSubscribe *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::PATTERN_SUBSCRIBE_REQUEST,
+            offsetof(ManagerProtocol::PatternRequest, m_pattern))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::PatternRequest *>(buffer), true);
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::PATTERN_UNSUBSCRIBE_REQUEST,
+            offsetof(ManagerProtocol::PatternRequest, m_pattern))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::PatternRequest *>(buffer), false);
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::READER_PROGRESS,
+            offsetof(ManagerProtocol::ReaderProgress, m_channelName))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::ReaderProgress *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::QUERY_REQUEST,
+            offsetof(ManagerProtocol::QueryRequest, m_prefix))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::QueryRequest *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::RESIZE_REQUEST,
+            offsetof(ManagerProtocol::ResizeRequest, m_channelName))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::ResizeRequest *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::BOARD_SWITCHED,
+            offsetof(ManagerProtocol::BoardSwitched, m_channelName))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::BoardSwitched *>(buffer));
+      break;
+    }
+
+    if (ManagerProtocol::isMessage(
+            buffer, bytesRead, ManagerProtocol::BATCH_UNSUBSCRIBE_REQUEST,
+            offsetof(ManagerProtocol::BatchUnsubscribe, m_channelNames))) {
+      retVal = handleMessage(
+          reinterpret_cast<ManagerProtocol::BatchUnsubscribe *>(buffer));
+      break;
+    }
+
+    if (HandoverProtocol::isMessage(buffer, bytesRead,
+                                    HandoverProtocol::HANDOVER_REQUEST,
+                                    sizeof(HandoverProtocol::Request))) {
+      // only returns if the handover failed
+      retVal = m_manager->handOver(this);
+      break;
+    }
+
+    m_manager->m_log.logEvent(ManagerLog::CLIENT_UNSUPPORTED_MESSAGE, m_pid);
+    goto UNSUPPORTED_MESSAGE_ERROR;
+  }
+  }
+
+  if (0 == retVal) {
+    return 0;
+  } else {
+    disconnect();
+    return TTECH_DELETE_CHAN;
+  }
+
+UNSUPPORTED_MESSAGE_ERROR:
+MESSAGE_SIZE_ERROR:
+VERSION_ERROR:
+READ_ERROR:
+  disconnect();
+  return TTECH_DELETE_CHAN;
+}
+
+int ShMemBCastManager::Client::addSubscription(Channel *channel, bool writer) {
+  Subscription *subscription = m_subscriptions.find(channel);
+  if (0 == subscription) {
+    Subscription newSubscription;
+    newSubscription.m_readerCount = 0;
+    newSubscription.m_writer = false;
+    if (0 != m_subscriptions.insert(channel, newSubscription)) {
+      return -1;
+    }
+    subscription = m_subscriptions.find(channel);
+  }
+
+  if (writer) {
+    subscription->m_writer = true;
+  } else {
+    subscription->m_readerCount++;
+  }
+
+  return 0;
+}
+
+void ShMemBCastManager::Client::removeSubscription(Channel *channel,
+                                                   bool writer) {
+  Subscription *subscription = m_subscriptions.find(channel);
+  if (0 == subscription) {
+    return;
+  }
+
+  if (writer) {
+    subscription->m_writer = false;
+  } else if (0 < subscription->m_readerCount) {
+    subscription->m_readerCount--;
+  }
+
+  if ((!subscription->m_writer) && (0 == subscription->m_readerCount)) {
+    m_subscriptions.erase(channel);
+  }
+}
+
+ShMemBCastManager::Channel *
+ShMemBCastManager::Client::findSubscription(const char *channelName,
+                                            bool writer) {
+  Channel *channel = m_manager->findChannel(channelName);
+  if (0 == channel) {
+    return 0;
+  }
+
+  Subscription *subscription = m_subscriptions.find(channel);
+  if ((0 == subscription) ||
+      (writer ? (!subscription->m_writer)
+              : (0 == subscription->m_readerCount))) {
+    return 0;
+  }
+
+  return channel;
+}
+
+void ShMemBCastManager::Client::disconnect(void) {
+  m_manager->m_log.logEvent(ManagerLog::CLIENT_DISCONNECTED, m_pid);
+
+  endQuery();
+
+  for (size_t i = 0; i < m_patterns.size(); i++) {
+    m_manager->m_patterns.erase(m_patterns[i].c_str(), this);
+  }
+  m_patterns.clear();
+
+  // the channel survives until this client's last subscription to it
+  // is gone, so its name can be logged before each unsubscribe
+  m_subscriptions.forEach([this](Channel *channel,
+                                 const Subscription &subscription) {
+    for (uint32_t i = 0; i < subscription.m_readerCount; i++) {
+      // log and unsubscribe
+      m_manager->m_log.logSubscription(ManagerLog::CONSIDERED_UNSUBSCRIBED,
+                                       m_pid, channel->m_name, false);
+
+      m_manager->unsubscribe(this, channel, false);
+    }
+
+    if (subscription.m_writer) {
+      // log and unsubscribe
+      m_manager->m_log.logSubscription(ManagerLog::CONSIDERED_UNSUBSCRIBED,
+                                       m_pid, channel->m_name, true);
+
+      m_manager->unsubscribe(this, channel, true);
+    }
+  });
+  m_subscriptions.clear();
+  m_manager->m_clients.erase(this);
+
+  m_output.clear();
+  m_link.close();
+}
+
+ShMemBCastManager::Channel *
+ShMemBCastManager::subscribe(Client *client, const char *channelName,
+                             bool writer, uint32_t requestedSize) {
+  // search for existing channel
+  Channel *channel = findChannel(channelName);
+  if (0 != channel) {
+    // found an existing channel
+    if (writer) {
+      // add a writer
+      if (0 != channel->m_writer) {
+        // writer already subscribed
+        return 0;
+      }
+
+      channel->m_writer = client;
+    } else {
+      // add a reader
+      Reader *reader = channel->m_readers.find(client);
+      if (0 != reader) {
+        reader->m_count++;
+      } else if (0 != channel->m_readers.insert(client, Reader(1))) {
+        m_log.logChannel(ManagerLog::READER_INSERT_ERROR, channel->m_name);
+        return 0;
+      }
+      channel->m_numReaders++;
+
+      if (0 != channel->m_writer) {
+        // send a channel subscription event
+        channel->m_writer->sendChannelSubscriptionEvent(channel->m_numReaders,
+                                                        channel->m_name);
+      }
+    }
+
+    return channel;
+  }
+
+  // could not find an existing channel. Create a new one.
+  const ChannelConfig::Options &options = m_channelConfig.lookup(channelName);
+  BoardAllocator::Board board;
+  BoardPool::BoardClass boardClass;
+  ManagerLog::BoardReport report;
+
+  boardClass.m_requestedSize =
+      (0 == requestedSize) ? (m_defaultBufferSize) : (requestedSize);
+  boardClass.m_pageSize = options.m_pageSize;
+  boardClass.m_numaNode = placementNode(options, client);
+  boardClass.m_prefault = options.m_prefault;
+  boardClass.m_lock = options.m_lock;
+  boardClass.m_areas.m_lastValueKeys = options.m_lastValueKeys;
+  boardClass.m_areas.m_lastValueSize = options.m_lastValueSize;
+  boardClass.m_areas.m_keyIndexCapacity = options.m_keyIndexCapacity;
+  boardClass.m_areas.m_waitArea = options.m_waitArea;
+
+  // (1) create the board
+  if (0 != createBoard(channelName, options, boardClass, &board, &report)) {
+    return 0;
+  }
+
+  // (2) create the channel and add it to the index
+  channel = createChannel(channelName, board);
+  if (0 == channel) {
+    goto CHANNEL_CREATE_ERROR;
+  }
+  channel->m_boardClass = boardClass;
+
+  // (3) subscribe client
+  if (writer) {
+    channel->m_writer = client;
+  } else {
+    if (0 != channel->m_readers.insert(client, Reader(1))) {
+      goto READER_INSERT_ERROR;
+    }
+    channel->m_numReaders = 1;
+  }
+
+  // log this event
+  m_log.logChannelCreated(channel->m_name, report);
+
+  // (4) subscribe the clients waiting for it
+  announceChannel(channel);
+
+  return channel;
+
+READER_INSERT_ERROR:
+  m_channels.erase(channel->m_name);
+  m_channelNames.erase(channel->m_name, channel);
+  delete[](channel->m_name);
+  delete channel;
+
+CHANNEL_CREATE_ERROR:
+  m_boards.destroy(channelName, board);
+  return 0;
+}
+
+int ShMemBCastManager::createBoard(const char *channelName,
+                                   const ChannelConfig::Options &options,
+                                   const BoardPool::BoardClass &boardClass,
+                                   BoardAllocator::Board *board,
+                                   ManagerLog::BoardReport *report) {
+  const int numaNode = boardClass.m_numaNode;
+  uint64_t warmNanos;
+  int retVal;
+
+  if (0 == m_pool.take(boardClass, options.m_poolSize, board)) {
+    // a spare board is already placed and warmed
+    if (0 != channelName) {
+      m_boards.adopt(channelName, board);
+    }
+    reportBoard(options, numaNode, *board, 0, report);
+    report->m_pooled = true;
+  } else {
+    // (1) create the board. Whatever the manager allocates for it until
+    // it is warmed comes from the chosen node
+    if (NumaUtil::NO_NODE != numaNode) {
+      NumaUtil::setPreferredNode(numaNode);
+    }
+    retVal = (0 != channelName)
+                 ? (m_boards.create(channelName, boardClass.m_requestedSize,
+                                    options.m_pageSize, boardClass.m_areas,
+                                    board))
+                 : (m_boards.createSpare(boardClass.m_requestedSize,
+                                         options.m_pageSize,
+                                         boardClass.m_areas, board));
+    if (0 != retVal) {
+      // board creation failed
+      goto BOARD_CREATE_ERROR;
+    }
+    if (NumaUtil::NO_NODE != numaNode) {
+      BoardAllocator::place(board, numaNode);
+    }
+
+    // (2) warm the board before anybody maps it
+    warmNanos = warmBoard(options, board);
+    if (NumaUtil::NO_NODE != numaNode) {
+      NumaUtil::setPreferredNode(NumaUtil::NO_NODE);
+    }
+    reportBoard(options, numaNode, *board, warmNanos, report);
+    report->m_pooled = false;
+  }
+  if ((0 != channelName) && m_boards.named() && !board->m_named &&
+      (BoardAllocator::NORMAL_PAGES == board->m_pageSize)) {
+    m_log.logChannel(ManagerLog::NAMED_BOARD_ERROR, channelName);
+  }
+
+  return 0;
+
+BOARD_CREATE_ERROR:
+  if (NumaUtil::NO_NODE != numaNode) {
+    NumaUtil::setPreferredNode(NumaUtil::NO_NODE);
+  }
+  return -1;
+}
+
+ShMemBCastManager::Channel *
+ShMemBCastManager::createChannel(const char *channelName,
+                                 const BoardAllocator::Board &board) {
+  Channel *channel;
+  char *channelNameCopy;
+
+  // (1) create the interned copy of channel name
+  channelNameCopy = new (std::nothrow) char[::strlen(channelName) + 1];
+  if (0 == channelNameCopy) {
+    goto CHANNEL_NAME_ALLOCATION_ERROR;
+  }
+  ::strcpy(channelNameCopy, channelName);
+
+  // (2) create the channel
+  channel = new (std::nothrow) Channel();
+  if (0 == channel) {
+    goto CHANNEL_ALLOCATION_ERROR;
+  }
+  channel->m_name = channelNameCopy;
+  channel->m_board = board;
+  channel->m_numReaders = 0;
+  channel->m_writer = 0;
+  channel->m_header = 0;
+  channel->m_sampleTime = 0;
+  channel->m_sampleSequence = 0;
+  channel->m_samplePosition = 0;
+  channel->m_resizing = false;
+  channel->m_resizeDeadline = 0;
+
+  // (3) add channel to the indexes
+  if (0 != m_channels.insert(channel->m_name, channel)) {
+    // log this event
+    m_log.logChannel(ManagerLog::INDEX_INSERT_ERROR, channelNameCopy);
+    goto INDEX_INSERT_ERROR;
+  }
+  if (0 != m_channelNames.insert(channel->m_name, channel)) {
+    m_log.logChannel(ManagerLog::INDEX_INSERT_ERROR, channelNameCopy);
+    goto PREFIX_INDEX_INSERT_ERROR;
+  }
+  m_boardBytes += board.m_size;
+
+  return channel;
+
+PREFIX_INDEX_INSERT_ERROR:
+  m_channels.erase(channel->m_name);
+
+INDEX_INSERT_ERROR:
+  delete channel;
+
+CHANNEL_ALLOCATION_ERROR:
+  delete[] channelNameCopy;
+
+CHANNEL_NAME_ALLOCATION_ERROR:
+  return 0;
+}
+
+int ShMemBCastManager::placementNode(const ChannelConfig::Options &options,
+                                     const Client *client) const {
+  if (0 <= options.m_numaNode) {
+    return options.m_numaNode;
+  }
+
+  if (NumaUtil::NO_NODE != client->numaHint()) {
+    return client->numaHint();
+  }
+
+  if (ChannelConfig::AUTO_NODE == options.m_numaNode) {
+    // the CPU the client last ran on, likely the one it is pinned to
+    return NumaUtil::nodeOfProcess(client->pid());
+  }
+
+  return NumaUtil::NO_NODE;
+}
+
+uint64_t ShMemBCastManager::warmBoard(const ChannelConfig::Options &options,
+                                      BoardAllocator::Board *board) {
+  struct timespec start;
+  struct timespec end;
+
+  if (!options.m_prefault && !options.m_lock) {
+    return 0;
+  }
+
+  ::clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // locking populates the pages as well, but prefaulting first makes
+  // sure they are all allocated even if the lock fails
+  board->m_prefaulted = (0 == BoardAllocator::prefault(*board));
+  if (options.m_lock) {
+    BoardAllocator::lock(board);
+  }
+
+  ::clock_gettime(CLOCK_MONOTONIC, &end);
+  return ((end.tv_sec - start.tv_sec) * 1000000000LL) +
+         (end.tv_nsec - start.tv_nsec);
+}
+
+void ShMemBCastManager::reportBoard(const ChannelConfig::Options &options,
+                                    int numaNode,
+                                    const BoardAllocator::Board &board,
+                                    uint64_t warmNanos,
+                                    ManagerLog::BoardReport *report) {
+  report->m_size = board.m_size;
+  report->m_pageBytes = BoardAllocator::pageBytes(board.m_pageSize);
+  report->m_hugePageFallback = (board.m_pageSize != options.m_pageSize);
+  report->m_prefaulted = board.m_prefaulted;
+  report->m_prefaultFailed =
+      (options.m_prefault || options.m_lock) && !board.m_prefaulted;
+  report->m_locked = (0 != board.m_lockedMapping);
+  report->m_lockFailed = options.m_lock && !report->m_locked;
+  report->m_warmNanos = warmNanos;
+  report->m_numaNode = numaNode;
+  report->m_placementFailed =
+      (NumaUtil::NO_NODE != numaNode) && (board.m_numaNode != numaNode);
+}
+
+void ShMemBCastManager::announceChannel(Channel *channel) {
+  std::vector<Client *> clients;
+
+  try {
+    m_patterns.forEachPrefixOf(channel->m_name, [&clients](Client *client) {
+      clients.push_back(client);
+    });
+  } catch (std::bad_alloc &) {
+    // those found so far still get it
+  }
+
+  // once per client, however many of its patterns match
+  std::sort(clients.begin(), clients.end());
+  clients.erase(std::unique(clients.begin(), clients.end()), clients.end());
+
+  for (size_t i = 0; i < clients.size(); i++) {
+    clients[i]->matchChannel(channel);
+  }
+}
+
+int ShMemBCastManager::resize(Client *client, Channel *channel,
+                              uint32_t requestedSize) {
+  const ChannelConfig::Options &options =
+      m_channelConfig.lookup(channel->m_name);
+  BoardPool::BoardClass &boardClass = channel->m_nextBoardClass;
+  ManagerLog::BoardReport report;
+  struct timespec now;
+  Timer *timer = 0;
+
+  if (channel->m_resizing || (channel->m_board.m_size >= requestedSize)) {
+    return -1;
+  }
+  if ((0 != channel->m_writer) && !channel->m_writer->eventMode()) {
+    // the writer could not be told
+    return -1;
+  }
+  // the timer starts after 'now', so that it never fires before the
+  // deadline
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  if (0 != channel->m_writer) {
+    // a writer that never moves must not hold the new board forever
+    timer = new (std::nothrow)
+        Timer(this, &ShMemBCastManager::abandonResizes);
+    if ((0 == timer) || (0 != timer->init(m_resizeTimeoutMillis, false))) {
+      delete timer;
+      return -1;
+    }
+  }
+
+  // the new board goes where the old one is
+  boardClass.m_requestedSize = requestedSize;
+  boardClass.m_pageSize = options.m_pageSize;
+  boardClass.m_numaNode = channel->m_board.m_numaNode;
+  boardClass.m_prefault = options.m_prefault;
+  boardClass.m_lock = options.m_lock;
+  boardClass.m_areas.m_lastValueKeys = options.m_lastValueKeys;
+  boardClass.m_areas.m_lastValueSize = options.m_lastValueSize;
+  boardClass.m_areas.m_keyIndexCapacity = options.m_keyIndexCapacity;
+  boardClass.m_areas.m_waitArea = options.m_waitArea;
+
+  // a spare until the writer moved, so that the channel's name still
+  // refers to the board in use
+  if (0 != createBoard(0, options, boardClass, &(channel->m_nextBoard),
+                       &report)) {
+    delete timer;
+    return -1;
+  }
+  if ((0 != timer) && (DispatcherBase::ON_READ !=
+                       m_dispatcher->addChannel(timer,
+                                                DispatcherBase::ON_READ))) {
+    delete timer;
+    m_boards.destroy(0, channel->m_nextBoard);
+    return -1;
+  }
+  channel->m_resizing = true;
+  channel->m_resizeDeadline =
+      nanosOf(now) + (m_resizeTimeoutMillis * 1000000ULL);
+  m_numResizing++;
+
+  // log this event
+  m_log.logResize(ManagerLog::RESIZE_STARTED, client->pid(), channel->m_name,
+                  channel->m_nextBoard.m_size, channel->m_board.m_size);
+
+  if (0 == channel->m_writer) {
+    // nobody writes to the old board any more
+    const DatagramBoard::BoardInfo *header = boardHeader(channel);
+    switchBoard(channel, (0 == header) ? (0) : (header->m_sequence));
+  } else {
+    channel->m_writer->sendBoardResized(channel, channel->m_nextBoard, 0);
+  }
+
+  return 0;
+}
+
+void ShMemBCastManager::switchBoard(Channel *channel, uint64_t sequence) {
+  size_t i = 0;
+
+  if (0 == channel->m_writer) {
+    // a writer carries the last values over as it moves. Without one,
+    // nobody updates them any more, so the manager does
+    if (0 != BoardAllocator::copyLastValues(channel->m_board,
+                                            channel->m_nextBoard)) {
+      m_log.logResize(ManagerLog::LAST_VALUES_LOST, 0, channel->m_name,
+                      channel->m_nextBoard.m_size);
+    }
+  }
+
+  // the watches of the channel's readers read the old board's header.
+  // Their next reports watch them again
+  while (i < m_watches.size()) {
+    if (channel == m_watches[i].m_channel) {
+      // the last watch takes this one's place
+      unwatchReader(channel->m_readers.find(m_watches[i].m_client));
+    } else {
+      i++;
+    }
+  }
+  BoardAllocator::unmapHeader(channel->m_board, channel->m_header);
+  channel->m_header = 0;
+
+  // clients still map the old board, so it cannot go back to the pool.
+  // It is freed once the last of them unmaps it
+  m_boards.destroy(channel->m_name, channel->m_board);
+  m_boardBytes += channel->m_nextBoard.m_size - channel->m_board.m_size;
+  channel->m_board = channel->m_nextBoard;
+  channel->m_boardClass = channel->m_nextBoardClass;
+  m_boards.adopt(channel->m_name, &(channel->m_board));
+  channel->m_resizing = false;
+  m_numResizing--;
+  channel->m_sampleTime = 0;
+
+  // log this event
+  m_log.logResize(ManagerLog::CHANNEL_RESIZED, 0, channel->m_name,
+                  channel->m_board.m_size, sequence);
+
+  channel->m_readers.forEach(
+      [channel, sequence](Client *client, const Reader &) {
+        client->sendBoardResized(channel, channel->m_board, sequence);
+      });
+}
+
+void ShMemBCastManager::abandonResizes(void) {
+  std::vector<Channel *> abandoned;
+  struct timespec now;
+
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+  // the index must not change while it is walked
+  try {
+    m_channels.forEach([&abandoned, &now](const char *, Channel *channel) {
+      if (channel->m_resizing &&
+          (channel->m_resizeDeadline <= nanosOf(now))) {
+        abandoned.push_back(channel);
+      }
+    });
+  } catch (std::bad_alloc &) {
+    // the rest are abandoned when the next resize times out
+  }
+
+  for (size_t i = 0; i < abandoned.size(); i++) {
+    Channel *channel = abandoned[i];
+
+    // log this event
+    m_log.logResize(ManagerLog::RESIZE_ABANDONED,
+                    (0 == channel->m_writer) ? (0)
+                                             : (channel->m_writer->pid()),
+                    channel->m_name, channel->m_nextBoard.m_size);
+
+    // the writer may still map it, so it cannot go back to the pool.
+    // A BoardSwitched it sends late is ignored
+    m_boards.destroy(0, channel->m_nextBoard);
+    channel->m_resizing = false;
+    m_numResizing--;
+  }
+}
+
+void ShMemBCastManager::destroyChannel(Channel *channel) {
+  if (channel->m_resizing) {
+    // the writer left before moving
+    m_boards.destroy(0, channel->m_nextBoard);
+    m_numResizing--;
+  }
+  m_channels.erase(channel->m_name);
+  m_channelNames.erase(channel->m_name, channel);
+  m_boardBytes -= channel->m_board.m_size;
+  BoardAllocator::unmapHeader(channel->m_board, channel->m_header);
+  if ((0 == channel->m_boardClass.m_requestedSize) ||
+      (0 != m_boards.release(channel->m_name, &(channel->m_board))) ||
+      (0 != m_pool.give(channel->m_boardClass, channel->m_board))) {
+    m_boards.destroy(channel->m_name, channel->m_board);
+  }
+  delete[](channel->m_name);
+  delete channel;
+}
+
+int ShMemBCastManager::unsubscribe(Client *client, const char *channelName,
+                                   bool writer) {
+  // search for existing channel
+  Channel *channel = findChannel(channelName);
+  if (0 == channel) {
+    // channel not found
+    return -1;
+  }
+
+  return unsubscribe(client, channel, writer);
+}
+
+int ShMemBCastManager::unsubscribe(Client *client, Channel *channel,
+                                   bool writer) {
+  // Remove the subscription
+  if (writer) {
+    if (channel->m_writer == client) {
+      channel->m_writer = 0;
+    } else {
+      // not the writer
+      return -1;
+    }
+
+    if (channel->m_resizing && (0 < channel->m_numReaders)) {
+      // the writer left before moving, so the readers move on from
+      // where it stopped. Without readers, the channel is destroyed
+      const DatagramBoard::BoardInfo *header = boardHeader(channel);
+      switchBoard(channel, (0 == header) ? (0) : (header->m_sequence));
+    }
+  } else {
+    // remove a reader
+    Reader *reader = channel->m_readers.find(client);
+    if (0 == reader) {
+      // client does not have a read subscription to this channel
+      return -1;
+    }
+
+    if (0 == --(reader->m_count)) {
+      unwatchReader(reader);
+      channel->m_readers.erase(client);
+    }
+    channel->m_numReaders--;
+
+    if (0 != channel->m_writer) {
+      // send a channel subscription event
+      channel->m_writer->sendChannelSubscriptionEvent(channel->m_numReaders,
+                                                      channel->m_name);
+    }
+  }
+
+  // delete channel if unsubscribed
+  if ((0 == channel->m_writer) && (0 == channel->m_numReaders)) {
+    // need to delete the buffer for good
+    // log this event
+    m_log.logChannel(ManagerLog::CHANNEL_DESTROYED, channel->m_name);
+
+    destroyChannel(channel);
+  }
+
+  return 0;
+}
+
+int ShMemBCastManager::recoverChannels(void) {
+  std::vector<BoardAllocator::RecoveredBoard> boards;
+  int retVal = m_boards.recover(&boards);
+
+  for (size_t i = 0; i < boards.size(); i++) {
+    BoardAllocator::RecoveredBoard &recovered = boards[i];
+    // the crashed manager's locks went with it
+    warmBoard(m_channelConfig.lookup(recovered.m_channelName.c_str()),
+              &(recovered.m_board));
+
+    Channel *channel =
+        createChannel(recovered.m_channelName.c_str(), recovered.m_board);
+    if (0 == channel) {
+      m_boards.destroy(recovered.m_channelName.c_str(), recovered.m_board);
+      retVal = -1;
+      continue;
+    }
+
+    // log this event
+    m_log.logChannel(ManagerLog::CHANNEL_RECOVERED, channel->m_name,
+                     channel->m_board.m_size);
+  }
+
+  return retVal;
+}
+
+void ShMemBCastManager::destroyUnclaimedChannels(void) {
+  std::vector<Channel *> unclaimed;
+
+  // the index must not change while it is walked
+  try {
+    m_channels.forEach([&unclaimed](const char *, Channel *channel) {
+      if ((0 == channel->m_writer) && (0 == channel->m_numReaders)) {
+        unclaimed.push_back(channel);
+      }
+    });
+  } catch (std::bad_alloc &) {
+    // destroy what was collected, the rest stays around
+  }
+
+  for (size_t i = 0; i < unclaimed.size(); i++) {
+    // log this event
+    m_log.logChannel(ManagerLog::CHANNEL_UNCLAIMED, unclaimed[i]->m_name);
+
+    destroyChannel(unclaimed[i]);
+  }
+}
+
+const DatagramBoard::BoardInfo *
+ShMemBCastManager::boardHeader(Channel *channel) {
+  // mapped here rather than when the channel is created, so that
+  // channels cost no mapping unless they are sampled or checked
+  if (0 == channel->m_header) {
+    channel->m_header = BoardAllocator::mapHeader(channel->m_board);
+  }
+
+  return channel->m_header;
+}
+
+void ShMemBCastManager::reportProgress(Channel *channel, Client *client,
+                                       Reader *reader) {
+  if (NO_WATCH != reader->m_watch) {
+    m_watches[reader->m_watch].m_position = reader->m_position;
+    return;
+  }
+
+  const ChannelConfig::Options &options =
+      m_channelConfig.lookup(channel->m_name);
+  if ((ChannelConfig::IGNORE_SLOW_READERS == options.m_slowReaderPolicy) ||
+      (0 == boardHeader(channel))) {
+    return;
+  }
+
+  Watch watch;
+  watch.m_header = channel->m_header;
+  watch.m_position = reader->m_position;
+  watch.m_threshold =
+      (channel->m_board.m_size * options.m_slowReaderLag) / 100;
+  watch.m_channel = channel;
+  watch.m_client = client;
+  watch.m_policy = options.m_slowReaderPolicy;
+  watch.m_lagging = false;
+
+  try {
+    m_watches.push_back(watch);
+  } catch (std::bad_alloc &) {
+    // the reader goes unchecked until its next report
+    return;
+  }
+  reader->m_watch = m_watches.size() - 1;
+}
+
+void ShMemBCastManager::unwatchReader(Reader *reader) {
+  const uint32_t index = reader->m_watch;
+  if (NO_WATCH == index) {
+    return;
+  }
+
+  // the last watch takes the place of the removed one
+  reader->m_watch = NO_WATCH;
+  if (m_watches.size() - 1 != index) {
+    Watch &moved = m_watches[index];
+    moved = m_watches.back();
+    moved.m_channel->m_readers.find(moved.m_client)->m_watch = index;
+  }
+  m_watches.pop_back();
+}
+
+void ShMemBCastManager::checkReaders(void) {
+  size_t i = 0;
+
+  while (i < m_watches.size()) {
+    Watch &watch = m_watches[i];
+    const uint64_t writerPosition = watch.m_header->m_position;
+    const uint64_t lag = (writerPosition > watch.m_position)
+                             ? (writerPosition - watch.m_position)
+                             : (0);
+
+    if (!watch.m_lagging) {
+      if ((watch.m_threshold < lag) && handleSlowReader(i, lag)) {
+        // another watch took this one's place
+        continue;
+      }
+    } else if ((watch.m_threshold / 2) >= lag) {
+      // caught up well below the threshold, so that a reader hovering
+      // around it is not reported over and over
+      watch.m_lagging = false;
+      m_log.logSlowReader(ManagerLog::SLOW_READER_RECOVERED,
+                          watch.m_client->pid(), watch.m_channel->m_name,
+                          lag, watch.m_channel->m_board.m_size);
+      if ((ChannelConfig::NOTIFY_SLOW_READERS <= watch.m_policy) &&
+          (0 != watch.m_channel->m_writer)) {
+        watch.m_channel->m_writer->sendSlowReaderEvent(
+            watch.m_channel->m_name, watch.m_client->pid(),
+            ManagerProtocol::READER_CAUGHT_UP, lag);
+      }
+    }
+
+    i++;
+  }
+}
+
+bool ShMemBCastManager::handleSlowReader(size_t index, uint64_t lag) {
+  Watch &watch = m_watches[index];
+  Channel *channel = watch.m_channel;
+  Client *client = watch.m_client;
+  const pid_t pid = client->pid();
+
+  watch.m_lagging = true;
+  m_log.logSlowReader(ManagerLog::SLOW_READER, pid, channel->m_name, lag,
+                      channel->m_board.m_size);
+
+  if (ChannelConfig::UNSUBSCRIBE_SLOW_READERS != watch.m_policy) {
+    if ((ChannelConfig::NOTIFY_SLOW_READERS == watch.m_policy) &&
+        (0 != channel->m_writer)) {
+      channel->m_writer->sendSlowReaderEvent(
+          channel->m_name, pid, ManagerProtocol::READER_LAGGING, lag);
+    }
+    return false;
+  }
+
+  m_log.logSlowReader(ManagerLog::SLOW_READER_DROPPED, pid, channel->m_name,
+                      lag, channel->m_board.m_size);
+  client->sendSlowReaderEvent(channel->m_name, pid,
+                              ManagerProtocol::READER_UNSUBSCRIBED, lag);
+  if ((0 != channel->m_writer) && (client != channel->m_writer)) {
+    channel->m_writer->sendSlowReaderEvent(
+        channel->m_name, pid, ManagerProtocol::READER_UNSUBSCRIBED, lag);
+  }
+
+  // removes the watch, and may destroy the channel
+  client->dropReader(channel);
+
+  return true;
+}
+
+void ShMemBCastManager::sampleStats(void) {
+  struct timespec monotonic;
+  struct timespec realtime;
+
+  ::clock_gettime(CLOCK_MONOTONIC, &monotonic);
+  ::clock_gettime(CLOCK_REALTIME, &realtime);
+
+  m_stats.begin();
+  m_channels.forEach([this, &monotonic](const char *, Channel *channel) {
+    sampleChannel(channel, nanosOf(monotonic));
+  });
+  m_stats.end(nanosOf(realtime));
+}
+
+void ShMemBCastManager::sampleChannel(Channel *channel, uint64_t now) {
+  StatsSegment::ChannelRow *row;
+  uint64_t sequence = 0;
+  uint64_t position = 0;
+  uint32_t index;
+
+  if (0 != boardHeader(channel)) {
+    sequence = channel->m_header->m_sequence;
+    position = channel->m_header->m_position;
+  }
+
+  row = m_stats.addChannel(&index);
+  if (0 != row) {
+    ::strncpy(row->m_name, channel->m_name, sizeof(row->m_name) - 1);
+    row->m_name[sizeof(row->m_name) - 1] = '\0';
+    row->m_boardSize = channel->m_board.m_size;
+    row->m_sequence = sequence;
+    row->m_position = position;
+    row->m_messagesPerSecond =
+        (0 == channel->m_sampleTime)
+            ? (0)
+            : (perSecond(channel->m_sampleSequence, sequence,
+                         now - channel->m_sampleTime));
+    row->m_bytesPerSecond =
+        (0 == channel->m_sampleTime)
+            ? (0)
+            : (perSecond(channel->m_samplePosition, position,
+                         now - channel->m_sampleTime));
+    row->m_writerPid = (0 == channel->m_writer) ? (0)
+                                                : (channel->m_writer->pid());
+    row->m_numReaders = channel->m_numReaders;
+    row->m_firstReader = m_stats.numReaders();
+
+    channel->m_readers.forEach([this, channel, index, sequence, position,
+                                now](Client *client, const Reader &progress) {
+      StatsSegment::ReaderRow *reader = m_stats.addReader();
+      if (0 == reader) {
+        return;
+      }
+
+      ::memset(reader, 0, sizeof(*reader));
+      reader->m_channel = index;
+      reader->m_pid = client->pid();
+      reader->m_count = progress.m_count;
+      if (0 == progress.m_reportTime) {
+        reader->m_lagMessages = StatsSegment::UNKNOWN_LAG;
+        reader->m_lagBytes = StatsSegment::UNKNOWN_LAG;
+        return;
+      }
+
+      reader->m_flags = StatsSegment::REPORTED_FLAG;
+      reader->m_sequence = progress.m_sequence;
+      reader->m_position = progress.m_position;
+      reader->m_overruns = progress.m_overruns;
+      reader->m_reportAgeMillis = (now - progress.m_reportTime) / 1000000;
+      if (sequence > progress.m_sequence) {
+        reader->m_lagMessages = sequence - progress.m_sequence;
+      }
+      if (position > progress.m_position) {
+        reader->m_lagBytes = position - progress.m_position;
+      }
+      if (channel->m_board.m_size < reader->m_lagBytes) {
+        reader->m_flags |= StatsSegment::LAPPED_FLAG;
+      }
+    });
+
+    row->m_numReaderRows = m_stats.numReaders() - row->m_firstReader;
+  }
+
+  channel->m_sampleTime = now;
+  channel->m_sampleSequence = sequence;
+  channel->m_samplePosition = position;
+}
+
+int ShMemBCastManager::initStats(const Settings &settings) {
+  Timer *timer;
+
+  if (0 == settings.m_statsIntervalMillis) {
+    return 0;
+  }
+
+  if (0 != m_stats.init(settings.m_vlan, settings.m_statsChannels,
+                        settings.m_statsChannels * STATS_READERS_PER_CHANNEL,
+                        settings.m_statsIntervalMillis)) {
+    std::cerr << "Could not create the stats segment" << std::endl;
+    return -1;
+  }
+
+  timer = new (std::nothrow) Timer(this, &ShMemBCastManager::sampleStats);
+  if ((0 == timer) || (0 != timer->init(settings.m_statsIntervalMillis,
+                                        true))) {
+    delete timer;
+    std::cerr << "Could not create the stats timer" << std::endl;
+    return -1;
+  }
+  if (DispatcherBase::ON_READ !=
+      m_dispatcher->addChannel(timer, DispatcherBase::ON_READ)) {
+    delete timer;
+    std::cerr << "Could not add the stats timer" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ShMemBCastManager::init(const Settings &settings) {
+  const IPCAddress &managerAddress =
+      ShMemBCastProtocol::getManagerIPCAddress(settings.m_vlan);
+  std::string managerSocketDir = managerAddress.peer();
+  int retVal = 0;
+  int takeoverResult = 1;
+  bool unclaimed = false;
+  struct sigaction sigaction;
+
+  // (1) Set allowed uid and gid set
+  try {
+    m_permittedUIDSet = settings.m_permittedUIDSet;
+    m_permittedGIDSet = settings.m_permittedGIDSet;
+    m_channelConfig = settings.m_channelConfig;
+  } catch (std::bad_alloc &) {
+    std::cerr << "Out of memory when copying the settings" << std::endl;
+    goto COPY_PERMISSIONS_ERROR;
+  }
+
+  // (2) set buffer size
+  m_defaultBufferSize = settings.m_defaultBufferSize;
+  m_clientQueueSize = settings.m_clientQueueSize;
+  m_resizeTimeoutMillis = settings.m_resizeTimeoutMillis;
+
+  // (3) Open the log file and the board directory
+  if (0 != m_log.open(settings.m_logFilePath, settings.m_logMode)) {
+    goto LOG_OPEN_ERROR;
+  }
+
+  if (0 != m_boards.init(settings.m_boardDir)) {
+    std::cerr << "Could not use \"" << settings.m_boardDir
+              << "\" as the board directory" << std::endl;
+    retVal = -1;
+    goto BOARD_DIR_ERROR;
+  }
+
+  if (ChannelConfig::AUTO_NODE != m_channelConfig.defaults().m_numaNode) {
+    // the first channels likely have the default size and options
+    const ChannelConfig::Options &defaults = m_channelConfig.defaults();
+    BoardPool::BoardClass defaultClass;
+    defaultClass.m_requestedSize = m_defaultBufferSize;
+    defaultClass.m_pageSize = defaults.m_pageSize;
+    defaultClass.m_numaNode = defaults.m_numaNode;
+    defaultClass.m_prefault = defaults.m_prefault;
+    defaultClass.m_lock = defaults.m_lock;
+    defaultClass.m_areas.m_lastValueKeys = defaults.m_lastValueKeys;
+    defaultClass.m_areas.m_lastValueSize = defaults.m_lastValueSize;
+    defaultClass.m_areas.m_keyIndexCapacity = defaults.m_keyIndexCapacity;
+    defaultClass.m_areas.m_waitArea = defaults.m_waitArea;
+    m_pool.reserve(defaultClass, defaults.m_poolSize);
+  }
+
+  // (4) take over from the running manager, or open listening UDS
+  if (settings.m_takeover) {
+    takeoverResult = takeOver(managerAddress);
+    if (0 > takeoverResult) {
+      std::cerr << "Could not take over from the running manager"
+                << std::endl;
+      retVal = -1;
+      goto TAKEOVER_ERROR;
+    }
+  }
+
+  if (0 != takeoverResult) {
+    // try to make the directory
+    if (managerSocketDir[managerSocketDir.size() - 1] != '/') {
+      // Need to make sure there is a trailing '/' or otherwise
+      // tdefu::FileUtil::mkdirpForFile would ignore the last part of the
+      // path
+      managerSocketDir += '/';
+    }
+
+    FileUtil::mkdirpForFile(managerSocketDir.c_str(), 0777);
+
+    if (0 != m_link.init(managerAddress,
+                         ShMemBCastProtocol::UNIX_DOMAIN_SOCKET_TYPE)) {
+      goto LINK_INIT_ERROR;
+    }
+
+    // tte::tteso::UnixSocketUtil::bind() changes mode to 0755, so reset
+    // again!
+    ::chmod(managerSocketDir.c_str(), 0777);
+
+    // ::system("/bin/ls -l /spare/local/.smb_manager/spaunov/");
+
+    // the boards of a previous manager are either adopted or deleted
+    if (settings.m_recover) {
+      if (0 != recoverChannels()) {
+        std::cerr << "Could not recover every channel" << std::endl;
+      }
+    } else {
+      m_boards.clear();
+    }
+  }
+
+  // (5) ignore SIGPIPE
+  sigaction.sa_handler = SIG_IGN;
+  ::sigemptyset(&(sigaction.sa_mask));
+  sigaction.sa_flags = 0;
+  if (0 != ::sigaction(SIGPIPE, &sigaction, 0)) {
+    retVal = -EINTR;
+    goto SIGACTION_ERROR;
+  }
+
+  // (6) Create the dispatcher and add to it
+  if (EPOLL_DISPATCHER == settings.m_dispatcherType) {
+    EpollDispatcher *epollDispatcher = new (std::nothrow) EpollDispatcher();
+    if ((0 == epollDispatcher) || (0 != epollDispatcher->init())) {
+      delete epollDispatcher;
+      std::cerr << "Could not create the epoll dispatcher" << std::endl;
+      retVal = -1;
+      goto DISPATCHER_CREATE_ERROR;
+    }
+    m_dispatcher = epollDispatcher;
+  } else {
+    m_dispatcher = new (std::nothrow) SelectDispatcher();
+    if (0 == m_dispatcher) {
+      std::cerr << "Could not create the select dispatcher" << std::endl;
+      retVal = -1;
+      goto DISPATCHER_CREATE_ERROR;
     }
   }
-  (*m_logStream) << std::endl;
 
-  (*m_logStream) << "  Permitted GID's     : ";
-  if (!m_permittedGIDSet.empty()) {
-    std::set<gid_t>::const_iterator iter = m_permittedGIDSet.begin();
-    std::set<gid_t>::const_iterator iterEnd = m_permittedGIDSet.end();
+  if (DispatcherBase::ON_READ !=
+      (retVal = m_dispatcher->addChannel(this, DispatcherBase::ON_READ))) {
+    goto DISPATCHER_ERROR;
+  }
+
+  // clients taken over from the previous manager
+  retVal = 0;
+  m_clients.forEach([this, &retVal](Client *client, bool) {
+    if ((0 == retVal) &&
+        (DispatcherBase::ON_READ !=
+         m_dispatcher->addChannel(client, DispatcherBase::ON_READ))) {
+      m_log.logEvent(ManagerLog::DISPATCHER_ADD_ERROR, client->pid());
+      retVal = -1;
+    }
+  });
+  if (0 != retVal) {
+    goto DISPATCHER_ERROR;
+  }
 
-    (*m_logStream) << *iter;
-    iter++;
+  // channels nobody subscribes to again are destroyed after a while
+  m_channels.forEach([&unclaimed](const char *, Channel *channel) {
+    unclaimed = unclaimed ||
+                ((0 == channel->m_writer) && (0 == channel->m_numReaders));
+  });
+  if (unclaimed) {
+    Timer *timer = new (std::nothrow)
+        Timer(this, &ShMemBCastManager::destroyUnclaimedChannels);
+    if ((0 == timer) || (0 != timer->init(UNCLAIMED_CHANNEL_TIMEOUT_MILLIS,
+                                          false))) {
+      delete timer;
+      std::cerr << "Could not create the unclaimed channel timer"
+                << std::endl;
+      retVal = -1;
+      goto DISPATCHER_ERROR;
+    }
+    if (DispatcherBase::ON_READ !=
+        m_dispatcher->addChannel(timer, DispatcherBase::ON_READ)) {
+      delete timer;
+      std::cerr << "Could not add the unclaimed channel timer" << std::endl;
+      retVal = -1;
+      goto DISPATCHER_ERROR;
+    }
+  }
 
-    for (; iterEnd != iter; iter++) {
-      (*m_logStream) << "," << *iter;
+  // readers only have their lag checked if a channel asks for it
+  if (m_channelConfig.checksSlowReaders()) {
+    Timer *timer =
+        new (std::nothrow) Timer(this, &ShMemBCastManager::checkReaders);
+    if ((0 == timer) ||
+        (0 != timer->init(settings.m_slowReaderIntervalMillis, true))) {
+      delete timer;
+      std::cerr << "Could not create the slow reader timer" << std::endl;
+      retVal = -1;
+      goto DISPATCHER_ERROR;
+    }
+    if (DispatcherBase::ON_READ !=
+        m_dispatcher->addChannel(timer, DispatcherBase::ON_READ)) {
+      delete timer;
+      std::cerr << "Could not add the slow reader timer" << std::endl;
+      retVal = -1;
+      goto DISPATCHER_ERROR;
     }
   }
-  (*m_logStream) << std::endl;
 
-  (*m_logStream) << "  Default Buffer Size : " << m_defaultBufferSize
-                 << std::endl;
-  (*m_logStream) << "  Log File            : " << logFilePath << std::endl;
+  // (7) complete the takeover. From here on, this manager is the only one
+  if ((0 == takeoverResult) && (0 != completeTakeover())) {
+    std::cerr << "Could not complete the takeover" << std::endl;
+    retVal = -1;
+    goto COMPLETE_TAKEOVER_ERROR;
+  }
+
+  // (8) publish stats. The manager works without them
+  initStats(settings);
+
+  // log starting stats
+  try {
+    std::ostringstream banner;
+
+    banner << std::endl;
+
+    banner << "---------------------------------------------------------------"
+           << std::endl;
 
-  (*m_logStream)
-      << "---------------------------------------------------------------"
-      << std::endl;
+    banner << "Manager Started with Settings:" << std::endl;
+    banner << "  VLAN                : " << settings.m_vlan << std::endl;
+
+    banner << "  Permitted UID's     : ";
+    if (!m_permittedUIDSet.empty()) {
+      std::set<uid_t>::const_iterator iter = m_permittedUIDSet.begin();
+      std::set<uid_t>::const_iterator iterEnd = m_permittedUIDSet.end();
+
+      banner << *iter;
+      iter++;
+
+      for (; iterEnd != iter; iter++) {
+        banner << "," << *iter;
+      }
+    }
+    banner << std::endl;
+
+    banner << "  Permitted GID's     : ";
+    if (!m_permittedGIDSet.empty()) {
+      std::set<gid_t>::const_iterator iter = m_permittedGIDSet.begin();
+      std::set<gid_t>::const_iterator iterEnd = m_permittedGIDSet.end();
+
+      banner << *iter;
+      iter++;
+
+      for (; iterEnd != iter; iter++) {
+        banner << "," << *iter;
+      }
+    }
+    banner << std::endl;
+
+    banner << "  Default Buffer Size : " << m_defaultBufferSize << std::endl;
+    banner << "  Client Queue Size   : " << m_clientQueueSize << std::endl;
+    banner << "  Dispatcher          : "
+           << ((EPOLL_DISPATCHER == settings.m_dispatcherType) ? ("epoll")
+                                                               : ("select"))
+           << std::endl;
+    banner << "  Log File            : " << settings.m_logFilePath
+           << std::endl;
+    banner << "  Log Mode            : "
+           << ((ManagerLog::ASYNC_MODE == settings.m_logMode) ? ("async")
+                                                               : ("sync"))
+           << std::endl;
+    banner << "  Board Directory     : "
+           << (m_boards.named() ? (m_boards.boardDir())
+                                : (std::string("(anonymous)")))
+           << std::endl;
+    banner << "  Huge Pages          : "
+           << ChannelConfig::pageSizeName(
+                  m_channelConfig.defaults().m_pageSize)
+           << std::endl;
+    banner << "  Board Warming       : "
+           << (m_channelConfig.defaults().m_lock
+                   ? ("prefault and lock")
+                   : (m_channelConfig.defaults().m_prefault ? ("prefault")
+                                                            : ("none")))
+           << std::endl;
+    banner << "  NUMA Node           : "
+           << ChannelConfig::numaNodeName(
+                  m_channelConfig.defaults().m_numaNode)
+           << " (of " << NumaUtil::numNodes() << ")" << std::endl;
+    banner << "  Board Pool          : "
+           << m_channelConfig.defaults().m_poolSize << " per class"
+           << std::endl;
+    banner << "  Stats Segment       : "
+           << (m_stats.enabled()
+                   ? (m_stats.name() + " every " +
+                      std::to_string(settings.m_statsIntervalMillis) +
+                      " ms")
+                   : (std::string("(none)")))
+           << std::endl;
+    banner << "  Slow Readers        : "
+           << ChannelConfig::slowReaderPolicyName(
+                  m_channelConfig.defaults().m_slowReaderPolicy);
+    if (ChannelConfig::IGNORE_SLOW_READERS !=
+        m_channelConfig.defaults().m_slowReaderPolicy) {
+      banner << " at " << m_channelConfig.defaults().m_slowReaderLag
+             << "% of the board";
+    }
+    if (m_channelConfig.checksSlowReaders()) {
+      banner << ", checked every " << settings.m_slowReaderIntervalMillis
+             << " ms";
+    }
+    banner << std::endl;
+    banner << "  Resize Timeout      : " << m_resizeTimeoutMillis << " ms"
+           << std::endl;
+    banner << "  Channel Config      : "
+           << (m_channelConfig.path().empty() ? (std::string("(none)"))
+                                              : (m_channelConfig.path()))
+           << std::endl;
+    banner << "  Started By          : "
+           << ((0 == takeoverResult)
+                   ? ("takeover")
+                   : (settings.m_recover ? ("recovery") : ("fresh start")))
+           << std::endl;
+
+    banner << "---------------------------------------------------------------"
+           << std::endl;
+
+    m_log.write(banner.str());
+  } catch (std::bad_alloc &) {
+    std::cerr << "Out of memory when logging the settings" << std::endl;
+  }
 
   // success!
   return 0;
 
+COMPLETE_TAKEOVER_ERROR:
 DISPATCHER_ERROR:
+  delete m_dispatcher;
+  m_dispatcher = 0;
+
+DISPATCHER_CREATE_ERROR:
 SIGACTION_ERROR:
+  if (0 == takeoverResult) {
+    // the outgoing manager keeps everything received so far
+    abortTakeover();
+  }
   m_link.close();
 
 LINK_INIT_ERROR:
-  delete m_logStream;
-  m_logStream = 0;
-
-CREATE_LOG_STREAM_ERROR:
-LOG_FILE_OPEN_ERROR:
-MKDIRP_ERROR:
+TAKEOVER_ERROR:
+BOARD_DIR_ERROR:
+LOG_OPEN_ERROR:
 COPY_PERMISSIONS_ERROR:
   return retVal;
 }
 
+void ShMemBCastManager::run(void) {
+  if (0 != m_log.start()) {
+    // keep logging, just on this thread
+    std::cerr << "Could not start the log thread, logging synchronously"
+              << std::endl;
+    m_log.stop();
+  }
+
+  if (0 != m_pool.start()) {
+    // every board is then created on demand
+    std::cerr << "Could not start the board pool thread" << std::endl;
+  }
+
+  m_dispatcher->run();
+}
+
+int ShMemBCastManager::acceptClient(void) {
+  if (0 > m_adoptedLinkFd) {
+    return m_link.accept();
+  }
+
+  // the listening socket handed over by the previous manager
+  return ::accept4(m_adoptedLinkFd, 0, 0, SOCK_CLOEXEC);
+}
+
 int ShMemBCastManager::onRead(void) {
   int clientFd = -1;
-  if (0 > (clientFd = m_link.accept())) {
+  if (0 > (clientFd = acceptClient())) {
     // silently drop this.
     return 0;
   }
@@ -869,49 +2603,42 @@ int ShMemBCastManager::onRead(void) {
   uid_t uid;
   gid_t gid;
   if (0 != UnixSocketUtil::getCredentials(&pid, &uid, &gid, clientFd)) {
-    printLogPrefix();
-    (*m_logStream) << "Failed to get client credentials. Dropping connection"
-                   << std::endl;
+    m_log.logEvent(ManagerLog::CREDENTIALS_ERROR);
     return 0;
   }
 
-  // get the passwd object for this client
-  struct passwd *userDetails = ::getpwuid(uid);
-  struct group *groupDetails = ::getgrgid(gid);
-
   if ((m_permittedUIDSet.end() == m_permittedUIDSet.find(uid)) &&
       (m_permittedGIDSet.end() == m_permittedGIDSet.find(gid))) {
     // cannot accept this client
     ::close(clientFd);
 
-    // log rejection
-    printLogPrefix();
-    (*m_logStream) << "Rejected connection from Process " << pid
-                   << ", running under user "
-                   << ((0 == userDetails) ? ("<unknown>")
-                                          : (userDetails->pw_name))
-                   << " (" << uid << ") and group "
-                   << ((0 == groupDetails) ? ("<unknown>")
-                                           : (groupDetails->gr_name))
-                   << " (" << gid << ")" << std::endl;
+    // log rejection. User and group names are resolved by the log
+    m_log.logConnection(ManagerLog::CONNECTION_REJECTED, pid, uid, gid);
 
     return 0;
   }
 
   // log acceptance
-  printLogPrefix();
-  (*m_logStream) << "Accepted connection from Process " << pid
-                 << ", running under user "
-                 << ((0 == userDetails) ? ("<unknown>")
-                                        : (userDetails->pw_name))
-                 << " (" << uid << ") and group "
-                 << ((0 == groupDetails) ? ("<unknown>")
-                                         : (groupDetails->gr_name))
-                 << " (" << gid << ")" << std::endl;
-
-  // add client to dispatcher to handle subscription
-  Client *client = new Client(clientFd, pid, this);
-  m_dispatcher.addChannel(client, DispatcherBase::ON_READ);
+  m_log.logConnection(ManagerLog::CONNECTION_ACCEPTED, pid, uid, gid);
+
+  // add client to dispatcher to handle subscription. Every client is
+  // tracked so it can be handed over
+  Client *client = new Client(clientFd, pid, uid, this);
+  if (0 != client->init(m_clientQueueSize)) {
+    m_log.logEvent(ManagerLog::CLIENT_QUEUE_ERROR, pid);
+    delete client;
+    ::close(clientFd);
+  } else if (0 != m_clients.insert(client, true)) {
+    m_log.logEvent(ManagerLog::DISPATCHER_ADD_ERROR, pid);
+    delete client;
+    ::close(clientFd);
+  } else if (DispatcherBase::ON_READ !=
+             m_dispatcher->addChannel(client, DispatcherBase::ON_READ)) {
+    m_log.logEvent(ManagerLog::DISPATCHER_ADD_ERROR, pid);
+    m_clients.erase(client);
+    delete client;
+    ::close(clientFd);
+  }
 
   return 0;
 }
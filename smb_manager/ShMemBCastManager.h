@@ -26,17 +26,59 @@
  *    the existing channel, and the writer will pick up where he left
  *    off.
  *
+ * Readers may also subscribe to every channel whose name starts with a
+ * prefix (see ManagerProtocol.h). Channel names and patterns are both
+ * kept in prefix tries, so matching a new channel or a new pattern walks
+ * one path rather than every channel or pattern.
+ *
+ * On a timer the manager samples how far the writer of each
+ * channel got, through a read-only mapping of the board header, and
+ * publishes message and byte rates, together with how far behind each
+ * reader is, to a shared memory stats segment (see StatsSegment.h).
+ * Readers tell the manager how far they got themselves, as the board
+ * does not record it; the lag of a reader that does not is unknown.
+ * Reporting readers of channels with a slow reader policy (see
+ * ChannelConfig.h) also have their lag checked on a fast timer, which
+ * warns about, reports or unsubscribes those falling behind. Readers
+ * that never report are not checked.
+ *
+ * The manager never blocks on a client. Replies and events that do not
+ * fit in a client's socket buffer wait in its outbound queue (see
+ * OutboundQueue.h) until the socket is writable, and a client that lets
+ * the queue fill up is disconnected, so that one client that stopped
+ * reading cannot stall the others.
+ *
+ * A channel that outgrows its board can be moved to a larger one while
+ * in use (see ManagerProtocol.h). The writer moves first, and the
+ * readers follow from the first message it wrote to the new board. A
+ * writer that does not move within the resize timeout loses the new
+ * board, and the channel stays where it is. Handovers wait until no
+ * channel is being moved.
+ *
+ * Tools like smb_admin query the manager over the same socket for its
+ * channels, their boards and subscribers, and its pool and memory use.
+ * Long listings are streamed at the pace the tool reads them, and
+ * handovers wait for them as well.
+ *
+ * A replacement manager started with takeover set receives every
+ * channel, client and the listening socket from the running manager
+ * (see HandoverProtocol.h), so it can be upgraded without clients
+ * noticing.
+ *
  * @warning
- * If the manager crashes or is closed, any restarted manager is
- * unaware of any existing channels. While no channel will be
- * destroyed, and the subscribers can still communicate, no new
- * subscribers can be added. Connecting to a channel with the same
- * name as an existing channel creates a brand new channel.
+ * If the manager crashes or is closed, a restarted manager is unaware
+ * of the existing channels, unless boards are named (a board directory
+ * is set) and the new manager is started with recover set. Without
+ * that, while no channel will be destroyed and the subscribers can
+ * still communicate, no new subscribers can be added. Connecting to a
+ * channel with the same name as an existing channel creates a brand
+ * new channel.
  */
 
 #include <core/dispatcher/ChannelBase.h>
 #include <core/dispatcher/DispatcherBase.h>
 #include <core/dispatcher/SelectDispatcher.h>
+#include <core/link/DatagramBoard.h>
 #include <core/link/IPCAddress.h>
 #include <core/link/ShMemBCastProtocol.h>
 #include <core/link/UnixLink.h>
@@ -45,14 +87,25 @@
 #include <core/link/UnixSocketUtil.h>
 #include <core/utils/FileUtil.h>
 
+#include "BoardAllocator.h"
+#include "BoardPool.h"
+#include "ChannelConfig.h"
+#include "ManagerLog.h"
+#include "ManagerProtocol.h"
+#include "NumaUtil.h"
+#include "OpenHashMap.h"
+#include "OutboundQueue.h"
+#include "PrefixTrie.h"
+#include "StatsPublisher.h"
+
 #include <fstream>
 #include <ios>
 #include <iostream>
-#include <list>
 #include <memory>
 #include <ostream>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <errno.h>
 #include <grp.h>
@@ -65,6 +118,70 @@
 #include <unistd.h>
 
 class ShMemBCastManager : public ReadCB {
+public:
+  /***
+   * The event dispatcher driving the manager and its clients
+   *
+   * @var SELECT_DISPATCHER select(2) based. Limited to descriptors
+   * below FD_SETSIZE
+   * @var EPOLL_DISPATCHER level-triggered epoll(7) based. Scales with
+   * the number of active clients rather than the highest descriptor
+   */
+  enum DispatcherType { SELECT_DISPATCHER, EPOLL_DISPATCHER };
+
+  /***
+   * The manager's settings
+   *
+   * @var Settings::m_vlan The vlan to manage
+   * @var Settings::m_permittedUIDSet The set of permitted UID's
+   * @var Settings::m_permittedGIDSet The set of permitted GID's
+   * @var Settings::m_defaultBufferSize The minimum buffer size in bytes
+   * @var Settings::m_logFilePath Path to the log file to open. The
+   * special value of "-" indicates stdout
+   * @var Settings::m_dispatcherType The dispatcher implementation to
+   * run on
+   * @var Settings::m_logMode Whether log records are written by a
+   * background thread or synchronously
+   * @var Settings::m_boardDir Directory for named, recoverable boards.
+   * Empty for anonymous boards
+   * @var Settings::m_recover Adopt the named boards left in m_boardDir
+   * by a previous manager, rather than deleting them
+   * @var Settings::m_takeover Take over from the running manager of
+   * this vlan, if there is one
+   * @var Settings::m_channelConfig The daemon-wide and per-channel board
+   * options
+   * @var Settings::m_statsIntervalMillis Time between stats samples. 0
+   * for no stats segment
+   * @var Settings::m_statsChannels The number of channels the stats
+   * segment has room for. It has room for four readers per channel
+   * @var Settings::m_slowReaderIntervalMillis Time between checks of
+   * the readers' lag, if any channel has a slow reader policy
+   * @var Settings::m_resizeTimeoutMillis Time a writer has to move to
+   * the board of a resized channel before the resize is abandoned
+   * @var Settings::m_clientQueueSize The bytes queued for a client that
+   * does not keep up before it is disconnected
+   */
+  struct Settings {
+    std::string m_vlan;
+    std::set<uid_t> m_permittedUIDSet;
+    std::set<gid_t> m_permittedGIDSet;
+    uint64_t m_defaultBufferSize;
+    std::string m_logFilePath;
+    DispatcherType m_dispatcherType;
+    ManagerLog::Mode m_logMode;
+    std::string m_boardDir;
+    bool m_recover;
+    bool m_takeover;
+    ChannelConfig m_channelConfig;
+    uint32_t m_statsIntervalMillis;
+    uint32_t m_statsChannels;
+    uint32_t m_slowReaderIntervalMillis;
+    uint32_t m_resizeTimeoutMillis;
+    uint64_t m_clientQueueSize;
+
+    Settings(void);
+  };
+
 private:
   /***
    * typedef ShMemBCastProtocol to keep from having absurdly long
@@ -72,26 +189,85 @@ private:
    */
   typedef ShMemBCastProtocol Protocol;
 
+  struct Channel;
+
+  typedef OpenHashMap<Channel *, uint32_t, PointerKeyTraits<Channel>>
+      ChannelIndexMap;
+
   /***
    * Class that holds and monitors the client links. It must be
    * created with new as it does indicate TTECH_DELETE_CHAN to the
    * dispatcher.
    */
-  class Client : public ReadCB {
+  class Client : public ReadCB, public WriteCB {
   private:
     /***
-     * Information about a subscription
+     * Information about the subscriptions of this client to one
+     * channel. Keyed by the Channel, whose m_name is the interned
+     * channel name.
      *
-     * @var Subscription::m_channelName The name of the channel
-     * subscribed to. Not owned by the struct
-     * @var Subscription::m_writer Whether or not this subscription is
-     * a writer
+     * @var Subscription::m_readerCount Number of reader subscriptions.
+     * A client may join the same channel as a reader more than once
+     * @var Subscription::m_writer Whether or not this client is the
+     * writer
      */
     struct Subscription {
-      const char *m_channelName;
+      uint32_t m_readerCount;
       bool m_writer;
     };
 
+    typedef OpenHashMap<Channel *, Subscription, PointerKeyTraits<Channel>>
+        SubscriptionMap;
+
+    /***
+     * A query whose channel listing is being sent
+     *
+     * @var Query::m_prefix The prefix of the channels to list
+     * @var Query::m_cursor The last channel listed, empty until the
+     * first one was
+     * @var Query::m_numListed Channels listed so far
+     */
+    struct Query {
+      char m_prefix[Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+      char m_cursor[Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+      uint32_t m_numListed;
+    };
+
+    /***
+     * QueryChannels messages sent per dispatcher pass, at most
+     */
+    static const uint32_t QUERY_MESSAGES_PER_PASS = 4;
+
+    /***
+     * Records a new subscription
+     *
+     * @param channel The channel subscribed to
+     * @param writer Whether this is a writer subscription
+     *
+     * @return 0 on success, non-zero on allocation failure
+     */
+    int addSubscription(Channel *channel, bool writer);
+
+    /***
+     * Forgets one subscription. Only the address of the channel is
+     * used, so it is safe to call after the channel was destroyed.
+     *
+     * @param channel The channel unsubscribed from
+     * @param writer Whether this was a writer subscription
+     */
+    void removeSubscription(Channel *channel, bool writer);
+
+    /***
+     * Finds a subscription by channel name
+     *
+     * @param channelName A NUL-terminated channel name string
+     * @param writer Whether to look for a writer subscription
+     *
+     * @return the channel if this client holds such a subscription,
+     * 0 otherwise
+     */
+    Channel *findSubscription(const char *channelName, bool writer);
+
     /***
      * Sends an approval or denial message
      *
@@ -156,6 +332,206 @@ private:
      */
     int handleMessage(Protocol::ReaderUnsubscribeRequest *request);
 
+    /***
+     * Handles a Placement Hint
+     *
+     * @param request The request to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::PlacementHint *request);
+
+    /***
+     * Handles a Batch Subscribe Request. Each channel is subscribed to
+     * as by a single subscribe request, and logged the same way.
+     *
+     * @param request The request to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::BatchSubscribe *request);
+
+    /***
+     * Handles a Batch Unsubscribe Request
+     *
+     * @param request The request to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::BatchUnsubscribe *request);
+
+    /***
+     * Checks the channel names of a batch request
+     *
+     * @param channelNames The first channel name
+     * @param count The number of channel names
+     * @param end The end of the request
+     *
+     * @return whether there are count well formed names before end
+     */
+    static bool validChannelNames(const char *channelNames, size_t count,
+                                  const char *end);
+
+    /***
+     * Allocates m_batchApproved, m_batchFds and m_batchReply for the
+     * largest batch the protocol allows, on the first batch request
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int allocateBatchScratch(void);
+
+    /***
+     * Sends the reply to a batch request, followed by the fds of the
+     * approved channels in as few BatchFds messages as possible. The
+     * approval flags and fds are taken from m_batchApproved and
+     * m_batchFds
+     *
+     * @param count The number of channels
+     * @param numFds The number of fds
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendBatchReply(uint16_t count, uint16_t numFds);
+
+    /***
+     * Handles a Pattern Subscribe or Unsubscribe Request
+     *
+     * @param request The request to handle
+     * @param subscribe Whether it is a Pattern Subscribe Request
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::PatternRequest *request,
+                      bool subscribe);
+
+    /***
+     * Handles a Reader Progress report. It is not answered
+     *
+     * @param report The report to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::ReaderProgress *report);
+
+    /***
+     * Handles a Resize Request
+     *
+     * @param request The request to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::ResizeRequest *request);
+
+    /***
+     * Handles a writer's Board Switched message. It is not answered
+     *
+     * @param message The message to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::BoardSwitched *message);
+
+    /***
+     * Handles a Query Request
+     *
+     * @param request The request to handle
+     *
+     * @return 0 on success, non-zero on fatal error
+     */
+    int handleMessage(ManagerProtocol::QueryRequest *request);
+
+    /***
+     * Sends the next messages of the listing, as long as the socket
+     * takes them, and the summary once every channel was listed. The
+     * listing goes on from onWrite() on a later dispatcher pass.
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int continueQuery(void);
+
+    /***
+     * Adds a channel to a QueryChannels message. A channel with too many
+     * readers to fit in an empty message is added with as many reader
+     * pids as fit, so that the listing always moves on
+     *
+     * @return the new message size, or -1 if the channel does not fit
+     */
+    static ssize_t appendChannel(char *buffer, size_t size,
+                                 Channel *channel);
+
+    /***
+     * Sends the QuerySummary ending a reply
+     *
+     * @param numListed The number of channels listed before it
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendQuerySummary(uint32_t numListed);
+
+    /***
+     * Forgets the query being answered, if any
+     */
+    void endQuery(void);
+
+    /***
+     * Subscribes as a reader to a channel matching one of this client's
+     * patterns, and logs it
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int subscribeMatch(Channel *channel);
+
+    /***
+     * Sends a ChannelMatch with the channel's board fd
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendChannelMatch(const Channel *channel);
+
+    /***
+     * Sends one message, passing fds with it. It is queued if the
+     * socket buffer is full
+     *
+     * @param size The message size, as returned by its init(). Negative
+     * sizes fail
+     * @param fds At most ManagerProtocol::MAX_FDS_PER_MESSAGE fds
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendBuffer(const char *buffer, ssize_t size, const int *fds = 0,
+                   size_t numFds = 0);
+
+    /***
+     * Sends a board fd with UnixSocketUtil::sendFd(). It is queued if the
+     * socket buffer is full
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendBoardFd(int fd);
+
+    /***
+     * Sends a message now if nothing is queued before it, and queues it
+     * otherwise. Cuts the client off if the queue is full
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int deliver(OutboundQueue::Kind kind, const char *buffer, size_t size,
+                const int *fds, size_t numFds);
+
+    /***
+     * Gives up on a client that stopped reading. Its queue is dropped
+     * and its connection shut down, so that the dispatcher disconnects
+     * it on its next read.
+     */
+    void cutOff(void);
+
+    /***
+     * Flushes the queue, waiting for the socket to be writable
+     *
+     * @return 0 once the queue is empty, non-zero on error or timeout
+     */
+    int drainOutput(int timeoutMillis);
+
     /***
      * Disconnects this client, unsubscribing from all subscriptions
      */
@@ -164,10 +540,20 @@ private:
     static const struct timeval TIMEOUT;
 
     UnixLink m_link;
-    std::list<Subscription> m_subscriptions;
+    SubscriptionMap m_subscriptions;
+    std::vector<std::string> m_patterns;
     ShMemBCastManager *const m_manager;
     const pid_t m_pid;
+    const uid_t m_uid;
     bool m_eventMode;
+    int m_numaHint;
+    OutboundQueue m_output;
+    bool m_cutOff;
+    Query *m_query;
+    // reused by every batch request, rather than allocated for each
+    std::vector<uint8_t> m_batchApproved;
+    std::vector<int> m_batchFds;
+    std::vector<char> m_batchReply;
 
   public:
     /***
@@ -175,10 +561,101 @@ private:
      *
      * @param fd The file descriptor to map this link to
      * @param pid The pid of this client, for logging purposes
+     * @param uid The user of this client
      * @param manager The manager that this client is associated
      * with.
      */
-    Client(int fd, const pid_t pid, ShMemBCastManager *manager);
+    Client(int fd, const pid_t pid, const uid_t uid,
+           ShMemBCastManager *manager);
+
+    /***
+     * Makes the connection non-blocking and allocates its outbound queue
+     *
+     * @param queueSize The bytes the queue holds
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int init(size_t queueSize);
+
+    pid_t pid(void) const;
+
+    uid_t uid(void) const;
+
+    /***
+     * @return the NUMA node this client asked for the boards of new
+     * channels to be placed on, NumaUtil::NO_NODE if none
+     */
+    int numaHint(void) const;
+
+    /***
+     * Sends this client's connection and subscriptions to a replacement
+     * manager
+     *
+     * @param handoverFd The handover connection
+     * @param channelIndexes The handover index of every channel
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int sendHandoverState(int handoverFd,
+                          const ChannelIndexMap &channelIndexes);
+
+    /***
+     * Restores subscriptions received from the outgoing manager. The
+     * channel's own book-keeping is left to the caller.
+     *
+     * @return 0 on success, non-zero on allocation failure
+     */
+    int restoreSubscriptions(Channel *channel, uint32_t readerCount,
+                             bool writer);
+
+    /***
+     * Starts matching new channels against a pattern
+     *
+     * @param prefix The prefix the pattern matches
+     *
+     * @return 0 on success, non-zero on allocation failure
+     */
+    int addPattern(const char *prefix);
+
+    /***
+     * Subscribes this client to a new channel one of its patterns
+     * matches, and pushes the board fd. Does nothing unless this is an
+     * Event Mode connection. Failures only undo the subscription, as for
+     * any event.
+     */
+    void matchChannel(Channel *channel);
+
+    /***
+     * Unsubscribes every reader subscription of this client to a
+     * channel, as if it had asked to. The channel is destroyed if that
+     * leaves it without subscribers.
+     */
+    void dropReader(Channel *channel);
+
+    /***
+     * sends a SlowReader event to the client, if it is an Event Mode
+     * connection
+     *
+     * @param pid The slow reader
+     * @param lag How far behind the writer it is, in bytes
+     */
+    void sendSlowReaderEvent(const char *channelName, pid_t pid,
+                             ManagerProtocol::SlowReaderState state,
+                             uint64_t lag);
+
+    void setEventMode(bool eventMode);
+
+    bool eventMode(void) const;
+
+    /***
+     * sends a BoardResized event with the board's fd to the client, if
+     * it is an Event Mode connection
+     *
+     * @param sequence The first message on the board, 0 for the writer
+     */
+    void sendBoardResized(const Channel *channel,
+                          const BoardAllocator::Board &board,
+                          uint64_t sequence);
 
     /***
      * sends a channel subscription event to the client, if it is an
@@ -194,6 +671,74 @@ private:
 
     int readFileDescriptor(void) const;
 
+    // WriteCB Functions
+    int onWrite(void);
+
+    int writeFileDescriptor(void) const;
+
+    // ChannelBase Functions
+    int onClose(void);
+
+    int mode(void) const;
+  };
+
+  /***
+   * A reader client of a channel
+   *
+   * @var Reader::m_count Number of times it joined
+   * @var Reader::m_watch Its entry in m_watches, NO_WATCH if it has none
+   * @var Reader::m_sequence Messages read, as last reported
+   * @var Reader::m_position Bytes read, as last reported
+   * @var Reader::m_overruns Messages lost, as last reported
+   * @var Reader::m_reportTime When it last reported, in nanoseconds on
+   * CLOCK_MONOTONIC. 0 if it never did
+   */
+  struct Reader {
+    uint32_t m_count;
+    uint32_t m_watch;
+    uint64_t m_sequence;
+    uint64_t m_position;
+    uint64_t m_overruns;
+    uint64_t m_reportTime;
+
+    explicit Reader(uint32_t count = 0);
+  };
+
+  typedef OpenHashMap<Client *, Reader, PointerKeyTraits<Client>>
+      ReaderMap;
+
+  typedef OpenHashMap<Client *, bool, PointerKeyTraits<Client>> ClientSet;
+
+  /***
+   * A timer on the dispatcher, calling back into the manager. A one-shot
+   * timer deletes itself once it fired.
+   */
+  class Timer : public ReadCB {
+  private:
+    ShMemBCastManager *const m_manager;
+    void (ShMemBCastManager::*const m_callback)(void);
+    int m_fd;
+    bool m_periodic;
+
+  public:
+    Timer(ShMemBCastManager *manager,
+          void (ShMemBCastManager::*callback)(void));
+
+    ~Timer(void);
+
+    /***
+     * @param milliseconds Time until the (first) expiry
+     * @param periodic Whether to keep firing every 'milliseconds'
+     *
+     * @return 0 on success, non-zero on error
+     */
+    int init(uint64_t milliseconds, bool periodic);
+
+    // ReadCB Functions
+    int onRead(void);
+
+    int readFileDescriptor(void) const;
+
     // ChannelBase Functions
     int onClose(void);
 
@@ -203,21 +748,84 @@ private:
   /***
    * This struct holds the channel data
    *
-   * @var Channel::m_readers List of reader clients. Clients can be
-   * repeated. The pointers are not owned by the Channel
+   * @var Channel::m_readers Reader clients, mapped to the number of
+   * times they joined and how far they read. The pointers are not owned
+   * by the Channel
+   * @var Channel::m_numReaders Total number of reader subscriptions,
+   * counting repeats
    * @var Channel::m_writer The client which has the writer
    * subscription
-   * @var Channel::m_name The name of the channel
-   * @var Channel::m_fd The file descriptor of the datagram board
-   * associated with this channel
+   * @var Channel::m_name The name of the channel. This is the interned
+   * copy every other structure refers to
+   * @var Channel::m_board The datagram board associated with this
+   * channel
+   * @var Channel::m_boardClass The pool class the board goes back to
+   * when the channel is destroyed
+   * @var Channel::m_header The board header, mapped read-only when the
+   * channel is first sampled. 0 until then
+   * @var Channel::m_sampleTime When the channel was last sampled, in
+   * nanoseconds on CLOCK_MONOTONIC. 0 if it never was
+   * @var Channel::m_sampleSequence The writer's sequence then
+   * @var Channel::m_samplePosition The writer's position then
+   * @var Channel::m_nextBoard The board the channel is being moved to,
+   * while m_resizing
+   * @var Channel::m_nextBoardClass The pool class of m_nextBoard
+   * @var Channel::m_resizing Whether the writer was sent m_nextBoard and
+   * has not moved to it yet
+   * @var Channel::m_resizeDeadline When the resize is abandoned unless
+   * the writer moved, in nanoseconds on CLOCK_MONOTONIC
    */
   struct Channel {
-    std::list<Client *> m_readers;
+    ReaderMap m_readers;
+    uint32_t m_numReaders;
     Client *m_writer;
     const char *m_name;
-    int m_fd;
+    BoardAllocator::Board m_board;
+    BoardPool::BoardClass m_boardClass;
+    const DatagramBoard::BoardInfo *m_header;
+    uint64_t m_sampleTime;
+    uint64_t m_sampleSequence;
+    uint64_t m_samplePosition;
+    BoardAllocator::Board m_nextBoard;
+    BoardPool::BoardClass m_nextBoardClass;
+    bool m_resizing;
+    uint64_t m_resizeDeadline;
+  };
+
+  typedef OpenHashMap<const char *, Channel *, StringKeyTraits> ChannelMap;
+
+  /***
+   * A reader whose lag is checked. Watches are kept in a dense vector,
+   * holding what the check needs, so that checking every reader only
+   * walks that vector and reads each board's header.
+   *
+   * @var Watch::m_header The channel's board header
+   * @var Watch::m_position Bytes read, as last reported
+   * @var Watch::m_threshold The lag in bytes the reader is slow at
+   * @var Watch::m_channel The channel
+   * @var Watch::m_client The reader
+   * @var Watch::m_policy What to do about the reader being slow
+   * @var Watch::m_lagging Whether the reader is slow
+   */
+  struct Watch {
+    const DatagramBoard::BoardInfo *m_header;
+    uint64_t m_position;
+    uint64_t m_threshold;
+    Channel *m_channel;
+    Client *m_client;
+    ChannelConfig::SlowReaderPolicy m_policy;
+    bool m_lagging;
   };
 
+  /***
+   * Finds a channel by name
+   *
+   * @param channelName A NUL-terminated channel name string
+   *
+   * @return the channel, or 0 if there is no such channel
+   */
+  Channel *findChannel(const char *channelName) const;
+
   /***
    * subscribe to the requested channel, and create the channel
    * if non-existent.
@@ -250,22 +858,245 @@ private:
   int unsubscribe(Client *client, const char *channelName, bool writer);
 
   /***
-   * Prints the prefix for a log message
+   * unsubscribe from a channel already looked up. See
+   * unsubscribe(Client *, const char *, bool).
+   */
+  int unsubscribe(Client *client, Channel *channel, bool writer);
+
+  /***
+   * Creates a channel without subscribers and adds it to the index
+   *
+   * @param channelName A NUL-terminated channel name string. It is
+   * copied
+   * @param board The channel's board. Owned by the channel on success
+   *
+   * @return the Channel on success, 0 on error
+   */
+  Channel *createChannel(const char *channelName,
+                         const BoardAllocator::Board &board);
+
+  /***
+   * Pushes a new channel to the clients whose patterns match it
+   */
+  void announceChannel(Channel *channel);
+
+  /***
+   * Picks the NUMA node for the board of a new channel: the channel
+   * config's node, else the creating client's hint, else the node the
+   * client runs on if the config says "auto"
+   *
+   * @return the node, or NumaUtil::NO_NODE
+   */
+  int placementNode(const ChannelConfig::Options &options,
+                    const Client *client) const;
+
+  /***
+   * Takes a board of a class from the pool, or creates, places and warms
+   * one
+   *
+   * @param channelName The channel the board is for. 0 for a board that
+   * stays a spare until it is adopted
+   * @param report Set to describe the board for the log
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int createBoard(const char *channelName,
+                  const ChannelConfig::Options &options,
+                  const BoardPool::BoardClass &boardClass,
+                  BoardAllocator::Board *board,
+                  ManagerLog::BoardReport *report);
+
+  /***
+   * Prefaults and locks a board as its channel's options ask for
+   *
+   * @return how long it took, in nanoseconds
+   */
+  uint64_t warmBoard(const ChannelConfig::Options &options,
+                     BoardAllocator::Board *board);
+
+  /***
+   * Describes a new board for the CHANNEL_CREATED log
+   *
+   * @param numaNode The node the board was to be placed on
+   * @param warmNanos How long warming the board took
+   */
+  static void reportBoard(const ChannelConfig::Options &options,
+                          int numaNode, const BoardAllocator::Board &board,
+                          uint64_t warmNanos,
+                          ManagerLog::BoardReport *report);
+
+  /***
+   * Removes a channel from the index, gives its board back to the pool
+   * or destroys it, and deletes the channel
    */
-  void printLogPrefix(void);
+  void destroyChannel(Channel *channel);
 
-  static const size_t LOG_TIME_LENGTH = 20;
-  static const char *const LOG_TIME_FORMAT;
-  static const char *const LOG_TIME_ERROR;
+  /***
+   * Starts moving a channel to a larger board. The board is sent to the
+   * writer, and the channel switches to it once the writer did. A
+   * channel without a writer switches at once.
+   *
+   * @param client The client asking for it
+   * @param requestedSize The new board size
+   *
+   * @return 0 on success, non-zero if the channel cannot be resized
+   */
+  int resize(Client *client, Channel *channel, uint32_t requestedSize);
+
+  /***
+   * Makes the board a resizing channel is being moved to its board,
+   * destroys the old one and sends the new one to the readers
+   *
+   * @param sequence The first message on the new board
+   */
+  void switchBoard(Channel *channel, uint64_t sequence);
+
+  /***
+   * Gives up the resizes whose writer did not move in time: their new
+   * board is destroyed, and the channels stay on their board
+   */
+  void abandonResizes(void);
+
+  /***
+   * @return the channel's board header, mapping it if it is not yet.
+   * 0 if it cannot be mapped
+   */
+  const DatagramBoard::BoardInfo *boardHeader(Channel *channel);
+
+  /***
+   * Records a reader's progress report, and starts checking its lag if
+   * the channel's policy asks for it
+   */
+  void reportProgress(Channel *channel, Client *client, Reader *reader);
+
+  /***
+   * Stops checking a reader's lag. Must be called before the reader is
+   * removed from the channel
+   */
+  void unwatchReader(Reader *reader);
+
+  /***
+   * Checks the lag of every watched reader, and applies the channel's
+   * policy to those that fell behind or caught up
+   */
+  void checkReaders(void);
+
+  /***
+   * Applies the policy to a watched reader that fell behind
+   *
+   * @param index The reader's watch
+   * @param lag How far behind it is, in bytes
+   *
+   * @return whether the watch was removed, i.e. the reader unsubscribed
+   */
+  bool handleSlowReader(size_t index, uint64_t lag);
+
+  /***
+   * Samples every channel and publishes the sample to the stats segment
+   */
+  void sampleStats(void);
+
+  /***
+   * Samples one channel and its readers
+   *
+   * @param now The time of the sample, on CLOCK_MONOTONIC
+   */
+  void sampleChannel(Channel *channel, uint64_t now);
+
+  /***
+   * Sets up the stats segment and the timer sampling into it. Failing to
+   * only costs the stats
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int initStats(const Settings &settings);
+
+  /***
+   * Adopts the named boards of a crashed manager as channels without
+   * subscribers
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int recoverChannels(void);
+
+  /***
+   * Destroys every channel that still has no subscribers, i.e. the
+   * recovered or handed over channels nobody claimed
+   */
+  void destroyUnclaimedChannels(void);
+
+  /***
+   * Hands all channels, clients and the listening socket over to the
+   * replacement manager on the other end of 'client', then exits. Only
+   * returns if the handover failed, in which case this manager carries
+   * on.
+   *
+   * @return non-zero
+   */
+  int handOver(Client *client);
+
+  /***
+   * Requests a handover from the running manager and receives its
+   * state. The takeover is only completed by completeTakeover().
+   *
+   * @return 0 on success, 1 if no manager is running, negative on error
+   */
+  int takeOver(const IPCAddress &managerAddress);
+
+  /***
+   * Tells the outgoing manager that everything was received, and waits
+   * for it to exit
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int completeTakeover(void);
+
+  /***
+   * Tells the outgoing manager to carry on, after a failed takeover
+   */
+  void abortTakeover(void);
+
+  /***
+   * Accepts a connection on the listening socket
+   *
+   * @return the connection's file descriptor, negative on error
+   */
+  int acceptClient(void);
+
+  static const uint64_t UNCLAIMED_CHANNEL_TIMEOUT_MILLIS = 60 * 1000;
+
+  /***
+   * Rows of the stats segment per channel row
+   */
+  static const uint32_t STATS_READERS_PER_CHANNEL = 4;
+
+  /***
+   * Reader::m_watch of a reader whose lag is not checked
+   */
+  static const uint32_t NO_WATCH = UINT32_MAX;
 
   UnixServerLink m_link;
-  SelectDispatcher m_dispatcher;
-  std::list<Channel> m_channels;
+  int m_adoptedLinkFd;
+  int m_handoverFd;
+  DispatcherBase *m_dispatcher;
+  ChannelMap m_channels;
+  PrefixTrie<Channel *> m_channelNames;
+  PrefixTrie<Client *> m_patterns;
+  ClientSet m_clients;
+  BoardAllocator m_boards;
+  BoardPool m_pool;
+  ChannelConfig m_channelConfig;
   std::set<uid_t> m_permittedUIDSet;
   std::set<gid_t> m_permittedGIDSet;
-  std::ofstream m_logFile;
   uint64_t m_defaultBufferSize;
-  std::ostream *m_logStream;
+  uint64_t m_clientQueueSize;
+  uint64_t m_resizeTimeoutMillis;
+  ManagerLog m_log;
+  StatsPublisher m_stats;
+  std::vector<Watch> m_watches;
+  uint32_t m_numResizing;
+  uint32_t m_numQueries;
+  uint64_t m_boardBytes;
 
 public:
   /***
@@ -283,30 +1114,33 @@ public:
   /***
    * Initializes the Manager
    *
-   * 1) Copies the Permitted UID and GID sets
+   * 1) Copies the Permitted UID and GID sets and the channel config
    * 2) Sets the default buffer size to 'defaultBufferSize'
-   * 3) Open the log file
-   * 4) Opens the listening UDS at
-   * ShMemBCastProtocol::getManagerIPCAddress()
+   * 3) Open the log file and the board directory, and reserves spare
+   * boards of the default class
+   * 4) Takes over the listening UDS, channels and clients of the
+   * running manager, or opens the listening UDS at
+   * ShMemBCastProtocol::getManagerIPCAddress() and recovers or clears
+   * the named boards
    * 5) Sets SIGPIPE to ignore
-   * 6) Adds itself to the dispatcher.
+   * 6) Creates the dispatcher and adds itself, the clients, the
+   * unclaimed channel timer and the slow reader timer to it.
+   * 7) Completes the takeover
+   * 8) Creates the stats segment and adds the timer sampling into it
    *
-   * @param vlan The vlan to manager
-   * @param permittedUIDSet The set of permitted UID's
-   * @param permittedGIDSet The set of permitted GID's
-   * @param defaultBufferSize The minimum buffer size in bytes
-   * @param logFilePath Path to the log file to open. The special value of "-"
-   * indicates stdout
+   * @param settings The manager's settings
    *
    * @return 0 on success, non-zero on error
    */
-  int init(const std::string &vlan, const std::set<uid_t> &permittedUIDSet,
-           const std::set<gid_t> &permittedGIDSet, uint64_t defaultBufferSize,
-           const std::string &logFilePath);
+  int init(const Settings &settings);
 
   /***
    * Runs the Manager. Call init() before calling this function. This
    * function should not return.
+   *
+   * The log's formatter thread and the board pool's thread are started
+   * here rather than in init(), so that the process may daemonize in
+   * between.
    */
   void run(void);
 
@@ -322,15 +1156,47 @@ public:
 };
 
 // inline and template functions
-inline ShMemBCastManager::Client::Client(int fd, pid_t pid,
+inline ShMemBCastManager::Settings::Settings(void)
+    : m_vlan(), m_permittedUIDSet(), m_permittedGIDSet(),
+      m_defaultBufferSize(0), m_logFilePath(),
+      m_dispatcherType(SELECT_DISPATCHER), m_logMode(ManagerLog::ASYNC_MODE),
+      m_boardDir(), m_recover(false), m_takeover(false),
+      m_channelConfig(), m_statsIntervalMillis(0), m_statsChannels(0),
+      m_slowReaderIntervalMillis(0), m_resizeTimeoutMillis(0),
+      m_clientQueueSize(0) {}
+
+inline ShMemBCastManager::Client::Client(int fd, pid_t pid, uid_t uid,
                                          ShMemBCastManager *manager)
-    : m_link(fd), m_subscriptions(), m_manager(manager), m_pid(pid),
-      m_eventMode(false) {}
+    : m_link(fd), m_subscriptions(), m_patterns(), m_manager(manager),
+      m_pid(pid),
+      m_uid(uid), m_eventMode(false), m_numaHint(NumaUtil::NO_NODE),
+      m_output(), m_cutOff(false), m_query(0), m_batchApproved(),
+      m_batchFds(), m_batchReply() {}
+
+inline pid_t ShMemBCastManager::Client::pid(void) const { return m_pid; }
+
+inline uid_t ShMemBCastManager::Client::uid(void) const { return m_uid; }
+
+inline int ShMemBCastManager::Client::numaHint(void) const {
+  return m_numaHint;
+}
+
+inline bool ShMemBCastManager::Client::eventMode(void) const {
+  return m_eventMode;
+}
+
+inline void ShMemBCastManager::Client::setEventMode(bool eventMode) {
+  m_eventMode = eventMode;
+}
 
 inline int ShMemBCastManager::Client::readFileDescriptor(void) const {
   return m_link.fileDescriptor();
 }
 
+inline int ShMemBCastManager::Client::writeFileDescriptor(void) const {
+  return m_link.fileDescriptor();
+}
+
 inline int ShMemBCastManager::Client::onClose(void) {
   return TTECH_DELETE_CHAN;
 }
@@ -339,40 +1205,49 @@ inline int ShMemBCastManager::Client::mode(void) const {
   return ChannelBase::SELECT_MODE;
 }
 
-inline void ShMemBCastManager::printLogPrefix(void) {
-  // static buffer to remove allocation time
-  static char timeString[LOG_TIME_LENGTH];
-
-  // get time
-  time_t rawTime = ::time(0);
-  struct tm *localTime = ::localtime(&rawTime);
-  if (0 ==
-      ::strftime(timeString, sizeof(timeString), LOG_TIME_FORMAT, localTime)) {
-    ::strncpy(timeString, LOG_TIME_ERROR, LOG_TIME_LENGTH - 1);
-    timeString[LOG_TIME_LENGTH - 1] = '\0';
-  }
-
-  // skip the std::endl as this is the beginning of a line
-  (*m_logStream) << timeString << ": ";
+inline ShMemBCastManager::Timer::Timer(
+    ShMemBCastManager *manager, void (ShMemBCastManager::*callback)(void))
+    : m_manager(manager), m_callback(callback), m_fd(-1), m_periodic(false) {}
+
+inline int ShMemBCastManager::Timer::readFileDescriptor(void) const {
+  return m_fd;
 }
 
-inline ShMemBCastManager::ShMemBCastManager(void)
-    : m_link(), m_dispatcher(), m_channels(), m_permittedUIDSet(),
-      m_permittedGIDSet(), m_logFile(), m_defaultBufferSize(0), m_logStream(0) {
+inline int ShMemBCastManager::Timer::onClose(void) {
+  return TTECH_DELETE_CHAN;
 }
 
-inline ShMemBCastManager::~ShMemBCastManager(void) { delete m_logStream; }
+inline int ShMemBCastManager::Timer::mode(void) const {
+  return ChannelBase::SELECT_MODE;
+}
 
-inline void ShMemBCastManager::run(void) { m_dispatcher.run(); }
+inline ShMemBCastManager::Reader::Reader(uint32_t count)
+    : m_count(count), m_watch(NO_WATCH), m_sequence(0), m_position(0),
+      m_overruns(0), m_reportTime(0) {}
+
+inline ShMemBCastManager::Channel *
+ShMemBCastManager::findChannel(const char *channelName) const {
+  Channel *const *channel = m_channels.find(channelName);
+  return (0 == channel) ? (0) : (*channel);
+}
+
+inline ShMemBCastManager::ShMemBCastManager(void)
+    : m_link(), m_adoptedLinkFd(-1), m_handoverFd(-1), m_dispatcher(0),
+      m_channels(), m_channelNames(), m_patterns(), m_clients(), m_boards(),
+      m_pool(&m_boards), m_channelConfig(), m_permittedUIDSet(),
+      m_permittedGIDSet(), m_defaultBufferSize(0), m_clientQueueSize(0),
+      m_resizeTimeoutMillis(0), m_log(), m_stats(), m_watches(),
+      m_numResizing(0), m_numQueries(0), m_boardBytes(0) {}
+
+inline ShMemBCastManager::~ShMemBCastManager(void) { delete m_dispatcher; }
 
 inline int ShMemBCastManager::readFileDescriptor(void) const {
-  return m_link.fileDescriptor();
+  return (0 <= m_adoptedLinkFd) ? (m_adoptedLinkFd) : (m_link.fileDescriptor());
 }
 
 inline int ShMemBCastManager::onClose(void) {
   // log
-  printLogPrefix();
-  (*m_logStream) << "Manager Ending" << std::endl;
+  m_log.logEvent(ManagerLog::MANAGER_ENDING);
 
   return 0;
 }
@@ -20,6 +20,7 @@
 #include <pwd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -28,6 +29,17 @@ const char *const DEFAULT_LOG_FILE_SUFFIX = "/smb_manager.log";
 const size_t LOG_FILE_PATH_LENGTH = 256;
 const size_t MINIMUM_BUFFER_SIZE = USHRT_MAX;
 const size_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+const char *const DEFAULT_BOARD_DIR_PREFIX = "/dev/shm/smb_manager/";
+const uint32_t DEFAULT_STATS_INTERVAL_MILLIS = 1000;
+const uint32_t MAX_STATS_INTERVAL_MILLIS = 3600 * 1000;
+const uint32_t DEFAULT_STATS_CHANNELS = 4096;
+const uint32_t MAX_STATS_CHANNELS = 1024 * 1024;
+const uint32_t DEFAULT_SLOW_READER_INTERVAL_MILLIS = 1;
+const size_t DEFAULT_CLIENT_QUEUE_SIZE = 256 * 1024;
+const size_t MAX_CLIENT_QUEUE_SIZE = 64 * 1024 * 1024;
+const uint32_t MAX_SLOW_READER_INTERVAL_MILLIS = 60 * 1000;
+const uint32_t DEFAULT_RESIZE_TIMEOUT_MILLIS = 5000;
+const uint32_t MAX_RESIZE_TIMEOUT_MILLIS = 3600 * 1000;
 
 /**
  * Generates the log file path
@@ -175,6 +187,56 @@ int parsePermissions(std::set<uid_t> *permittedUIDSet,
   return 0;
 }
 
+/**
+ * Raises the soft open file limit to the hard limit, so that the epoll
+ * dispatcher can actually hold more than the default 1024 clients.
+ *
+ * @return 0 on success, non-zero on error. Errors are logged to stderr
+ */
+int raiseOpenFileLimit(void) {
+  struct rlimit limit;
+  if (0 != ::getrlimit(RLIMIT_NOFILE, &limit)) {
+    std::cerr << "Could not get the open file limit" << std::endl;
+    return -1;
+  }
+
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    if (0 != ::setrlimit(RLIMIT_NOFILE, &limit)) {
+      std::cerr << "Could not raise the open file limit to " << limit.rlim_max
+                << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Raises the soft locked memory limit to the hard limit, so that boards
+ * can be locked
+ *
+ * @return 0 on success, non-zero on error. Errors are logged to stderr
+ */
+int raiseMemoryLockLimit(void) {
+  struct rlimit limit;
+  if (0 != ::getrlimit(RLIMIT_MEMLOCK, &limit)) {
+    std::cerr << "Could not get the locked memory limit" << std::endl;
+    return -1;
+  }
+
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    if (0 != ::setrlimit(RLIMIT_MEMLOCK, &limit)) {
+      std::cerr << "Could not raise the locked memory limit to "
+                << limit.rlim_max << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 void usage(const char *programName) {
   std::cerr << programName << " [option]*" << std::endl
 
@@ -206,6 +268,107 @@ void usage(const char *programName) {
             << "(default: /spare/local/smb_manager/${VLAN}/smb_manager.log)"
             << std::endl
 
+            << "  --dispatcher  | -D <string>  : event dispatcher, \"select\" "
+            << "or \"epoll\". epoll also raises the open file limit to the "
+            << "hard limit (default: select)" << std::endl
+
+            << "  --log_mode    | -L <string>  : \"async\" formats and writes "
+            << "the log on a background thread, \"sync\" writes every line "
+            << "before the next request is handled, for debugging (default: "
+            << "async)" << std::endl
+
+            << "  --board_dir   | -B <string>  : keep channel boards in named "
+            << "files in this directory, which must be on a tmpfs, so that "
+            << "they can be recovered after a crash (default: anonymous "
+            << "boards)" << std::endl
+
+            << "  --named_boards| -n           : same as --board_dir "
+            << DEFAULT_BOARD_DIR_PREFIX << "${VLAN}" << std::endl
+
+            << "  --recover     | -r           : adopt the named boards left "
+            << "in the board directory by a crashed manager. Channels nobody "
+            << "subscribes to again are destroyed after a minute. Without "
+            << "this option, they are deleted" << std::endl
+
+            << "  --takeover    | -t           : take over the channels, "
+            << "clients and socket of the running manager of this vlan, "
+            << "which then exits. Starts normally if no manager is running"
+            << std::endl
+
+            << "  --huge_pages  | -H <string>  : back boards with huge "
+            << "pages, \"none\", \"2M\" or \"1G\". Boards keep normal "
+            << "pages if not enough huge pages are reserved (default: none)"
+            << std::endl
+
+            << "  --prefault    | -P           : allocate every page of a "
+            << "new board before handing it out, so that the first writes "
+            << "do not fault (default: off)" << std::endl
+
+            << "  --lock        | -k           : prefault and lock every "
+            << "page of a new board in memory. Raises the locked memory "
+            << "limit to the hard limit (default: off)" << std::endl
+
+            << "  --numa_node   | -N <string>  : place boards on a NUMA "
+            << "node, \"none\", \"auto\" for the node of the client "
+            << "creating the channel, or a node number. A client's "
+            << "placement hint wins over \"auto\" and \"none\" "
+            << "(default: none)" << std::endl
+
+            << "  --pool_size   | -S <count>   : spare boards to keep ready "
+            << "per board size, page size, NUMA node and warming, so that "
+            << "new channels do not wait for their board. Boards of "
+            << "destroyed channels are scrubbed and reused (default: 0)"
+            << std::endl
+
+            << "  --channel_config | -c <string> : per-channel board "
+            << "options, overriding the daemon-wide ones. Sections name a "
+            << "channel, or a prefix ending in '*', and may set "
+            << "huge_pages, prefault, lock, numa_node, pool_size, "
+            << "slow_reader, slow_reader_lag, last_value_keys and "
+            << "last_value_size"
+            << ((ChannelConfig::WRITER_AREAS)
+                    ? (", and for writers built on BoardRing key_index and "
+                       "wait_area")
+                    : (""))
+            << std::endl
+
+            << "  --stats_interval | -s <ms>   : sample every channel's "
+            << "writer and readers into the stats segment /dev/shm"
+            << StatsSegment::name("${VLAN}") << " this often, for "
+            << "smb_stats. 0 for no stats segment (default: "
+            << DEFAULT_STATS_INTERVAL_MILLIS << ")" << std::endl
+
+            << "  --stats_channels | -C <count> : channels the stats "
+            << "segment has room for, with four readers each (default: "
+            << DEFAULT_STATS_CHANNELS << ")" << std::endl
+
+            << "  --slow_reader | -R <string>  : what to do about readers "
+            << "lagging too far behind the writer, \"ignore\", \"warn\" "
+            << "to log it, \"notify\" to also tell the writer, or "
+            << "\"unsubscribe\" to also unsubscribe the reader. Lags are "
+            << "judged from the readers' progress reports, so readers "
+            << "that do not report are never slow (default: ignore)"
+            << std::endl
+
+            << "  --slow_reader_lag | -a <percent> : how far behind the "
+            << "writer a reader is slow, in percent of the board size "
+            << "(default: " << ChannelConfig::DEFAULT_SLOW_READER_LAG
+            << ")" << std::endl
+
+            << "  --slow_reader_interval | -i <ms> : time between checks "
+            << "of the readers' lag (default: "
+            << DEFAULT_SLOW_READER_INTERVAL_MILLIS << ")" << std::endl
+
+            << "  --resize_timeout | -T <ms>   : time a writer has to move "
+            << "to the board of a resized channel, before the resize is "
+            << "abandoned and the channel stays on its board (default: "
+            << DEFAULT_RESIZE_TIMEOUT_MILLIS << ")" << std::endl
+
+            << "  --queue_size  | -q <integer> : bytes of replies and events "
+            << "queued for a client that does not keep up, before it is "
+            << "disconnected (default: 256KiB, constraints: >= "
+            << OutboundQueue::MIN_CAPACITY << ")" << std::endl
+
             << "  --daemon      | -d           : daemonize process (REQUIRES "
             << "--log_file)" << std::endl
 
@@ -220,16 +383,56 @@ int main(int argc, char **argv) {
   std::string permissions;
   uint64_t bufferSize = 0;
   std::string logFilePath;
+  ShMemBCastManager::DispatcherType dispatcherType =
+      ShMemBCastManager::SELECT_DISPATCHER;
+  ManagerLog::Mode logMode = ManagerLog::ASYNC_MODE;
+  std::string boardDir;
+  bool namedBoards = false;
+  bool recover = false;
+  bool takeover = false;
+  BoardAllocator::PageSize pageSize = BoardAllocator::NORMAL_PAGES;
+  bool prefault = false;
+  bool lock = false;
+  int numaNode = NumaUtil::NO_NODE;
+  uint32_t poolSize = 0;
+  std::string channelConfigPath;
+  uint64_t statsInterval = DEFAULT_STATS_INTERVAL_MILLIS;
+  uint64_t statsChannels = DEFAULT_STATS_CHANNELS;
+  ChannelConfig::SlowReaderPolicy slowReaderPolicy =
+      ChannelConfig::IGNORE_SLOW_READERS;
+  uint32_t slowReaderLag = ChannelConfig::DEFAULT_SLOW_READER_LAG;
+  uint64_t slowReaderInterval = DEFAULT_SLOW_READER_INTERVAL_MILLIS;
+  uint64_t resizeTimeout = DEFAULT_RESIZE_TIMEOUT_MILLIS;
+  uint64_t queueSize = DEFAULT_CLIENT_QUEUE_SIZE;
   bool daemon = false;
 
   // setup getopt_long options
-  const char *optstring = "-:v:p:b:l:dh?";
+  const char *optstring = "-:v:p:b:l:D:L:B:nrtH:PkN:S:c:s:C:R:a:i:T:q:dh?";
   const struct option longopts[] =
       // {char* name, int has_arg, int* flag, int val}
       {{"vlan", required_argument, 0, 'v'},
        {"permissions", required_argument, 0, 'p'},
        {"buffer_size", required_argument, 0, 'b'},
        {"log_file", required_argument, 0, 'l'},
+       {"dispatcher", required_argument, 0, 'D'},
+       {"log_mode", required_argument, 0, 'L'},
+       {"board_dir", required_argument, 0, 'B'},
+       {"named_boards", no_argument, 0, 'n'},
+       {"recover", no_argument, 0, 'r'},
+       {"takeover", no_argument, 0, 't'},
+       {"huge_pages", required_argument, 0, 'H'},
+       {"prefault", no_argument, 0, 'P'},
+       {"lock", no_argument, 0, 'k'},
+       {"numa_node", required_argument, 0, 'N'},
+       {"pool_size", required_argument, 0, 'S'},
+       {"channel_config", required_argument, 0, 'c'},
+       {"stats_interval", required_argument, 0, 's'},
+       {"stats_channels", required_argument, 0, 'C'},
+       {"slow_reader", required_argument, 0, 'R'},
+       {"slow_reader_lag", required_argument, 0, 'a'},
+       {"slow_reader_interval", required_argument, 0, 'i'},
+       {"resize_timeout", required_argument, 0, 'T'},
+       {"queue_size", required_argument, 0, 'q'},
        {"daemon", no_argument, 0, 'd'},
        {"help", no_argument, 0, 'h'},
        {0, 0, 0, 0}};
@@ -260,6 +463,157 @@ int main(int argc, char **argv) {
       logFilePath = ::optarg;
     } break;
 
+    case 'D': {
+      if (0 == ::strcmp(::optarg, "select")) {
+        dispatcherType = ShMemBCastManager::SELECT_DISPATCHER;
+      } else if (0 == ::strcmp(::optarg, "epoll")) {
+        dispatcherType = ShMemBCastManager::EPOLL_DISPATCHER;
+      } else {
+        std::cerr << "Unknown dispatcher \"" << ::optarg << "\"" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'L': {
+      if (0 == ::strcmp(::optarg, "async")) {
+        logMode = ManagerLog::ASYNC_MODE;
+      } else if (0 == ::strcmp(::optarg, "sync")) {
+        logMode = ManagerLog::SYNC_MODE;
+      } else {
+        std::cerr << "Unknown log mode \"" << ::optarg << "\"" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'B': {
+      boardDir = ::optarg;
+    } break;
+
+    case 'n': {
+      namedBoards = true;
+    } break;
+
+    case 'r': {
+      recover = true;
+    } break;
+
+    case 't': {
+      takeover = true;
+    } break;
+
+    case 'H': {
+      if (0 != ChannelConfig::parsePageSize(::optarg, &pageSize)) {
+        std::cerr << "Unknown huge page size \"" << ::optarg << "\""
+                  << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'P': {
+      prefault = true;
+    } break;
+
+    case 'k': {
+      lock = true;
+    } break;
+
+    case 'N': {
+      if (0 != ChannelConfig::parseNumaNode(::optarg, &numaNode)) {
+        std::cerr << "Unknown NUMA node \"" << ::optarg << "\"" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'S': {
+      if (0 != ChannelConfig::parsePoolSize(::optarg, &poolSize)) {
+        std::cerr << "Please enter a pool size of at most "
+                  << ChannelConfig::MAX_POOL_SIZE << " boards" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'c': {
+      channelConfigPath = ::optarg;
+    } break;
+
+    case 's': {
+      statsInterval = StrToInt::parseUint(::optarg);
+      if (((0 == statsInterval) && (0 != ::strcmp(::optarg, "0"))) ||
+          (MAX_STATS_INTERVAL_MILLIS < statsInterval)) {
+        std::cerr << "Please enter a stats interval of at most "
+                  << MAX_STATS_INTERVAL_MILLIS << " ms" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'C': {
+      statsChannels = StrToInt::parseUint(::optarg);
+      if ((0 == statsChannels) || (MAX_STATS_CHANNELS < statsChannels)) {
+        std::cerr << "Please enter a stats segment size of 1 to "
+                  << MAX_STATS_CHANNELS << " channels" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'R': {
+      if (0 != ChannelConfig::parseSlowReaderPolicy(::optarg,
+                                                    &slowReaderPolicy)) {
+        std::cerr << "Unknown slow reader policy \"" << ::optarg << "\""
+                  << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'a': {
+      if (0 != ChannelConfig::parseSlowReaderLag(::optarg, &slowReaderLag)) {
+        std::cerr << "Please enter a slow reader lag of 1 to 100 percent"
+                  << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'i': {
+      slowReaderInterval = StrToInt::parseUint(::optarg);
+      if ((0 == slowReaderInterval) ||
+          (MAX_SLOW_READER_INTERVAL_MILLIS < slowReaderInterval)) {
+        std::cerr << "Please enter a slow reader interval of 1 to "
+                  << MAX_SLOW_READER_INTERVAL_MILLIS << " ms" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'T': {
+      resizeTimeout = StrToInt::parseUint(::optarg);
+      if ((0 == resizeTimeout) || (MAX_RESIZE_TIMEOUT_MILLIS < resizeTimeout)) {
+        std::cerr << "Please enter a resize timeout of 1 to "
+                  << MAX_RESIZE_TIMEOUT_MILLIS << " ms" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    case 'q': {
+      queueSize = StrToInt::parseUint(::optarg);
+      if ((OutboundQueue::MIN_CAPACITY > queueSize) ||
+          (MAX_CLIENT_QUEUE_SIZE < queueSize)) {
+        std::cerr << "Please enter a queue size of "
+                  << OutboundQueue::MIN_CAPACITY << " to "
+                  << MAX_CLIENT_QUEUE_SIZE << " bytes" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
     case 'd': {
       daemon = true;
     } break;
@@ -295,6 +649,90 @@ int main(int argc, char **argv) {
         usage(argv[0]);
         return 1;
       } break;
+
+      case 'D': {
+        std::cerr << "Please specify a dispatcher" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'L': {
+        std::cerr << "Please specify a log mode" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'B': {
+        std::cerr << "Please specify a board directory" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'H': {
+        std::cerr << "Please specify a huge page size" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'N': {
+        std::cerr << "Please specify a NUMA node" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'S': {
+        std::cerr << "Please specify a pool size" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'c': {
+        std::cerr << "Please specify a channel config file" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 's': {
+        std::cerr << "Please specify a stats interval" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'C': {
+        std::cerr << "Please specify a stats segment size" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'R': {
+        std::cerr << "Please specify a slow reader policy" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'a': {
+        std::cerr << "Please specify a slow reader lag" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'i': {
+        std::cerr << "Please specify a slow reader interval" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'T': {
+        std::cerr << "Please specify a resize timeout" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
+
+      case 'q': {
+        std::cerr << "Please specify a queue size" << std::endl;
+        usage(argv[0]);
+        return 1;
+      } break;
       }
     } break;
     }
@@ -344,9 +782,44 @@ int main(int argc, char **argv) {
     logFilePath = path;
   }
 
-  std::set<uid_t> permittedUIDSet;
-  std::set<gid_t> permittedGIDSet;
-  if (0 != parsePermissions(&permittedUIDSet, &permittedGIDSet, permissions)) {
+  if (boardDir.empty() && namedBoards) {
+    // use default board directory
+    boardDir = DEFAULT_BOARD_DIR_PREFIX + vlan;
+  }
+
+  if (recover && boardDir.empty()) {
+    std::cerr << "Only named boards can be recovered, please specify a "
+              << "board directory" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  ShMemBCastManager::Settings settings;
+  if (0 != parsePermissions(&(settings.m_permittedUIDSet),
+                            &(settings.m_permittedGIDSet), permissions)) {
+    return 1;
+  }
+
+  // the config file overrides the daemon-wide options
+  settings.m_channelConfig.defaults().m_pageSize = pageSize;
+  settings.m_channelConfig.defaults().m_prefault = prefault;
+  settings.m_channelConfig.defaults().m_lock = lock;
+  settings.m_channelConfig.defaults().m_numaNode = numaNode;
+  settings.m_channelConfig.defaults().m_poolSize = poolSize;
+  settings.m_channelConfig.defaults().m_slowReaderPolicy = slowReaderPolicy;
+  settings.m_channelConfig.defaults().m_slowReaderLag = slowReaderLag;
+  if (!channelConfigPath.empty() &&
+      (0 != settings.m_channelConfig.load(channelConfigPath))) {
+    return 1;
+  }
+
+  if (settings.m_channelConfig.usesLock()) {
+    // boards that cannot be locked are still created, so carry on
+    raiseMemoryLockLimit();
+  }
+
+  if ((ShMemBCastManager::EPOLL_DISPATCHER == dispatcherType) &&
+      (0 != raiseOpenFileLimit())) {
     return 1;
   }
 
@@ -355,8 +828,20 @@ int main(int argc, char **argv) {
 
   // create manager
   ShMemBCastManager manager;
-  if (0 != manager.init(vlan, permittedUIDSet, permittedGIDSet, bufferSize,
-                        logFilePath)) {
+  settings.m_vlan = vlan;
+  settings.m_defaultBufferSize = bufferSize;
+  settings.m_logFilePath = logFilePath;
+  settings.m_dispatcherType = dispatcherType;
+  settings.m_logMode = logMode;
+  settings.m_boardDir = boardDir;
+  settings.m_recover = recover;
+  settings.m_takeover = takeover;
+  settings.m_statsIntervalMillis = statsInterval;
+  settings.m_statsChannels = statsChannels;
+  settings.m_slowReaderIntervalMillis = slowReaderInterval;
+  settings.m_resizeTimeoutMillis = resizeTimeout;
+  settings.m_clientQueueSize = queueSize;
+  if (0 != manager.init(settings)) {
     std::cerr << "Could not initialize Manager" << std::endl;
     return 1;
   }
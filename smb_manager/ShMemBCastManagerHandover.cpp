@@ -0,0 +1,558 @@
+#include "HandoverProtocol.h"
+#include "ShMemBCastManager.h"
+
+#include <core/link/UnixSocketUtil.h>
+
+#include <new>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+/***
+ * How long either manager waits for the other one during a handover
+ */
+const struct timeval HANDOVER_TIMEOUT = {5, 0};
+
+/***
+ * How long a client gets to take in its queued messages before it is
+ * handed over
+ */
+const int HANDOVER_DRAIN_MILLIS = 100;
+
+/***
+ * Sends one handover message
+ *
+ * @param size The message size, as returned by its init(). Negative sizes
+ * fail
+ *
+ * @return 0 on success, non-zero on error
+ */
+int sendMessage(int fd, const char *buffer, ssize_t size) {
+  if (0 > size) {
+    return -1;
+  }
+
+  return (size == ::send(fd, buffer, size, MSG_NOSIGNAL)) ? (0) : (-1);
+}
+
+/***
+ * Receives a file descriptor sent with UnixSocketUtil::sendFd(). It is
+ * marked close-on-exec.
+ *
+ * @return the file descriptor, negative on error
+ */
+int receiveFd(int socketFd) {
+  char control[CMSG_SPACE(sizeof(int))];
+  char data[sizeof(int)];
+  struct iovec iov;
+  struct msghdr message;
+  struct cmsghdr *header;
+  int fd;
+
+  iov.iov_base = data;
+  iov.iov_len = sizeof(data);
+  ::memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (0 >= ::recvmsg(socketFd, &message, MSG_CMSG_CLOEXEC)) {
+    return -1;
+  }
+
+  header = CMSG_FIRSTHDR(&message);
+  if ((0 == header) || (SOL_SOCKET != header->cmsg_level) ||
+      (SCM_RIGHTS != header->cmsg_type) ||
+      (CMSG_LEN(sizeof(int)) != header->cmsg_len)) {
+    return -1;
+  }
+  ::memcpy(&fd, CMSG_DATA(header), sizeof(fd));
+
+  return fd;
+}
+
+/***
+ * Applies HANDOVER_TIMEOUT to both directions of a socket
+ *
+ * @return 0 on success, non-zero on error
+ */
+int setHandoverTimeouts(int fd) {
+  if ((0 != ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &HANDOVER_TIMEOUT,
+                         sizeof(HANDOVER_TIMEOUT))) ||
+      (0 != ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &HANDOVER_TIMEOUT,
+                         sizeof(HANDOVER_TIMEOUT)))) {
+    return -1;
+  }
+
+  return 0;
+}
+} // namespace
+
+int ShMemBCastManager::Client::drainOutput(int timeoutMillis) {
+  struct pollfd writable = {m_link.fileDescriptor(), POLLOUT, 0};
+  int result;
+
+  while (0 < (result = m_output.flush(m_link.fileDescriptor()))) {
+    if (0 >= ::poll(&writable, 1, timeoutMillis)) {
+      return -1;
+    }
+  }
+
+  return result;
+}
+
+int ShMemBCastManager::Client::sendHandoverState(
+    int handoverFd, const ChannelIndexMap &channelIndexes) {
+  char buffer[HandoverProtocol::BUFFER_SIZE];
+  HandoverProtocol::Subscription subscriptions
+      [HandoverProtocol::MAX_SUBSCRIPTIONS];
+  uint32_t count = 0;
+  bool failed = false;
+  ssize_t size;
+
+  // (0) what is queued for it, which the replacement could not send. A
+  // client that does not take it in time is cut off, and disconnected by
+  // the replacement
+  if (0 != drainOutput(HANDOVER_DRAIN_MILLIS)) {
+    cutOff();
+  }
+
+  // (1) the client and its connection
+  size = HandoverProtocol::Client::init(
+      buffer, sizeof(buffer), m_pid, m_uid,
+      m_eventMode ? (HandoverProtocol::EVENT_MODE_FLAG) : (0));
+  if ((0 != sendMessage(handoverFd, buffer, size)) ||
+      (0 != UnixSocketUtil::sendFd(handoverFd, m_link.fileDescriptor()))) {
+    return -1;
+  }
+
+  // (2) its subscriptions, in batches
+  m_subscriptions.forEach([&](Channel *channel,
+                              const Subscription &subscription) {
+    if (failed) {
+      return;
+    }
+
+    const uint32_t *index = channelIndexes.find(channel);
+    if (0 == index) {
+      failed = true;
+      return;
+    }
+
+    subscriptions[count].m_channelIndex = *index;
+    subscriptions[count].m_readerCount = subscription.m_readerCount;
+    subscriptions[count].m_writer = subscription.m_writer ? (1) : (0);
+    if (HandoverProtocol::MAX_SUBSCRIPTIONS == ++count) {
+      size = HandoverProtocol::Subscriptions::init(buffer, sizeof(buffer),
+                                                   subscriptions, count);
+      failed = (0 != sendMessage(handoverFd, buffer, size));
+      count = 0;
+    }
+  });
+  if (failed) {
+    return -1;
+  }
+
+  if (0 < count) {
+    size = HandoverProtocol::Subscriptions::init(buffer, sizeof(buffer),
+                                                 subscriptions, count);
+    if (0 != sendMessage(handoverFd, buffer, size)) {
+      return -1;
+    }
+  }
+
+  // (3) its patterns
+  for (size_t i = 0; i < m_patterns.size(); i++) {
+    size = HandoverProtocol::Pattern::init(buffer, sizeof(buffer),
+                                           m_patterns[i].c_str());
+    if (0 != sendMessage(handoverFd, buffer, size)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int ShMemBCastManager::Client::restoreSubscriptions(Channel *channel,
+                                                    uint32_t readerCount,
+                                                    bool writer) {
+  Subscription *subscription = m_subscriptions.find(channel);
+  if (0 != subscription) {
+    subscription->m_readerCount += readerCount;
+    subscription->m_writer = subscription->m_writer || writer;
+    return 0;
+  }
+
+  Subscription newSubscription;
+  newSubscription.m_readerCount = readerCount;
+  newSubscription.m_writer = writer;
+
+  return m_subscriptions.insert(channel, newSubscription);
+}
+
+int ShMemBCastManager::handOver(Client *requester) {
+  char buffer[HandoverProtocol::BUFFER_SIZE];
+  ChannelIndexMap channelIndexes;
+  const int handoverFd = requester->readFileDescriptor();
+  const uint32_t numChannels = m_channels.size();
+  // the requester itself stays behind
+  const uint32_t numClients = m_clients.size() - 1;
+  uint32_t nextIndex = 0;
+  bool failed = false;
+  ssize_t size;
+  int flags;
+
+  // only a manager run by the same user may take over
+  if (requester->uid() != ::geteuid()) {
+    m_log.logHandover(ManagerLog::HANDOVER_DENIED, requester->pid(),
+                      requester->uid(), 0, 0);
+    size = HandoverProtocol::Abort::init(buffer, sizeof(buffer));
+    sendMessage(handoverFd, buffer, size);
+    return -1;
+  }
+
+  // a board being moved to exists on this side only, and so does the
+  // progress of a listing. The replacement manager may ask again once
+  // the writers moved and the listings were sent
+  if ((0 != m_numResizing) || (0 != m_numQueries)) {
+    m_log.logHandover(ManagerLog::HANDOVER_POSTPONED, requester->pid(),
+                      requester->uid(), m_numResizing, m_numQueries);
+    size = HandoverProtocol::Abort::init(buffer, sizeof(buffer));
+    sendMessage(handoverFd, buffer, size);
+    return -1;
+  }
+
+  // everything is sent in one go, so block, but not forever
+  flags = ::fcntl(handoverFd, F_GETFL);
+  if ((0 > flags) ||
+      (0 != ::fcntl(handoverFd, F_SETFL, flags & ~O_NONBLOCK)) ||
+      (0 != setHandoverTimeouts(handoverFd))) {
+    goto SETUP_ERROR;
+  }
+
+  // (1) Begin, followed by the listening socket
+  size = HandoverProtocol::Begin::init(buffer, sizeof(buffer), numChannels,
+                                       numClients);
+  if ((0 != sendMessage(handoverFd, buffer, size)) ||
+      (0 != UnixSocketUtil::sendFd(handoverFd, readFileDescriptor()))) {
+    goto SEND_ERROR;
+  }
+
+  // (2) the channels, each followed by its board
+  m_channels.forEach([&](const char *, Channel *channel) {
+    if (failed) {
+      return;
+    }
+
+    if (0 != channelIndexes.insert(channel, nextIndex)) {
+      failed = true;
+      return;
+    }
+
+    size = HandoverProtocol::Channel::init(
+        buffer, sizeof(buffer), nextIndex++, channel->m_board.m_size,
+        channel->m_board.m_named ? (HandoverProtocol::NAMED_BOARD_FLAG) : (0),
+        channel->m_name);
+    failed = (0 != sendMessage(handoverFd, buffer, size)) ||
+             (0 != UnixSocketUtil::sendFd(handoverFd, channel->m_board.m_fd));
+  });
+  if (failed) {
+    goto SEND_ERROR;
+  }
+
+  // (3) the clients, each followed by its connection and subscriptions
+  m_clients.forEach([&](Client *client, bool) {
+    if (failed || (requester == client)) {
+      return;
+    }
+
+    failed = (0 != client->sendHandoverState(handoverFd, channelIndexes));
+  });
+  if (failed) {
+    goto SEND_ERROR;
+  }
+
+  // (4) End, then wait for the replacement to confirm
+  size = HandoverProtocol::End::init(buffer, sizeof(buffer));
+  if (0 != sendMessage(handoverFd, buffer, size)) {
+    goto SEND_ERROR;
+  }
+
+  size = ::recv(handoverFd, buffer, sizeof(buffer), 0);
+  if (!HandoverProtocol::isMessage(buffer, size,
+                                   HandoverProtocol::HANDOVER_COMPLETE,
+                                   sizeof(HandoverProtocol::Complete))) {
+    goto COMPLETE_ERROR;
+  }
+
+  m_log.logHandover(ManagerLog::HANDED_OVER, requester->pid(),
+                    requester->uid(), numChannels, numClients);
+  m_log.stop();
+  // removes the spare boards from the board directory
+  m_pool.stop();
+
+  // The replacement owns every channel, client and the socket now. Leave
+  // without running any destructor, which could unlink the socket or
+  // destroy boards.
+  ::_exit(0);
+
+COMPLETE_ERROR:
+SEND_ERROR:
+  size = HandoverProtocol::Abort::init(buffer, sizeof(buffer));
+  sendMessage(handoverFd, buffer, size);
+  ::fcntl(handoverFd, F_SETFL, flags);
+
+SETUP_ERROR:
+  m_log.logHandover(ManagerLog::HANDOVER_FAILED, requester->pid(),
+                    requester->uid(), 0, 0);
+  return -1;
+}
+
+int ShMemBCastManager::takeOver(const IPCAddress &managerAddress) {
+  char buffer[HandoverProtocol::BUFFER_SIZE];
+  const size_t minimumChannelSize =
+      offsetof(HandoverProtocol::Channel, m_channelName) + 1;
+  const size_t minimumSubscriptionsSize =
+      offsetof(HandoverProtocol::Subscriptions, m_subscriptions);
+  struct sockaddr_un address = managerAddress.toSockAddrUn();
+  std::vector<Channel *> channelsByIndex;
+  Client *client = 0;
+  int retVal = -1;
+  ssize_t size;
+
+  // (1) connect like any client and ask for the handover
+  m_handoverFd =
+      ::socket(AF_UNIX, ShMemBCastProtocol::UNIX_DOMAIN_SOCKET_TYPE |
+                            SOCK_CLOEXEC,
+               0);
+  if (0 > m_handoverFd) {
+    goto SOCKET_ERROR;
+  }
+
+  if (0 != ::connect(m_handoverFd, reinterpret_cast<sockaddr *>(&address),
+                     sizeof(address))) {
+    if ((ENOENT == errno) || (ECONNREFUSED == errno)) {
+      // nobody to take over from
+      retVal = 1;
+    }
+    goto CONNECT_ERROR;
+  }
+
+  size = HandoverProtocol::Request::init(buffer, sizeof(buffer));
+  if ((0 != setHandoverTimeouts(m_handoverFd)) ||
+      (0 != sendMessage(m_handoverFd, buffer, size))) {
+    goto HANDOVER_ERROR;
+  }
+
+  // (2) Begin, followed by the listening socket
+  size = ::recv(m_handoverFd, buffer, sizeof(buffer), 0);
+  if (!HandoverProtocol::isMessage(buffer, size,
+                                   HandoverProtocol::HANDOVER_BEGIN,
+                                   sizeof(HandoverProtocol::Begin))) {
+    std::cerr << "The running manager refused the handover" << std::endl;
+    goto HANDOVER_ERROR;
+  }
+
+  m_adoptedLinkFd = receiveFd(m_handoverFd);
+  if (0 > m_adoptedLinkFd) {
+    goto HANDOVER_ERROR;
+  }
+
+  // (3) channels and clients until End. Nothing received here is ever
+  // destroyed on error, as it still belongs to the outgoing manager
+  for (;;) {
+    size = ::recv(m_handoverFd, buffer, sizeof(buffer), 0);
+
+    if (HandoverProtocol::isMessage(buffer, size,
+                                    HandoverProtocol::HANDOVER_END,
+                                    sizeof(HandoverProtocol::End))) {
+      break;
+    }
+
+    if (HandoverProtocol::isMessage(buffer, size,
+                                    HandoverProtocol::HANDOVER_CHANNEL,
+                                    minimumChannelSize)) {
+      HandoverProtocol::Channel *message =
+          reinterpret_cast<HandoverProtocol::Channel *>(buffer);
+      BoardAllocator::Board board;
+      Channel *channel;
+
+      buffer[size - 1] = '\0';
+      if (channelsByIndex.size() != message->m_index) {
+        goto HANDOVER_ERROR;
+      }
+
+      board.m_fd = receiveFd(m_handoverFd);
+      if (0 > board.m_fd) {
+        goto HANDOVER_ERROR;
+      }
+      board.m_size = message->m_size;
+      board.m_pageSize = BoardAllocator::pageSizeOf(board.m_fd);
+      board.m_lockedMapping = 0;
+      board.m_lockedSize = 0;
+      board.m_prefaulted = false;
+      board.m_spare = false;
+      board.m_numaNode = NumaUtil::NO_NODE;
+      board.m_named = (0 != (HandoverProtocol::NAMED_BOARD_FLAG &
+                             message->m_flags));
+
+      // the outgoing manager's locks go when it exits
+      warmBoard(m_channelConfig.lookup(message->m_channelName), &board);
+
+      channel = createChannel(message->m_channelName, board);
+      if (0 == channel) {
+        ::close(board.m_fd);
+        goto HANDOVER_ERROR;
+      }
+
+      try {
+        channelsByIndex.push_back(channel);
+      } catch (std::bad_alloc &) {
+        goto HANDOVER_ERROR;
+      }
+    } else if (HandoverProtocol::isMessage(
+                   buffer, size, HandoverProtocol::HANDOVER_CLIENT,
+                   sizeof(HandoverProtocol::Client))) {
+      HandoverProtocol::Client *message =
+          reinterpret_cast<HandoverProtocol::Client *>(buffer);
+
+      int clientFd = receiveFd(m_handoverFd);
+      if (0 > clientFd) {
+        goto HANDOVER_ERROR;
+      }
+
+      client = new (std::nothrow)
+          Client(clientFd, message->m_pid, message->m_uid, this);
+      if ((0 == client) || (0 != client->init(m_clientQueueSize)) ||
+          (0 != m_clients.insert(client, true))) {
+        delete client;
+        ::close(clientFd);
+        goto HANDOVER_ERROR;
+      }
+      client->setEventMode(
+          0 != (HandoverProtocol::EVENT_MODE_FLAG & message->m_flags));
+    } else if ((0 != client) &&
+               HandoverProtocol::isMessage(
+                   buffer, size, HandoverProtocol::HANDOVER_SUBSCRIPTIONS,
+                   minimumSubscriptionsSize)) {
+      HandoverProtocol::Subscriptions *message =
+          reinterpret_cast<HandoverProtocol::Subscriptions *>(buffer);
+
+      if ((HandoverProtocol::MAX_SUBSCRIPTIONS < message->m_count) ||
+          (static_cast<size_t>(size) !=
+           (minimumSubscriptionsSize +
+            (message->m_count * sizeof(HandoverProtocol::Subscription))))) {
+        goto HANDOVER_ERROR;
+      }
+
+      for (uint32_t i = 0; i < message->m_count; i++) {
+        const HandoverProtocol::Subscription &subscription =
+            message->m_subscriptions[i];
+        if (channelsByIndex.size() <= subscription.m_channelIndex) {
+          goto HANDOVER_ERROR;
+        }
+        Channel *channel = channelsByIndex[subscription.m_channelIndex];
+
+        if (0 != subscription.m_writer) {
+          channel->m_writer = client;
+        }
+        if ((0 < subscription.m_readerCount) &&
+            (0 != channel->m_readers.insert(
+                      client, Reader(subscription.m_readerCount)))) {
+          goto HANDOVER_ERROR;
+        }
+        channel->m_numReaders += subscription.m_readerCount;
+
+        if (0 != client->restoreSubscriptions(channel,
+                                              subscription.m_readerCount,
+                                              0 != subscription.m_writer)) {
+          goto HANDOVER_ERROR;
+        }
+      }
+    } else if ((0 != client) &&
+               HandoverProtocol::isMessage(
+                   buffer, size, HandoverProtocol::HANDOVER_PATTERN,
+                   offsetof(HandoverProtocol::Pattern, m_prefix) + 1)) {
+      HandoverProtocol::Pattern *message =
+          reinterpret_cast<HandoverProtocol::Pattern *>(buffer);
+
+      buffer[size - 1] = '\0';
+      if (0 != client->addPattern(message->m_prefix)) {
+        goto HANDOVER_ERROR;
+      }
+    } else {
+      // refused half way, or the connection broke
+      goto HANDOVER_ERROR;
+    }
+  }
+
+  // the takeover is completed by completeTakeover()
+  return 0;
+
+HANDOVER_ERROR:
+  abortTakeover();
+  return -1;
+
+CONNECT_ERROR:
+  ::close(m_handoverFd);
+  m_handoverFd = -1;
+
+SOCKET_ERROR:
+  return retVal;
+}
+
+int ShMemBCastManager::completeTakeover(void) {
+  char buffer[sizeof(HandoverProtocol::Complete)];
+  pid_t pid = 0;
+  uid_t uid = 0;
+  gid_t gid;
+  ssize_t size;
+
+  UnixSocketUtil::getCredentials(&pid, &uid, &gid, m_handoverFd);
+
+  size = HandoverProtocol::Complete::init(buffer, sizeof(buffer));
+  if (0 != sendMessage(m_handoverFd, buffer, size)) {
+    // the outgoing manager sees the connection close and carries on
+    abortTakeover();
+    return -1;
+  }
+
+  // the outgoing manager exits as soon as it reads Complete, and must be
+  // gone before this one starts accepting on the shared socket
+  while (0 < ::recv(m_handoverFd, buffer, sizeof(buffer), 0)) {
+  }
+
+  ::close(m_handoverFd);
+  m_handoverFd = -1;
+
+  m_log.logHandover(ManagerLog::TOOK_OVER, pid, uid, m_channels.size(),
+                    m_clients.size());
+
+  return 0;
+}
+
+void ShMemBCastManager::abortTakeover(void) {
+  char buffer[sizeof(HandoverProtocol::Abort)];
+  ssize_t size;
+
+  if (0 > m_handoverFd) {
+    return;
+  }
+
+  size = HandoverProtocol::Abort::init(buffer, sizeof(buffer));
+  sendMessage(m_handoverFd, buffer, size);
+
+  ::close(m_handoverFd);
+  m_handoverFd = -1;
+}
@@ -0,0 +1,109 @@
+#include "StatsPublisher.h"
+
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+StatsPublisher::~StatsPublisher(void) {
+  if (0 != m_segment) {
+    ::munmap(m_segment, m_size);
+  }
+}
+
+int StatsPublisher::init(const std::string &vlan, uint32_t maxChannels,
+                         uint32_t maxReaders, uint32_t intervalMillis) {
+  const size_t size = StatsSegment::size(maxChannels, maxReaders);
+  void *mapping;
+  int fd;
+
+  try {
+    m_name = StatsSegment::name(vlan);
+  } catch (std::bad_alloc &) {
+    return -1;
+  }
+
+  // readers of the previous manager's segment keep their mapping
+  ::shm_unlink(m_name.c_str());
+  fd = ::shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                  0644);
+  if (0 > fd) {
+    goto OPEN_ERROR;
+  }
+
+  if (0 != ::ftruncate(fd, size)) {
+    goto TRUNCATE_ERROR;
+  }
+
+  mapping = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == mapping) {
+    goto MAP_ERROR;
+  }
+  ::close(fd);
+
+  // the file is zero-filled, so the generation starts even
+  m_segment = new (mapping) StatsSegment::Header();
+  m_segment->m_magic = StatsSegment::MAGIC;
+  m_segment->m_version = StatsSegment::VERSION;
+  m_segment->m_maxChannels = maxChannels;
+  m_segment->m_maxReaders = maxReaders;
+  m_segment->m_managerPid = ::getpid();
+  m_segment->m_intervalMillis = intervalMillis;
+  m_size = size;
+
+  return 0;
+
+MAP_ERROR:
+TRUNCATE_ERROR:
+  ::close(fd);
+  ::shm_unlink(m_name.c_str());
+
+OPEN_ERROR:
+  return -1;
+}
+
+void StatsPublisher::begin(void) {
+  uint64_t generation =
+      m_segment->m_generation.load(std::memory_order_relaxed);
+
+  m_segment->m_generation.store(generation + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  m_numChannels = 0;
+  m_numReaders = 0;
+  m_droppedChannels = 0;
+  m_droppedReaders = 0;
+}
+
+StatsSegment::ChannelRow *StatsPublisher::addChannel(uint32_t *index) {
+  if (m_segment->m_maxChannels <= m_numChannels) {
+    m_droppedChannels++;
+    return 0;
+  }
+
+  *index = m_numChannels;
+  return StatsSegment::channels(m_segment) + (m_numChannels++);
+}
+
+StatsSegment::ReaderRow *StatsPublisher::addReader(void) {
+  if (m_segment->m_maxReaders <= m_numReaders) {
+    m_droppedReaders++;
+    return 0;
+  }
+
+  return StatsSegment::readers(m_segment) + (m_numReaders++);
+}
+
+void StatsPublisher::end(uint64_t sampleTime) {
+  m_segment->m_sampleTime = sampleTime;
+  m_segment->m_numChannels = m_numChannels;
+  m_segment->m_numReaders = m_numReaders;
+  m_segment->m_droppedChannels = m_droppedChannels;
+  m_segment->m_droppedReaders = m_droppedReaders;
+
+  m_segment->m_generation.store(
+      m_segment->m_generation.load(std::memory_order_relaxed) + 1,
+      std::memory_order_release);
+}
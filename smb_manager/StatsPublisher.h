@@ -0,0 +1,112 @@
+#ifndef DAEMONS_STATSPUBLISHER_H_
+#define DAEMONS_STATSPUBLISHER_H_
+
+/***
+ * @file StatsPublisher.h
+ *
+ * @brief
+ * Writes the ShMemBCast Manager's samples to its stats segment.
+ *
+ * @description
+ * The segment is created by init() under StatsSegment::name(), replacing
+ * the segment of any previous manager of the vlan. Each sample is
+ * written between begin() and end(), which bump the segment's
+ * generation so that readers can tell a torn copy (see
+ * StatsSegment.h). Rows are handed out in order; once they run out, the
+ * rest of the sample is counted as dropped.
+ *
+ * All functions must be called from one thread.
+ */
+
+#include "StatsSegment.h"
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class StatsPublisher {
+private:
+  // not copyable
+  StatsPublisher(const StatsPublisher &);
+  StatsPublisher &operator=(const StatsPublisher &);
+
+  StatsSegment::Header *m_segment;
+  size_t m_size;
+  std::string m_name;
+  uint32_t m_numChannels;
+  uint32_t m_numReaders;
+  uint32_t m_droppedChannels;
+  uint32_t m_droppedReaders;
+
+public:
+  StatsPublisher(void);
+
+  /***
+   * Unmaps the segment. It is left in place for readers
+   */
+  ~StatsPublisher(void);
+
+  /***
+   * Creates and maps the segment of a vlan
+   *
+   * @param maxChannels The number of ChannelRows
+   * @param maxReaders The number of ReaderRows
+   * @param intervalMillis The time between samples, for readers
+   *
+   * @return 0 on success, non-zero on error
+   */
+  int init(const std::string &vlan, uint32_t maxChannels,
+           uint32_t maxReaders, uint32_t intervalMillis);
+
+  /***
+   * @return whether init() succeeded
+   */
+  bool enabled(void) const;
+
+  /***
+   * Starts writing a sample
+   */
+  void begin(void);
+
+  /***
+   * @param index Set to the index of the row
+   *
+   * @return the next ChannelRow, or 0 if there is none left
+   */
+  StatsSegment::ChannelRow *addChannel(uint32_t *index);
+
+  /***
+   * @return the next ReaderRow, or 0 if there is none left
+   */
+  StatsSegment::ReaderRow *addReader(void);
+
+  /***
+   * @return the index the next ReaderRow will have
+   */
+  uint32_t numReaders(void) const;
+
+  /***
+   * Publishes the sample written since begin()
+   *
+   * @param sampleTime When it was taken, in nanoseconds since the epoch
+   */
+  void end(uint64_t sampleTime);
+
+  const std::string &name(void) const;
+};
+
+// inline and template functions
+inline StatsPublisher::StatsPublisher(void)
+    : m_segment(0), m_size(0), m_name(), m_numChannels(0), m_numReaders(0),
+      m_droppedChannels(0), m_droppedReaders(0) {}
+
+inline bool StatsPublisher::enabled(void) const { return 0 != m_segment; }
+
+inline uint32_t StatsPublisher::numReaders(void) const {
+  return m_numReaders;
+}
+
+inline const std::string &StatsPublisher::name(void) const { return m_name; }
+
+#endif // DAEMONS_STATSPUBLISHER_H_
@@ -0,0 +1,252 @@
+#ifndef DAEMONS_STATSSEGMENT_H_
+#define DAEMONS_STATSSEGMENT_H_
+
+/***
+ * @file StatsSegment.h
+ *
+ * @brief
+ * Layout of the shared memory segment the ShMemBCast Manager publishes
+ * channel and reader telemetry to.
+ *
+ * @description
+ * The manager samples the header of every board on a timer and rewrites
+ * the whole segment after each sample: a Header, then up to
+ * m_maxChannels ChannelRows, then up to m_maxReaders ReaderRows. The
+ * readers of a channel are the m_numReaderRows rows starting at its
+ * m_firstReader.
+ *
+ * The segment is guarded by a sequence lock. m_generation is odd while
+ * the manager writes, so a reader copies the segment with snapshot()
+ * and retries if the generation changed meanwhile. Reading takes no
+ * system call and never blocks the manager.
+ *
+ * A manager that starts, or takes over, unlinks the segment and creates
+ * a new one. Readers still mapping the old segment see its m_sampleTime
+ * stop moving, and should open it again.
+ */
+
+#include <core/link/ShMemBCastProtocol.h>
+
+#include <atomic>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct StatsSegment {
+  typedef ShMemBCastProtocol Protocol;
+
+  static const uint32_t MAGIC = 0x534D4253; // "SMBS"
+  static const uint32_t VERSION = 2;
+
+  /***
+   * @var Header::m_magic MAGIC
+   * @var Header::m_version VERSION
+   * @var Header::m_maxChannels Number of ChannelRows
+   * @var Header::m_maxReaders Number of ReaderRows
+   * @var Header::m_generation Odd while the manager writes
+   * @var Header::m_managerPid The manager publishing to the segment
+   * @var Header::m_intervalMillis Time between samples
+   * @var Header::m_sampleTime When the last sample was taken, in
+   * nanoseconds since the epoch
+   * @var Header::m_numChannels ChannelRows in use
+   * @var Header::m_numReaders ReaderRows in use
+   * @var Header::m_droppedChannels Channels left out for lack of rows
+   * @var Header::m_droppedReaders Readers left out for lack of rows
+   */
+  struct Header {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_maxChannels;
+    uint32_t m_maxReaders;
+    std::atomic<uint64_t> m_generation;
+    int32_t m_managerPid;
+    uint32_t m_intervalMillis;
+    uint64_t m_sampleTime;
+    uint32_t m_numChannels;
+    uint32_t m_numReaders;
+    uint32_t m_droppedChannels;
+    uint32_t m_droppedReaders;
+  };
+
+  /***
+   * @var ChannelRow::m_name The NUL-terminated channel name
+   * @var ChannelRow::m_boardSize The board size in bytes
+   * @var ChannelRow::m_sequence Messages written so far
+   * @var ChannelRow::m_position Bytes written so far
+   * @var ChannelRow::m_messagesPerSecond Over the last interval
+   * @var ChannelRow::m_bytesPerSecond Over the last interval
+   * @var ChannelRow::m_writerPid The writer, 0 if there is none
+   * @var ChannelRow::m_numReaders Reader subscriptions, counting repeats
+   * @var ChannelRow::m_firstReader The channel's first ReaderRow
+   * @var ChannelRow::m_numReaderRows The channel's ReaderRows
+   */
+  struct ChannelRow {
+    char m_name[Protocol::Constants::MAX_CHANNEL_NAME_LENGTH + 1];
+    uint64_t m_boardSize;
+    uint64_t m_sequence;
+    uint64_t m_position;
+    uint64_t m_messagesPerSecond;
+    uint64_t m_bytesPerSecond;
+    int32_t m_writerPid;
+    uint32_t m_numReaders;
+    uint32_t m_firstReader;
+    uint32_t m_numReaderRows;
+  };
+
+  /***
+   * @var REPORTED_FLAG The reader reported its progress, so the lag is
+   * known
+   * @var LAPPED_FLAG The writer is more than a board ahead of the
+   * reader, which has lost messages
+   */
+  static const uint32_t REPORTED_FLAG = 0x1;
+  static const uint32_t LAPPED_FLAG = 0x2;
+
+  /***
+   * @var UNKNOWN_LAG The lag of a reader that never reported its
+   * progress. The manager cannot see where such a reader is, so its lag
+   * is unknown rather than 0
+   */
+  static const uint64_t UNKNOWN_LAG = UINT64_MAX;
+
+  /***
+   * One reader client of a channel. Lags are measured from the last
+   * progress the reader reported (see ManagerProtocol::ReaderProgress)
+   * to the writer's position when sampled.
+   *
+   * @var ReaderRow::m_channel The channel's ChannelRow
+   * @var ReaderRow::m_pid The reader
+   * @var ReaderRow::m_count Its subscriptions to the channel
+   * @var ReaderRow::m_flags REPORTED_FLAG and LAPPED_FLAG
+   * @var ReaderRow::m_sequence Messages read, as reported
+   * @var ReaderRow::m_position Bytes read, as reported
+   * @var ReaderRow::m_lagMessages Messages written but not read, or
+   * UNKNOWN_LAG
+   * @var ReaderRow::m_lagBytes Bytes written but not read, or UNKNOWN_LAG
+   * @var ReaderRow::m_overruns Messages lost, as reported
+   * @var ReaderRow::m_reportAgeMillis Time since the report
+   */
+  struct ReaderRow {
+    uint32_t m_channel;
+    int32_t m_pid;
+    uint32_t m_count;
+    uint32_t m_flags;
+    uint64_t m_sequence;
+    uint64_t m_position;
+    uint64_t m_lagMessages;
+    uint64_t m_lagBytes;
+    uint64_t m_overruns;
+    uint64_t m_reportAgeMillis;
+  };
+
+  /***
+   * @return the shm_open(3) name of the segment of a vlan
+   */
+  static std::string name(const std::string &vlan);
+
+  /***
+   * @return the size of a segment with the given number of rows
+   */
+  static size_t size(uint32_t maxChannels, uint32_t maxReaders);
+
+  static ChannelRow *channels(Header *header);
+
+  static const ChannelRow *channels(const Header *header);
+
+  static ReaderRow *readers(Header *header);
+
+  static const ReaderRow *readers(const Header *header);
+
+  /***
+   * Copies a consistent sample of a segment
+   *
+   * @param segment The mapped segment
+   * @param copy At least size(segment->m_maxChannels,
+   * segment->m_maxReaders) bytes, suitably aligned
+   * @param maxAttempts How many times to retry while the manager writes
+   *
+   * @return 0 on success, non-zero if no consistent copy was made
+   */
+  static int snapshot(const Header *segment, Header *copy,
+                      size_t maxAttempts);
+};
+
+// inline and template functions
+inline std::string StatsSegment::name(const std::string &vlan) {
+  std::string segmentName = "/smb_manager." + vlan + ".stats";
+
+  // shm_open(3) names hold no other '/'
+  for (size_t i = 1; i < segmentName.size(); i++) {
+    if ('/' == segmentName[i]) {
+      segmentName[i] = '_';
+    }
+  }
+
+  return segmentName;
+}
+
+inline size_t StatsSegment::size(uint32_t maxChannels, uint32_t maxReaders) {
+  return sizeof(Header) + (maxChannels * sizeof(ChannelRow)) +
+         (maxReaders * sizeof(ReaderRow));
+}
+
+inline StatsSegment::ChannelRow *StatsSegment::channels(Header *header) {
+  return reinterpret_cast<ChannelRow *>(header + 1);
+}
+
+inline const StatsSegment::ChannelRow *
+StatsSegment::channels(const Header *header) {
+  return reinterpret_cast<const ChannelRow *>(header + 1);
+}
+
+inline StatsSegment::ReaderRow *StatsSegment::readers(Header *header) {
+  return reinterpret_cast<ReaderRow *>(channels(header) +
+                                       header->m_maxChannels);
+}
+
+inline const StatsSegment::ReaderRow *
+StatsSegment::readers(const Header *header) {
+  return reinterpret_cast<const ReaderRow *>(channels(header) +
+                                             header->m_maxChannels);
+}
+
+inline int StatsSegment::snapshot(const Header *segment, Header *copy,
+                                  size_t maxAttempts) {
+  const size_t rowsSize =
+      size(segment->m_maxChannels, segment->m_maxReaders) - sizeof(Header);
+
+  for (size_t i = 0; i < maxAttempts; i++) {
+    uint64_t before = segment->m_generation.load(std::memory_order_acquire);
+    if (0 != (before & 1)) {
+      continue;
+    }
+
+    // every field but the generation, which is not copyable
+    copy->m_magic = segment->m_magic;
+    copy->m_version = segment->m_version;
+    copy->m_maxChannels = segment->m_maxChannels;
+    copy->m_maxReaders = segment->m_maxReaders;
+    copy->m_managerPid = segment->m_managerPid;
+    copy->m_intervalMillis = segment->m_intervalMillis;
+    copy->m_sampleTime = segment->m_sampleTime;
+    copy->m_numChannels = segment->m_numChannels;
+    copy->m_numReaders = segment->m_numReaders;
+    copy->m_droppedChannels = segment->m_droppedChannels;
+    copy->m_droppedReaders = segment->m_droppedReaders;
+    ::memcpy(static_cast<void *>(copy + 1),
+             static_cast<const void *>(segment + 1), rowsSize);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (before == segment->m_generation.load(std::memory_order_relaxed)) {
+      copy->m_generation.store(before, std::memory_order_relaxed);
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+#endif // DAEMONS_STATSSEGMENT_H_
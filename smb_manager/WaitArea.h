@@ -0,0 +1,203 @@
+#ifndef DAEMONS_WAITAREA_H_
+#define DAEMONS_WAITAREA_H_
+
+/***
+ * @file WaitArea.h
+ *
+ * @brief
+ * Layout of the wait area of a channel's board, the futex word readers
+ * of a quiet channel block on instead of spinning.
+ *
+ * @description
+ * Boards of channels configured with wait_area have the area behind
+ * their other areas, at a page boundary: behind the key index if there
+ * is one, else behind the last-value area if there is one, else behind
+ * the datagram ring. find() tells it apart by the magic, so other boards
+ * simply have none.
+ *
+ * A reader with nothing to read registers in m_waiters, checks the board
+ * once more and then blocks on m_wakes. The writer calls wake() after
+ * each datagram it publishes: it bumps m_wakes and wakes the blocked
+ * readers, but only if there are any, so that a writer nobody waits for
+ * never enters the kernel. The writer publishes before it checks
+ * m_waiters and a reader registers before it checks the board, both
+ * behind a full fence, so that one of them always sees the other.
+ *
+ * Only writers built on smb_bridge/BoardRing.h wake readers; one
+ * writing through DatagramBoard alone never does, which is why only
+ * managers built with SMB_BOARDRING_WRITER lay the area out (see
+ * ChannelConfig.h). Waking writers count
+ * themselves in m_wakers while they have the board mapped, and readers
+ * only block while there is one. As a writer that dies stays counted,
+ * readers never block for longer than MAX_BLOCK_NANOS at a time.
+ *
+ * The futex is a shared one, as the board is mapped by several
+ * processes. Readers map the area writable on its own, to register, so
+ * the rest of the board stays read-only to them.
+ */
+
+#include "KeyIndex.h"
+#include "LastValueArea.h"
+
+#include <core/link/DatagramBoard.h>
+
+#include <atomic>
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct WaitArea {
+  static const uint32_t MAGIC = 0x57424D53; // "SMBW"
+  static const uint32_t VERSION = 2;
+
+  /***
+   * @var SIZE The area takes a cache line
+   */
+  static const uint64_t SIZE = 64;
+
+  /***
+   * @var MAX_BLOCK_NANOS The longest a reader blocks before it looks at
+   * the board again
+   */
+  static const uint64_t MAX_BLOCK_NANOS = 10000000;
+
+  /***
+   * @var Header::m_magic MAGIC
+   * @var Header::m_version VERSION
+   * @var Header::m_wakes The futex word, bumped by every wake
+   * @var Header::m_waiters Readers registered to be woken
+   * @var Header::m_wakers Writers that wake them, mapping the board
+   */
+  struct Header {
+    uint32_t m_magic;
+    uint32_t m_version;
+    std::atomic<uint32_t> m_wakes;
+    std::atomic<uint32_t> m_waiters;
+    std::atomic<uint32_t> m_wakers;
+  };
+
+  /***
+   * @return the offset of the area in a board of boardSize bytes, as in
+   * DatagramBoard::BoardInfo::m_size, with the given last-value area and
+   * key index
+   */
+  static uint64_t offset(uint64_t boardSize, uint32_t lastValueKeys,
+                         uint32_t lastValueSize, uint64_t keyIndexCapacity);
+
+  /***
+   * Writes the header of a fresh area
+   */
+  static void init(Header *header);
+
+  /***
+   * @param board The mapped board, starting with its BoardInfo
+   * @param mapSize The size of the mapping
+   *
+   * @return the board's area, or 0 if it has none
+   */
+  static Header *find(void *board, uint64_t mapSize);
+
+  /***
+   * Wakes the blocked readers, if there are any. Call it after
+   * publishing a datagram
+   */
+  static void wake(Header *header);
+
+  /***
+   * Blocks until the writer wakes the readers, or for at most
+   * timeoutNanos, itself at most MAX_BLOCK_NANOS. Register in m_waiters
+   * first
+   *
+   * @param wakes m_wakes as it was before the reader last checked the
+   * board. The call returns at once if it changed since
+   */
+  static void block(Header *header, uint32_t wakes, uint64_t timeoutNanos);
+};
+
+// inline and template functions
+inline uint64_t WaitArea::offset(uint64_t boardSize, uint32_t lastValueKeys,
+                                 uint32_t lastValueSize,
+                                 uint64_t keyIndexCapacity) {
+  uint64_t end;
+
+  if (0 != keyIndexCapacity) {
+    end = KeyIndex::offset(boardSize, lastValueKeys, lastValueSize) +
+          KeyIndex::size(keyIndexCapacity);
+  } else if (0 != lastValueKeys) {
+    end = LastValueArea::offset(boardSize) +
+          LastValueArea::size(lastValueKeys, lastValueSize);
+  } else {
+    return LastValueArea::offset(boardSize);
+  }
+
+  return (end + LastValueArea::PAGE_ALIGNMENT - 1) &
+         ~(LastValueArea::PAGE_ALIGNMENT - 1);
+}
+
+inline void WaitArea::init(Header *header) {
+  header->m_magic = MAGIC;
+  header->m_version = VERSION;
+  header->m_wakes.store(0, std::memory_order_relaxed);
+  header->m_waiters.store(0, std::memory_order_relaxed);
+  header->m_wakers.store(0, std::memory_order_relaxed);
+}
+
+inline WaitArea::Header *WaitArea::find(void *board, uint64_t mapSize) {
+  const DatagramBoard::BoardInfo *info =
+      static_cast<const DatagramBoard::BoardInfo *>(board);
+  const LastValueArea::Header *area;
+  const KeyIndex::Header *index;
+  Header *header;
+  uint64_t areaOffset;
+
+  if (sizeof(DatagramBoard::BoardInfo) > mapSize) {
+    return 0;
+  }
+  area = LastValueArea::find(board, mapSize);
+  index = KeyIndex::find(board, mapSize);
+  areaOffset =
+      offset(info->m_size, (0 != area) ? (area->m_numKeys) : (0),
+             (0 != area) ? (area->m_valueSize) : (0),
+             (0 != index) ? (index->m_capacity) : (0));
+  if ((areaOffset < info->m_size) || (mapSize < areaOffset) ||
+      (mapSize - areaOffset < SIZE)) {
+    return 0;
+  }
+
+  header = reinterpret_cast<Header *>(static_cast<char *>(board) +
+                                      areaOffset);
+  if ((MAGIC != header->m_magic) || (VERSION != header->m_version)) {
+    return 0;
+  }
+
+  return header;
+}
+
+inline void WaitArea::wake(Header *header) {
+  // the datagram is published before the waiters are checked, as a
+  // reader registers before it checks the board
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (0 == header->m_waiters.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  header->m_wakes.fetch_add(1, std::memory_order_release);
+  ::syscall(SYS_futex, &header->m_wakes, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+inline void WaitArea::block(Header *header, uint32_t wakes,
+                            uint64_t timeoutNanos) {
+  const uint64_t nanos =
+      (MAX_BLOCK_NANOS < timeoutNanos) ? (MAX_BLOCK_NANOS) : (timeoutNanos);
+  const struct timespec timeout = {static_cast<time_t>(nanos / 1000000000),
+                                   static_cast<long>(nanos % 1000000000)};
+
+  // spurious returns, e.g. on a signal, are the caller's to sort out
+  ::syscall(SYS_futex, &header->m_wakes, FUTEX_WAIT, wakes, &timeout, 0, 0);
+}
+
+#endif // DAEMONS_WAITAREA_H_
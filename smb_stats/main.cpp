@@ -0,0 +1,308 @@
+#include <smb_manager/StatsSegment.h>
+
+#include <core/utils/StrToInt.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+/**
+ * Samples older than this many intervals mean the manager is gone, or
+ * replaced its segment
+ */
+const uint64_t STALE_INTERVALS = 3;
+
+const size_t SNAPSHOT_ATTEMPTS = 1000;
+
+/**
+ * A mapped stats segment and a copy to read it into
+ *
+ * @var Segment::m_mapping The manager's segment
+ * @var Segment::m_size The size of m_mapping
+ * @var Segment::m_copy The last consistent copy of it
+ */
+struct Segment {
+  const StatsSegment::Header *m_mapping;
+  size_t m_size;
+  std::vector<uint64_t> m_copy;
+
+  Segment(void) : m_mapping(0), m_size(0), m_copy() {}
+
+  ~Segment(void) { close(); }
+
+  void close(void) {
+    if (0 != m_mapping) {
+      ::munmap(const_cast<StatsSegment::Header *>(m_mapping), m_size);
+      m_mapping = 0;
+    }
+  }
+};
+
+void usage(const char *programName) {
+  std::cerr << programName << " [option]* [prefix]" << std::endl
+
+            << "Prints the channel and reader stats the smb_manager of a "
+            << "vlan publishes, for the channels starting with prefix"
+            << std::endl
+
+            << "Option Descriptions:" << std::endl
+
+            << "  --vlan    | -v <string>  : vlan of the manager (default: "
+            << "${USER})" << std::endl
+
+            << "  --readers | -r           : list every reader under its "
+            << "channel" << std::endl
+
+            << "  --watch   | -w <seconds> : print again every so many "
+            << "seconds, until interrupted" << std::endl
+
+            << "  --help    | -[h?]        : display this help message"
+            << std::endl;
+}
+
+/**
+ * Maps the stats segment of a vlan
+ *
+ * @return 0 on success, non-zero on error
+ */
+int openSegment(const std::string &vlan, Segment *segment) {
+  const std::string name = StatsSegment::name(vlan);
+  struct stat status;
+  void *mapping;
+  int fd;
+
+  fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (0 > fd) {
+    std::cerr << "No stats segment /dev/shm" << name << ", is the manager "
+              << "running with --stats_interval?" << std::endl;
+    return -1;
+  }
+
+  if ((0 != ::fstat(fd, &status)) ||
+      (static_cast<off_t>(sizeof(StatsSegment::Header)) > status.st_size)) {
+    ::close(fd);
+    std::cerr << "The stats segment is not ready yet" << std::endl;
+    return -1;
+  }
+
+  mapping = ::mmap(0, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == mapping) {
+    std::cerr << "Could not map the stats segment" << std::endl;
+    return -1;
+  }
+
+  segment->close();
+  segment->m_mapping = static_cast<const StatsSegment::Header *>(mapping);
+  segment->m_size = status.st_size;
+
+  if ((StatsSegment::MAGIC != segment->m_mapping->m_magic) ||
+      (StatsSegment::VERSION != segment->m_mapping->m_version) ||
+      (StatsSegment::size(segment->m_mapping->m_maxChannels,
+                          segment->m_mapping->m_maxReaders) >
+       segment->m_size)) {
+    std::cerr << "Unsupported stats segment" << std::endl;
+    segment->close();
+    return -1;
+  }
+
+  segment->m_copy.resize((segment->m_size + sizeof(uint64_t) - 1) /
+                         sizeof(uint64_t));
+
+  return 0;
+}
+
+uint64_t now(clockid_t clock) {
+  struct timespec time;
+  ::clock_gettime(clock, &time);
+  return (time.tv_sec * 1000000000ULL) + time.tv_nsec;
+}
+
+/**
+ * @return whether the manager stopped publishing to the segment
+ */
+bool stale(const StatsSegment::Header *sample) {
+  const uint64_t interval =
+      sample->m_intervalMillis * STALE_INTERVALS * 1000000ULL;
+  return (0 != sample->m_sampleTime) &&
+         (sample->m_sampleTime + interval < now(CLOCK_REALTIME));
+}
+
+void printReader(const StatsSegment::ReaderRow &reader, uint64_t boardSize) {
+  std::cout << "    reader " << std::setw(8) << reader.m_pid << " x"
+            << reader.m_count;
+
+  if ((0 == (StatsSegment::REPORTED_FLAG & reader.m_flags)) ||
+      (StatsSegment::UNKNOWN_LAG == reader.m_lagBytes)) {
+    std::cout << "  lag unknown (no progress reported)" << std::endl;
+    return;
+  }
+
+  std::cout << "  lag " << reader.m_lagMessages << " msgs "
+            << reader.m_lagBytes << " bytes ("
+            << std::fixed << std::setprecision(1)
+            << ((0 == boardSize)
+                    ? (0.0)
+                    : (100.0 * reader.m_lagBytes / boardSize))
+            << "% of board)  overruns " << reader.m_overruns
+            << "  reported " << reader.m_reportAgeMillis << " ms ago";
+  if (0 != (StatsSegment::LAPPED_FLAG & reader.m_flags)) {
+    std::cout << "  LAPPED";
+  }
+  std::cout << std::endl;
+}
+
+void print(const StatsSegment::Header *sample, const std::string &prefix,
+           bool readers) {
+  const StatsSegment::ChannelRow *channels = StatsSegment::channels(sample);
+  const StatsSegment::ReaderRow *readerRows = StatsSegment::readers(sample);
+  const uint32_t numChannels =
+      std::min(sample->m_numChannels, sample->m_maxChannels);
+  const uint32_t numReaders =
+      std::min(sample->m_numReaders, sample->m_maxReaders);
+  time_t sampleTime = sample->m_sampleTime / 1000000000ULL;
+  char timeString[32];
+
+  ::strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S",
+             ::localtime(&sampleTime));
+  std::cout << "Sampled " << timeString << " by manager "
+            << sample->m_managerPid << " every " << sample->m_intervalMillis
+            << " ms, " << numChannels << " channels";
+  if ((0 != sample->m_droppedChannels) || (0 != sample->m_droppedReaders)) {
+    std::cout << " (" << sample->m_droppedChannels << " channels and "
+              << sample->m_droppedReaders << " readers did not fit, see "
+              << "--stats_channels)";
+  }
+  std::cout << std::endl;
+
+  std::cout << std::left << std::setw(40) << "CHANNEL" << std::right
+            << std::setw(9) << "WRITER" << std::setw(8) << "READERS"
+            << std::setw(12) << "MSGS/S" << std::setw(14) << "BYTES/S"
+            << std::setw(14) << "MESSAGES" << std::setw(12) << "BOARD"
+            << std::endl;
+
+  for (uint32_t i = 0; i < numChannels; i++) {
+    const StatsSegment::ChannelRow &channel = channels[i];
+    if (0 != ::strncmp(channel.m_name, prefix.c_str(), prefix.size())) {
+      continue;
+    }
+
+    std::cout << std::left << std::setw(40) << channel.m_name << std::right
+              << std::setw(9) << channel.m_writerPid << std::setw(8)
+              << channel.m_numReaders << std::setw(12)
+              << channel.m_messagesPerSecond << std::setw(14)
+              << channel.m_bytesPerSecond << std::setw(14)
+              << channel.m_sequence << std::setw(12) << channel.m_boardSize
+              << std::endl;
+
+    for (uint32_t j = 0; readers && (j < channel.m_numReaderRows); j++) {
+      if (numReaders > channel.m_firstReader + j) {
+        printReader(readerRows[channel.m_firstReader + j],
+                    channel.m_boardSize);
+      }
+    }
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string vlan;
+  std::string prefix;
+  bool readers = false;
+  uint64_t watch = 0;
+  Segment segment;
+
+  // setup getopt_long options
+  const char *optstring = "v:rw:h?";
+  const struct option longopts[] =
+      // {char* name, int has_arg, int* flag, int val}
+      {{"vlan", required_argument, 0, 'v'},
+       {"readers", no_argument, 0, 'r'},
+       {"watch", required_argument, 0, 'w'},
+       {"help", no_argument, 0, 'h'},
+       {0, 0, 0, 0}};
+
+  int option;
+  while (-1 != (option = ::getopt_long(argc, argv, optstring, longopts, 0))) {
+    switch (option) {
+    case 'v': {
+      vlan = ::optarg;
+    } break;
+
+    case 'r': {
+      readers = true;
+    } break;
+
+    case 'w': {
+      watch = StrToInt::parseUint(::optarg);
+      if (0 == watch) {
+        std::cerr << "Please enter a watch interval in seconds" << std::endl;
+        usage(argv[0]);
+        return 1;
+      }
+    } break;
+
+    default: {
+      usage(argv[0]);
+      return 1;
+    } break;
+    }
+  }
+
+  if (::optind < argc) {
+    prefix = argv[::optind];
+  }
+
+  if (vlan.empty()) {
+    struct passwd *userDetails = ::getpwuid(::getuid());
+    vlan = userDetails->pw_name;
+  }
+
+  if (0 != openSegment(vlan, &segment)) {
+    return 1;
+  }
+
+  for (;;) {
+    StatsSegment::Header *copy =
+        reinterpret_cast<StatsSegment::Header *>(segment.m_copy.data());
+
+    if (0 == segment.m_mapping) {
+      // the manager was replaced, and its segment is not there yet
+      openSegment(vlan, &segment);
+    } else if (0 != StatsSegment::snapshot(segment.m_mapping, copy,
+                                           SNAPSHOT_ATTEMPTS)) {
+      std::cerr << "The manager kept writing, no consistent sample"
+                << std::endl;
+    } else if (0 == copy->m_sampleTime) {
+      std::cout << "No sample yet" << std::endl;
+    } else {
+      print(copy, prefix, readers);
+      if (stale(copy)) {
+        std::cerr << "The sample is stale, opening the segment again"
+                  << std::endl;
+        segment.close();
+        openSegment(vlan, &segment);
+      }
+    }
+
+    if (0 == watch) {
+      break;
+    }
+    std::cout << std::endl;
+    ::sleep(watch);
+  }
+
+  return 0;
+}